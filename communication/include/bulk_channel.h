@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Payloads at least this size are sent through shared memory instead of fragments
+#define BULK_THRESHOLD 1024
+
+// Regions a sender keeps until their receivers read them, while this many wait larger messages go as fragments
+#define MAX_PENDING_BULKS 256
+
+// The descriptor that travels on the bus instead of the payload (fits one frame)
+struct BulkDescriptor
+{
+    uint32_t seq;  // Sequence number of the region, unique per source
+    uint32_t size; // Size of the payload in bytes
+};
+
+// Moves large payloads between processes on the same host through POSIX shared memory
+class BulkChannel
+{
+public:
+    // Copies the payload into a new shared memory region, returns false if it is not possible
+    static bool publish(uint32_t srcID, uint32_t seq, const void *data, size_t size);
+
+    // Copies the payload out of the described region and removes the region
+    static void *consume(uint32_t srcID, const BulkDescriptor &descriptor);
+
+    // Removes a region that was published but may have not been consumed
+    static void discard(uint32_t srcID, uint32_t seq);
+
+    // Returns the shared memory name of a region
+    static std::string regionName(uint32_t srcID, uint32_t seq);
+};
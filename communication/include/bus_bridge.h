@@ -0,0 +1,115 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "packet.h"
+#include "error_code.h"
+#include "../sockets/Isocket.h"
+#include "../sockets/real_socket.h"
+
+// Largest batch of encoded frames written to the bridge at once
+#define BRIDGE_MAX_BATCH_BYTES 65536
+
+// Frames waiting for the bridge before the senders are held back
+#define BRIDGE_QUEUE_LIMIT 4096
+
+// Compact encoding of the frames on the bridge stream. The header of a frame that continues the previous
+// frame's message (same IDs, trace flow and flags, next PSN) is left out, other fields are variable-length integers.
+class BridgeCodec
+{
+private:
+    Packet previous;
+    bool hasPrevious;
+
+public:
+    // Constructor
+    BridgeCodec();
+
+    // Appends the encoded frame to the buffer
+    void encode(const Packet &packet, std::vector<uint8_t> &buffer);
+
+    // Decodes the next frame and moves position past it, false if the data is malformed
+    bool decode(const uint8_t *&position, const uint8_t *end, Packet &packet);
+
+    // Forgets the previous frame, both ends reset when the stream starts
+    void reset();
+};
+
+// Connects this bus to a bus in another process or host over a single stream that carries the frames of
+// all the clients. Frames are queued and written in batches - the more the writer lags, the larger the batch.
+class BusBridge
+{
+private:
+    ISocket *socketInterface;
+    int listenSocket;
+    int bridgeSocket;
+    std::atomic<bool> running;
+    std::atomic<bool> connected;
+    std::function<void(Packet &)> deliver;
+    std::thread readerThread;
+    std::thread writerThread;
+
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::deque<Packet> outgoing;
+
+    std::mutex routeMutex;
+    std::unordered_set<uint32_t> routes;
+
+    BridgeCodec encoder;
+    BridgeCodec decoder;
+    std::atomic<uint64_t> framesSent;
+    std::atomic<uint64_t> bytesSent;
+
+    // Starts the reader and writer on the connected stream
+    void startStream();
+
+    // Runs in a thread - waits for the other bus to connect, then reads from it
+    void acceptAndRead();
+
+    // Runs in a thread - reads batches and passes their frames to the bus
+    void readBatches();
+
+    // Runs in a thread - writes the queued frames in batches
+    void writeBatches();
+
+public:
+    // Constructor, deliver receives the frames that arrive from the other bus
+    BusBridge(std::function<void(Packet &)> deliver, ISocket *socketInterface = new RealSocket());
+
+    // Waits in the background for the other bus to connect to the port
+    ErrorCode listen(int port);
+
+    // Connects to the other bus
+    ErrorCode connect(const std::string &host, int port);
+
+    // Queues a frame for the other bus, waits while the queue is full - bulk descriptors are refused
+    ErrorCode forward(const Packet &packet);
+
+    // Adds an ID that is reachable through the bridge, with no routes every unknown ID is
+    void addRoute(uint32_t id);
+
+    // Checks if frames for the ID should go through the bridge
+    bool isRouted(uint32_t id);
+
+    // Checks if the other bus is connected
+    bool isConnected();
+
+    // Returns the number of frames written to the stream
+    uint64_t getFramesSent();
+
+    // Returns the number of bytes written to the stream
+    uint64_t getBytesSent();
+
+    // Closes the stream and stops the threads
+    void stop();
+
+    // Destructor
+    ~BusBridge();
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "simulation_clock.h"
+
+// How the bus daemon moves the frames
+enum class BusTransport {
+    SOCKET, // BusManager over the ISocket interface - scheduler, clock, bridge and value cache
+    POOLED  // PooledServerConnection over direct system calls - forwarding only
+};
+
+// How the bus orders the data frames
+enum class SchedulerMode {
+    EVENT,         // Frames go out as they arrive
+    TIME_TRIGGERED // Frames wait for the slots of the schedule file
+};
+
+// Settings of the bus daemon, read from "key = value" lines
+struct BusConfig
+{
+    int port = 8080;
+    std::vector<uint32_t> ids; // Clients that may connect, empty for any
+    uint32_t limit = 0;        // Clients connected at once, 0 for no limit
+    BusTransport transport = BusTransport::SOCKET;
+    SchedulerMode scheduler = SchedulerMode::EVENT;
+    std::string scheduleFile;  // Relative paths are relative to the config file
+    ClockMode clockMode = ClockMode::REAL_TIME;
+    uint64_t clockStepUs = 1000;
+    double clockSpeed = 0;
+    int bridgeListenPort = 0;  // 0 - no other bus connects to this one
+    std::string bridgeHost;    // Empty - this bus does not connect to another one
+    int bridgePort = 0;
+    std::vector<uint32_t> bridgeRoutes;
+    bool valueCache = false;
+    bool replayOnConnect = false;
+    std::vector<int> ioCpus;        // CPUs of the server, client and bridge threads, empty for any
+    std::vector<int> schedulerCpus; // CPUs of the schedule and clock threads, empty for any
+    bool asyncLog = false;          // The log lines are written by a background thread
+    std::string traceFile;          // Binary trace of the packets instead of text lines, empty for none
+    uint64_t logSegmentBytes = 0;   // Log written to rotating memory-mapped segments of this size, 0 for one file
+    uint64_t logRotateSeconds = 0;  // Segments of the log and the trace are also closed at this age, 0 for never
+    uint64_t logRetentionBytes = 0; // Oldest segments are deleted above this total, 0 to keep all
+    double logRateLimit = 0;        // Packet lines per second and call site, 0 for no limit
+    double logBurst = 1;            // Packet lines a call site may write at once under the rate limit
+    uint32_t logSampleOneIn = 1;    // Only every Nth packet line of a call site is written
+    uint64_t logSummarySeconds = 10; // Time between the counts of suppressed packet lines
+    std::string chromeTrace;        // Timeline of the forwarded frames in the Chrome trace format, empty for none
+
+    // Reads a config file, throws std::invalid_argument with the line of the first mistake
+    static BusConfig loadFromFile(const std::string &path);
+
+    // Returns the problems of the settings - invalid ports and CPUs, options the transport does not support
+    std::vector<std::string> validate() const;
+};
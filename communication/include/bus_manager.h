@@ -1,32 +1,152 @@
 #pragma once
 #include <mutex>
 #include <utility>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
 #include "server_connection.h"
+#include "simulation_clock.h"
+#include "time_triggered_schedule.h"
+#include "bus_bridge.h"
+#include "value_cache.h"
 #include <iostream>
 
 class BusManager
 {
 private:
+    // A data frame waiting for its slot, the credit of a frame from a client here returns when it is sent
+    struct ScheduledFrame
+    {
+        Packet packet;
+        bool creditHeld;
+    };
+
     ServerConnection server;
 
     // Singleton instance
     static BusManager* instance;
     static std::mutex managerMutex;
     //SyncCommunication syncCommunication;
+
+    // Simulation clock distribution
+    std::thread clockThread;
+    std::atomic<bool> clockRunning;
+    ClockMode clockMode;
+    std::chrono::nanoseconds clockStep;
+    double clockSpeed;
+    std::mutex clockMutex;
+    std::condition_variable acksArrived;
+    uint64_t tickTime;
+    size_t acksPending;
+
+    // Time-triggered mode - data frames wait in the buffers for a slot of their ID
+    std::thread scheduleThread;
+    std::atomic<bool> scheduleRunning;
+    std::unique_ptr<TimeTriggeredSchedule> schedule;
+    std::mutex scheduleMutex;
+    std::condition_variable frameBuffered;
+    std::map<uint32_t, std::deque<ScheduledFrame>> scheduleBuffers;
+    std::set<uint64_t> rejectedMessages; // Source and MSN of messages dropped because their buffer was full
+
+    // Connection to a bus in another process, frames for clients that are not here go through it
+    std::unique_ptr<BusBridge> bridge;
+
+    // Last value of every stream (message ID, source, destination), answers RTR frames and brings late clients up to date
+    ValueCache valueCache;
+    std::atomic<bool> valueCacheEnabled;
+    std::atomic<bool> replayOnConnect;
     
     // Sending according to broadcast variable
     ErrorCode sendToClients(const Packet &packet);
 
+    // Runs in a thread - advances the simulation time and broadcasts the ticks
+    void runClock();
+
+    // Counts the acknowledgment of the current lockstep tick
+    void handleClockAck(Packet &p);
+
+    // Runs in a thread - opens the slots of every cycle and sends the frames buffered for them
+    void runSchedule();
+
+    // Keeps a data frame until a slot of its ID, false if it was dropped - no slot for it or its message did not fit
+    bool bufferScheduled(const Packet &p, bool fromClient);
+
+    // Takes the buffered frame with the lowest ID that may use the slot, false if there is none
+    bool takeScheduled(const ScheduleSlot &slot, ScheduledFrame &frame);
+
+    // Sends a frame that waited for its slot and returns the credit of its source
+    void sendScheduled(const ScheduledFrame &frame);
+
+    // Sleeps until the time, spins the last microseconds
+    void waitUntil(std::chrono::steady_clock::time_point time);
+
+    // Sends a bulk descriptor back to its source when the destination can not read the region, true if it did
+    bool refuseBulk(const Packet &p);
+
+    // Passes a frame to the other bus if it is meant for it, true if no client here needs it
+    bool forwardToBridge(const Packet &p);
+
+    // Sends a frame that arrived from the other bus to the clients here
+    void receiveFromBridge(Packet &p);
+
+    // Sends the frame to the clients here, in its slot in the time-triggered mode. fromClient marks a frame
+    // that a client of this bus sent, its flow control credit is held while the frame waits for the slot.
+    void deliverLocally(Packet &p, bool fromClient = false);
+
+    // Answers an RTR frame with the cached value of its ID, false if there is none
+    bool answerRemoteRequest(const Packet &p);
+
+    // Sends the cached values that a client that just connected would have received
+    void replayValues(uint32_t clientID);
+
+    // Sends a copy of a cached message to the client, through the bridge or here
+    void sendCachedValue(std::vector<Packet> &packets, uint32_t clientID);
+
     // Private constructor
-    BusManager(std::vector<uint32_t> idShouldConnect, uint32_t limit);
+    BusManager(std::vector<uint32_t> idShouldConnect, uint32_t limit, int port);
 
 public:
     //Static function to return a singleton instance
-    static BusManager* getInstance(std::vector<uint32_t> idShouldConnect, uint32_t limit);
+    static BusManager* getInstance(std::vector<uint32_t> idShouldConnect, uint32_t limit, int port = 8080);
 
     // Sends to the server to listen for requests
     ErrorCode startConnection();
 
+    // Stops the clock, the schedule and the bridge, then closes the server
+    void stopConnection();
+
+    // Starts distributing virtual time, speed is simulated seconds per wall second (0 - as fast as possible)
+    ErrorCode startClock(ClockMode mode, std::chrono::nanoseconds step, double speed = 0);
+
+    // Stops distributing virtual time
+    void stopClock();
+
+    // Starts the time-triggered mode, data frames are sent only in the slots of their ID
+    ErrorCode startSchedule(const TimeTriggeredSchedule &newSchedule);
+
+    // Stops the time-triggered mode and sends the frames that are still buffered
+    void stopSchedule();
+
+    // Waits in the background for another bus to connect its bridge to the port
+    ErrorCode listenBridge(int port);
+
+    // Connects a bridge to another bus
+    ErrorCode connectBridge(const std::string &host, int port);
+
+    // Returns the bridge to add routes to it, nullptr if there is none
+    BusBridge *getBridge();
+
+    // Closes the bridge
+    void stopBridge();
+
+    // Keeps the last value of every stream and answers RTR frames from it, disabling forgets the values
+    void setValueCache(bool enable);
+
+    // Sends the cached values to every client that connects, while the cache is enabled
+    void setReplayOnConnect(bool enable);
+
     // Receives the packet that arrived and checks it before sending it out
     void receiveData(Packet &p);
 
@@ -10,20 +10,76 @@
 #include "../sockets/real_socket.h"
 #include <string>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
 #include "error_code.h"
 
 #define PORT 8080
 #define IP "127.0.0.1"
 
+// Time a sender waits for the bus to grant credits, while none of its packets could be written
+#define FLOW_CONTROL_TIMEOUT_MS 5000
+
 class ClientConnection
 {
 private:
     int clientSocket;
     sockaddr_in servAddress;
+    std::string serverIP;
+    int serverPort;
     std::atomic<bool> connected;
     std::function<void(Packet &)> passPacketCom;
     ISocket* socketInterface;
     std::thread receiveThread;
+    std::atomic<std::thread::id> receiveThreadId;
+    bool bulkCapable;
+
+    // The packets of one send call, the caller waits until all of them are written
+    struct SendBatch
+    {
+        size_t remaining;
+        ErrorCode result;
+    };
+
+    // A packet waiting for its turn on the socket
+    struct PendingSend
+    {
+        Packet packet;
+        std::shared_ptr<SendBatch> batch;
+    };
+
+    // Outgoing queues - like CAN arbitration the lowest ID goes first, packets of one ID keep their order
+    std::mutex sendMutex;
+    std::condition_variable sendProgress;
+    std::deque<PendingSend> controlQueue;
+    std::map<uint32_t, std::deque<PendingSend>> priorityQueues;
+    bool writing;
+
+    // Flow control, active once the bus granted the first credits
+    bool flowControlled;
+    uint32_t credits;
+
+    // Writes the packet to the socket
+    ErrorCode writePacket(Packet &packet);
+
+    // Checks if a queued packet can be written now, called with sendMutex locked
+    bool hasWritable();
+
+    // Writes the queued packets by priority while credits last, called with sendMutex locked
+    void pump(std::unique_lock<std::mutex> &lock);
+
+    // Drops the packets of a batch that were not written yet, called with sendMutex locked
+    void cancelBatch(const std::shared_ptr<SendBatch> &batch);
+
+    // Adds the credits granted by the bus and sends the queued packets
+    void handleCredit(Packet &packet);
+
+    // Waits for the receive thread of the last connection to return, lets it go when called from it
+    void releaseReceiveThread();
 
 public:
     // Constructor
@@ -35,18 +91,39 @@ public:
     // Sends the packet to the manager-sync
     ErrorCode sendPacket(Packet &packet);
 
+    // Queues the packets by priority and waits until they are written, the receive thread does not wait
+    ErrorCode sendPackets(std::vector<Packet> &packets);
+
     // Waits for a message and forwards it to Communication
     void receivePacket();
 
     // Closes the connection
     ErrorCode closeConnection();
 
+    // Closes the connection and waits until the receive thread passed its last packet
+    ErrorCode stopConnection();
+
     // Setter for passPacketCom
     void setCallback(std::function<void(Packet&)> callback);
     
     // Setter for socketInterface
     void setSocketInterface(ISocket* socketInterface);
 
+    // Sets the address of the bus to connect to, throws an exception if it is invalid
+    void setServerAddress(const std::string &ip, int port);
+
+    // Checks if the server runs on this host (shared memory is reachable)
+    bool isLocalConnection();
+
+    // Sets if the bus may pass bulk descriptors to this client, announced when connecting
+    void setBulkCapable(bool capable);
+
+    // Checks if the caller runs on the thread that receives the packets
+    bool isReceiveThread();
+
+    // Returns the credits left, for testing
+    uint32_t getCredits();
+
     // For testing
     int getClientSocket();
     
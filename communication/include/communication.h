@@ -1,16 +1,77 @@
 #pragma once
 #include <unordered_map>
+#include <unordered_set>
+#include <condition_variable>
 #include <csignal>
+#include <deque>
+#include <thread>
 #include "client_connection.h"
+#include "bulk_channel.h"
+#include "simulation_clock.h"
+#include "sliding_window.h"
+#include "delta_encoder.h"
+#include "compression.h"
+#include "timer_wheel.h"
 #include "../sockets/Isocket.h"
 #include "error_code.h"
+// Resolution of the cyclic messages
+#define CYCLIC_TICK_US 1000
+
 class Communication
 {
 private:
+    // A message sent every period, the provider fills the data of each cycle and returns false to skip it
+    struct CyclicMessage
+    {
+        std::function<bool(std::vector<uint8_t> &)> provider;
+        uint64_t period; // In ticks
+        uint32_t destID;
+        uint32_t srcID;
+        bool isBroadcast;
+    };
+
     ClientConnection client;
-    std::unordered_map<std::string, Message> receivedMessages;
+    std::unordered_map<uint64_t, Message> receivedMessages;
     void (*passData)(uint32_t, void *); 
     uint32_t id;
+    size_t bulkThreshold;
+    size_t compressionThreshold;
+    std::atomic<uint32_t> bulkSeq;
+    bool canFD;
+    std::atomic<uint32_t> nextMSN;
+
+    // Reliable delivery - windows of the messages being sent, by MSN
+    std::mutex reliableMutex;
+    std::condition_variable ackArrived;
+    std::unordered_map<uint32_t, SlidingWindow *> outgoingWindows;
+    RttEstimator rttEstimator;
+    std::unordered_set<uint64_t> completedMessages;
+    std::deque<uint64_t> completedOrder;
+
+    // Bulk regions their receivers did not read yet, and the destinations the bus refused a bulk message for
+    std::mutex bulkMutex;
+    std::deque<std::pair<uint32_t, uint32_t>> publishedBulks;
+    std::unordered_set<uint32_t> fragmentedDestinations;
+
+    // Only-on-change streams, by source and destination
+    std::mutex deltaMutex;
+    std::unordered_map<uint64_t, DeltaEncoder> deltaEncoders;
+    std::unordered_map<uint64_t, DeltaDecoder> deltaDecoders;
+    uint32_t deltaFullEvery;
+    uint32_t deltaHeartbeatEvery;
+
+    // Receiver of the RPC messages
+    std::mutex rpcMutex;
+    std::function<void(uint32_t, void *, size_t)> rpcHandler;
+
+    // Cyclic messages, by handle
+    std::mutex cyclicMutex;
+    std::condition_variable cyclicChanged;
+    std::unordered_map<uint32_t, CyclicMessage> cyclicMessages;
+    TimerWheel cyclicWheel;
+    uint32_t nextCyclicHandle;
+    bool cyclicRunning;
+    std::thread cyclicThread;
     //SyncCommunication syncCommunication;
 
     // A static variable that holds an instance of the class
@@ -28,15 +89,55 @@ private:
     // Receives the packet and adds it to the message
     void handlePacket(Packet &p);
     
-    // Implement error handling according to CAN bus
-    void handleError();
+    // Implement error handling according to CAN bus - a corrupt reliable packet is requested again
+    void handleError(Packet &p);
     
     // Implement arrival confirmation according to the CAN bus
-    Packet hadArrived();
+    Packet hadArrived(const Packet &p, uint32_t cumulative, uint32_t bitmap, bool isNack);
+
+    // Builds the acknowledgment of the packet's message and sends it back to its source
+    void sendAck(const Packet &p, uint32_t cumulative, uint32_t bitmap, bool isNack);
+
+    // Sends the packets of a reliable message and waits until all of them are acknowledged
+    ErrorCode sendReliable(Message &msg);
+
+    // Applies an ACK / NACK to the window of the message it belongs to
+    void handleAck(Packet &p);
+
+    // Remembers a completed reliable message for late retransmissions
+    void rememberCompleted(uint64_t messageId);
     
     // Adding the packet to the complete message
     void addPacketToMessage(Packet &p);
 
+    // Sends the data as one message, isDelta marks a payload of an only-on-change stream, isRpc one of an RPC channel,
+    // messageID is the CAN ID its frames are arbitrated by
+    ErrorCode sendData(void *data, size_t dataSize, uint32_t destID, uint32_t srcID, bool isBroadcast, bool isReliable, bool isDelta, bool isRpc, uint32_t messageID = DEFAULT_MESSAGE_ID);
+
+    // Passes the data of a complete message on, rebuilds the data of an only-on-change stream first
+    void deliverData(const Packet &p, void *data, size_t dataSize);
+
+    // Checks if the message should go through the bulk channel
+    bool shouldUseBulk(size_t dataSize, uint32_t destID, bool isBroadcast);
+
+    // Sends the data through shared memory with a single descriptor frame
+    ErrorCode sendBulk(void *data, size_t dataSize, uint32_t destID, uint32_t srcID, bool isDelta, bool isRpc, uint32_t messageID);
+
+    // Reads the data that the descriptor points to and passes it on
+    void handleBulk(Packet &p);
+
+    // Sends the data of a refused bulk message again as fragments, later messages to its destination skip the bulk channel
+    void handleBulkRefused(Packet &p);
+
+    // Forgets a bulk region its receiver read
+    void handleBulkConsumed(Packet &p);
+
+    // Runs in a thread - sends the cyclic messages that are due, the messages of a tick in one batch
+    void runCyclic();
+
+    // Advances the local simulation clock, acknowledges lockstep ticks
+    void handleClockTick(Packet &p);
+
     // Static method to handle SIGINT signal
     static void signalHandler(int signum);
 
@@ -46,14 +147,54 @@ private:
 
 public:
     // Constructor
-    Communication(uint32_t id, void (*passDataCallback)(uint32_t, void *));
+    Communication(uint32_t id, void (*passDataCallback)(uint32_t, void *), ISocket* socketInterface = new RealSocket());
     
     // Sends the client to connect to server
     ErrorCode startConnection();
     
-    // Sends a message to manager
-    ErrorCode sendMessage(void *data, size_t dataSize, uint32_t destID, uint32_t srcID, bool isBroadcast);
+    // Sends a message to manager, a reliable unicast returns once the destination acknowledged all of it.
+    // messageID is the CAN ID that arbitrates its frames against other messages - the lower, the sooner they leave.
+    // By default it is srcID + destID.
+    ErrorCode sendMessage(void *data, size_t dataSize, uint32_t destID, uint32_t srcID, bool isBroadcast, bool isReliable = false, uint32_t messageID = DEFAULT_MESSAGE_ID);
     
+    // Sends periodic data only when it changed - as the changed byte ranges, with a full frame every few cycles.
+    // The receiver gets the full data as with sendMessage.
+    ErrorCode sendMessageOnChange(void *data, size_t dataSize, uint32_t destID, uint32_t srcID, bool isBroadcast, bool isReliable = false);
+
+    // Sets the cycles between full frames and the unchanged cycles between heartbeats (0 for none) of sendMessageOnChange
+    void setDeltaIntervals(uint32_t fullEvery, uint32_t heartbeatEvery);
+
+    // Asks for the last value of the message ID with an RTR frame, the bus answers from its cache or passes it to destID
+    ErrorCode requestValue(uint32_t messageID, uint32_t destID, uint32_t srcID);
+
+    // Registers a message sent every period, at the offset within the period on the simulation time.
+    // The provider fills the data of each cycle and returns false to skip it, it runs on the cyclic thread.
+    // Returns the handle of the message.
+    uint32_t addCyclicMessage(std::function<bool(std::vector<uint8_t> &)> provider, std::chrono::microseconds period,
+                              std::chrono::microseconds offset, uint32_t destID, uint32_t srcID, bool isBroadcast);
+
+    // Stops sending a cyclic message
+    void removeCyclicMessage(uint32_t handle);
+
+    // Sends a message that the destination passes to its RPC handler instead of passData
+    ErrorCode sendRpcMessage(void *data, size_t dataSize, uint32_t destID, uint32_t srcID);
+
+    // Sets the receiver of RPC messages - source, data (freed by the receiver) and size, nullptr drops them
+    void setRpcHandler(std::function<void(uint32_t, void *, size_t)> handler);
+
+    // Sets the minimal size of data that is sent through the bulk channel, 0 disables it.
+    // Before startConnection, 0 also asks the bus to pass no bulk messages to this process.
+    void setBulkThreshold(size_t threshold);
+
+    // Sets the minimal size of data that is compressed before it is split into frames, 0 disables it
+    void setCompressionThreshold(size_t threshold);
+
+    // Sets the frame payload size of this connection, 64 bytes (CAN-FD) or 8 bytes (classic)
+    void setCanFD(bool enable);
+
+    // Sets the address of the bus, before startConnection
+    void setServerAddress(const std::string &ip, int port);
+
     // Sends a message to manager - Async
     void sendMessageAsync(void *data, size_t dataSize, uint32_t destID, uint32_t srcID, std::function<void(ErrorCode)> passSend, bool isBroadcast);
 
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Smallest message that Communication compresses by default, smaller messages rarely save a frame
+#define COMPRESSION_THRESHOLD 64
+
+// Bits of the position hash of the compressor's match table
+#define COMPRESSION_HASH_BITS 12
+
+// Fast LZ77 compression in the LZ4 block format - byte-aligned tokens, no entropy coding
+class Compression
+{
+public:
+    // Appends the compressed data to out
+    static void compress(const void *data, size_t size, std::vector<uint8_t> &out);
+
+    // Decompresses exactly outSize bytes into out, false if the data is malformed
+    static bool decompress(const uint8_t *data, size_t size, uint8_t *out, size_t outSize);
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Cycles between full frames of an only-on-change stream, a receiver that missed a frame recovers at the next one
+#define DELTA_FULL_EVERY 10
+
+// Unchanged cycles between heartbeats of an only-on-change stream, 0 sends nothing while the data is unchanged
+#define DELTA_HEARTBEAT_EVERY 0
+
+// Changed byte ranges this close together are sent as one range, a range costs about 2 bytes of header
+#define DELTA_MERGE_GAP 4
+
+// Kinds of payload of an only-on-change stream
+enum class DeltaKind : uint8_t {
+    FULL = 0,      // The whole data
+    DELTA = 1,     // The byte ranges that changed since the previous payload
+    HEARTBEAT = 2  // The data did not change
+};
+
+// Result of applying a payload at the receiver
+enum class DeltaResult {
+    DATA,         // The data was rebuilt
+    HEARTBEAT,    // The data did not change, nothing to pass on
+    MISSING_BASE, // A payload of the stream was lost, waiting for the next full frame
+    MALFORMED
+};
+
+// Sender side of an only-on-change stream - encodes each cycle's data against the previous cycle's.
+// Payload: kind byte, varint sequence number, varint data size, then the data (FULL) or
+// varint range count and per range varint gap from the previous range, varint length and the bytes (DELTA).
+class DeltaEncoder
+{
+private:
+    std::vector<uint8_t> previous;
+    bool hasPrevious;
+    uint32_t seq;
+    uint32_t sinceFull;
+    uint32_t sinceSent;
+
+public:
+    // Constructor
+    DeltaEncoder();
+
+    // Encodes the cycle's data, false when nothing has to be sent
+    bool encode(const void *data, size_t size, uint32_t fullEvery, uint32_t heartbeatEvery, std::vector<uint8_t> &payload);
+
+    // Forgets the previous data, the next payload is a full frame
+    void reset();
+};
+
+// Receiver side of an only-on-change stream - rebuilds the full data from the payloads
+class DeltaDecoder
+{
+private:
+    std::vector<uint8_t> current;
+    bool hasCurrent;
+    uint32_t seq;
+
+public:
+    // Constructor
+    DeltaDecoder();
+
+    // Applies the payload, on DATA data points to the rebuilt data (malloc, the receiver frees it)
+    DeltaResult decode(const void *payload, size_t size, void *&data);
+};
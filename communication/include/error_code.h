@@ -17,7 +17,12 @@ enum class ErrorCode {
     SOCKET_INTERFACE_ERROR = -12,
     INVALID_DATA_SIZE = -13,     
     INVALID_DATA = -14,          
-    INVALID_ID = -15             
+    INVALID_ID = -15,
+    FLOW_CONTROL_TIMEOUT = -16,
+    DELIVERY_FAILED = -17,
+    RPC_TIMEOUT = -18,
+    RPC_UNKNOWN_METHOD = -19,
+    RPC_FAILED = -20
 };
 
 // Function to convert ErrorCode to string
@@ -39,6 +44,11 @@ inline const char* toString(ErrorCode error) {
         case ErrorCode::INVALID_DATA_SIZE: return "INVALID_DATA_SIZE";
         case ErrorCode::INVALID_DATA: return "INVALID_DATA";
         case ErrorCode::INVALID_ID: return "INVALID_ID";
+        case ErrorCode::FLOW_CONTROL_TIMEOUT: return "FLOW_CONTROL_TIMEOUT";
+        case ErrorCode::DELIVERY_FAILED: return "DELIVERY_FAILED";
+        case ErrorCode::RPC_TIMEOUT: return "RPC_TIMEOUT";
+        case ErrorCode::RPC_UNKNOWN_METHOD: return "RPC_UNKNOWN_METHOD";
+        case ErrorCode::RPC_FAILED: return "RPC_FAILED";
         default: return "UNKNOWN_ERROR";
     }
 }
@@ -8,31 +8,58 @@
 #include <iostream>
 #include "packet.h"
 
+// The CAN ID of a message that asks for the default one - srcID + destID
+#define DEFAULT_MESSAGE_ID UINT32_MAX
+
+// Largest data of a message sent in frames, a peer's frame with a larger TPS or compressed size is rejected
+#define MAX_MESSAGE_SIZE (64u << 20)
+
 class Message
 {
 private:
     std::vector<Packet> packets;
+    std::vector<bool> received;
     uint32_t tps;
+
+    // Get the size of the data in the packets, compressed or not
+    size_t receivedDataSize() const;
                   
 public:
     // Default
     Message() = default;
 
-    // Constructor for sending message
-    Message(uint32_t srcID, void *data, int dlc, bool isBroadcast, uint32_t destID = 0xFFFF);
+    // Constructor for sending message, frameSize is SIZE_PACKET (classic) or SIZE_PACKET_FD,
+    // data of at least compressThreshold bytes (0 never) is compressed when that saves frames,
+    // messageID is the CAN ID its frames are arbitrated by - the lower, the more urgent
+    Message(uint32_t srcID, void *data, int dlc, bool isBroadcast, uint32_t destID = 0xFFFF, size_t frameSize = SIZE_PACKET, uint32_t msn = 0, size_t compressThreshold = 0, uint32_t messageID = DEFAULT_MESSAGE_ID);
     
-    // Constructor for receiving message
+    // Constructor for receiving message, throws std::invalid_argument for more frames than MAX_MESSAGE_SIZE needs
     Message(uint32_t tps);
 
-    // Add a packet to the received message
+    // Checks if the TPS of a received frame fits a message of at most MAX_MESSAGE_SIZE in frames of its size
+    static bool isValidTps(const Packet &p);
+
+    // Add a packet to the received message, false for a duplicate or invalid packet
     bool addPacket(const Packet &p);
 
+    // Returns the lowest PSN that was not received yet (TPS when complete)
+    uint32_t firstMissing() const;
+
+    // Returns a bitmap of the 32 packets after firstMissing, bit i set if PSN firstMissing+1+i arrived
+    uint32_t receivedBitmap() const;
+
     // Check if the message is complete
     bool isComplete() const;
 
-    // Get the complete data of the message
+    // Get the complete data of the message, nullptr if compressed data is malformed
     void *completeData() const;
 
+    // Get the size of the complete data of the message
+    size_t completeDataSize() const;
+
+    // Check if the packets carry compressed data
+    bool isCompressed() const;
+
     // Get the packets of the message
     std::vector<Packet> &getPackets();
 };
\ No newline at end of file
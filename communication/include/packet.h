@@ -10,7 +10,22 @@
 #include <cstdint>
 #include <iomanip>
 #include <sstream>
+#include <stdexcept>
 #define SIZE_PACKET 8
+#define SIZE_PACKET_FD 64
+
+// Kinds of frames on the bus, frames other than DATA are handled inside the library
+enum class FrameType : uint8_t {
+    DATA = 0,
+    CLOCK_TICK, // Bus to clients: the simulation time advanced
+    CLOCK_ACK,  // Client to bus: the tick was handled (lockstep mode)
+    CREDIT,     // Bus to client: more packets may be sent (flow control)
+    ACK,        // Receiver to sender: cumulative and selective acknowledgment
+    NACK,       // Receiver to sender: like ACK, the missing packets should be sent again
+    BULK_REFUSED, // Bus to sender: the destination can not read the bulk region, the descriptor comes back
+    BULK_CONSUMED // Receiver to sender: the bulk region was read, the sender forgets it
+};
+
 class Packet
 {
 public:
@@ -20,23 +35,33 @@ public:
         uint32_t ID;      // Message ID
         uint32_t PSN;     // Packet Sequence Number
         uint32_t TPS;     // Total Packet Sum
+        uint32_t MSN;     // Message Sequence Number of the source
         uint32_t SrcID;   // Source ID
         uint32_t DestID;  // Destination ID
-        uint8_t DLC;          // Data Length Code (0-8 bits)
+        uint8_t DLC;      // Data Length Code (0-8 classic, 9-15 only in CAN-FD)
         uint16_t CRC;     // Cyclic Redundancy Check for error detection
-        int timestamp;    // Timestamp field
+        uint64_t timestamp; // Simulation time in nanoseconds
         bool isBroadcast; // True for broadcast, false for unicas
         bool passive;
         bool RTR;
+        bool isBulk;      // True when the data is a bulk transfer descriptor
+        bool isFD;        // True for a CAN-FD frame (64 bytes per frame)
+        uint8_t padding;  // Bytes added to round the data up to the DLC length
+        FrameType type;   // Data or one of the library's control frames
+        bool isReliable;  // The receiver acknowledges the packets of the message
+        bool isDelta;     // The data is encoded against the previous message of the stream (only-on-change mode)
+        bool isCompressed; // The data of the message is compressed, starting with the original size
+        bool isRpc;       // The message is a request or response of an RPC channel
+        uint32_t flowID;  // Trace flow of the message, 0 for none - fills the alignment gap, the frame keeps its size
     } header;
 
-    void *data[SIZE_PACKET];
+    uint8_t data[SIZE_PACKET_FD];
 
     // Default constructor for Packet.
     Packet() = default;
 
-    // Constructor for sending message
-    Packet(uint32_t id, uint32_t psn, uint32_t tps, uint32_t srcID, uint32_t destID, void *data, uint8_t dlc, bool isBroadcast, bool RTR = false, bool passive = false);
+    // Constructor for sending message, length is the size of the data in bytes
+    Packet(uint32_t id, uint32_t psn, uint32_t tps, uint32_t srcID, uint32_t destID, void *data, uint8_t length, bool isBroadcast, bool RTR = false, bool passive = false, bool isFD = false);
 
     // Constructor for receiving message
     Packet(uint32_t id);
@@ -44,6 +69,18 @@ public:
     // Calculate CRC for the given data and length
     uint16_t calculateCRC(const void *data, size_t length);
 
+    // Returns the number of valid data bytes in the packet
+    size_t getDataLength() const;
+
+    // Returns the payload size of a full frame of this packet's type
+    size_t getFrameSize() const;
+
+    // Converts a data length in bytes to the smallest DLC code that holds it
+    static uint8_t lengthToDlc(size_t length);
+
+    // Converts a DLC code to the data length in bytes
+    static size_t dlcToLength(uint8_t dlc);
+
     // A function to convert the data to hexa (logger)
     std::string pointerToHex(const void *ptr, size_t size) const;
 };
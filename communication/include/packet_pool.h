@@ -0,0 +1,76 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include "packet.h"
+
+// Frames of a pool, the readers wait when all of them are in flight
+#define PACKET_POOL_SIZE 4096
+
+// A frame of the pool, next links it into one free list or queue at a time
+struct PooledPacket
+{
+    Packet packet;
+    PooledPacket *next;
+};
+
+// Fixed set of frames allocated once, taken and returned without touching the heap
+class PacketPool
+{
+private:
+    std::vector<PooledPacket> nodes;
+    PooledPacket *freeList;
+    size_t freeCount;
+    std::mutex poolMutex;
+    std::condition_variable released;
+
+public:
+    // Constructor
+    PacketPool(size_t size = PACKET_POOL_SIZE);
+
+    // Takes a frame, waits while the pool is empty
+    PooledPacket *acquire();
+
+    // Takes up to count frames without waiting, linked through next, returns the number taken
+    size_t tryAcquire(PooledPacket **frames, size_t count);
+
+    // Returns a frame
+    void release(PooledPacket *node);
+
+    // Returns a list of frames linked through next
+    void releaseList(PooledPacket *head);
+
+    // Returns the number of frames that are not in use
+    size_t getFreeCount();
+
+    // Returns the number of frames of the pool
+    size_t getSize() const;
+};
+
+// Intrusive FIFO of pool frames - many producers, one consumer that takes everything queued at once
+class PacketQueue
+{
+private:
+    PooledPacket *head;
+    PooledPacket *tail;
+    bool closed;
+    std::mutex queueMutex;
+    std::condition_variable pushed;
+
+public:
+    // Constructor
+    PacketQueue();
+
+    // Appends a frame, false if the queue is closed (the frame stays with the caller)
+    bool push(PooledPacket *node);
+
+    // Takes all the queued frames in order, waits while the queue is empty, nullptr once closed and empty
+    PooledPacket *popAll();
+
+    // Wakes the consumer, no more frames are accepted
+    void close();
+
+    // Takes the frames that were never consumed
+    PooledPacket *drain();
+};
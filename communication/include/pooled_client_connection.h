@@ -0,0 +1,134 @@
+#pragma once
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "pooled_server_connection.h"
+
+// Client handler that ignores the received frames
+struct IgnoreAll
+{
+    void operator()(Packet &) {}
+};
+
+// Bus client with the transport and the handler of the received frames as compile-time policies.
+// Frames are sent with gather writes and received in batches, the handler runs on the receive thread.
+template <class Transport = PosixTransport, class Handler = IgnoreAll>
+class PooledClientConnection
+{
+private:
+    Transport transport;
+    Handler handler;
+    int clientSocket;
+    std::atomic<bool> connected;
+    std::mutex sendMutex;
+    std::thread receiveThread;
+
+    // Runs in a thread - receives batches of frames and passes them to the handler
+    void receivePackets()
+    {
+        Packet frames[POOLED_BATCH];
+        char *buffer = reinterpret_cast<char *>(frames);
+        size_t filled = 0;
+        while (connected) {
+            ssize_t valread = transport.recv(clientSocket, buffer + filled, sizeof(frames) - filled);
+            if (valread <= 0)
+                break;
+            filled += valread;
+
+            size_t whole = filled / sizeof(Packet);
+            for (size_t i = 0; i < whole; ++i)
+                handler(frames[i]);
+            // A partial frame moves to the front and is completed by the next read
+            filled -= whole * sizeof(Packet);
+            if (filled)
+                memmove(buffer, buffer + whole * sizeof(Packet), filled);
+        }
+        connected = false;
+    }
+
+public:
+    // Constructor
+    PooledClientConnection(Handler handler = Handler(), Transport transport = Transport())
+        : transport(transport), handler(handler), clientSocket(-1), connected(false)
+    {
+    }
+
+    // Connects to the server and announces the ID of the client
+    ErrorCode connectToServer(uint32_t id, const std::string &ip = "127.0.0.1", int port = 8080)
+    {
+        clientSocket = transport.socket(AF_INET, SOCK_STREAM, 0);
+        if (clientSocket < 0)
+            return ErrorCode::SOCKET_FAILED;
+
+        sockaddr_in servAddress = {};
+        servAddress.sin_family = AF_INET;
+        servAddress.sin_port = htons(port);
+        if (inet_pton(AF_INET, ip.c_str(), &servAddress.sin_addr) <= 0 ||
+            transport.connect(clientSocket, (struct sockaddr *)&servAddress, sizeof(servAddress)) < 0) {
+            transport.close(clientSocket);
+            return ErrorCode::CONNECTION_FAILED;
+        }
+
+        int noDelay = 1;
+        transport.setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        Packet connect(id);
+        if (transport.send(clientSocket, &connect, sizeof(Packet)) < (ssize_t)sizeof(Packet)) {
+            transport.close(clientSocket);
+            return ErrorCode::SEND_FAILED;
+        }
+
+        connected = true;
+        receiveThread = std::thread(&PooledClientConnection::receivePackets, this);
+        return ErrorCode::SUCCESS;
+    }
+
+    // Sends the frames with gather writes, POOLED_BATCH frames per call
+    ErrorCode sendPackets(const Packet *packets, size_t count)
+    {
+        if (!connected)
+            return ErrorCode::CONNECTION_FAILED;
+
+        struct iovec iov[POOLED_BATCH];
+        std::lock_guard<std::mutex> lock(sendMutex);
+        while (count > 0) {
+            int batch = count < POOLED_BATCH ? count : POOLED_BATCH;
+            for (int i = 0; i < batch; ++i)
+                iov[i] = {const_cast<Packet *>(&packets[i]), sizeof(Packet)};
+            if (!transportSendAll(transport, clientSocket, iov, batch))
+                return ErrorCode::SEND_FAILED;
+            packets += batch;
+            count -= batch;
+        }
+        return ErrorCode::SUCCESS;
+    }
+
+    // Checks if the connection is open
+    bool isConnected()
+    {
+        return connected;
+    }
+
+    // Closes the connection and waits for the receive thread
+    void closeConnection()
+    {
+        if (clientSocket < 0)
+            return;
+        connected = false;
+        ::shutdown(clientSocket, SHUT_RDWR);
+        if (receiveThread.joinable())
+            receiveThread.join();
+        transport.close(clientSocket);
+        clientSocket = -1;
+    }
+
+    // Destructor
+    ~PooledClientConnection()
+    {
+        closeConnection();
+    }
+};
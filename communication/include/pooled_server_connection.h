@@ -0,0 +1,358 @@
+#pragma once
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "packet_pool.h"
+#include "transport.h"
+#include "error_code.h"
+
+// Frames read with one scatter call or written with one gather call
+#define POOLED_BATCH 64
+
+// Server handler that forwards every frame
+struct ForwardAll
+{
+    bool operator()(Packet &) { return true; }
+};
+
+// Bus server with the transport and the frame handler as compile-time policies. Frames are read straight into
+// pool frames, in batches, and move to the destination's writer through an intrusive queue without being copied.
+// The handler runs on the reader thread of the source and returns false to drop the frame.
+// A broadcast waits until the pool has a copy for every client, so the pool needs more than two frames per client.
+template <class Transport = PosixTransport, class Handler = ForwardAll>
+class PooledServerConnection
+{
+private:
+    // A connected client and the writer that drains its queue
+    struct Client
+    {
+        int socket;
+        uint32_t id;
+        PacketQueue outgoing;
+        std::thread writer;
+    };
+
+    Transport transport;
+    Handler handler;
+    int port;
+    int serverSocket;
+    std::atomic<bool> running;
+    PacketPool pool;
+    std::thread acceptThread;
+    std::mutex clientMutex;
+    std::unordered_map<uint32_t, std::shared_ptr<Client>> clients;
+    std::vector<int> sockets;
+    std::mutex readerMutex;
+    std::vector<std::thread> readers;
+    std::atomic<uint64_t> framesForwarded;
+    std::mutex broadcastMutex;
+
+    // Runs in a thread - accepts the clients and starts a reader for each
+    void acceptClients()
+    {
+        while (running) {
+            int clientSocket = transport.accept(serverSocket, nullptr, nullptr);
+            if (clientSocket < 0)
+                return;
+
+            int noDelay = 1;
+            transport.setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            std::lock_guard<std::mutex> lock(readerMutex);
+            if (!running) {
+                transport.close(clientSocket);
+                return;
+            }
+            sockets.push_back(clientSocket);
+            readers.emplace_back(&PooledServerConnection::readClient, this, clientSocket);
+        }
+    }
+
+    // Runs in a thread for each client - reads batches of frames and routes them
+    void readClient(int clientSocket)
+    {
+        // The first frame carries the ID of the client
+        Packet connect;
+        if (!transportRecvAll(transport, clientSocket, &connect, sizeof(Packet))) {
+            forgetSocket(clientSocket);
+            return;
+        }
+
+        auto client = std::make_shared<Client>();
+        client->socket = clientSocket;
+        client->id = connect.header.SrcID;
+        {
+            std::lock_guard<std::mutex> lock(clientMutex);
+            clients[client->id] = client;
+        }
+        client->writer = std::thread(&PooledServerConnection::writeClient, this, client.get());
+
+        PooledPacket *frames[POOLED_BATCH];
+        struct iovec iov[POOLED_BATCH];
+        while (running) {
+            // Waits for the next frame holding a single pool frame, so idle clients do not drain the pool
+            frames[0] = pool.acquire();
+            if (!transportRecvAll(transport, clientSocket, &frames[0]->packet, sizeof(Packet))) {
+                pool.release(frames[0]);
+                break;
+            }
+
+            // Takes the frames that arrived meanwhile with one more call
+            size_t count = 1 + pool.tryAcquire(frames + 1, POOLED_BATCH - 1);
+            for (size_t i = 1; i < count; ++i)
+                iov[i] = {&frames[i]->packet, sizeof(Packet)};
+            ssize_t received = 0;
+            bool ok = true;
+            if (count > 1) {
+                received = transport.recvWaiting(clientSocket, iov + 1, count - 1);
+                // Nothing waiting is not an error, zero is the end of the stream
+                ok = received > 0 || (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+                received = std::max<ssize_t>(received, 0);
+            }
+            size_t whole = 1 + received / sizeof(Packet);
+            size_t partial = received % sizeof(Packet);
+            // The read ended in the middle of a frame, the rest of it follows
+            if (partial) {
+                ok = transportRecvAll(transport, clientSocket, reinterpret_cast<char *>(&frames[whole]->packet) + partial, sizeof(Packet) - partial);
+                if (ok)
+                    whole++;
+            }
+
+            // The frames the read did not fill go back together, before a broadcast may wait for free frames
+            for (size_t i = whole; i + 1 < count; ++i)
+                frames[i]->next = frames[i + 1];
+            if (whole < count)
+                pool.releaseList(frames[whole]);
+
+            for (size_t i = 0; i < whole; ++i) {
+                if (!handler(frames[i]->packet))
+                    pool.release(frames[i]);
+                else if (!frames[i]->packet.header.isBroadcast)
+                    route(frames[i]);
+                else if (!tryBroadcast(frames[i])) {
+                    routeSpilled(frames + i, whole - i);
+                    break;
+                }
+            }
+            if (!ok)
+                break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(clientMutex);
+            auto it = clients.find(client->id);
+            if (it != clients.end() && it->second == client)
+                clients.erase(it);
+        }
+        client->outgoing.close();
+        client->writer.join();
+        pool.releaseList(client->outgoing.drain());
+        forgetSocket(clientSocket);
+    }
+
+    // Closes the socket of a client that left
+    void forgetSocket(int clientSocket)
+    {
+        std::lock_guard<std::mutex> lock(readerMutex);
+        sockets.erase(std::find(sockets.begin(), sockets.end(), clientSocket));
+        transport.close(clientSocket);
+    }
+
+    // Runs in a thread for each client - writes the queued frames in batches
+    void writeClient(Client *client)
+    {
+        struct iovec iov[POOLED_BATCH];
+        while (PooledPacket *list = client->outgoing.popAll()) {
+            while (list) {
+                PooledPacket *batch = list;
+                int count = 0;
+                PooledPacket *last = nullptr;
+                for (; list && count < POOLED_BATCH; list = list->next) {
+                    iov[count++] = {&list->packet, sizeof(Packet)};
+                    last = list;
+                }
+                last->next = nullptr;
+                bool ok = transportSendAll(transport, client->socket, iov, count);
+                pool.releaseList(batch);
+                if (!ok) {
+                    pool.releaseList(list);
+                    return;
+                }
+                framesForwarded += count;
+            }
+        }
+    }
+
+    // Passes a unicast frame to the queue of its destination
+    void route(PooledPacket *node)
+    {
+        std::lock_guard<std::mutex> lock(clientMutex);
+        auto it = clients.find(node->packet.header.DestID);
+        if (it == clients.end() || !it->second->outgoing.push(node))
+            pool.release(node);
+    }
+
+    // Queues a broadcast frame for every client, the last one takes the original and the others the copies.
+    // false if more clients connected than there are copies, nothing was queued then.
+    bool distribute(PooledPacket *node, std::vector<PooledPacket *> &copies)
+    {
+        std::lock_guard<std::mutex> lock(clientMutex);
+        if (clients.size() > copies.size() + 1)
+            return false;
+
+        size_t used = 0;
+        size_t remaining = clients.size();
+        for (auto &client : clients) {
+            PooledPacket *copy = node;
+            if (--remaining) {
+                copy = copies[used++];
+                copy->packet = node->packet;
+            }
+            if (!client.second->outgoing.push(copy))
+                pool.release(copy);
+        }
+        if (clients.empty())
+            pool.release(node);
+        for (; used < copies.size(); ++used)
+            pool.release(copies[used]);
+        copies.clear();
+        return true;
+    }
+
+    // Broadcasts the frame if the pool has the copies free now, false otherwise - the frame is still the caller's then
+    bool tryBroadcast(PooledPacket *node)
+    {
+        size_t count = getConnectedCount();
+        std::vector<PooledPacket *> copies(count ? count - 1 : 0);
+        size_t taken = copies.empty() ? 0 : pool.tryAcquire(copies.data(), copies.size());
+        if (taken == copies.size() && distribute(node, copies))
+            return true;
+        for (size_t i = 0; i < taken; ++i)
+            pool.release(copies[i]);
+        return false;
+    }
+
+    // Broadcasts the frame, waiting for the copies without clientMutex. One reader waits at a time, so two readers
+    // never hold part of their copies each while the pool is empty.
+    void broadcast(PooledPacket *node)
+    {
+        std::lock_guard<std::mutex> waiting(broadcastMutex);
+        std::vector<PooledPacket *> copies;
+        do {
+            size_t count = getConnectedCount();
+            while (copies.size() + 1 < count)
+                copies.push_back(pool.acquire());
+        } while (!distribute(node, copies));
+    }
+
+    // Routes the rest of a batch after a broadcast found the pool short. The frames go back to the pool and are
+    // taken again one at a time, so the frames of the batch are free for the copies the broadcast waits for.
+    // The first frame passed the handler already.
+    void routeSpilled(PooledPacket **frames, size_t count)
+    {
+        Packet spilled[POOLED_BATCH];
+        for (size_t i = 0; i < count; ++i) {
+            spilled[i] = frames[i]->packet;
+            pool.release(frames[i]);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (i > 0 && !handler(spilled[i]))
+                continue;
+            PooledPacket *node = pool.acquire();
+            node->packet = spilled[i];
+            if (node->packet.header.isBroadcast)
+                broadcast(node);
+            else
+                route(node);
+        }
+    }
+
+public:
+    // Constructor
+    PooledServerConnection(int port, Handler handler = Handler(), Transport transport = Transport(), size_t poolSize = PACKET_POOL_SIZE)
+        : transport(transport), handler(handler), port(port), serverSocket(-1), running(false), pool(poolSize), framesForwarded(0)
+    {
+    }
+
+    // Initializes the listening socket and starts accepting clients
+    ErrorCode startConnection()
+    {
+        serverSocket = transport.socket(AF_INET, SOCK_STREAM, 0);
+        if (serverSocket < 0)
+            return ErrorCode::SOCKET_FAILED;
+
+        // One option per call, the option names are not flags that can be combined
+        int opt = 1;
+        if (transport.setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+            transport.setsockopt(serverSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+            transport.close(serverSocket);
+            return ErrorCode::SOCKET_FAILED;
+        }
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY;
+        address.sin_port = htons(port);
+        if (transport.bind(serverSocket, (struct sockaddr *)&address, sizeof(address)) < 0) {
+            transport.close(serverSocket);
+            return ErrorCode::BIND_FAILED;
+        }
+        if (transport.listen(serverSocket, 5) < 0) {
+            transport.close(serverSocket);
+            return ErrorCode::LISTEN_FAILED;
+        }
+
+        running = true;
+        acceptThread = std::thread(&PooledServerConnection::acceptClients, this);
+        return ErrorCode::SUCCESS;
+    }
+
+    // Closes the sockets and waits for the threads
+    void stopServer()
+    {
+        if (!running.exchange(false))
+            return;
+
+        // Closing alone does not wake a blocked accept
+        ::shutdown(serverSocket, SHUT_RDWR);
+        transport.close(serverSocket);
+        if (acceptThread.joinable())
+            acceptThread.join();
+
+        std::vector<std::thread> stopping;
+        {
+            std::lock_guard<std::mutex> lock(readerMutex);
+            // The readers leave when their sockets fail
+            for (int clientSocket : sockets)
+                ::shutdown(clientSocket, SHUT_RDWR);
+            stopping.swap(readers);
+        }
+        for (auto &reader : stopping)
+            reader.join();
+    }
+
+    // Returns the number of connected clients
+    size_t getConnectedCount()
+    {
+        std::lock_guard<std::mutex> lock(clientMutex);
+        return clients.size();
+    }
+
+    // Returns the number of frames written to the clients
+    uint64_t getFramesForwarded()
+    {
+        return framesForwarded;
+    }
+
+    // Destructor
+    ~PooledServerConnection()
+    {
+        stopServer();
+    }
+};
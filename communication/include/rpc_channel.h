@@ -0,0 +1,101 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "communication.h"
+#include "error_code.h"
+
+// Time a call waits for its response when the caller does not set one
+#define RPC_DEFAULT_TIMEOUT_MS 1000
+
+// Kinds of RPC messages, the first byte of the message
+enum class RpcKind : uint8_t {
+    REQUEST = 0,  // Correlation ID, method, arguments
+    RESPONSE = 1, // Correlation ID, result
+    ERROR = 2     // Correlation ID, ErrorCode of the failure
+};
+
+// Outcome of a call
+struct RpcResult
+{
+    ErrorCode status;          // SUCCESS, RPC_TIMEOUT, RPC_UNKNOWN_METHOD, RPC_FAILED or the send error
+    std::vector<uint8_t> data; // The result when status is SUCCESS
+};
+
+// Request/response calls over a Communication. Every call carries a correlation ID, so many calls may be
+// outstanding to the same peer, each completes a future or a callback when its response arrives or it times out.
+// Methods run on the receive thread - they should not wait for calls of their own.
+class RpcChannel
+{
+public:
+    // A method - the caller's ID and the arguments, returns the result, throws to fail the call
+    using Method = std::function<std::vector<uint8_t>(uint32_t, const std::vector<uint8_t> &)>;
+
+    // Completion of a call, runs on the receive thread or the timeout thread
+    using Callback = std::function<void(RpcResult)>;
+
+private:
+    struct PendingCall
+    {
+        uint32_t destID;
+        std::chrono::steady_clock::time_point deadline;
+        Callback callback;
+    };
+
+    Communication &comm;
+    uint32_t srcID;
+    std::atomic<uint64_t> nextCorrelation;
+
+    std::mutex methodMutex;
+    std::unordered_map<uint32_t, Method> methods;
+
+    std::mutex callMutex;
+    std::condition_variable deadlineChanged;
+    std::unordered_map<uint64_t, PendingCall> pending;
+    std::multimap<std::chrono::steady_clock::time_point, uint64_t> deadlines;
+    bool running;
+    std::thread timeoutThread;
+
+    // Receives the RPC messages from the communication
+    void handleMessage(uint32_t senderID, void *data, size_t dataSize);
+
+    // Runs the method of a request and sends its response
+    void handleRequest(uint32_t senderID, uint64_t correlation, uint32_t method, const uint8_t *arguments, size_t size);
+
+    // Completes a pending call, false if it already completed
+    bool complete(uint64_t correlation, uint32_t senderID, RpcResult result);
+
+    // Sends an RPC message of the kind
+    ErrorCode sendMessage(RpcKind kind, uint32_t destID, uint64_t correlation, uint32_t method, const void *data, size_t size);
+
+    // Runs in a thread - fails the calls whose time is up
+    void expireCalls();
+
+public:
+    // Constructor, receives the RPC messages of the communication, srcID is the ID the calls are sent from
+    RpcChannel(Communication &comm, uint32_t srcID);
+
+    // Registers a method that peers may call
+    void registerMethod(uint32_t method, Method handler);
+
+    // Calls a method of the peer, the callback runs when the call completes
+    void call(uint32_t destID, uint32_t method, const void *data, size_t size, Callback callback,
+              std::chrono::milliseconds timeout = std::chrono::milliseconds(RPC_DEFAULT_TIMEOUT_MS));
+
+    // Calls a method of the peer, the future is ready when the call completes
+    std::future<RpcResult> call(uint32_t destID, uint32_t method, const void *data, size_t size,
+                                std::chrono::milliseconds timeout = std::chrono::milliseconds(RPC_DEFAULT_TIMEOUT_MS));
+
+    // Returns the number of calls waiting for a response
+    size_t getPendingCount();
+
+    // Destructor, fails the calls that are still waiting
+    ~RpcChannel();
+};
@@ -7,12 +7,17 @@
 #include <unistd.h>
 #include <functional>
 #include <map>
+#include <memory>
+#include <set>
 #include <csignal>
 #include "message.h"
 #include "../sockets/Isocket.h"
 #include "../sockets/real_socket.h"
 #include "error_code.h"
 
+// Packets a client may send before the bus returns credits, 0 disables flow control
+#define FLOW_CONTROL_WINDOW 64
+
 class ServerConnection
 {
 private:
@@ -26,14 +31,24 @@ private:
     std::mutex socketMutex;
     std::mutex threadMutex;
     std::function<void(Packet&)> receiveDataCallback;
+    std::function<void(uint32_t)> connectCallback;
     std::map<int, uint32_t> clientIDMap;
+    std::set<uint32_t> bulkClients; // Clients that can read the bulk regions of this host
+    std::map<int, std::shared_ptr<std::mutex>> sendMutexes; // Per client socket, frames from several threads do not interleave
+    std::map<int, uint32_t> consumedCredits; // Per client socket, frames that left the bus since the last credit
     std::mutex IDMapMutex;
     ISocket* socketInterface;
+    uint32_t flowControlWindow;
+    std::set<uint32_t> allowedIds; // Empty - any ID may connect
+    uint32_t connectionLimit;      // 0 - no limit
+
+    // Set by the receive callback of the current client thread when it keeps the frame
+    static thread_local bool creditHeld;
 
     // Starts listening for connection requests
     void startThread();
 
-    // Implementation according to the CAN BUS
+    // Implementation according to the CAN BUS - the ID is allowed and no connected client has it, called with IDMapMutex locked
     bool isValidId(uint32_t id);
     
     // Runs in a thread for each process - waits for a message and forwards it to the manager
@@ -42,6 +57,15 @@ private:
     // Returns the sockets ID
     int getClientSocketByID(uint32_t destID);
 
+    // Grants the client permission to send more packets
+    ErrorCode sendCredit(int clientSocket, uint32_t clientID, uint32_t credits);
+
+    // Counts a frame of the client that left the bus, returns the credits every half window
+    void consumeCredit(int clientSocket, uint32_t clientID);
+
+    // Writes one frame to the client socket, holding the send mutex of the socket
+    ssize_t sendFrame(int clientSocket, const Packet &packet);
+
 public:
 
     // Constructor
@@ -62,11 +86,38 @@ public:
     // Sets the callback for receiving data, throws an exception if the callback is null.
     void setReceiveDataCallback(std::function<void(Packet&)> callback);
 
+    // Sets the callback that gets the ID of every client that completed the connection, nullptr for none
+    void setConnectCallback(std::function<void(uint32_t)> callback);
+
     // Sets the socket interface, throws an exception if the socketInterface is null.
     void setSocketInterface(ISocket *socketInterface);              
 
+    // Sets the number of packets a client may send ahead, 0 disables flow control
+    void setFlowControlWindow(uint32_t window);
+
+    // Sets the IDs that may connect, the connections of other IDs are closed. Empty allows every ID.
+    void setAllowedIds(const std::vector<uint32_t> &ids);
+
+    // Sets the number of clients that may be connected at once, 0 for no limit
+    void setConnectionLimit(uint32_t limit);
+
     // Sends the message to destination
     ErrorCode sendDestination(const Packet &packet);
+
+    // Called by the receive callback that keeps the frame to send it later, its credit waits for releaseCredit
+    void holdCredit();
+
+    // Returns the credit of a held frame of the client, once the frame is sent or dropped
+    void releaseCredit(uint32_t clientID);
+
+    // Returns the number of clients that completed the connection
+    size_t getConnectedCount();
+
+    // Checks if a client with the ID is connected to this bus
+    bool hasClient(uint32_t id);
+
+    // Checks if the client is connected and reads the shared memory of this host (bulk channel)
+    bool canReadBulk(uint32_t id);
     
     // For testing
     int getServerSocket();
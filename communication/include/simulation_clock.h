@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+
+// Wall time the bus waits for the clients to acknowledge a lockstep tick
+#define CLOCK_ACK_TIMEOUT_MS 1000
+
+// How time advances in the simulation
+enum class ClockMode {
+    REAL_TIME, // Wall clock time
+    VIRTUAL,   // Time advances only by ticks from the bus, without waiting for the clients
+    LOCKSTEP   // Like VIRTUAL, but the bus waits for every client to finish the tick
+};
+
+// The data of a CLOCK_TICK / CLOCK_ACK frame
+struct ClockTick
+{
+    uint64_t time;  // Simulation time in nanoseconds
+    bool lockstep;  // The bus waits for an acknowledgment of this tick
+};
+
+// Process wide simulation time, driven by the bus in the virtual modes
+class SimulationClock
+{
+private:
+    std::atomic<ClockMode> mode;
+    std::atomic<uint64_t> virtualTime;
+    std::chrono::steady_clock::time_point startTime;
+    std::mutex clockMutex;
+    std::condition_variable timeAdvanced;
+    std::condition_variable stepDone;
+    std::multiset<uint64_t> deadlines;
+    int runningThreads;
+
+    // Set on a thread that was woken by a tick and did not go back to sleep yet
+    static thread_local bool woken;
+
+    // Private constructor
+    SimulationClock();
+
+    // Marks the current thread as finished with its step
+    void finishStep();
+
+public:
+    // Static function to return a singleton instance
+    static SimulationClock &getInstance();
+
+    // Returns the current mode
+    ClockMode getMode();
+
+    // Switches mode, threads sleeping on virtual time are released
+    void setMode(ClockMode newMode);
+
+    // Returns the simulation time in nanoseconds
+    uint64_t now();
+
+    // Sleeps on wall time or until the virtual time has advanced by duration
+    void sleepFor(std::chrono::nanoseconds duration);
+
+    // Moves the virtual time forward and wakes the threads whose deadline passed
+    void advanceTo(uint64_t time);
+
+    // Waits until every thread woken by the last ticks sleeps again, false on timeout
+    bool waitIdle(std::chrono::milliseconds timeout);
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Packets of a reliable message that may be in flight before an acknowledgment
+#define RELIABLE_WINDOW_SIZE 32
+
+// Time without acknowledgment before the unacknowledged packets are sent again, until the round trip is measured
+#define RELIABLE_RTO_MS 200
+
+// Bounds of the measured retransmission timeout
+#define RELIABLE_MIN_RTO_MS 5
+#define RELIABLE_MAX_RTO_MS 2000
+
+// Timeouts in a row, without any progress, before the message is given up
+#define RELIABLE_MAX_RETRIES 10
+
+// The receiver acknowledges every this many packets, and at a gap or the end of a message
+#define RELIABLE_ACK_EVERY 8
+
+// Completed messages the receiver remembers, to answer retransmissions of them
+#define RELIABLE_HISTORY_SIZE 256
+
+// Retransmission timeout from the measured round trip times (RFC 6298)
+class RttEstimator
+{
+private:
+    double srtt;   // Smoothed round trip time in nanoseconds
+    double rttvar; // Round trip time variation in nanoseconds
+    bool measured;
+
+public:
+    // Constructor
+    RttEstimator();
+
+    // Adds a round trip time of a packet that was sent once
+    void addSample(std::chrono::nanoseconds rtt);
+
+    // Returns the timeout, doubled for every timeout in a row
+    std::chrono::nanoseconds getTimeout(int backoff = 0) const;
+};
+
+// Sender side state of one reliable message - which packets to send, resend or forget
+class SlidingWindow
+{
+private:
+    uint32_t tps;
+    uint32_t size;
+    uint32_t base; // First packet that was not acknowledged
+    uint32_t next; // First packet that was never sent
+    std::vector<bool> acked;
+    std::vector<bool> resent;
+    std::vector<std::chrono::steady_clock::time_point> sentAt;
+    std::vector<uint32_t> retransmits;
+    bool news;
+    std::chrono::nanoseconds timeoutDuration;
+    std::chrono::nanoseconds rttSample;
+
+    // Queues the packet for retransmission unless it was sent very recently
+    void requestRetransmit(uint32_t psn, std::chrono::steady_clock::time_point now);
+
+public:
+    // Constructor
+    SlidingWindow(uint32_t tps, uint32_t size = RELIABLE_WINDOW_SIZE);
+
+    // Checks if a new packet fits in the window
+    bool canSend() const;
+
+    // Returns the next new packet to send and marks it as sent
+    uint32_t takeNext();
+
+    // Returns the packets to send again and clears the list
+    std::vector<uint32_t> takeRetransmits();
+
+    // Marks a packet as sent again
+    void markSent(uint32_t psn);
+
+    // Applies an acknowledgment, a NACK also requests the missing packets
+    void acknowledge(uint32_t cumulative, uint32_t bitmap, bool isNack);
+
+    // No acknowledgment arrived in time, every packet in flight is sent again
+    void timeout();
+
+    // Checks and clears whether anything arrived since the last call
+    bool takeNews();
+
+    // Checks if every packet was acknowledged
+    bool isComplete() const;
+
+    // Sets the current retransmission timeout
+    void setTimeout(std::chrono::nanoseconds timeout);
+
+    // Returns the round trip time measured by the last acknowledgment, false if there is none
+    bool takeRttSample(std::chrono::nanoseconds &sample);
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "packet.h"
+
+// Bit rate used to compute frame times when the schedule file does not set one
+#define SCHEDULE_DEFAULT_BITRATE 500000
+
+// Frames of one ID the bus keeps until a slot, a message that starts while the buffer is full is dropped whole
+#define SCHEDULE_BUFFER_LIMIT 256
+
+// The timer thread sleeps until this close to a slot and spins the rest, for a jitter-free start
+#define SCHEDULE_SPIN_US 50
+
+// A transmission window of the cycle
+struct ScheduleSlot
+{
+    std::chrono::microseconds start;  // Offset from the start of the cycle
+    std::chrono::microseconds length;
+    std::vector<uint32_t> ids;        // Message IDs that own the window, empty for an arbitrating window open to unscheduled IDs
+};
+
+// Static TTCAN-style schedule - a repeating cycle of windows, each reserved for some message IDs
+class TimeTriggeredSchedule
+{
+private:
+    std::chrono::microseconds cycle;
+    uint32_t bitrate;
+    size_t frameSize;
+    std::vector<ScheduleSlot> slots; // Sorted by start
+
+public:
+    // Constructor, frameSize is the payload of a frame - 8 bytes (classic) or 64 bytes (CAN-FD)
+    TimeTriggeredSchedule(std::chrono::microseconds cycle, uint32_t bitrate = SCHEDULE_DEFAULT_BITRATE, size_t frameSize = SIZE_PACKET);
+
+    // Reads a schedule file - cycle_us, bitrate, can_fd and "slot = start_us length_us id..." lines
+    static TimeTriggeredSchedule loadFromFile(const std::string &path);
+
+    // Adds a window, ids empty or "*" in the file for an arbitrating window
+    void addSlot(std::chrono::microseconds start, std::chrono::microseconds length, const std::vector<uint32_t> &ids);
+
+    // Returns the length of the cycle
+    std::chrono::microseconds getCycle() const;
+
+    // Returns the windows sorted by start
+    const std::vector<ScheduleSlot> &getSlots() const;
+
+    // Checks if the ID owns a window
+    bool isScheduled(uint32_t id) const;
+
+    // Checks if the ID may transmit in the window
+    bool isAllowed(const ScheduleSlot &slot, uint32_t id) const;
+
+    // Checks if the ID may transmit in any window
+    bool hasSlotFor(uint32_t id) const;
+
+    // Returns the worst case time of a full frame on the wire, with bit stuffing
+    std::chrono::nanoseconds frameTime() const;
+
+    // Returns the number of full frames that fit in the window
+    size_t slotCapacity(const ScheduleSlot &slot) const;
+
+    // Returns the share of the cycle that the windows reserve
+    double utilisation() const;
+
+    // Returns the problems of the schedule - windows outside the cycle, overlapping or shorter than a frame
+    std::vector<std::string> validate() const;
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Slots of a level of the wheel are 2^TIMER_WHEEL_BITS, a level covers the whole range of the level below
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_LEVELS 4
+
+// A timer of the wheel
+struct WheelTimer
+{
+    uint64_t expiry; // Tick the timer fires at
+    uint32_t id;
+};
+
+// Hierarchical timer wheel - O(1) scheduling, timers of a far level move down a level when their slot comes up.
+// Removing a timer is left to the owner, which ignores the IDs it no longer knows.
+class TimerWheel
+{
+private:
+    std::vector<WheelTimer> slots[TIMER_WHEEL_LEVELS][1 << TIMER_WHEEL_BITS];
+    uint64_t current; // The next tick to process
+    size_t count;
+
+    // Puts the timer in the slot for its distance from the current tick
+    void place(const WheelTimer &timer);
+
+    // Moves the timers of the higher levels whose slots come up at the current tick down
+    void cascade();
+
+public:
+    // Constructor, start is the first tick to process
+    TimerWheel(uint64_t start = 0);
+
+    // Adds a timer, a tick that was already processed fires at the next one
+    void schedule(uint32_t id, uint64_t expiry);
+
+    // Processes the ticks before until and appends the timers that fired
+    void advance(uint64_t until, std::vector<WheelTimer> &expired);
+
+    // Returns the first tick that may have timers - a tick with timers or where far timers move down, UINT64_MAX if empty
+    uint64_t nextTick() const;
+
+    // Returns the next tick to process
+    uint64_t getCurrent() const;
+
+    // Returns the number of timers
+    size_t size() const;
+};
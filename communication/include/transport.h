@@ -0,0 +1,112 @@
+#pragma once
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include "../sockets/Isocket.h"
+#include "../sockets/real_socket.h"
+
+// Transport policies of the pooled connections - the calls are resolved at compile time.
+// A policy has socket, setsockopt, bind, listen, accept, connect, send, sendv, recv, recvWaiting and close.
+
+// Direct system calls, no logging and no virtual calls - the hot path of the bus
+struct PosixTransport
+{
+    int socket(int domain, int type, int protocol) { return ::socket(domain, type, protocol); }
+    int setsockopt(int fd, int level, int name, const void *value, socklen_t length) { return ::setsockopt(fd, level, name, value, length); }
+    int bind(int fd, const struct sockaddr *addr, socklen_t length) { return ::bind(fd, addr, length); }
+    int listen(int fd, int backlog) { return ::listen(fd, backlog); }
+    int accept(int fd, struct sockaddr *addr, socklen_t *length) { return ::accept(fd, addr, length); }
+    int connect(int fd, const struct sockaddr *addr, socklen_t length) { return ::connect(fd, addr, length); }
+    ssize_t send(int fd, const void *buf, size_t len) { return ::send(fd, buf, len, MSG_NOSIGNAL); }
+    ssize_t recv(int fd, void *buf, size_t len) { return ::recv(fd, buf, len, 0); }
+
+    // Sends the buffers with one system call
+    ssize_t sendv(int fd, const struct iovec *iov, int count)
+    {
+        struct msghdr message = {};
+        message.msg_iov = const_cast<struct iovec *>(iov);
+        message.msg_iovlen = count;
+        return ::sendmsg(fd, &message, MSG_NOSIGNAL);
+    }
+
+    // Receives what is already waiting into the buffers with one system call, without blocking
+    ssize_t recvWaiting(int fd, const struct iovec *iov, int count)
+    {
+        struct msghdr message = {};
+        message.msg_iov = const_cast<struct iovec *>(iov);
+        message.msg_iovlen = count;
+        return ::recvmsg(fd, &message, MSG_DONTWAIT);
+    }
+
+    int close(int fd)
+    {
+        ::shutdown(fd, SHUT_RDWR);
+        return ::close(fd);
+    }
+};
+
+// The virtual ISocket interface, so the pooled connections run over the mock and fault injecting sockets
+struct SocketTransport
+{
+    ISocket *socketInterface;
+
+    SocketTransport(ISocket *socketInterface = new RealSocket()) : socketInterface(socketInterface) {}
+    int socket(int domain, int type, int protocol) { return socketInterface->socket(domain, type, protocol); }
+    int setsockopt(int fd, int level, int name, const void *value, socklen_t length) { return socketInterface->setsockopt(fd, level, name, value, length); }
+    int bind(int fd, const struct sockaddr *addr, socklen_t length) { return socketInterface->bind(fd, addr, length); }
+    int listen(int fd, int backlog) { return socketInterface->listen(fd, backlog); }
+    int accept(int fd, struct sockaddr *addr, socklen_t *length) { return socketInterface->accept(fd, addr, length); }
+    int connect(int fd, const struct sockaddr *addr, socklen_t length) { return socketInterface->connect(fd, addr, length); }
+    ssize_t send(int fd, const void *buf, size_t len) { return socketInterface->send(fd, buf, len, MSG_NOSIGNAL); }
+    ssize_t recv(int fd, void *buf, size_t len) { return socketInterface->recv(fd, buf, len, 0); }
+
+    // One frame per call, the ISocket interface has no gather
+    ssize_t sendv(int fd, const struct iovec *iov, int count) { return count ? send(fd, iov[0].iov_base, iov[0].iov_len) : 0; }
+
+    // The ISocket interface has no scatter, the frames are read one per call
+    ssize_t recvWaiting(int, const struct iovec *, int)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    int close(int fd) { return socketInterface->close(fd); }
+};
+
+// Sends all the buffers, repeating partial sends, false if the connection failed
+template <class Transport>
+bool transportSendAll(Transport &transport, int fd, struct iovec *iov, int count)
+{
+    while (count > 0) {
+        ssize_t sent = transport.sendv(fd, iov, count);
+        if (sent <= 0)
+            return false;
+        // Skips the buffers that went out whole, the first of the rest may be partial
+        while (count > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    return true;
+}
+
+// Receives exactly len bytes, false if the connection was closed or failed
+template <class Transport>
+bool transportRecvAll(Transport &transport, int fd, void *buf, size_t len)
+{
+    size_t received = 0;
+    while (received < len) {
+        ssize_t valread = transport.recv(fd, static_cast<char *>(buf) + received, len - received);
+        if (valread <= 0)
+            return false;
+        received += std::min((size_t)valread, len - received);
+    }
+    return true;
+}
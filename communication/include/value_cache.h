@@ -0,0 +1,63 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+#include "packet.h"
+
+// Streams whose last value the bus keeps, the oldest stream is forgotten beyond it
+#define VALUE_CACHE_LIMIT 4096
+
+// Last complete message of every stream that passed the bus - message ID, source and destination, as the IDs
+// of different streams may be equal - to answer remote requests (RTR frames)
+// and to bring clients that connect late up to date. Only plain data messages are kept - bulk descriptors,
+// deltas and RPC messages mean nothing without what came before them.
+class ValueCache
+{
+private:
+    // Message ID, source and destination
+    typedef std::tuple<uint32_t, uint32_t, uint32_t> StreamKey;
+
+    // The frames of the message that is arriving for a stream
+    struct Assembly
+    {
+        uint32_t srcID;
+        uint32_t msn;
+        std::vector<Packet> packets;
+        std::vector<bool> received;
+        uint32_t count;
+    };
+
+    struct Entry
+    {
+        std::vector<Packet> packets;
+        uint64_t stored; // Order of storing, to forget the oldest stream
+    };
+
+    std::mutex cacheMutex;
+    std::map<StreamKey, Assembly> assemblies;
+    std::map<StreamKey, Entry> values;
+    uint64_t storeCount;
+
+    // Checks if the frame belongs to a message worth keeping
+    static bool isCacheable(const Packet &p);
+
+public:
+    // Constructor
+    ValueCache();
+
+    // Adds a frame, its message becomes the value of its stream once all its frames arrived
+    void store(const Packet &p);
+
+    // Copies the frames of the last value of the ID that the source sent to the client or broadcast, false if there is none
+    bool lookup(uint32_t id, uint32_t srcID, uint32_t clientID, std::vector<Packet> &packets);
+
+    // Returns the last values that the client would have received - sent to it or broadcast
+    std::vector<std::vector<Packet>> snapshotFor(uint32_t clientID);
+
+    // Returns the number of streams with a value
+    size_t size();
+
+    // Forgets all the values
+    void clear();
+};
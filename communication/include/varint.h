@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Appends an unsigned integer, 7 bits per byte
+inline void putVarint(std::vector<uint8_t> &buffer, uint64_t value)
+{
+    while (value >= 0x80) {
+        buffer.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((uint8_t)value);
+}
+
+// Reads an unsigned integer, false if the data ends first
+inline bool getVarint(const uint8_t *&position, const uint8_t *end, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (position == end)
+            return false;
+        uint8_t byte = *position++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Reads an unsigned integer that fits in 32 bits
+inline bool getVarint32(const uint8_t *&position, const uint8_t *end, uint32_t &value)
+{
+    uint64_t wide;
+    if (!getVarint(position, end, wide) || wide > UINT32_MAX)
+        return false;
+    value = (uint32_t)wide;
+    return true;
+}
@@ -2,6 +2,7 @@
 #define ISOCKET_H
 
 #include <sys/socket.h>
+#include <algorithm>
 #include "../../logger/logger.h"
 
 class ISocket {
@@ -16,6 +17,38 @@ public:
     virtual ssize_t recv(int sockfd, void *buf, size_t len, int flags) = 0;
     virtual int close(int fd) = 0;
     virtual ~ISocket() = default;
+
+    // Sends the whole buffer, repeating partial sends
+    ssize_t sendAll(int sockfd, const void *buf, size_t len, int flags);
+
+    // Receives exactly len bytes unless the connection was closed or failed
+    ssize_t recvAll(int sockfd, void *buf, size_t len, int flags);
 };
 
+// Sends the whole buffer, repeating partial sends
+inline ssize_t ISocket::sendAll(int sockfd, const void *buf, size_t len, int flags)
+{
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t bytesSent = send(sockfd, static_cast<const char *>(buf) + sent, len - sent, flags);
+        if (bytesSent <= 0)
+            return bytesSent;
+        sent += std::min((size_t)bytesSent, len - sent);
+    }
+    return sent;
+}
+
+// Receives exactly len bytes unless the connection was closed or failed
+inline ssize_t ISocket::recvAll(int sockfd, void *buf, size_t len, int flags)
+{
+    size_t received = 0;
+    while (received < len) {
+        ssize_t valread = recv(sockfd, static_cast<char *>(buf) + received, len - received, flags);
+        if (valread <= 0)
+            return valread;
+        received += std::min((size_t)valread, len - received);
+    }
+    return received;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,349 @@
+#include "fault_injection_socket.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+// Sets one option by its name in the configuration file
+void FaultConfig::set(const std::string &key, const std::string &value)
+{
+    double number;
+    try {
+        size_t used;
+        number = std::stod(value, &used);
+        if (used != value.size())
+            throw std::invalid_argument(value);
+    }
+    catch (const std::exception &) {
+        throw std::invalid_argument("Invalid value for " + key + ": " + value);
+    }
+    if (number < 0)
+        throw std::invalid_argument(key + " cannot be negative");
+
+    double *rate = nullptr;
+    if (key == "latency_us")
+        latency = std::chrono::microseconds((int64_t)number);
+    else if (key == "jitter_us")
+        jitter = std::chrono::microseconds((int64_t)number);
+    else if (key == "bandwidth_bytes_per_sec")
+        bandwidth = (uint64_t)number;
+    else if (key == "reorder_delay_us")
+        reorderDelay = std::chrono::microseconds((int64_t)number);
+    else if (key == "seed")
+        seed = (unsigned int)number;
+    else if (key == "send_loss")
+        rate = &sendLoss;
+    else if (key == "recv_loss")
+        rate = &recvLoss;
+    else if (key == "corrupt_rate")
+        rate = &corruptRate;
+    else if (key == "reorder_rate")
+        rate = &reorderRate;
+    else if (key == "partial_send_rate")
+        rate = &partialSendRate;
+    else if (key == "partial_recv_rate")
+        rate = &partialRecvRate;
+    else
+        throw std::invalid_argument("Unknown fault injection option: " + key);
+
+    if (rate) {
+        if (number > 1)
+            throw std::invalid_argument(key + " must be between 0 and 1");
+        *rate = number;
+    }
+}
+
+// Reads "key = value" lines, '#' starts a comment
+FaultConfig FaultConfig::loadFromFile(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Cannot open fault injection configuration: " + path);
+
+    const char *whitespace = " \t\r";
+    FaultConfig config;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(whitespace) == std::string::npos)
+            continue;
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos)
+            throw std::invalid_argument(path + ":" + std::to_string(lineNumber) + ": expected key = value");
+        std::string key = line.substr(0, equals);
+        std::string value = line.substr(equals + 1);
+        key = key.substr(key.find_first_not_of(whitespace));
+        key.erase(key.find_last_not_of(whitespace) + 1);
+        size_t valueStart = value.find_first_not_of(whitespace);
+        value = valueStart == std::string::npos ? "" : value.substr(valueStart);
+        value.erase(value.find_last_not_of(whitespace) + 1);
+        config.set(key, value);
+    }
+    return config;
+}
+
+// Constructor, takes ownership of socketInterface
+FaultInjectionSocket::FaultInjectionSocket(ISocket *socketInterface, const FaultConfig &config)
+    : socketInterface(socketInterface), config(config), random(config.seed), nextChunk(0), deliveringSocket(-1), running(false)
+{
+    if (!socketInterface)
+        throw std::invalid_argument("Socket interface cannot be null");
+}
+
+// Constructor that reads the configuration file, takes ownership of socketInterface
+FaultInjectionSocket::FaultInjectionSocket(ISocket *socketInterface, const std::string &configPath)
+    : FaultInjectionSocket(socketInterface, FaultConfig::loadFromFile(configPath))
+{
+}
+
+int FaultInjectionSocket::socket(int domain, int type, int protocol)
+{
+    return socketInterface->socket(domain, type, protocol);
+}
+
+int FaultInjectionSocket::setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen)
+{
+    return socketInterface->setsockopt(sockfd, level, optname, optval, optlen);
+}
+
+int FaultInjectionSocket::bind(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
+{
+    return socketInterface->bind(sockfd, addr, addrlen);
+}
+
+int FaultInjectionSocket::listen(int sockfd, int backlog)
+{
+    return socketInterface->listen(sockfd, backlog);
+}
+
+int FaultInjectionSocket::accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
+{
+    return socketInterface->accept(sockfd, addr, addrlen);
+}
+
+int FaultInjectionSocket::connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
+{
+    return socketInterface->connect(sockfd, addr, addrlen);
+}
+
+// Hands out received frames, possibly in pieces, after losing or corrupting some of them
+ssize_t FaultInjectionSocket::recv(int sockfd, void *buf, size_t len, int flags)
+{
+    if (config.recvLoss <= 0 && config.corruptRate <= 0 && config.partialRecvRate <= 0)
+        return socketInterface->recv(sockfd, buf, len, flags);
+
+    std::shared_ptr<RecvBuffer> buffer;
+    {
+        std::lock_guard<std::mutex> lock(recvMutex);
+        std::shared_ptr<RecvBuffer> &slot = recvBuffers[sockfd];
+        if (!slot)
+            slot = std::make_shared<RecvBuffer>();
+        buffer = slot;
+    }
+
+    // Faults are decided per frame, so a whole frame is read before any of it is returned
+    if (buffer->position == buffer->size) {
+        while (true) {
+            ssize_t valread = socketInterface->recvAll(sockfd, &buffer->frame, sizeof(Packet), flags);
+            if (valread <= 0)
+                return valread;
+            if (!isFaultable(&buffer->frame, sizeof(Packet)))
+                break;
+            if (chance(config.recvLoss))
+                continue;
+            if (buffer->frame.getDataLength() && chance(config.corruptRate))
+                buffer->frame.data[0] ^= 0x01;
+            break;
+        }
+        buffer->position = 0;
+        buffer->size = sizeof(Packet);
+    }
+
+    size_t count = std::min(len, buffer->size - buffer->position);
+    if (count > 1 && chance(config.partialRecvRate))
+        count = uniform(1, count - 1);
+    std::memcpy(buf, reinterpret_cast<uint8_t *>(&buffer->frame) + buffer->position, count);
+    buffer->position += count;
+    return count;
+}
+
+// Loses frames, accepts only part of the buffer, or queues the bytes in the delay line
+ssize_t FaultInjectionSocket::send(int sockfd, const void *buf, size_t len, int flags)
+{
+    if (isFaultable(buf, len) && chance(config.sendLoss))
+        return len;
+
+    size_t count = len;
+    if (len > 1 && chance(config.partialSendRate))
+        count = uniform(1, len - 1);
+
+    if (!isDelayed())
+        return socketInterface->send(sockfd, buf, count, flags);
+
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::nanoseconds delay = config.latency;
+    if (config.jitter.count())
+        delay += std::chrono::microseconds(uniform(-config.jitter.count(), config.jitter.count()));
+    delay = std::max<std::chrono::nanoseconds>(delay, std::chrono::nanoseconds(0));
+
+    std::lock_guard<std::mutex> lock(sendMutex);
+    if (!running) {
+        running = true;
+        deliveryThread = std::thread(&FaultInjectionSocket::deliver, this);
+    }
+
+    // The link sends one chunk at a time, a chunk arrives after it was fully sent
+    auto start = std::max(now, linkFree);
+    linkFree = start;
+    if (config.bandwidth)
+        linkFree += std::chrono::nanoseconds(count * 1000000000ull / config.bandwidth);
+    auto due = linkFree + delay;
+
+    SendStream &stream = sendStreams[sockfd];
+    const uint8_t *bytes = static_cast<const uint8_t *>(buf);
+    Chunk chunk{sockfd, flags, std::vector<uint8_t>(bytes, bytes + count)};
+    if (count == sizeof(Packet) && stream.offset == 0 && !stream.held && chance(config.reorderRate)) {
+        stream.held.reset(new HeldFrame{std::move(chunk), due, now + config.reorderDelay});
+        sendCondition.notify_all();
+        return count;
+    }
+
+    // Jitter does not reorder a stream, a chunk waits for the chunks sent before it
+    due = std::max(due, stream.lastDue);
+    stream.lastDue = due;
+    enqueue(std::move(chunk), due);
+    stream.offset = (stream.offset + count) % sizeof(Packet);
+    if (stream.offset == 0 && stream.held)
+        releaseHeld(stream);
+    return count;
+}
+
+// Sends what is still queued for the connection, like a TCP close, then closes it
+int FaultInjectionSocket::close(int fd)
+{
+    {
+        std::unique_lock<std::mutex> lock(sendMutex);
+        auto stream = sendStreams.find(fd);
+        if (stream != sendStreams.end() && stream->second.held)
+            releaseHeld(stream->second);
+        sendCondition.wait(lock, [this, fd]() {
+            if (!running)
+                return true;
+            if (deliveringSocket == fd)
+                return false;
+            for (auto &entry : delayLine)
+                if (entry.second.sockfd == fd)
+                    return false;
+            return true;
+        });
+        sendStreams.erase(fd);
+    }
+    {
+        std::lock_guard<std::mutex> lock(recvMutex);
+        recvBuffers.erase(fd);
+    }
+    return socketInterface->close(fd);
+}
+
+FaultInjectionSocket::~FaultInjectionSocket()
+{
+    {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        running = false;
+        sendCondition.notify_all();
+    }
+    if (deliveryThread.joinable())
+        deliveryThread.join();
+    delete socketInterface;
+}
+
+// Returns true with the given probability
+bool FaultInjectionSocket::chance(double rate)
+{
+    if (rate <= 0)
+        return false;
+    std::lock_guard<std::mutex> lock(randomMutex);
+    return std::uniform_real_distribution<double>(0, 1)(random) < rate;
+}
+
+// Returns a random number between min and max, inclusive
+int64_t FaultInjectionSocket::uniform(int64_t min, int64_t max)
+{
+    std::lock_guard<std::mutex> lock(randomMutex);
+    return std::uniform_int_distribution<int64_t>(min, max)(random);
+}
+
+// Checks if the frame may be lost or corrupted
+bool FaultInjectionSocket::isFaultable(const void *buf, size_t len)
+{
+    if (len != sizeof(Packet))
+        return false;
+    FrameType type = static_cast<const Packet *>(buf)->header.type;
+    return type == FrameType::DATA || type == FrameType::ACK || type == FrameType::NACK;
+}
+
+// Checks if sends go through the delay line
+bool FaultInjectionSocket::isDelayed() const
+{
+    return config.latency.count() || config.jitter.count() || config.bandwidth || config.reorderRate > 0;
+}
+
+// Puts bytes in the delay line, called with sendMutex locked
+void FaultInjectionSocket::enqueue(Chunk chunk, std::chrono::steady_clock::time_point due)
+{
+    delayLine.emplace(std::make_pair(due, nextChunk++), std::move(chunk));
+    sendCondition.notify_all();
+}
+
+// Puts a held frame after everything queued on its connection, called with sendMutex locked
+void FaultInjectionSocket::releaseHeld(SendStream &stream)
+{
+    auto due = std::max(stream.held->due, stream.lastDue);
+    stream.lastDue = due;
+    enqueue(std::move(stream.held->chunk), due);
+    stream.held.reset();
+}
+
+// Sends the delayed bytes on time
+void FaultInjectionSocket::deliver()
+{
+    std::unique_lock<std::mutex> lock(sendMutex);
+    while (running) {
+        auto now = std::chrono::steady_clock::now();
+        auto wake = std::chrono::steady_clock::time_point::max();
+
+        // A frame nobody overtook in time is sent anyway, unless a frame is half sent
+        for (auto &entry : sendStreams) {
+            SendStream &stream = entry.second;
+            if (!stream.held || stream.offset != 0)
+                continue;
+            if (stream.held->deadline <= now)
+                releaseHeld(stream);
+            else
+                wake = std::min(wake, stream.held->deadline);
+        }
+
+        if (!delayLine.empty()) {
+            auto first = delayLine.begin();
+            if (first->first.first <= now) {
+                Chunk chunk = std::move(first->second);
+                delayLine.erase(first);
+                deliveringSocket = chunk.sockfd;
+                lock.unlock();
+                socketInterface->sendAll(chunk.sockfd, chunk.bytes.data(), chunk.bytes.size(), chunk.flags);
+                lock.lock();
+                deliveringSocket = -1;
+                sendCondition.notify_all();
+                continue;
+            }
+            wake = std::min(wake, first->first.first);
+        }
+
+        if (wake == std::chrono::steady_clock::time_point::max())
+            sendCondition.wait(lock);
+        else
+            sendCondition.wait_until(lock, wake);
+    }
+}
@@ -0,0 +1,143 @@
+#ifndef FAULTINJECTIONSOCKET_H
+#define FAULTINJECTIONSOCKET_H
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Isocket.h"
+#include "../include/packet.h"
+
+// Network conditions injected by a FaultInjectionSocket, everything is off by default
+struct FaultConfig
+{
+    std::chrono::microseconds latency{0};        // Delay of every sent frame
+    std::chrono::microseconds jitter{0};         // Random variation of the delay, in both directions
+    uint64_t bandwidth = 0;                      // Bytes per second that can be sent, 0 for unlimited
+    double sendLoss = 0;                         // Chance of a sent frame to be lost
+    double recvLoss = 0;                         // Chance of a received frame to be lost
+    double corruptRate = 0;                      // Chance of a received frame to have a flipped data bit
+    double reorderRate = 0;                      // Chance of a sent frame to be overtaken by the next one
+    std::chrono::microseconds reorderDelay{1000}; // Longest time a frame waits to be overtaken
+    double partialSendRate = 0;                  // Chance of a send to accept only part of the buffer
+    double partialRecvRate = 0;                  // Chance of a recv to return only part of a frame
+    unsigned int seed = 1;                       // Seed of the random decisions, for repeatable runs
+
+    // Sets one option by its name in the configuration file
+    void set(const std::string &key, const std::string &value);
+
+    // Reads "key = value" lines, '#' starts a comment
+    static FaultConfig loadFromFile(const std::string &path);
+};
+
+// Wraps another socket and injects latency, jitter, a bandwidth cap, loss, reordering and partial sends and receives.
+// Decorators can be stacked. Loss and corruption hit only data and acknowledgment frames - credit and clock frames
+// model a reliable side channel. Loss on the sending side of a client also loses its flow control credits, so put
+// send loss on the bus socket, or disable flow control.
+class FaultInjectionSocket : public ISocket
+{
+private:
+    // Bytes waiting in the delay line
+    struct Chunk
+    {
+        int sockfd;
+        int flags;
+        std::vector<uint8_t> bytes;
+    };
+
+    // A frame held back to be overtaken by the next one
+    struct HeldFrame
+    {
+        Chunk chunk;
+        std::chrono::steady_clock::time_point due;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    // Send side state of one connection
+    struct SendStream
+    {
+        std::chrono::steady_clock::time_point lastDue;
+        size_t offset = 0; // Position inside the current frame, reordering happens only between frames
+        std::unique_ptr<HeldFrame> held;
+    };
+
+    // Receive side state of one connection
+    struct RecvBuffer
+    {
+        Packet frame;
+        size_t position = 0;
+        size_t size = 0;
+    };
+
+    ISocket *socketInterface;
+    FaultConfig config;
+    std::mutex randomMutex;
+    std::mt19937 random;
+
+    std::mutex sendMutex;
+    std::condition_variable sendCondition;
+    std::map<std::pair<std::chrono::steady_clock::time_point, uint64_t>, Chunk> delayLine;
+    std::map<int, SendStream> sendStreams;
+    std::chrono::steady_clock::time_point linkFree;
+    uint64_t nextChunk;
+    int deliveringSocket; // Connection the delivery thread is sending to, -1 if none
+    bool running;
+    std::thread deliveryThread;
+
+    std::mutex recvMutex;
+    std::map<int, std::shared_ptr<RecvBuffer>> recvBuffers;
+
+    // Returns true with the given probability
+    bool chance(double rate);
+
+    // Returns a random number between min and max, inclusive
+    int64_t uniform(int64_t min, int64_t max);
+
+    // Checks if the frame may be lost or corrupted
+    static bool isFaultable(const void *buf, size_t len);
+
+    // Checks if sends go through the delay line
+    bool isDelayed() const;
+
+    // Puts bytes in the delay line, called with sendMutex locked
+    void enqueue(Chunk chunk, std::chrono::steady_clock::time_point due);
+
+    // Puts a held frame after everything queued on its connection, called with sendMutex locked
+    void releaseHeld(SendStream &stream);
+
+    // Sends the delayed bytes on time
+    void deliver();
+
+public:
+    // Constructor, takes ownership of socketInterface
+    FaultInjectionSocket(ISocket *socketInterface, const FaultConfig &config);
+
+    // Constructor that reads the configuration file, takes ownership of socketInterface
+    FaultInjectionSocket(ISocket *socketInterface, const std::string &configPath);
+
+    int socket(int domain, int type, int protocol) override;
+
+    int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen) override;
+
+    int bind(int sockfd, const struct sockaddr *addr, socklen_t addrlen) override;
+
+    int listen(int sockfd, int backlog) override;
+
+    int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) override;
+
+    int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) override;
+
+    ssize_t recv(int sockfd, void *buf, size_t len, int flags) override;
+
+    ssize_t send(int sockfd, const void *buf, size_t len, int flags) override;
+
+    int close(int fd) override;
+
+    ~FaultInjectionSocket() override;
+};
+#endif
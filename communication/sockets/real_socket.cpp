@@ -1,7 +1,24 @@
 #include "real_socket.h"
+#include "../../logger/trace_log.h"
 
 logger RealSocket::log("communication");
 
+// Writes a binary trace record of the packet, false if no trace is set
+static bool tracePacket(logger::LogLevel level, TraceEvent event, const Packet *p)
+{
+    TraceWriter *trace = logger::getTrace();
+    if (!trace || !RealSocket::log.isLogging(level))
+        return false;
+
+    uint8_t payload[sizeof(TracePacket) + SIZE_PACKET_FD];
+    TracePacket fields = {p->header.ID, p->header.PSN};
+    size_t length = std::min(p->getDataLength(), (size_t)SIZE_PACKET_FD);
+    memcpy(payload, &fields, sizeof(fields));
+    memcpy(payload + sizeof(fields), p->data, length);
+    trace->write(static_cast<uint8_t>(level), TraceComponent::COMMUNICATION, p->header.SrcID, p->header.DestID, event, payload, sizeof(fields) + length);
+    return true;
+}
+
 RealSocket::RealSocket(){}
 
 int RealSocket::socket(int domain, int type, int protocol) 
@@ -83,16 +100,17 @@ ssize_t RealSocket::recv(int sockfd, void *buf, size_t len, int flags)
     const Packet *p = static_cast<const Packet *>(buf);
 
     if (valread < 0)
-        RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(p->header.SrcID), std::to_string(p->header.DestID), std::string(" Error occurred: in socket ") + std::to_string(sockfd) + std::string(" ") + std::string(strerror(errno)));
+        LOG_SRC_DST_AT(RealSocket::log, logger::LogLevel::ERROR, p->header.SrcID, p->header.DestID, " Error occurred: in socket ", sockfd, ' ', strerror(errno));
     else if (valread == 0)
-        RealSocket::log.logMessage(logger::LogLevel::INFO, std::to_string(p->header.SrcID), std::to_string(p->header.DestID), std::string(" connection closed: in socket ") + std::to_string(sockfd) + std::string(" ") + std::string(strerror(errno)));
-    else {
+        LOG_SRC_DST_AT(RealSocket::log, logger::LogLevel::INFO, p->header.SrcID, p->header.DestID, " connection closed: in socket ", sockfd, ' ', strerror(errno));
+    else if (valread != sizeof(Packet))
+        LOG_LIMITED_AT(RealSocket::log, logger::LogLevel::INFO, "received ", valread, " bytes of a packet in socket ", sockfd);
+    else if (!tracePacket(logger::LogLevel::INFO, TraceEvent::RECEIVE, p)) {
         if (!p->header.DLC)
-            RealSocket::log.logMessage(logger::LogLevel::INFO, std::to_string(p->header.SrcID), std::to_string(p->header.DestID), std::string("received packet number: ") + std::to_string(p->header.PSN) + std::string(", of messageId: ") + std::to_string(p->header.ID) + std::string(" ") + std::string(strerror(errno)) + " ID for connection: " + std::to_string(p->header.SrcID));
+            LOG_SRC_DST_LIMITED_AT(RealSocket::log, logger::LogLevel::INFO, p->header.SrcID, p->header.DestID, "received packet number: ", p->header.PSN, ", of messageId: ", p->header.ID, ' ', strerror(errno), " ID for connection: ", p->header.SrcID);
         else
-            RealSocket::log.logMessage(logger::LogLevel::INFO, std::to_string(p->header.SrcID), std::to_string(p->header.DestID), std::string("received packet number: ") + std::to_string(p->header.PSN) + std::string(", of messageId: ") + std::to_string(p->header.ID) + std::string(" ") + std::string(strerror(errno)) + " Data: " + p->pointerToHex(p->data,p->header.DLC));
+            LOG_SRC_DST_LIMITED_AT(RealSocket::log, logger::LogLevel::INFO, p->header.SrcID, p->header.DestID, "received packet number: ", p->header.PSN, ", of messageId: ", p->header.ID, ' ', strerror(errno), " Data: ", p->pointerToHex(p->data, p->getDataLength()));
     }
-        
 
     return valread;
 }
@@ -101,14 +119,25 @@ ssize_t RealSocket::send(int sockfd, const void *buf, size_t len, int flags)
 {
     int sendAns = ::send(sockfd, buf, len, flags);
     const Packet *p = static_cast<const Packet *>(buf);
+    // The rest of a partial send starts in the middle of a packet
+    if (len != sizeof(Packet))
+    {
+        if (sendAns <= 0)
+            LOG_ERROR(RealSocket::log, "sending ", len, " bytes in socket ", sockfd, ' ', strerror(errno));
+        else
+            LOG_LIMITED_AT(RealSocket::log, logger::LogLevel::INFO, "sending ", sendAns, " bytes in socket ", sockfd);
+        return sendAns;
+    }
     if (sendAns <= 0)
     {
-        RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(p->header.SrcID), std::to_string(p->header.DestID), "sending packet number: " + std::to_string(p->header.PSN) + ", of messageId: " + std::to_string(p->header.ID) + std::string(" ") + std::string(strerror(errno)));
+        LOG_SRC_DST_AT(RealSocket::log, logger::LogLevel::ERROR, p->header.SrcID, p->header.DestID, "sending packet number: ", p->header.PSN, ", of messageId: ", p->header.ID, ' ', strerror(errno));
     }
+    if (sendAns > 0 && tracePacket(logger::LogLevel::INFO, TraceEvent::SEND, p))
+        return sendAns;
     if (!p->header.DLC)
-        RealSocket::log.logMessage(logger::LogLevel::INFO, std::to_string(p->header.SrcID), std::to_string(p->header.DestID), "sending packet number: " + std::to_string(p->header.PSN) + ", of messageId: " + std::to_string(p->header.ID) + std::string(" ") + std::string(strerror(errno)) + " ID for connection: " + std::to_string(p->header.SrcID));
+        LOG_SRC_DST_LIMITED_AT(RealSocket::log, logger::LogLevel::INFO, p->header.SrcID, p->header.DestID, "sending packet number: ", p->header.PSN, ", of messageId: ", p->header.ID, ' ', strerror(errno), " ID for connection: ", p->header.SrcID);
     else
-        RealSocket::log.logMessage(logger::LogLevel::INFO, std::to_string(p->header.SrcID), std::to_string(p->header.DestID), "sending packet number: " + std::to_string(p->header.PSN) + ", of messageId: " + std::to_string(p->header.ID) + std::string(" ") + std::string(strerror(errno)) + " Data: " + p->pointerToHex(p->data,p->header.DLC));
+        LOG_SRC_DST_LIMITED_AT(RealSocket::log, logger::LogLevel::INFO, p->header.SrcID, p->header.DestID, "sending packet number: ", p->header.PSN, ", of messageId: ", p->header.ID, ' ', strerror(errno), " Data: ", p->pointerToHex(p->data, p->getDataLength()));
     return sendAns;
 }
 
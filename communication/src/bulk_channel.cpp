@@ -0,0 +1,67 @@
+#include "../include/bulk_channel.h"
+#include <cstring>
+#include <cstdlib>
+
+// Copies the payload into a new shared memory region, returns false if it is not possible
+bool BulkChannel::publish(uint32_t srcID, uint32_t seq, const void *data, size_t size)
+{
+    std::string name = regionName(srcID, seq);
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        // A region left behind by a previous run
+        shm_unlink(name.c_str());
+        fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+            return false;
+    }
+
+    if (ftruncate(fd, size) < 0) {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    void *region = mmap(nullptr, size, PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (region == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    std::memcpy(region, data, size);
+    munmap(region, size);
+    return true;
+}
+
+// Copies the payload out of the described region and removes the region
+void *BulkChannel::consume(uint32_t srcID, const BulkDescriptor &descriptor)
+{
+    std::string name = regionName(srcID, descriptor.seq);
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return nullptr;
+
+    void *region = mmap(nullptr, descriptor.size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    shm_unlink(name.c_str());
+    if (region == MAP_FAILED)
+        return nullptr;
+
+    void *data = malloc(descriptor.size);
+    if (data)
+        std::memcpy(data, region, descriptor.size);
+    munmap(region, descriptor.size);
+    return data;
+}
+
+// Removes a region that was published but may have not been consumed
+void BulkChannel::discard(uint32_t srcID, uint32_t seq)
+{
+    shm_unlink(regionName(srcID, seq).c_str());
+}
+
+// Returns the shared memory name of a region
+std::string BulkChannel::regionName(uint32_t srcID, uint32_t seq)
+{
+    return "/vcs_bulk_" + std::to_string(srcID) + "_" + std::to_string(seq);
+}
@@ -0,0 +1,383 @@
+#include "../include/bus_bridge.h"
+#include "../include/varint.h"
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <cstring>
+
+// Bits of the first byte of an encoded frame
+#define BRIDGE_CONTINUATION 0x01
+
+// Bits of the flags, written as a variable-length integer
+#define BRIDGE_FLAG_BROADCAST 0x01
+#define BRIDGE_FLAG_PASSIVE 0x02
+#define BRIDGE_FLAG_RTR 0x04
+// 0x08 is not used - bulk descriptors point to shared memory of one host and do not cross the bridge
+#define BRIDGE_FLAG_FD 0x10
+#define BRIDGE_FLAG_RELIABLE 0x20
+#define BRIDGE_FLAG_DELTA 0x40
+#define BRIDGE_FLAG_COMPRESSED 0x80
+#define BRIDGE_FLAG_RPC 0x100
+
+// Packs the boolean header fields into one integer
+static uint32_t packFlags(const Packet::Header &header)
+{
+    return (header.isBroadcast ? BRIDGE_FLAG_BROADCAST : 0) | (header.passive ? BRIDGE_FLAG_PASSIVE : 0) |
+           (header.RTR ? BRIDGE_FLAG_RTR : 0) |
+           (header.isFD ? BRIDGE_FLAG_FD : 0) | (header.isReliable ? BRIDGE_FLAG_RELIABLE : 0) |
+           (header.isDelta ? BRIDGE_FLAG_DELTA : 0) | (header.isCompressed ? BRIDGE_FLAG_COMPRESSED : 0) |
+           (header.isRpc ? BRIDGE_FLAG_RPC : 0);
+}
+
+// Constructor
+BridgeCodec::BridgeCodec() : hasPrevious(false)
+{
+}
+
+// Appends the encoded frame to the buffer
+void BridgeCodec::encode(const Packet &packet, std::vector<uint8_t> &buffer)
+{
+    const Packet::Header &header = packet.header;
+    bool continuation = hasPrevious && header.ID == previous.header.ID && header.TPS == previous.header.TPS &&
+                        header.MSN == previous.header.MSN && header.SrcID == previous.header.SrcID &&
+                        header.DestID == previous.header.DestID && header.flowID == previous.header.flowID &&
+                        header.type == previous.header.type &&
+                        packFlags(header) == packFlags(previous.header) && header.PSN == previous.header.PSN + 1;
+
+    buffer.push_back(continuation ? BRIDGE_CONTINUATION : 0);
+    if (!continuation) {
+        putVarint(buffer, header.ID);
+        putVarint(buffer, header.PSN);
+        putVarint(buffer, header.TPS);
+        putVarint(buffer, header.MSN);
+        putVarint(buffer, header.SrcID);
+        putVarint(buffer, header.DestID);
+        putVarint(buffer, header.flowID);
+        putVarint(buffer, packFlags(header));
+        buffer.push_back((uint8_t)header.type);
+    }
+    buffer.push_back(header.DLC);
+    buffer.push_back(header.padding);
+    buffer.push_back((uint8_t)header.CRC);
+    buffer.push_back((uint8_t)(header.CRC >> 8));
+
+    // Timestamps of consecutive frames are close, zigzag keeps a negative difference short
+    int64_t delta = (int64_t)(header.timestamp - (hasPrevious ? previous.header.timestamp : 0));
+    putVarint(buffer, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+
+    size_t length = Packet::dlcToLength(header.DLC);
+    buffer.insert(buffer.end(), packet.data, packet.data + length);
+
+    previous = packet;
+    hasPrevious = true;
+}
+
+// Decodes the next frame and moves position past it, false if the data is malformed
+bool BridgeCodec::decode(const uint8_t *&position, const uint8_t *end, Packet &packet)
+{
+    if (position == end)
+        return false;
+    bool continuation = *position++ & BRIDGE_CONTINUATION;
+    if (continuation && !hasPrevious)
+        return false;
+
+    std::memset(&packet, 0, sizeof(Packet));
+    Packet::Header &header = packet.header;
+    uint32_t flags;
+    if (continuation) {
+        header = previous.header;
+        header.PSN++;
+        flags = packFlags(header);
+    }
+    else {
+        if (!getVarint32(position, end, header.ID) || !getVarint32(position, end, header.PSN) ||
+            !getVarint32(position, end, header.TPS) || !getVarint32(position, end, header.MSN) ||
+            !getVarint32(position, end, header.SrcID) || !getVarint32(position, end, header.DestID) ||
+            !getVarint32(position, end, header.flowID))
+            return false;
+        if (!getVarint32(position, end, flags) || position == end)
+            return false;
+        header.type = (FrameType)*position++;
+    }
+    header.isBroadcast = flags & BRIDGE_FLAG_BROADCAST;
+    header.passive = flags & BRIDGE_FLAG_PASSIVE;
+    header.RTR = flags & BRIDGE_FLAG_RTR;
+    header.isFD = flags & BRIDGE_FLAG_FD;
+    header.isReliable = flags & BRIDGE_FLAG_RELIABLE;
+    header.isDelta = flags & BRIDGE_FLAG_DELTA;
+    header.isCompressed = flags & BRIDGE_FLAG_COMPRESSED;
+    header.isRpc = flags & BRIDGE_FLAG_RPC;
+
+    if (end - position < 4)
+        return false;
+    header.DLC = *position++ & 0x0F;
+    header.padding = *position++;
+    header.CRC = position[0] | (position[1] << 8);
+    position += 2;
+
+    uint64_t zigzag;
+    if (!getVarint(position, end, zigzag))
+        return false;
+    int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+    header.timestamp = (hasPrevious ? previous.header.timestamp : 0) + delta;
+
+    size_t length = Packet::dlcToLength(header.DLC);
+    if ((size_t)(end - position) < length || header.padding > length)
+        return false;
+    std::memcpy(packet.data, position, length);
+    position += length;
+
+    previous = packet;
+    hasPrevious = true;
+    return true;
+}
+
+// Forgets the previous frame, both ends reset when the stream starts
+void BridgeCodec::reset()
+{
+    hasPrevious = false;
+}
+
+// Constructor, deliver receives the frames that arrive from the other bus
+BusBridge::BusBridge(std::function<void(Packet &)> deliver, ISocket *socketInterface)
+    : socketInterface(socketInterface), listenSocket(-1), bridgeSocket(-1), running(false), connected(false),
+      deliver(deliver), framesSent(0), bytesSent(0)
+{
+    if (!deliver)
+        throw std::invalid_argument("Deliver callback cannot be null");
+    if (!socketInterface)
+        throw std::invalid_argument("Socket interface cannot be null");
+}
+
+// Waits in the background for the other bus to connect to the port
+ErrorCode BusBridge::listen(int port)
+{
+    if (running)
+        return ErrorCode::CONNECTION_FAILED;
+
+    listenSocket = socketInterface->socket(AF_INET, SOCK_STREAM, 0);
+    if (listenSocket < 0)
+        return ErrorCode::SOCKET_FAILED;
+
+    int opt = 1;
+    if (socketInterface->setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)))
+        return ErrorCode::SOCKET_FAILED;
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    if (socketInterface->bind(listenSocket, (struct sockaddr *)&address, sizeof(address)) < 0)
+        return ErrorCode::BIND_FAILED;
+    if (socketInterface->listen(listenSocket, 1) < 0)
+        return ErrorCode::LISTEN_FAILED;
+
+    running = true;
+    readerThread = std::thread(&BusBridge::acceptAndRead, this);
+    return ErrorCode::SUCCESS;
+}
+
+// Connects to the other bus
+ErrorCode BusBridge::connect(const std::string &host, int port)
+{
+    if (running)
+        return ErrorCode::CONNECTION_FAILED;
+
+    bridgeSocket = socketInterface->socket(AF_INET, SOCK_STREAM, 0);
+    if (bridgeSocket < 0)
+        return ErrorCode::SOCKET_FAILED;
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+        socketInterface->close(bridgeSocket);
+        return ErrorCode::INVALID_DATA;
+    }
+    if (socketInterface->connect(bridgeSocket, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        socketInterface->close(bridgeSocket);
+        return ErrorCode::CONNECTION_FAILED;
+    }
+
+    running = true;
+    startStream();
+    readerThread = std::thread(&BusBridge::readBatches, this);
+    return ErrorCode::SUCCESS;
+}
+
+// Starts the reader and writer on the connected stream
+void BusBridge::startStream()
+{
+    // The batches are written as soon as they are ready
+    int noDelay = 1;
+    socketInterface->setsockopt(bridgeSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    encoder.reset();
+    decoder.reset();
+    connected = true;
+    writerThread = std::thread(&BusBridge::writeBatches, this);
+}
+
+// Runs in a thread - waits for the other bus to connect, then reads from it
+void BusBridge::acceptAndRead()
+{
+    int socket = socketInterface->accept(listenSocket, nullptr, nullptr);
+    if (socket < 0 || !running)
+        return;
+
+    // One bus on the other end, the port is not needed anymore
+    socketInterface->close(listenSocket);
+    listenSocket = -1;
+    bridgeSocket = socket;
+    startStream();
+    readBatches();
+}
+
+// Runs in a thread - reads batches and passes their frames to the bus
+void BusBridge::readBatches()
+{
+    std::vector<uint8_t> batch;
+    while (running) {
+        uint32_t size;
+        if (socketInterface->recvAll(bridgeSocket, &size, sizeof(size), 0) <= 0)
+            break;
+        size = ntohl(size);
+        if (size > BRIDGE_MAX_BATCH_BYTES) {
+            RealSocket::log.logMessage(logger::LogLevel::ERROR, "Bridge batch of " + std::to_string(size) + " bytes is too large");
+            break;
+        }
+
+        batch.resize(size);
+        if (socketInterface->recvAll(bridgeSocket, batch.data(), size, 0) <= 0)
+            break;
+
+        const uint8_t *position = batch.data();
+        const uint8_t *end = position + size;
+        while (position < end) {
+            Packet packet;
+            if (!decoder.decode(position, end, packet)) {
+                RealSocket::log.logMessage(logger::LogLevel::ERROR, "Malformed frame on the bridge");
+                position = end;
+                break;
+            }
+            deliver(packet);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    connected = false;
+    queueChanged.notify_all();
+}
+
+// Runs in a thread - writes the queued frames in batches
+void BusBridge::writeBatches()
+{
+    std::vector<uint8_t> batch;
+    std::unique_lock<std::mutex> lock(queueMutex);
+    while (running && connected) {
+        queueChanged.wait(lock, [this]() { return !running || !connected || !outgoing.empty(); });
+        if (!running || !connected)
+            break;
+
+        // Room for a size prefix, and for a whole frame after the last one that fits
+        batch.assign(sizeof(uint32_t), 0);
+        size_t frames = 0;
+        while (!outgoing.empty() && batch.size() + sizeof(Packet) + 16 <= BRIDGE_MAX_BATCH_BYTES) {
+            encoder.encode(outgoing.front(), batch);
+            outgoing.pop_front();
+            frames++;
+        }
+        queueChanged.notify_all();
+        lock.unlock();
+
+        uint32_t size = htonl(batch.size() - sizeof(uint32_t));
+        std::memcpy(batch.data(), &size, sizeof(size));
+        ssize_t bytes = socketInterface->sendAll(bridgeSocket, batch.data(), batch.size(), 0);
+
+        lock.lock();
+        if (bytes <= 0) {
+            connected = false;
+            queueChanged.notify_all();
+            break;
+        }
+        framesSent += frames;
+        bytesSent += batch.size();
+    }
+}
+
+// Queues a frame for the other bus, waits while the queue is full - bulk descriptors are refused
+ErrorCode BusBridge::forward(const Packet &packet)
+{
+    // The other bus could not read the region of a bulk descriptor
+    if (packet.header.isBulk)
+        return ErrorCode::INVALID_DATA;
+
+    std::unique_lock<std::mutex> lock(queueMutex);
+    // Holding the bus thread back holds back the flow control credits of the sender
+    queueChanged.wait(lock, [this]() { return !connected || outgoing.size() < BRIDGE_QUEUE_LIMIT; });
+    if (!connected)
+        return ErrorCode::CONNECTION_FAILED;
+
+    outgoing.push_back(packet);
+    queueChanged.notify_all();
+    return ErrorCode::SUCCESS;
+}
+
+// Adds an ID that is reachable through the bridge, with no routes every unknown ID is
+void BusBridge::addRoute(uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(routeMutex);
+    routes.insert(id);
+}
+
+// Checks if frames for the ID should go through the bridge
+bool BusBridge::isRouted(uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(routeMutex);
+    return routes.empty() || routes.count(id);
+}
+
+// Checks if the other bus is connected
+bool BusBridge::isConnected()
+{
+    return connected;
+}
+
+// Returns the number of frames written to the stream
+uint64_t BusBridge::getFramesSent()
+{
+    return framesSent;
+}
+
+// Returns the number of bytes written to the stream
+uint64_t BusBridge::getBytesSent()
+{
+    return bytesSent;
+}
+
+// Closes the stream and stops the threads
+void BusBridge::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!running)
+            return;
+        running = false;
+        queueChanged.notify_all();
+    }
+
+    if (listenSocket >= 0)
+        socketInterface->close(listenSocket);
+    if (writerThread.joinable())
+        writerThread.join();
+    if (bridgeSocket >= 0)
+        socketInterface->close(bridgeSocket);
+    if (readerThread.joinable())
+        readerThread.join();
+    connected = false;
+}
+
+// Destructor
+BusBridge::~BusBridge()
+{
+    stop();
+    delete socketInterface;
+}
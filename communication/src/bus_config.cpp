@@ -0,0 +1,198 @@
+#include "../include/bus_config.h"
+#include <sched.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+// Reads the whitespace separated numbers of a value, any base for IDs
+template <class T>
+static std::vector<T> parseList(const std::string &value)
+{
+    std::vector<T> items;
+    std::istringstream tokens(value);
+    std::string token;
+    while (tokens >> token)
+        items.push_back(std::stoul(token, nullptr, 0));
+    return items;
+}
+
+// Reads a true/false value
+static bool parseFlag(const std::string &value)
+{
+    std::string flag;
+    std::istringstream(value) >> flag;
+    if (flag == "true" || flag == "1")
+        return true;
+    if (flag == "false" || flag == "0")
+        return false;
+    throw std::invalid_argument("expected true or false");
+}
+
+// Reads a single word value
+static std::string parseWord(const std::string &value)
+{
+    std::string word;
+    std::istringstream(value) >> word;
+    return word;
+}
+
+// Reads a config file, throws std::invalid_argument with the line of the first mistake
+BusConfig BusConfig::loadFromFile(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Cannot open config: " + path);
+
+    BusConfig config;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            if (line.find_first_not_of(" \t\r") != std::string::npos)
+                throw std::invalid_argument(path + ":" + std::to_string(lineNumber) + ": expected key = value");
+            continue;
+        }
+
+        std::string key = parseWord(line.substr(0, equals));
+        std::string value = line.substr(equals + 1);
+        std::string word = parseWord(value);
+        try {
+            if (key == "port")
+                config.port = std::stoi(value);
+            else if (key == "ids")
+                config.ids = parseList<uint32_t>(value);
+            else if (key == "limit")
+                config.limit = std::stoul(value);
+            else if (key == "transport") {
+                if (word != "socket" && word != "pooled")
+                    throw std::invalid_argument("expected socket or pooled");
+                config.transport = word == "pooled" ? BusTransport::POOLED : BusTransport::SOCKET;
+            }
+            else if (key == "scheduler") {
+                if (word != "event" && word != "time_triggered")
+                    throw std::invalid_argument("expected event or time_triggered");
+                config.scheduler = word == "time_triggered" ? SchedulerMode::TIME_TRIGGERED : SchedulerMode::EVENT;
+            }
+            else if (key == "schedule_file") {
+                // Relative to the directory of the config file
+                size_t slash = path.rfind('/');
+                config.scheduleFile = word.empty() || word[0] == '/' || slash == std::string::npos ? word : path.substr(0, slash + 1) + word;
+            }
+            else if (key == "clock") {
+                if (word == "real_time")
+                    config.clockMode = ClockMode::REAL_TIME;
+                else if (word == "virtual")
+                    config.clockMode = ClockMode::VIRTUAL;
+                else if (word == "lockstep")
+                    config.clockMode = ClockMode::LOCKSTEP;
+                else
+                    throw std::invalid_argument("expected real_time, virtual or lockstep");
+            }
+            else if (key == "clock_step_us")
+                config.clockStepUs = std::stoull(value);
+            else if (key == "clock_speed")
+                config.clockSpeed = std::stod(value);
+            else if (key == "bridge_listen")
+                config.bridgeListenPort = std::stoi(value);
+            else if (key == "bridge_connect") {
+                size_t colon = word.rfind(':');
+                if (colon == std::string::npos)
+                    throw std::invalid_argument("expected host:port");
+                config.bridgeHost = word.substr(0, colon);
+                config.bridgePort = std::stoi(word.substr(colon + 1));
+            }
+            else if (key == "bridge_routes")
+                config.bridgeRoutes = parseList<uint32_t>(value);
+            else if (key == "value_cache")
+                config.valueCache = parseFlag(value);
+            else if (key == "replay_on_connect")
+                config.replayOnConnect = parseFlag(value);
+            else if (key == "io_cpus")
+                config.ioCpus = parseList<int>(value);
+            else if (key == "scheduler_cpus")
+                config.schedulerCpus = parseList<int>(value);
+            else if (key == "async_log")
+                config.asyncLog = parseFlag(value);
+            else if (key == "trace_file")
+                config.traceFile = word;
+            else if (key == "log_segment_bytes")
+                config.logSegmentBytes = std::stoull(value);
+            else if (key == "log_rotate_seconds")
+                config.logRotateSeconds = std::stoull(value);
+            else if (key == "log_retention_bytes")
+                config.logRetentionBytes = std::stoull(value);
+            else if (key == "log_rate_limit")
+                config.logRateLimit = std::stod(value);
+            else if (key == "log_burst")
+                config.logBurst = std::stod(value);
+            else if (key == "log_sample")
+                config.logSampleOneIn = std::stoul(value);
+            else if (key == "log_summary_seconds")
+                config.logSummarySeconds = std::stoull(value);
+            else if (key == "chrome_trace")
+                config.chromeTrace = word;
+            else
+                throw std::invalid_argument("unknown key " + key);
+        }
+        catch (const std::exception &e) {
+            throw std::invalid_argument(path + ":" + std::to_string(lineNumber) + ": " + e.what());
+        }
+    }
+    return config;
+}
+
+// Returns the problems of the settings - invalid ports and CPUs, options the transport does not support
+std::vector<std::string> BusConfig::validate() const
+{
+    std::vector<std::string> problems;
+    auto checkPort = [&problems](int value, const std::string &name) {
+        if (value <= 0 || value > 65535)
+            problems.push_back(name + " " + std::to_string(value) + " is not a valid port");
+    };
+    checkPort(port, "port");
+    if (bridgeListenPort)
+        checkPort(bridgeListenPort, "bridge_listen");
+    if (!bridgeHost.empty())
+        checkPort(bridgePort, "bridge_connect");
+    if (bridgeListenPort && !bridgeHost.empty())
+        problems.push_back("the bridge either listens or connects, not both");
+
+    for (const std::vector<int> *cpus : {&ioCpus, &schedulerCpus})
+        for (int cpu : *cpus)
+            if (cpu < 0 || cpu >= CPU_SETSIZE)
+                problems.push_back("CPU " + std::to_string(cpu) + " is out of range");
+
+    if (scheduler == SchedulerMode::TIME_TRIGGERED && scheduleFile.empty())
+        problems.push_back("the time_triggered scheduler needs a schedule_file");
+    if (clockMode != ClockMode::REAL_TIME && clockStepUs == 0)
+        problems.push_back("clock_step_us must be positive");
+    if (clockSpeed < 0)
+        problems.push_back("clock_speed must not be negative");
+    if (logRetentionBytes && logSegmentBytes && logRetentionBytes < logSegmentBytes)
+        problems.push_back("log_retention_bytes must hold at least one segment");
+    if ((logRotateSeconds || logRetentionBytes) && !logSegmentBytes && traceFile.empty())
+        problems.push_back("log_rotate_seconds and log_retention_bytes need log_segment_bytes or a trace_file");
+    if (logRateLimit < 0)
+        problems.push_back("log_rate_limit must not be negative");
+    if (logRateLimit > 0 && logBurst < 1)
+        problems.push_back("log_burst must be at least 1");
+    if (logSampleOneIn == 0)
+        problems.push_back("log_sample must be positive");
+
+    if (transport == BusTransport::POOLED) {
+        if (scheduler != SchedulerMode::EVENT)
+            problems.push_back("the pooled transport has no time_triggered scheduler");
+        if (clockMode != ClockMode::REAL_TIME)
+            problems.push_back("the pooled transport does not distribute a clock");
+        if (bridgeListenPort || !bridgeHost.empty())
+            problems.push_back("the pooled transport has no bridge");
+        if (valueCache)
+            problems.push_back("the pooled transport has no value cache");
+        if (!ids.empty() || limit)
+            problems.push_back("the pooled transport does not check ids and limit");
+    }
+    return problems;
+}
@@ -1,22 +1,27 @@
 #include "../include/bus_manager.h"
+#include "../../logger/chrome_trace.h"
 
 BusManager* BusManager::instance = nullptr;
 std::mutex BusManager::managerMutex;
 
 //Private constructor
-BusManager::BusManager(std::vector<uint32_t> idShouldConnect, uint32_t limit) :server(8080, std::bind(&BusManager::receiveData, this, std::placeholders::_1))//,syncCommunication(idShouldConnect, limit)
+BusManager::BusManager(std::vector<uint32_t> idShouldConnect, uint32_t limit, int port) :server(port, std::bind(&BusManager::receiveData, this, std::placeholders::_1)), clockRunning(false), tickTime(0), acksPending(0), scheduleRunning(false), valueCacheEnabled(false), replayOnConnect(false)//,syncCommunication(idShouldConnect, limit)
 {
+    server.setAllowedIds(idShouldConnect);
+    server.setConnectionLimit(limit);
+    server.setConnectCallback(std::bind(&BusManager::replayValues, this, std::placeholders::_1));
+
     // Setup the signal handler for SIGINT
     signal(SIGINT, BusManager::signalHandler);
 }
 
 // Static function to return a singleton instance
-BusManager* BusManager::getInstance(std::vector<uint32_t> idShouldConnect, uint32_t limit) {
+BusManager* BusManager::getInstance(std::vector<uint32_t> idShouldConnect, uint32_t limit, int port) {
     if (instance == nullptr) {
         // Lock the mutex to prevent multiple threads from creating instances simultaneously
         std::lock_guard<std::mutex> lock(managerMutex);
         if (instance == nullptr) {
-            instance = new BusManager(idShouldConnect, limit);
+            instance = new BusManager(idShouldConnect, limit, port);
         }
     }
     return instance;
@@ -31,10 +36,286 @@ ErrorCode BusManager::startConnection()
     return isConnected;
 }
 
+// Stops the clock, the schedule and the bridge, then closes the server
+void BusManager::stopConnection()
+{
+    stopClock();
+    stopSchedule();
+    stopBridge();
+    server.stopServer();
+}
+
+// Starts distributing virtual time, speed is simulated seconds per wall second (0 - as fast as possible)
+ErrorCode BusManager::startClock(ClockMode mode, std::chrono::nanoseconds step, double speed)
+{
+    if (mode == ClockMode::REAL_TIME || step.count() <= 0 || speed < 0)
+        return ErrorCode::INVALID_DATA;
+
+    stopClock();
+    clockMode = mode;
+    clockStep = step;
+    clockSpeed = speed;
+    clockRunning = true;
+    clockThread = std::thread(&BusManager::runClock, this);
+    return ErrorCode::SUCCESS;
+}
+
+// Stops distributing virtual time
+void BusManager::stopClock()
+{
+    if (!clockRunning)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        clockRunning = false;
+    }
+    acksArrived.notify_all();
+    if (clockThread.joinable() && clockThread.get_id() != std::this_thread::get_id())
+        clockThread.join();
+}
+
+// Starts the time-triggered mode, data frames are sent only in the slots of their ID
+ErrorCode BusManager::startSchedule(const TimeTriggeredSchedule &newSchedule)
+{
+    std::vector<std::string> problems = newSchedule.validate();
+    if (!problems.empty()) {
+        for (const std::string &problem : problems)
+            RealSocket::log.logMessage(logger::LogLevel::ERROR, "Invalid schedule: " + problem);
+        return ErrorCode::INVALID_DATA;
+    }
+
+    stopSchedule();
+    schedule.reset(new TimeTriggeredSchedule(newSchedule));
+    scheduleRunning = true;
+    scheduleThread = std::thread(&BusManager::runSchedule, this);
+    return ErrorCode::SUCCESS;
+}
+
+// Stops the time-triggered mode and sends the frames that are still buffered
+void BusManager::stopSchedule()
+{
+    if (!scheduleRunning)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(scheduleMutex);
+        scheduleRunning = false;
+    }
+    frameBuffered.notify_all();
+    if (scheduleThread.joinable() && scheduleThread.get_id() != std::this_thread::get_id())
+        scheduleThread.join();
+
+    std::map<uint32_t, std::deque<ScheduledFrame>> remaining;
+    {
+        std::lock_guard<std::mutex> lock(scheduleMutex);
+        remaining.swap(scheduleBuffers);
+        rejectedMessages.clear();
+    }
+    for (auto &buffer : remaining)
+        for (ScheduledFrame &frame : buffer.second)
+            sendScheduled(frame);
+}
+
+// Runs in a thread - opens the slots of every cycle and sends the frames buffered for them
+void BusManager::runSchedule()
+{
+    std::chrono::nanoseconds frameTime = schedule->frameTime();
+    auto cycleStart = std::chrono::steady_clock::now();
+
+    while (scheduleRunning) {
+        for (const ScheduleSlot &slot : schedule->getSlots()) {
+            auto slotEnd = cycleStart + slot.start + slot.length;
+            auto nextFrame = cycleStart + slot.start;
+            waitUntil(nextFrame);
+
+            // Frames go out back to back, each one takes a frame time of the window
+            while (scheduleRunning && nextFrame + frameTime <= slotEnd) {
+                ScheduledFrame frame;
+                bool taken = false;
+                {
+                    std::unique_lock<std::mutex> lock(scheduleMutex);
+                    // A frame that arrives during the window may still use it
+                    frameBuffered.wait_until(lock, slotEnd - frameTime, [&]() {
+                        return !scheduleRunning || (taken = takeScheduled(slot, frame));
+                    });
+                    if (!taken)
+                        break;
+                }
+                nextFrame = std::max(nextFrame, std::chrono::steady_clock::now());
+                if (nextFrame + frameTime > slotEnd) {
+                    // Too late for this window, the frame goes back to the front of its buffer
+                    std::lock_guard<std::mutex> lock(scheduleMutex);
+                    scheduleBuffers[frame.packet.header.ID].push_front(frame);
+                    break;
+                }
+                sendScheduled(frame);
+                nextFrame += frameTime;
+                waitUntil(nextFrame);
+            }
+            if (!scheduleRunning)
+                return;
+        }
+        cycleStart += schedule->getCycle();
+    }
+}
+
+// Keeps a data frame until a slot of its ID, false if it was dropped - no slot for it or its message did not fit
+bool BusManager::bufferScheduled(const Packet &p, bool fromClient)
+{
+    std::unique_lock<std::mutex> lock(scheduleMutex);
+    // The schedule stopped meanwhile and sent out its buffers already
+    if (!scheduleRunning) {
+        lock.unlock();
+        sendToClients(p);
+        return true;
+    }
+    if (!schedule->hasSlotFor(p.header.ID)) {
+        RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(p.header.SrcID), std::to_string(p.header.DestID), "Dropped packet of message " + std::to_string(p.header.ID) + ", the schedule has no slot for it");
+        return false;
+    }
+
+    // A message is buffered whole or not at all, the receiver can not use a part of it
+    uint64_t message = ((uint64_t)p.header.SrcID << 32) | p.header.MSN;
+    bool last = p.header.PSN + 1 >= p.header.TPS;
+    auto rejected = rejectedMessages.find(message);
+    if (rejected != rejectedMessages.end()) {
+        if (last)
+            rejectedMessages.erase(rejected);
+        return false;
+    }
+    std::deque<ScheduledFrame> &buffer = scheduleBuffers[p.header.ID];
+    if (p.header.PSN == 0 && buffer.size() >= SCHEDULE_BUFFER_LIMIT) {
+        if (!last)
+            rejectedMessages.insert(message);
+        RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(p.header.SrcID), std::to_string(p.header.DestID), "Dropped message " + std::to_string(p.header.MSN) + " of ID " + std::to_string(p.header.ID) + ", its schedule buffer is full");
+        return false;
+    }
+
+    // Held before the slot may send the frame and release it
+    if (fromClient)
+        server.holdCredit();
+    buffer.push_back({p, fromClient});
+    frameBuffered.notify_all();
+    return true;
+}
+
+// Takes the buffered frame with the lowest ID that may use the slot, false if there is none
+bool BusManager::takeScheduled(const ScheduleSlot &slot, ScheduledFrame &frame)
+{
+    for (auto it = scheduleBuffers.begin(); it != scheduleBuffers.end(); ++it) {
+        if (it->second.empty() || !schedule->isAllowed(slot, it->first))
+            continue;
+        frame = it->second.front();
+        it->second.pop_front();
+        if (it->second.empty())
+            scheduleBuffers.erase(it);
+        return true;
+    }
+    return false;
+}
+
+// Sends a frame that waited for its slot and returns the credit of its source
+void BusManager::sendScheduled(const ScheduledFrame &frame)
+{
+    sendToClients(frame.packet);
+    if (frame.creditHeld)
+        server.releaseCredit(frame.packet.header.SrcID);
+}
+
+// Sleeps until the time, spins the last microseconds
+void BusManager::waitUntil(std::chrono::steady_clock::time_point time)
+{
+    {
+        // Stopping the schedule does not wait for the next slot
+        std::unique_lock<std::mutex> lock(scheduleMutex);
+        frameBuffered.wait_until(lock, time - std::chrono::microseconds(SCHEDULE_SPIN_US), [this]() {
+            return !scheduleRunning;
+        });
+    }
+    while (scheduleRunning && std::chrono::steady_clock::now() < time)
+        ;
+}
+
+// Runs in a thread - advances the simulation time and broadcasts the ticks
+void BusManager::runClock()
+{
+    SimulationClock &clock = SimulationClock::getInstance();
+    clock.setMode(clockMode);
+    bool lockstep = clockMode == ClockMode::LOCKSTEP;
+    auto nextWallTick = std::chrono::steady_clock::now();
+
+    while (clockRunning) {
+        size_t clients = server.getConnectedCount();
+        // Nobody to run in lockstep with, the time stands still
+        if (lockstep && clients == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        uint64_t time = clock.now() + clockStep.count();
+        clock.advanceTo(time);
+        ClockTick tick = {time, lockstep};
+        Packet packet(0, 0, 1, 0, 0, &tick, sizeof(tick), true, false, false, true);
+        packet.header.type = FrameType::CLOCK_TICK;
+
+        if (lockstep) {
+            std::unique_lock<std::mutex> lock(clockMutex);
+            tickTime = time;
+            acksPending = clients;
+            server.sendBroadcast(packet);
+            // A client that does not answer (disconnected, stuck) delays the tick but does not stop the simulation
+            acksArrived.wait_for(lock, std::chrono::milliseconds(CLOCK_ACK_TIMEOUT_MS), [this]() {
+                return acksPending == 0 || !clockRunning;
+            });
+            continue;
+        }
+
+        server.sendBroadcast(packet);
+        if (clockSpeed > 0) {
+            nextWallTick += std::chrono::duration_cast<std::chrono::steady_clock::duration>(clockStep / clockSpeed);
+            std::this_thread::sleep_until(nextWallTick);
+        }
+    }
+}
+
+// Counts the acknowledgment of the current lockstep tick
+void BusManager::handleClockAck(Packet &p)
+{
+    ClockTick tick;
+    std::memcpy(&tick, p.data, sizeof(tick));
+
+    std::lock_guard<std::mutex> lock(clockMutex);
+    if (tick.time != tickTime || acksPending == 0)
+        return;
+    if (--acksPending == 0)
+        acksArrived.notify_all();
+}
+
 // Receives the packet that arrived and checks it before sending it out
 void BusManager::receiveData(Packet &p)
 {
-    ErrorCode res = sendToClients(p);
+    if (p.header.type == FrameType::CLOCK_ACK) {
+        handleClockAck(p);
+        return;
+    }
+
+    TRACE_SPAN("forward frame", "main_bus");
+    ChromeTrace::flowStep(p.header.flowID, "main_bus");
+
+    if (refuseBulk(p))
+        return;
+
+    if (valueCacheEnabled) {
+        if (p.header.RTR && answerRemoteRequest(p))
+            return;
+        valueCache.store(p);
+    }
+
+    if (forwardToBridge(p))
+        return;
+
+    deliverLocally(p, true);
 
     // Checking the case of collision and priority in functions : checkCollision,packetPriority
     // Packet* resolvedPacket = checkCollision(*p);
@@ -42,6 +323,157 @@ void BusManager::receiveData(Packet &p)
     //     server.sendToClients(*resolvedPacket);
 }
 
+// Sends the frame to the clients here, in its slot in the time-triggered mode
+void BusManager::deliverLocally(Packet &p, bool fromClient)
+{
+    // In the time-triggered mode data frames wait for their slot, control frames are not scheduled
+    if (scheduleRunning && p.header.type == FrameType::DATA) {
+        bufferScheduled(p, fromClient);
+        return;
+    }
+
+    sendToClients(p);
+}
+
+// Waits in the background for another bus to connect its bridge to the port
+ErrorCode BusManager::listenBridge(int port)
+{
+    stopBridge();
+    bridge.reset(new BusBridge(std::bind(&BusManager::receiveFromBridge, this, std::placeholders::_1)));
+    ErrorCode res = bridge->listen(port);
+    if (res != ErrorCode::SUCCESS)
+        bridge.reset();
+    return res;
+}
+
+// Connects a bridge to another bus
+ErrorCode BusManager::connectBridge(const std::string &host, int port)
+{
+    stopBridge();
+    bridge.reset(new BusBridge(std::bind(&BusManager::receiveFromBridge, this, std::placeholders::_1)));
+    ErrorCode res = bridge->connect(host, port);
+    if (res != ErrorCode::SUCCESS)
+        bridge.reset();
+    return res;
+}
+
+// Returns the bridge to add routes to it, nullptr if there is none
+BusBridge *BusManager::getBridge()
+{
+    return bridge.get();
+}
+
+// Closes the bridge
+void BusManager::stopBridge()
+{
+    if (bridge)
+        bridge->stop();
+    bridge.reset();
+}
+
+// Sends a bulk descriptor back to its source when the destination can not read the region, true if it did
+bool BusManager::refuseBulk(const Packet &p)
+{
+    if (p.header.type != FrameType::DATA || !p.header.isBulk)
+        return false;
+    if (server.canReadBulk(p.header.DestID))
+        return false;
+    // Behind the bridge the region can not be read either, a destination that is nowhere drops the frame
+    if (!server.hasClient(p.header.DestID) && !(bridge && bridge->isConnected() && bridge->isRouted(p.header.DestID)))
+        return false;
+
+    // The source sends the data again as fragments, the ends are swapped to route it back
+    Packet refused = p;
+    refused.header.type = FrameType::BULK_REFUSED;
+    refused.header.SrcID = p.header.DestID;
+    refused.header.DestID = p.header.SrcID;
+    RealSocket::log.logMessage(logger::LogLevel::INFO, std::to_string(p.header.SrcID), std::to_string(p.header.DestID), "Bulk message " + std::to_string(p.header.MSN) + " refused, the destination can not read shared memory");
+    server.sendDestination(refused);
+    return true;
+}
+
+// Passes a frame to the other bus if it is meant for it, true if no client here needs it
+bool BusManager::forwardToBridge(const Packet &p)
+{
+    // Credits belong to one connection and every bus runs its own clock
+    if (!bridge || !bridge->isConnected() || (p.header.type != FrameType::DATA && p.header.type != FrameType::ACK && p.header.type != FrameType::NACK))
+        return false;
+
+    if (p.header.isBroadcast) {
+        bridge->forward(p);
+        return false;
+    }
+
+    if (server.hasClient(p.header.DestID) || !bridge->isRouted(p.header.DestID))
+        return false;
+    bridge->forward(p);
+    return true;
+}
+
+// Sends a frame that arrived from the other bus to the clients here
+void BusManager::receiveFromBridge(Packet &p)
+{
+    if (valueCacheEnabled) {
+        if (p.header.RTR && answerRemoteRequest(p))
+            return;
+        valueCache.store(p);
+    }
+
+    // Never forwarded back, so frames do not loop between the buses
+    deliverLocally(p);
+}
+
+// Keeps the last value of every stream and answers RTR frames from it, disabling forgets the values
+void BusManager::setValueCache(bool enable)
+{
+    valueCacheEnabled = enable;
+    if (!enable)
+        valueCache.clear();
+}
+
+// Sends the cached values to every client that connects, while the cache is enabled
+void BusManager::setReplayOnConnect(bool enable)
+{
+    replayOnConnect = enable;
+}
+
+// Answers an RTR frame with the cached value of its ID, false if there is none
+bool BusManager::answerRemoteRequest(const Packet &p)
+{
+    std::vector<Packet> packets;
+    // The request goes to the source of the value, the answer back to the client that asked
+    if (!valueCache.lookup(p.header.ID, p.header.DestID, p.header.SrcID, packets))
+        return false;
+
+    RealSocket::log.logMessage(logger::LogLevel::INFO, std::to_string(p.header.SrcID), std::to_string(p.header.DestID), "Remote request for message " + std::to_string(p.header.ID) + " answered from the cache");
+    sendCachedValue(packets, p.header.SrcID);
+    return true;
+}
+
+// Sends the cached values that a client that just connected would have received
+void BusManager::replayValues(uint32_t clientID)
+{
+    if (!valueCacheEnabled || !replayOnConnect)
+        return;
+
+    std::vector<std::vector<Packet>> snapshot = valueCache.snapshotFor(clientID);
+    for (std::vector<Packet> &packets : snapshot)
+        sendCachedValue(packets, clientID);
+}
+
+// Sends a copy of a cached message to the client, through the bridge or here
+void BusManager::sendCachedValue(std::vector<Packet> &packets, uint32_t clientID)
+{
+    // The time stamps stay, they tell the age of the value
+    for (Packet &packet : packets) {
+        packet.header.DestID = clientID;
+        packet.header.isBroadcast = false;
+        packet.header.isReliable = false;
+        if (!forwardToBridge(packet))
+            deliverLocally(packet);
+    }
+}
+
 // Sending according to broadcast variable
 ErrorCode BusManager::sendToClients(const Packet &packet)
 {
@@ -65,12 +497,14 @@ Packet BusManager::packetPriority(Packet &a, Packet &b)
 // Static method to handle SIGINT signal
 void BusManager::signalHandler(int signum)
 {
-    if (instance) {
-        instance->server.stopServer();  // Call the stopServer method
-    }
+    if (instance)
+        instance->stopConnection();
     exit(signum);
 }
 
 BusManager::~BusManager() {
+    stopClock();
+    stopSchedule();
+    stopBridge();
     instance = nullptr;
 }
@@ -1,7 +1,9 @@
 #include "../include/client_connection.h"
+#include <netinet/tcp.h>
+#include <algorithm>
 
 // Constructor
-ClientConnection::ClientConnection(std::function<void(Packet &)> callback, ISocket* socketInterface): connected(false){
+ClientConnection::ClientConnection(std::function<void(Packet &)> callback, ISocket* socketInterface): serverIP(IP), serverPort(PORT), connected(false), bulkCapable(true), writing(false), flowControlled(false), credits(0){
         setCallback(callback);
         setSocketInterface(socketInterface);
 }
@@ -15,8 +17,8 @@ ErrorCode ClientConnection::connectToServer(int id)
     }
 
     servAddress.sin_family = AF_INET;
-    servAddress.sin_port = htons(PORT);
-    inet_pton(AF_INET, IP, &servAddress.sin_addr);
+    servAddress.sin_port = htons(serverPort);
+    inet_pton(AF_INET, serverIP.c_str(), &servAddress.sin_addr);
 
     int connectRes = socketInterface->connect(clientSocket, (struct sockaddr *)&servAddress, sizeof(servAddress));
     if (connectRes < 0) {
@@ -24,28 +26,88 @@ ErrorCode ClientConnection::connectToServer(int id)
         return ErrorCode::CONNECTION_FAILED;
     }
 
+    // Frames are small and acknowledgments wait for them, do not let TCP hold them back
+    int noDelay = 1;
+    socketInterface->setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    // The connection request tells the bus if the shared memory of its host is reachable from here
     Packet packet(id);
-    ssize_t bytesSent = socketInterface->send(clientSocket, &packet, sizeof(Packet), 0);
+    packet.header.isBulk = bulkCapable && isLocalConnection();
+    ssize_t bytesSent = socketInterface->sendAll(clientSocket, &packet, sizeof(Packet), 0);
     if (bytesSent < sizeof(Packet)) {
         socketInterface->close(clientSocket);
         return ErrorCode::SEND_FAILED;
     }
     
+    // The thread of an earlier connection ends once its socket is closed, it must not see the new one as its own
+    releaseReceiveThread();
     connected = true;
     receiveThread = std::thread(&ClientConnection::receivePacket, this);
-    receiveThread.detach();
 
     return ErrorCode::SUCCESS;
 }
 
 // Sends the packet to the manager-sync
 ErrorCode ClientConnection::sendPacket(Packet &packet)
+{
+    std::vector<Packet> packets(1, packet);
+    return sendPackets(packets);
+}
+
+// Queues the packets by priority and waits until they are written, the receive thread does not wait
+ErrorCode ClientConnection::sendPackets(std::vector<Packet> &packets)
 {
     //If send executed before start
     if (!connected)
         return ErrorCode::CONNECTION_FAILED;
-        
-    ssize_t bytesSent = socketInterface->send(clientSocket, &packet, sizeof(Packet), 0);
+    if (packets.empty())
+        return ErrorCode::SUCCESS;
+
+    auto batch = std::make_shared<SendBatch>(SendBatch{packets.size(), ErrorCode::SUCCESS});
+    std::unique_lock<std::mutex> lock(sendMutex);
+    for (auto &packet : packets) {
+        // Control frames are not counted by flow control and go before every data frame
+        if (packet.header.type == FrameType::DATA)
+            priorityQueues[packet.header.ID].push_back({packet, batch});
+        else
+            controlQueue.push_back({packet, batch});
+    }
+
+    // The receive thread brings the credits, so it can not wait for them
+    if (isReceiveThread()) {
+        if (!writing)
+            pump(lock);
+        return ErrorCode::SUCCESS;
+    }
+
+    size_t remaining = batch->remaining;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(FLOW_CONTROL_TIMEOUT_MS);
+    while (batch->remaining > 0) {
+        if (!connected) {
+            cancelBatch(batch);
+            return ErrorCode::CONNECTION_FAILED;
+        }
+        if (!writing && hasWritable()) {
+            pump(lock);
+            continue;
+        }
+        if (sendProgress.wait_until(lock, deadline) == std::cv_status::timeout && batch->remaining == remaining) {
+            cancelBatch(batch);
+            return ErrorCode::FLOW_CONTROL_TIMEOUT;
+        }
+        if (batch->remaining < remaining) {
+            remaining = batch->remaining;
+            deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(FLOW_CONTROL_TIMEOUT_MS);
+        }
+    }
+
+    return batch->result;
+}
+
+// Writes the packet to the socket
+ErrorCode ClientConnection::writePacket(Packet &packet)
+{
+    ssize_t bytesSent = socketInterface->sendAll(clientSocket, &packet, sizeof(Packet), 0);
     if (bytesSent==0) {
         closeConnection();
         return ErrorCode::CONNECTION_FAILED;
@@ -57,24 +119,111 @@ ErrorCode ClientConnection::sendPacket(Packet &packet)
     return ErrorCode::SUCCESS;
 }
 
+// Checks if a queued packet can be written now, called with sendMutex locked
+bool ClientConnection::hasWritable()
+{
+    return !controlQueue.empty() || (!priorityQueues.empty() && (!flowControlled || credits > 0));
+}
+
+// Writes the queued packets by priority while credits last, called with sendMutex locked
+void ClientConnection::pump(std::unique_lock<std::mutex> &lock)
+{
+    // One writer at a time, a packet that arrives meanwhile is arbitrated before the next write
+    writing = true;
+    while (connected && hasWritable()) {
+        PendingSend next;
+        if (!controlQueue.empty()) {
+            next = std::move(controlQueue.front());
+            controlQueue.pop_front();
+        }
+        else {
+            auto highest = priorityQueues.begin();
+            next = std::move(highest->second.front());
+            highest->second.pop_front();
+            if (highest->second.empty())
+                priorityQueues.erase(highest);
+            if (flowControlled)
+                credits--;
+        }
+
+        lock.unlock();
+        ErrorCode res = writePacket(next.packet);
+        lock.lock();
+
+        if (res != ErrorCode::SUCCESS)
+            next.batch->result = res;
+        next.batch->remaining--;
+        sendProgress.notify_all();
+    }
+    writing = false;
+    sendProgress.notify_all();
+}
+
+// Drops the packets of a batch that were not written yet, called with sendMutex locked
+void ClientConnection::cancelBatch(const std::shared_ptr<SendBatch> &batch)
+{
+    auto isInBatch = [&batch](const PendingSend &pending) { return pending.batch == batch; };
+    controlQueue.erase(std::remove_if(controlQueue.begin(), controlQueue.end(), isInBatch), controlQueue.end());
+    for (auto it = priorityQueues.begin(); it != priorityQueues.end();) {
+        it->second.erase(std::remove_if(it->second.begin(), it->second.end(), isInBatch), it->second.end());
+        if (it->second.empty())
+            it = priorityQueues.erase(it);
+        else
+            ++it;
+    }
+}
+
+// Adds the credits granted by the bus and sends the queued packets
+void ClientConnection::handleCredit(Packet &packet)
+{
+    uint32_t granted;
+    std::memcpy(&granted, packet.data, sizeof(granted));
+
+    std::unique_lock<std::mutex> lock(sendMutex);
+    flowControlled = true;
+    credits += granted;
+    // A sender that is writing picks the new credits up by itself
+    if (!writing)
+        pump(lock);
+    sendProgress.notify_all();
+}
+
 // Waits for a message and forwards it to Communication
 void ClientConnection::receivePacket()
 {
+    // Set by the thread itself before the callback can send, the thread that started it may not have returned yet
+    receiveThreadId = std::this_thread::get_id();
     while (connected) {
         Packet packet;
-        int valread = socketInterface->recv(clientSocket, &packet, sizeof(Packet), 0);
+        int valread = socketInterface->recvAll(clientSocket, &packet, sizeof(Packet), 0);
         if (valread==0)
             break;
 
         if (valread<0)
             continue;
 
+        if (packet.header.type == FrameType::CREDIT) {
+            handleCredit(packet);
+            continue;
+        }
+
         passPacketCom(packet);
     }
 
     closeConnection();
 }
 
+// Waits for the receive thread of the last connection to return, lets it go when called from it
+void ClientConnection::releaseReceiveThread()
+{
+    if (!receiveThread.joinable())
+        return;
+    if (receiveThread.get_id() == std::this_thread::get_id())
+        receiveThread.detach();
+    else
+        receiveThread.join();
+}
+
 // Closes the connection
 ErrorCode ClientConnection::closeConnection()
 {
@@ -83,10 +232,21 @@ ErrorCode ClientConnection::closeConnection()
         if(socketInterfaceRes < 0)
             return ErrorCode::CLOSE_FAILED;
         connected = false;
+        // Releases the senders that wait for credits
+        std::lock_guard<std::mutex> lock(sendMutex);
+        sendProgress.notify_all();
     }
     return ErrorCode::SUCCESS;  
 }
 
+// Closes the connection and waits until the receive thread passed its last packet
+ErrorCode ClientConnection::stopConnection()
+{
+    ErrorCode res = closeConnection();
+    releaseReceiveThread();
+    return res;
+}
+
 // Setter for passPacketCom
 void ClientConnection::setCallback(std::function<void(Packet&)> callback) {
     if (!callback)
@@ -103,6 +263,44 @@ void ClientConnection::setSocketInterface(ISocket* socketInterface) {
     this->socketInterface = socketInterface;
 }
 
+// Sets the address of the bus to connect to, throws an exception if it is invalid
+void ClientConnection::setServerAddress(const std::string &ip, int port)
+{
+    in_addr address;
+    if (inet_pton(AF_INET, ip.c_str(), &address) != 1)
+        throw std::invalid_argument("Invalid server address: " + ip);
+    if (port <= 0 || port > 65535)
+        throw std::invalid_argument("Invalid port number: Port must be between 1 and 65535.");
+
+    serverIP = ip;
+    serverPort = port;
+}
+
+// Checks if the server runs on this host (shared memory is reachable)
+bool ClientConnection::isLocalConnection()
+{
+    return (ntohl(servAddress.sin_addr.s_addr) >> 24) == 127;
+}
+
+// Sets if the bus may pass bulk descriptors to this client, announced when connecting
+void ClientConnection::setBulkCapable(bool capable)
+{
+    bulkCapable = capable;
+}
+
+// Checks if the caller runs on the thread that receives the packets
+bool ClientConnection::isReceiveThread()
+{
+    return std::this_thread::get_id() == receiveThreadId;
+}
+
+// Returns the credits left, for testing
+uint32_t ClientConnection::getCredits()
+{
+    std::lock_guard<std::mutex> lock(sendMutex);
+    return credits;
+}
+
 // For testing
 int ClientConnection::getClientSocket()
 {
@@ -122,6 +320,7 @@ bool ClientConnection::isReceiveThreadRunning()
 //Destructor
 ClientConnection::~ClientConnection()
 {
-    closeConnection();
+    // The receive thread uses the connection until it returns
+    stopConnection();
     delete socketInterface;
 }
\ No newline at end of file
@@ -1,14 +1,18 @@
 #include "../include/communication.h"
+#include "../../logger/chrome_trace.h"
+#include <algorithm>
 #include <future>
 
 Communication* Communication::instance = nullptr;
 
 // Constructor
-Communication::Communication(uint32_t id, void (*passDataCallback)(uint32_t, void *)) : 
-    client(std::bind(&Communication::receivePacket, this, std::placeholders::_1))
+Communication::Communication(uint32_t id, void (*passDataCallback)(uint32_t, void *), ISocket* socketInterface) : 
+    client(std::bind(&Communication::receivePacket, this, std::placeholders::_1), socketInterface), bulkThreshold(BULK_THRESHOLD), compressionThreshold(COMPRESSION_THRESHOLD), bulkSeq(0), canFD(false), nextMSN(0),
+    deltaFullEvery(DELTA_FULL_EVERY), deltaHeartbeatEvery(DELTA_HEARTBEAT_EVERY), nextCyclicHandle(1), cyclicRunning(false)
 {
     setId(id);
     setPassDataCallback(passDataCallback);
+    ChromeTrace::startFromEnvironment("process_" + std::to_string(id));
 
     instance = this;
 
@@ -28,8 +32,38 @@ ErrorCode Communication::startConnection()
     return isConnected;
 }
 
-// Sends a message sync
-ErrorCode Communication::sendMessage(void *data, size_t dataSize, uint32_t destID, uint32_t srcID, bool isBroadcast)
+// Sends a message sync, its frames are arbitrated by messageID
+ErrorCode Communication::sendMessage(void *data, size_t dataSize, uint32_t destID, uint32_t srcID, bool isBroadcast, bool isReliable, uint32_t messageID)
+{
+    return sendData(data, dataSize, destID, srcID, isBroadcast, isReliable, false, false, messageID);
+}
+
+// Sends periodic data only when it changed - as the changed byte ranges, with a full frame every few cycles
+ErrorCode Communication::sendMessageOnChange(void *data, size_t dataSize, uint32_t destID, uint32_t srcID, bool isBroadcast, bool isReliable)
+{
+    if (dataSize == 0)
+        return ErrorCode::INVALID_DATA_SIZE;
+
+    if (data == nullptr)
+        return ErrorCode::INVALID_DATA;
+
+    // Held while sending, so the payloads of a stream leave in the order they were encoded
+    std::lock_guard<std::mutex> lock(deltaMutex);
+    DeltaEncoder &encoder = deltaEncoders[((uint64_t)srcID << 32) | destID];
+    std::vector<uint8_t> payload;
+    if (!encoder.encode(data, dataSize, deltaFullEvery, deltaHeartbeatEvery, payload))
+        return ErrorCode::SUCCESS;
+
+    ErrorCode res = sendData(payload.data(), payload.size(), destID, srcID, isBroadcast, isReliable, true, false);
+    // The receiver may not have the payload, the next one has to stand alone
+    if (res != ErrorCode::SUCCESS)
+        encoder.reset();
+    return res;
+}
+
+// Sends the data as one message, isDelta marks a payload of an only-on-change stream, isRpc one of an RPC channel,
+// messageID is the CAN ID its frames are arbitrated by
+ErrorCode Communication::sendData(void *data, size_t dataSize, uint32_t destID, uint32_t srcID, bool isBroadcast, bool isReliable, bool isDelta, bool isRpc, uint32_t messageID)
 {
     if (dataSize == 0)
         return ErrorCode::INVALID_DATA_SIZE;
@@ -40,18 +74,260 @@ ErrorCode Communication::sendMessage(void *data, size_t dataSize, uint32_t destI
     if (!client.isConnected())
         return ErrorCode::CONNECTION_FAILED;
 
-    Message msg(srcID, data, dataSize, isBroadcast, destID);
+    // A message sent while another is delivered continues its flow, the reaction joins the timeline of its cause
+    TRACE_SPAN("send message", "communication");
+    uint32_t flow = ChromeTrace::currentFlow();
+    if (ChromeTrace::isEnabled()) {
+        if (flow)
+            ChromeTrace::flowStep(flow, "communication");
+        else
+            ChromeTrace::flowStart(flow = ChromeTrace::newFlow(), "communication");
+    }
+    ChromeTrace::FlowScope flowScope(flow);
+
+    // Large data skips the fragmentation, falls back to it if shared memory fails.
+    // A reliable message keeps its fragments, their ACKs and retransmissions are the delivery guarantee.
+    bool reliable = isReliable && !isBroadcast && !client.isReceiveThread();
+    if (!reliable && shouldUseBulk(dataSize, destID, isBroadcast)) {
+        ErrorCode res = sendBulk(data, dataSize, destID, srcID, isDelta, isRpc, messageID);
+        if (res != ErrorCode::INVALID_DATA)
+            return res;
+    }
+
+    if (dataSize > MAX_MESSAGE_SIZE)
+        return ErrorCode::INVALID_DATA_SIZE;
+
+    Message msg(srcID, data, dataSize, isBroadcast, destID, canFD ? SIZE_PACKET_FD : SIZE_PACKET, nextMSN++, compressionThreshold, messageID);
+    for (auto &packet : msg.getPackets()) {
+        packet.header.isDelta = isDelta;
+        packet.header.isRpc = isRpc;
+        packet.header.flowID = flow;
+    }
     
     //Sending the message to logger
     RealSocket::log.logMessage(logger::LogLevel::INFO,std::to_string(srcID),std::to_string(destID),"Complete message:" + msg.getPackets().at(0).pointerToHex(data, dataSize));
+
+    // A broadcast has no single receiver to acknowledge it, and the receive thread can not wait for ACKs
+    if (reliable) {
+        for (auto &packet : msg.getPackets())
+            packet.header.isReliable = true;
+        return sendReliable(msg);
+    }
     
-    for (auto &packet : msg.getPackets()) {
-        ErrorCode res = client.sendPacket(packet);
-        if (res != ErrorCode::SUCCESS)
-            return res;
+    // Queued as a whole, so the fragments interleave with other messages by CAN ID
+    return client.sendPackets(msg.getPackets());
+}
+
+// Checks if the message should go through the bulk channel
+bool Communication::shouldUseBulk(size_t dataSize, uint32_t destID, bool isBroadcast)
+{
+    // A broadcast region would have no single owner to remove it
+    if (!bulkThreshold || dataSize < bulkThreshold || isBroadcast || dataSize > UINT32_MAX || !client.isLocalConnection())
+        return false;
+
+    // The bus refused a bulk message to the destination before
+    std::lock_guard<std::mutex> lock(bulkMutex);
+    return fragmentedDestinations.count(destID) == 0;
+}
+
+// Sends the data through shared memory with a single descriptor frame
+ErrorCode Communication::sendBulk(void *data, size_t dataSize, uint32_t destID, uint32_t srcID, bool isDelta, bool isRpc, uint32_t messageID)
+{
+    BulkDescriptor descriptor = {bulkSeq++, (uint32_t)dataSize};
+    {
+        // The regions that wait are live data of slow receivers, the message goes as fragments instead
+        std::lock_guard<std::mutex> lock(bulkMutex);
+        if (publishedBulks.size() >= MAX_PENDING_BULKS)
+            return ErrorCode::INVALID_DATA;
+        publishedBulks.emplace_back(srcID, descriptor.seq);
+    }
+    if (!BulkChannel::publish(srcID, descriptor.seq, data, dataSize)) {
+        std::lock_guard<std::mutex> lock(bulkMutex);
+        publishedBulks.erase(std::find(publishedBulks.begin(), publishedBulks.end(), std::make_pair(srcID, descriptor.seq)));
+        return ErrorCode::INVALID_DATA;
+    }
+
+    Packet packet(messageID == DEFAULT_MESSAGE_ID ? srcID + destID : messageID, 0, 1, srcID, destID, &descriptor, sizeof(descriptor), false);
+    packet.header.isBulk = true;
+    packet.header.isDelta = isDelta;
+    packet.header.isRpc = isRpc;
+    packet.header.flowID = ChromeTrace::currentFlow();
+    packet.header.MSN = nextMSN++;
+
+    RealSocket::log.logMessage(logger::LogLevel::INFO, std::to_string(srcID), std::to_string(destID), "Bulk message of " + std::to_string(dataSize) + " bytes in region " + BulkChannel::regionName(srcID, descriptor.seq));
+
+    return client.sendPacket(packet);
+}
+
+// Sets the cycles between full frames and the unchanged cycles between heartbeats (0 for none) of sendMessageOnChange
+void Communication::setDeltaIntervals(uint32_t fullEvery, uint32_t heartbeatEvery)
+{
+    if (fullEvery == 0)
+        throw std::invalid_argument("Cycles between full frames must be positive");
+
+    std::lock_guard<std::mutex> lock(deltaMutex);
+    deltaFullEvery = fullEvery;
+    deltaHeartbeatEvery = heartbeatEvery;
+}
+
+// Asks for the last value of the message ID with an RTR frame, the bus answers from its cache or passes it to destID
+ErrorCode Communication::requestValue(uint32_t messageID, uint32_t destID, uint32_t srcID)
+{
+    if (!client.isConnected())
+        return ErrorCode::CONNECTION_FAILED;
+
+    uint8_t none = 0;
+    Packet packet(messageID, 0, 1, srcID, destID, &none, 0, false, true);
+    packet.header.MSN = nextMSN++;
+    return client.sendPacket(packet);
+}
+
+// Registers a message sent every period, at the offset within the period on the simulation time
+uint32_t Communication::addCyclicMessage(std::function<bool(std::vector<uint8_t> &)> provider, std::chrono::microseconds period,
+                                         std::chrono::microseconds offset, uint32_t destID, uint32_t srcID, bool isBroadcast)
+{
+    if (!provider)
+        throw std::invalid_argument("Cyclic message provider cannot be null");
+    if (period.count() < CYCLIC_TICK_US || offset.count() < 0 || offset >= period)
+        throw std::invalid_argument("Cyclic period must be at least one tick and the offset within it");
+
+    uint64_t periodTicks = period.count() / CYCLIC_TICK_US;
+    uint64_t offsetTicks = offset.count() / CYCLIC_TICK_US;
+
+    std::lock_guard<std::mutex> lock(cyclicMutex);
+    if (!cyclicRunning) {
+        cyclicWheel = TimerWheel(SimulationClock::getInstance().now() / (CYCLIC_TICK_US * 1000));
+        cyclicRunning = true;
+        cyclicThread = std::thread(&Communication::runCyclic, this);
+    }
+
+    // The first tick at the offset that is not processed yet, so messages of the same period keep their phases
+    uint64_t current = cyclicWheel.getCurrent();
+    uint64_t first = current - current % periodTicks + offsetTicks;
+    if (first < current)
+        first += periodTicks;
+
+    uint32_t handle = nextCyclicHandle++;
+    cyclicMessages[handle] = {provider, periodTicks, destID, srcID, isBroadcast};
+    cyclicWheel.schedule(handle, first);
+    cyclicChanged.notify_all();
+    return handle;
+}
+
+// Stops sending a cyclic message
+void Communication::removeCyclicMessage(uint32_t handle)
+{
+    // Its timer is dropped when it fires
+    std::lock_guard<std::mutex> lock(cyclicMutex);
+    cyclicMessages.erase(handle);
+}
+
+// Runs in a thread - sends the cyclic messages that are due, the messages of a tick in one batch
+void Communication::runCyclic()
+{
+    SimulationClock &clock = SimulationClock::getInstance();
+    const uint64_t tickNs = CYCLIC_TICK_US * 1000;
+    std::vector<WheelTimer> expired;
+    std::vector<std::pair<uint32_t, CyclicMessage>> due;
+    std::vector<uint8_t> data;
+    std::vector<Packet> batch;
+
+    std::unique_lock<std::mutex> lock(cyclicMutex);
+    while (cyclicRunning) {
+        uint64_t now = clock.now();
+        uint64_t nowTick = now / tickNs;
+        if (cyclicWheel.getCurrent() > nowTick) {
+            uint64_t next = cyclicWheel.nextTick();
+            if (next == UINT64_MAX) {
+                cyclicChanged.wait(lock);
+                continue;
+            }
+            uint64_t sleepNs = std::max(next, nowTick + 1) * tickNs - now;
+            if (clock.getMode() == ClockMode::REAL_TIME)
+                cyclicChanged.wait_for(lock, std::chrono::nanoseconds(sleepNs));
+            else {
+                // Virtual time only moves with the bus, a message added meanwhile waits at most a tick
+                lock.unlock();
+                clock.sleepFor(std::chrono::nanoseconds(std::min(sleepNs, tickNs)));
+                lock.lock();
+            }
+            continue;
+        }
+
+        // Every tick up to now, a late thread catches up in one batch
+        expired.clear();
+        cyclicWheel.advance(nowTick + 1, expired);
+        due.clear();
+        for (const WheelTimer &timer : expired) {
+            auto it = cyclicMessages.find(timer.id);
+            if (it == cyclicMessages.end())
+                continue;
+            due.emplace_back(timer.id, it->second);
+            // Periods are kept on the original phase, a missed cycle is not sent twice
+            uint64_t next = timer.expiry + it->second.period;
+            if (next <= nowTick)
+                next += (nowTick - next) / it->second.period * it->second.period + it->second.period;
+            cyclicWheel.schedule(timer.id, next);
+        }
+        if (due.empty())
+            continue;
+
+        // The providers may add or remove cyclic messages
+        lock.unlock();
+        batch.clear();
+        for (auto &message : due) {
+            data.clear();
+            if (!message.second.provider(data) || data.empty() || data.size() > MAX_MESSAGE_SIZE)
+                continue;
+            Message msg(message.second.srcID, data.data(), data.size(), message.second.isBroadcast, message.second.destID,
+                        canFD ? SIZE_PACKET_FD : SIZE_PACKET, nextMSN++, compressionThreshold);
+            batch.insert(batch.end(), msg.getPackets().begin(), msg.getPackets().end());
+        }
+        if (!batch.empty() && client.isConnected()) {
+            ErrorCode res = client.sendPackets(batch);
+            if (res != ErrorCode::SUCCESS)
+                RealSocket::log.logMessage(logger::LogLevel::ERROR, "Cyclic messages of " + std::to_string(id) + " were not sent: " + toString(res));
+        }
+        lock.lock();
     }
+}
+
+// Sends a message that the destination passes to its RPC handler instead of passData
+ErrorCode Communication::sendRpcMessage(void *data, size_t dataSize, uint32_t destID, uint32_t srcID)
+{
+    return sendData(data, dataSize, destID, srcID, false, false, false, true);
+}
+
+// Sets the receiver of RPC messages - source, data (freed by the receiver) and size, nullptr drops them
+void Communication::setRpcHandler(std::function<void(uint32_t, void *, size_t)> handler)
+{
+    std::lock_guard<std::mutex> lock(rpcMutex);
+    rpcHandler = handler;
+}
+
+// Sets the minimal size of data that is sent through the bulk channel, 0 disables it
+void Communication::setBulkThreshold(size_t threshold)
+{
+    bulkThreshold = threshold;
+    client.setBulkCapable(threshold != 0);
+}
+
+// Sets the minimal size of data that is compressed before it is split into frames, 0 disables it
+void Communication::setCompressionThreshold(size_t threshold)
+{
+    compressionThreshold = threshold;
+}
+
+// Sets the frame payload size of this connection, 64 bytes (CAN-FD) or 8 bytes (classic)
+void Communication::setCanFD(bool enable)
+{
+    canFD = enable;
+}
 
-    return ErrorCode::SUCCESS;  
+// Sets the address of the bus, before startConnection
+void Communication::setServerAddress(const std::string &ip, int port)
+{
+    client.setServerAddress(ip, port);
 }
 
 // Sends a message Async
@@ -72,11 +348,25 @@ void Communication::sendMessageAsync(void *data, size_t dataSize, uint32_t destI
 // Accepts the packet from the client and checks..
 void Communication::receivePacket(Packet &p)
 {
+    if (p.header.type == FrameType::CLOCK_TICK) {
+        handleClockTick(p);
+        return;
+    }
+
     if (checkDestId(p)) {
-        if (validCRC(p))
-            handlePacket(p);
+        // A request that the bus could not answer from its cache, the application sends its values on its own
+        if (p.header.RTR)
+            return;
+        if (!validCRC(p))
+            handleError(p);
+        else if (p.header.type == FrameType::ACK || p.header.type == FrameType::NACK)
+            handleAck(p);
+        else if (p.header.type == FrameType::BULK_REFUSED)
+            handleBulkRefused(p);
+        else if (p.header.type == FrameType::BULK_CONSUMED)
+            handleBulkConsumed(p);
         else
-            handleError();
+            handlePacket(p);
     }
 }
 
@@ -89,53 +379,301 @@ bool Communication::checkDestId(Packet &p)
 // Checks if the data is currect
 bool Communication::validCRC(Packet &p)
 {
-    return p.header.CRC == p.calculateCRC(p.data, p.header.DLC);
+    return p.header.CRC == p.calculateCRC(p.data, p.getDataLength());
 }
 
 // Receives the packet and adds it to the message
 void Communication::handlePacket(Packet &p)
 {
-    // Send acknowledgment according to CAN bus
-    // client.sendPacket(hadArrived());
-    addPacketToMessage(p);
+    // Reliable messages are acknowledged according to CAN bus in addPacketToMessage
+    if (p.header.isBulk)
+        handleBulk(p);
+    else
+        addPacketToMessage(p);
+}
+
+// Reads the data that the descriptor points to and passes it on
+void Communication::handleBulk(Packet &p)
+{
+    BulkDescriptor descriptor;
+    std::memcpy(&descriptor, p.data, sizeof(descriptor));
+    void *completeData = BulkChannel::consume(p.header.SrcID, descriptor);
+
+    // The region is gone either way, the sender stops counting it as waiting
+    Packet consumed(p.header.ID, 0, 1, id, p.header.SrcID, &descriptor, sizeof(descriptor), false);
+    consumed.header.MSN = p.header.MSN;
+    consumed.header.type = FrameType::BULK_CONSUMED;
+    client.sendPacket(consumed);
+
+    if (completeData == nullptr) {
+        RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(p.header.SrcID), std::to_string(id), "Bulk region " + BulkChannel::regionName(p.header.SrcID, descriptor.seq) + " is not available");
+        return;
+    }
+
+    deliverData(p, completeData, descriptor.size);
+}
+
+// Forgets a bulk region its receiver read
+void Communication::handleBulkConsumed(Packet &p)
+{
+    BulkDescriptor descriptor;
+    std::memcpy(&descriptor, p.data, sizeof(descriptor));
+    std::lock_guard<std::mutex> lock(bulkMutex);
+    auto it = std::find(publishedBulks.begin(), publishedBulks.end(), std::make_pair(p.header.DestID, descriptor.seq));
+    if (it != publishedBulks.end())
+        publishedBulks.erase(it);
+}
+
+// Sends the data of a refused bulk message again as fragments, later messages to its destination skip the bulk channel
+void Communication::handleBulkRefused(Packet &p)
+{
+    // The bus swapped the ends to route the descriptor back
+    uint32_t srcID = p.header.DestID;
+    uint32_t destID = p.header.SrcID;
+    BulkDescriptor descriptor;
+    std::memcpy(&descriptor, p.data, sizeof(descriptor));
+    {
+        std::lock_guard<std::mutex> lock(bulkMutex);
+        fragmentedDestinations.insert(destID);
+        auto it = std::find(publishedBulks.begin(), publishedBulks.end(), std::make_pair(srcID, descriptor.seq));
+        // Handled already
+        if (it == publishedBulks.end())
+            return;
+        publishedBulks.erase(it);
+    }
+
+    void *data = BulkChannel::consume(srcID, descriptor);
+    if (data == nullptr) {
+        RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(srcID), std::to_string(destID), "Refused bulk region " + BulkChannel::regionName(srcID, descriptor.seq) + " is not available");
+        return;
+    }
+
+    RealSocket::log.logMessage(logger::LogLevel::INFO, std::to_string(srcID), std::to_string(destID), "Bulk message refused by the bus, sending it as fragments");
+    ChromeTrace::FlowScope flowScope(p.header.flowID);
+    ErrorCode res = sendData(data, descriptor.size, destID, srcID, false, false, p.header.isDelta, p.header.isRpc, p.header.ID);
+    if (res != ErrorCode::SUCCESS)
+        RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(srcID), std::to_string(destID), "Refused bulk message was not sent again: " + std::string(toString(res)));
+    free(data);
 }
 
-// Implement error handling according to CAN bus
-void Communication::handleError()
+// Advances the local simulation clock, acknowledges lockstep ticks
+void Communication::handleClockTick(Packet &p)
 {
-    // Handle error cases according to CAN bus
+    ClockTick tick;
+    std::memcpy(&tick, p.data, sizeof(tick));
+
+    SimulationClock &clock = SimulationClock::getInstance();
+    ClockMode mode = tick.lockstep ? ClockMode::LOCKSTEP : ClockMode::VIRTUAL;
+    if (clock.getMode() != mode)
+        clock.setMode(mode);
+    clock.advanceTo(tick.time);
+
+    if (!tick.lockstep)
+        return;
+
+    // The threads woken by this tick run their step before the bus moves on
+    clock.waitIdle(std::chrono::milliseconds(CLOCK_ACK_TIMEOUT_MS));
+    Packet ack(0, 0, 1, id, 0, &tick, sizeof(tick), false, false, false, true);
+    ack.header.type = FrameType::CLOCK_ACK;
+    client.sendPacket(ack);
+}
+
+// Implement error handling according to CAN bus - a corrupt reliable packet is requested again
+void Communication::handleError(Packet &p)
+{
+    RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(p.header.SrcID), std::to_string(id), "CRC error in packet number: " + std::to_string(p.header.PSN) + ", of messageId: " + std::to_string(p.header.ID));
+
+    if (p.header.type != FrameType::DATA || !p.header.isReliable || p.header.isBulk)
+        return;
+
+    uint64_t messageId = ((uint64_t)p.header.SrcID << 32) | p.header.MSN;
+    auto it = receivedMessages.find(messageId);
+    if (it == receivedMessages.end()) {
+        sendAck(p, 0, 0, true);
+        return;
+    }
+    sendAck(p, it->second.firstMissing(), it->second.receivedBitmap(), true);
 }
 
 // Implement arrival confirmation according to the CAN bus
-Packet Communication::hadArrived()
+Packet Communication::hadArrived(const Packet &p, uint32_t cumulative, uint32_t bitmap, bool isNack)
 {
-    Packet ack;
-    // Construct and return acknowledgment packet
+    uint32_t info[2] = {cumulative, bitmap};
+    Packet ack(p.header.ID, 0, 1, id, p.header.SrcID, info, sizeof(info), false);
+    ack.header.MSN = p.header.MSN;
+    ack.header.type = isNack ? FrameType::NACK : FrameType::ACK;
     return ack;
 }
 
+// Builds the acknowledgment of the packet's message and sends it back to its source
+void Communication::sendAck(const Packet &p, uint32_t cumulative, uint32_t bitmap, bool isNack)
+{
+    Packet ack = hadArrived(p, cumulative, bitmap, isNack);
+    client.sendPacket(ack);
+}
+
+// Sends the packets of a reliable message and waits until all of them are acknowledged
+ErrorCode Communication::sendReliable(Message &msg)
+{
+    std::vector<Packet> &packets = msg.getPackets();
+    uint32_t msn = packets.front().header.MSN;
+    SlidingWindow window(packets.size());
+    ErrorCode res = ErrorCode::SUCCESS;
+    int retries = 0;
+
+    std::unique_lock<std::mutex> lock(reliableMutex);
+    outgoingWindows[msn] = &window;
+    while (!window.isComplete()) {
+        // Requested retransmissions go first, then new packets as far as the window allows
+        std::vector<uint32_t> toSend = window.takeRetransmits();
+        for (uint32_t psn : toSend)
+            window.markSent(psn);
+        while (window.canSend())
+            toSend.push_back(window.takeNext());
+
+        std::vector<Packet> batch;
+        for (uint32_t psn : toSend)
+            batch.push_back(packets[psn]);
+
+        lock.unlock();
+        res = client.sendPackets(batch);
+        lock.lock();
+        if (res != ErrorCode::SUCCESS || window.isComplete())
+            break;
+
+        std::chrono::nanoseconds timeout = rttEstimator.getTimeout(retries);
+        window.setTimeout(timeout);
+        if (ackArrived.wait_for(lock, timeout, [&window]() { return window.takeNews(); })) {
+            std::chrono::nanoseconds rtt;
+            if (window.takeRttSample(rtt))
+                rttEstimator.addSample(rtt);
+            retries = 0;
+            continue;
+        }
+        if (++retries > RELIABLE_MAX_RETRIES) {
+            res = ErrorCode::DELIVERY_FAILED;
+            break;
+        }
+        window.timeout();
+    }
+    outgoingWindows.erase(msn);
+    return res;
+}
+
+// Applies an ACK / NACK to the window of the message it belongs to
+void Communication::handleAck(Packet &p)
+{
+    uint32_t info[2];
+    std::memcpy(info, p.data, sizeof(info));
+
+    std::lock_guard<std::mutex> lock(reliableMutex);
+    auto it = outgoingWindows.find(p.header.MSN);
+    if (it == outgoingWindows.end())
+        return;
+    it->second->acknowledge(info[0], info[1], p.header.type == FrameType::NACK);
+    ackArrived.notify_all();
+}
+
+// Remembers a completed reliable message for late retransmissions
+void Communication::rememberCompleted(uint64_t messageId)
+{
+    completedMessages.insert(messageId);
+    completedOrder.push_back(messageId);
+    if (completedOrder.size() > RELIABLE_HISTORY_SIZE) {
+        completedMessages.erase(completedOrder.front());
+        completedOrder.pop_front();
+    }
+}
+
 // Adding the packet to the complete message
 void Communication::addPacketToMessage(Packet &p)
 {
-    std::string messageId = std::to_string(p.header.ID);
-    // If the message already exists, we will add the packet
-    if (receivedMessages.find(messageId) != receivedMessages.end()) {
-        receivedMessages[messageId].addPacket(p);
-    } else {
-        // If the message does not exist, we will create a new message
-        Message msg(p.header.TPS);
-        msg.addPacket(p);
-        receivedMessages[messageId] = msg;
+    // The sequence number tells apart messages of the same source
+    uint64_t messageId = ((uint64_t)p.header.SrcID << 32) | p.header.MSN;
+
+    // The sender did not get the final acknowledgment
+    if (p.header.isReliable && completedMessages.count(messageId)) {
+        sendAck(p, p.header.TPS, 0, false);
+        return;
+    }
+
+    auto it = receivedMessages.find(messageId);
+    // If the message does not exist, we will create a new message
+    if (it == receivedMessages.end()) {
+        if (!Message::isValidTps(p)) {
+            RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(p.header.SrcID), std::to_string(id), "Message " + std::to_string(p.header.MSN) + " of " + std::to_string(p.header.TPS) + " packets is larger than a message can be");
+            return;
+        }
+        it = receivedMessages.emplace(messageId, Message(p.header.TPS)).first;
+    }
+    Message &msg = it->second;
+
+    uint32_t expected = msg.firstMissing();
+    bool added = msg.addPacket(p);
+    bool complete = msg.isComplete();
+
+    if (p.header.isReliable) {
+        uint32_t missing = msg.firstMissing();
+        bool holes = msg.getPackets().size() > missing;
+        bool filledHole = added && p.header.PSN == expected && missing > expected + 1;
+        // A packet after a gap means the packets in between were lost
+        if (holes && (p.header.PSN > expected || filledHole))
+            sendAck(p, missing, msg.receivedBitmap(), true);
+        else if (complete || filledHole || !added || msg.getPackets().size() % RELIABLE_ACK_EVERY == 0)
+            sendAck(p, missing, msg.receivedBitmap(), false);
     }
 
     // If the message is complete, we pass the data to the passData function
-    if (receivedMessages[messageId].isComplete()) {
-        void *completeData = receivedMessages[messageId].completeData();
-        passData(p.header.SrcID, completeData);
-        receivedMessages.erase(messageId); // Removing the message once completed
+    if (complete) {
+        void *completeData = msg.completeData();
+        size_t completeSize = msg.completeDataSize();
+        if (p.header.isReliable)
+            rememberCompleted(messageId);
+        receivedMessages.erase(it); // Removing the message once completed
+        if (completeData == nullptr) {
+            RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(p.header.SrcID), std::to_string(id), "Compressed message " + std::to_string(p.header.MSN) + " is malformed");
+            return;
+        }
+        deliverData(p, completeData, completeSize);
     }
 }
 
+// Passes the data of a complete message on, rebuilds the data of an only-on-change stream first
+void Communication::deliverData(const Packet &p, void *data, size_t dataSize)
+{
+    // The handler runs in the span, messages it sends continue the flow
+    TRACE_SPAN("deliver message", "communication");
+    ChromeTrace::flowStep(p.header.flowID, "communication");
+    ChromeTrace::FlowScope flowScope(p.header.flowID);
+
+    if (p.header.isRpc) {
+        // Held during the call, so the handler is not removed while it runs
+        std::lock_guard<std::mutex> lock(rpcMutex);
+        if (rpcHandler)
+            rpcHandler(p.header.SrcID, data, dataSize);
+        else
+            free(data);
+        return;
+    }
+
+    if (!p.header.isDelta) {
+        passData(p.header.SrcID, data);
+        return;
+    }
+
+    void *fullData;
+    DeltaDecoder &decoder = deltaDecoders[((uint64_t)p.header.SrcID << 32) | p.header.DestID];
+    DeltaResult result = decoder.decode(data, dataSize, fullData);
+    free(data);
+
+    if (result == DeltaResult::DATA)
+        passData(p.header.SrcID, fullData);
+    else if (result == DeltaResult::MISSING_BASE)
+        RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(p.header.SrcID), std::to_string(id), "Only-on-change message " + std::to_string(p.header.MSN) + " has no base, waiting for a full frame");
+    else if (result == DeltaResult::MALFORMED)
+        RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(p.header.SrcID), std::to_string(id), "Only-on-change message " + std::to_string(p.header.MSN) + " is malformed");
+}
+
 // Static method to handle SIGINT signal
 void Communication::signalHandler(int signum)
 {
@@ -160,5 +698,20 @@ void Communication::setPassDataCallback(void (*callback)(uint32_t, void *))
 
 //Destructor
 Communication::~Communication() {
+    {
+        std::lock_guard<std::mutex> lock(cyclicMutex);
+        cyclicRunning = false;
+        cyclicChanged.notify_all();
+    }
+    if (cyclicThread.joinable())
+        cyclicThread.join();
+
+    // No packet may reach the members while they are destroyed
+    client.stopConnection();
+
+    // Regions that the receivers did not take
+    std::lock_guard<std::mutex> lock(bulkMutex);
+    for (auto &bulk : publishedBulks)
+        BulkChannel::discard(bulk.first, bulk.second);
     instance = nullptr;
 }
\ No newline at end of file
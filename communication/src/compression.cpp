@@ -0,0 +1,135 @@
+#include "../include/compression.h"
+#include <algorithm>
+#include <cstring>
+
+// Bytes at the end of the input that are always literals, and the last position a match may start at
+#define COMPRESSION_LAST_LITERALS 5
+#define COMPRESSION_MATCH_LIMIT 12
+#define COMPRESSION_MIN_MATCH 4
+#define COMPRESSION_MAX_OFFSET 65535
+
+// Reads 4 bytes in host order
+static uint32_t read32(const uint8_t *position)
+{
+    uint32_t value;
+    std::memcpy(&value, position, sizeof(value));
+    return value;
+}
+
+// Hashes 4 bytes into the match table
+static uint32_t hash32(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - COMPRESSION_HASH_BITS);
+}
+
+// Appends a length that did not fit in its 4 bits of the token
+static void putLength(std::vector<uint8_t> &out, size_t length)
+{
+    for (; length >= 255; length -= 255)
+        out.push_back(255);
+    out.push_back((uint8_t)length);
+}
+
+// Appends a sequence - literals followed by a match, matchLength 0 for the literals at the end
+static void putSequence(std::vector<uint8_t> &out, const uint8_t *literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+    size_t matchCode = matchLength ? matchLength - COMPRESSION_MIN_MATCH : 0;
+    out.push_back((uint8_t)((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15)));
+    if (literalLength >= 15)
+        putLength(out, literalLength - 15);
+    out.insert(out.end(), literals, literals + literalLength);
+    if (!matchLength)
+        return;
+    out.push_back((uint8_t)offset);
+    out.push_back((uint8_t)(offset >> 8));
+    if (matchCode >= 15)
+        putLength(out, matchCode - 15);
+}
+
+// Appends the compressed data to out
+void Compression::compress(const void *data, size_t size, std::vector<uint8_t> &out)
+{
+    const uint8_t *input = static_cast<const uint8_t *>(data);
+    // Positions plus one, 0 is an empty entry
+    std::vector<uint32_t> table(1 << COMPRESSION_HASH_BITS, 0);
+    size_t anchor = 0;
+    size_t position = 0;
+
+    if (size > COMPRESSION_MATCH_LIMIT) {
+        size_t matchLimit = size - COMPRESSION_MATCH_LIMIT;
+        size_t matchEnd = size - COMPRESSION_LAST_LITERALS;
+        while (position < matchLimit) {
+            uint32_t sequence = read32(input + position);
+            uint32_t &entry = table[hash32(sequence)];
+            size_t candidate = entry;
+            entry = position + 1;
+            if (!candidate || position + 1 - candidate > COMPRESSION_MAX_OFFSET || read32(input + candidate - 1) != sequence) {
+                position++;
+                continue;
+            }
+
+            size_t match = candidate - 1;
+            size_t length = COMPRESSION_MIN_MATCH;
+            while (position + length < matchEnd && input[match + length] == input[position + length])
+                length++;
+            putSequence(out, input + anchor, position - anchor, position - match, length);
+            position += length;
+            anchor = position;
+        }
+    }
+    putSequence(out, input + anchor, size - anchor, 0, 0);
+}
+
+// Decompresses exactly outSize bytes into out, false if the data is malformed
+bool Compression::decompress(const uint8_t *data, size_t size, uint8_t *out, size_t outSize)
+{
+    const uint8_t *end = data + size;
+    size_t written = 0;
+    while (data < end) {
+        uint8_t token = *data++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15) {
+            uint8_t byte;
+            do {
+                if (data == end)
+                    return false;
+                byte = *data++;
+                literalLength += byte;
+            } while (byte == 255);
+        }
+        if (literalLength > (size_t)(end - data) || literalLength > outSize - written)
+            return false;
+        std::memcpy(out + written, data, literalLength);
+        data += literalLength;
+        written += literalLength;
+
+        // The last sequence has no match
+        if (data == end)
+            break;
+
+        if (end - data < 2)
+            return false;
+        size_t offset = data[0] | (data[1] << 8);
+        data += 2;
+        if (offset == 0 || offset > written)
+            return false;
+
+        size_t matchLength = (token & 0x0F) + COMPRESSION_MIN_MATCH;
+        if ((token & 0x0F) == 15) {
+            uint8_t byte;
+            do {
+                if (data == end)
+                    return false;
+                byte = *data++;
+                matchLength += byte;
+            } while (byte == 255);
+        }
+        if (matchLength > outSize - written)
+            return false;
+        // The match may overlap the bytes it produces
+        for (size_t i = 0; i < matchLength; ++i, ++written)
+            out[written] = out[written - offset];
+    }
+    return written == outSize;
+}
@@ -0,0 +1,154 @@
+#include "../include/delta_encoder.h"
+#include "../include/varint.h"
+#include <cstdlib>
+#include <cstring>
+
+// Constructor
+DeltaEncoder::DeltaEncoder() : hasPrevious(false), seq(0), sinceFull(0), sinceSent(0)
+{
+}
+
+// Encodes the cycle's data, false when nothing has to be sent
+bool DeltaEncoder::encode(const void *data, size_t size, uint32_t fullEvery, uint32_t heartbeatEvery, std::vector<uint8_t> &payload)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    payload.clear();
+    sinceFull++;
+    sinceSent++;
+
+    bool full = !hasPrevious || size != previous.size() || sinceFull >= fullEvery;
+    if (!full) {
+        // Changed ranges, nearby ones merged
+        std::vector<std::pair<size_t, size_t>> ranges;
+        for (size_t i = 0; i < size; ++i) {
+            if (bytes[i] == previous[i])
+                continue;
+            if (!ranges.empty() && i - (ranges.back().first + ranges.back().second) <= DELTA_MERGE_GAP)
+                ranges.back().second = i + 1 - ranges.back().first;
+            else
+                ranges.emplace_back(i, 1);
+        }
+
+        if (ranges.empty()) {
+            if (heartbeatEvery == 0 || sinceSent < heartbeatEvery)
+                return false;
+            payload.push_back((uint8_t)DeltaKind::HEARTBEAT);
+            putVarint(payload, seq);
+            putVarint(payload, size);
+            sinceSent = 0;
+            return true;
+        }
+
+        payload.push_back((uint8_t)DeltaKind::DELTA);
+        putVarint(payload, seq + 1);
+        putVarint(payload, size);
+        putVarint(payload, ranges.size());
+        size_t end = 0;
+        for (auto &range : ranges) {
+            putVarint(payload, range.first - end);
+            putVarint(payload, range.second);
+            payload.insert(payload.end(), bytes + range.first, bytes + range.first + range.second);
+            end = range.first + range.second;
+        }
+        // Many scattered changes - the full data is as cheap and resynchronizes the receiver
+        if (payload.size() >= size)
+            full = true;
+    }
+
+    if (full) {
+        payload.clear();
+        payload.push_back((uint8_t)DeltaKind::FULL);
+        putVarint(payload, seq + 1);
+        putVarint(payload, size);
+        payload.insert(payload.end(), bytes, bytes + size);
+        sinceFull = 0;
+    }
+
+    previous.assign(bytes, bytes + size);
+    hasPrevious = true;
+    seq++;
+    sinceSent = 0;
+    return true;
+}
+
+// Forgets the previous data, the next payload is a full frame
+void DeltaEncoder::reset()
+{
+    hasPrevious = false;
+}
+
+// Constructor
+DeltaDecoder::DeltaDecoder() : hasCurrent(false), seq(0)
+{
+}
+
+// Applies the payload, on DATA data points to the rebuilt data (malloc, the receiver frees it)
+DeltaResult DeltaDecoder::decode(const void *payload, size_t size, void *&data)
+{
+    const uint8_t *position = static_cast<const uint8_t *>(payload);
+    const uint8_t *end = position + size;
+    data = nullptr;
+
+    if (position == end)
+        return DeltaResult::MALFORMED;
+    uint8_t kind = *position++;
+    uint32_t payloadSeq;
+    uint64_t dataSize;
+    if (!getVarint32(position, end, payloadSeq) || !getVarint(position, end, dataSize))
+        return DeltaResult::MALFORMED;
+
+    if (kind == (uint8_t)DeltaKind::HEARTBEAT) {
+        if (!hasCurrent || payloadSeq != seq || dataSize != current.size()) {
+            hasCurrent = false;
+            return DeltaResult::MISSING_BASE;
+        }
+        return DeltaResult::HEARTBEAT;
+    }
+
+    if (kind == (uint8_t)DeltaKind::FULL) {
+        if ((uint64_t)(end - position) != dataSize)
+            return DeltaResult::MALFORMED;
+        current.assign(position, end);
+    }
+    else if (kind == (uint8_t)DeltaKind::DELTA) {
+        // The payload is based on the one before it
+        if (!hasCurrent || payloadSeq != seq + 1 || dataSize != current.size()) {
+            hasCurrent = false;
+            return DeltaResult::MISSING_BASE;
+        }
+
+        // Checked as a whole before the data is changed
+        std::vector<std::pair<size_t, const uint8_t *>> ranges;
+        std::vector<size_t> lengths;
+        uint64_t count;
+        if (!getVarint(position, end, count))
+            return DeltaResult::MALFORMED;
+        size_t offset = 0;
+        for (uint64_t i = 0; i < count; ++i) {
+            uint64_t gap, length;
+            if (!getVarint(position, end, gap) || !getVarint(position, end, length))
+                return DeltaResult::MALFORMED;
+            if (gap > dataSize - offset || length > dataSize - offset - gap || length > (uint64_t)(end - position))
+                return DeltaResult::MALFORMED;
+            offset += gap;
+            ranges.emplace_back(offset, position);
+            lengths.push_back(length);
+            position += length;
+            offset += length;
+        }
+        if (position != end)
+            return DeltaResult::MALFORMED;
+        for (size_t i = 0; i < ranges.size(); ++i)
+            std::memcpy(current.data() + ranges[i].first, ranges[i].second, lengths[i]);
+    }
+    else
+        return DeltaResult::MALFORMED;
+
+    hasCurrent = true;
+    seq = payloadSeq;
+    data = malloc(current.size());
+    if (data == nullptr)
+        return DeltaResult::MALFORMED;
+    std::memcpy(data, current.data(), current.size());
+    return DeltaResult::DATA;
+}
@@ -1,54 +1,160 @@
 #include "../include/message.h"
+#include "../include/compression.h"
+#include "../include/varint.h"
 
-// Constructor for sending message
-Message::Message(uint32_t srcID, void *data, int dlc, bool isBroadcast, uint32_t destID)
+// Constructor for sending message, frameSize is SIZE_PACKET (classic) or SIZE_PACKET_FD,
+// data of at least compressThreshold bytes (0 never) is compressed when that saves frames,
+// messageID is the CAN ID its frames are arbitrated by - the lower, the more urgent
+Message::Message(uint32_t srcID, void *data, int dlc, bool isBroadcast, uint32_t destID, size_t frameSize, uint32_t msn, size_t compressThreshold, uint32_t messageID)
 {
+    if (frameSize != SIZE_PACKET && frameSize != SIZE_PACKET_FD)
+        throw std::invalid_argument("Invalid frame size: must be SIZE_PACKET or SIZE_PACKET_FD.");
+    if (dlc < 0 || (size_t)dlc > MAX_MESSAGE_SIZE)
+        throw std::invalid_argument("Invalid data size: must be at most MAX_MESSAGE_SIZE.");
+
+    bool isFD = frameSize == SIZE_PACKET_FD;
     size_t size = dlc;
-    uint32_t tps = (size + SIZE_PACKET-1) / SIZE_PACKET; // Calculate the number of packets needed
+    tps = (size + frameSize - 1) / frameSize; // Calculate the number of packets needed
+
+    // The compressed data starts with the size of the original data
+    std::vector<uint8_t> compressed;
+    if (compressThreshold && size >= compressThreshold) {
+        putVarint(compressed, size);
+        Compression::compress(data, size, compressed);
+        uint32_t compressedTps = (compressed.size() + frameSize - 1) / frameSize;
+        if (compressedTps < tps) {
+            data = compressed.data();
+            size = compressed.size();
+            tps = compressedTps;
+        }
+        else
+            compressed.clear();
+    }
+
+    uint32_t id = messageID == DEFAULT_MESSAGE_ID ? srcID + destID : messageID;
+    packets.reserve(tps);
     for (uint32_t i = 0; i < tps; ++i) {
-        uint8_t packetData[SIZE_PACKET];
-        size_t copySize = std::min(size - i * SIZE_PACKET, (size_t)SIZE_PACKET); // Determine how much data to copy for each packet
-        std::memcpy(packetData, (uint8_t *)data + i * SIZE_PACKET, copySize);
-        uint32_t id = srcID + destID;
-        packets.emplace_back(id, i, tps, srcID, destID, packetData, copySize, isBroadcast, false, false);
+        size_t copySize = std::min(size - i * frameSize, frameSize); // Determine how much data to copy for each packet
+        packets.emplace_back(id, i, tps, srcID, destID, (uint8_t *)data + i * frameSize, copySize, isBroadcast, false, false, isFD);
+        packets.back().header.MSN = msn;
+        packets.back().header.isCompressed = !compressed.empty();
     }
 }
 
-// Constructor for receiving message
+// Constructor for receiving message, throws std::invalid_argument for more frames than MAX_MESSAGE_SIZE needs
 Message::Message(uint32_t tps)
 {
+    // The TPS comes from a peer, it must not size the buffers beyond the largest message
+    if (tps > MAX_MESSAGE_SIZE / SIZE_PACKET)
+        throw std::invalid_argument("Invalid TPS: more frames than a message of MAX_MESSAGE_SIZE has.");
     this->tps = tps;
+    received.assign(tps, false);
+}
+
+// Checks if the TPS of a received frame fits a message of at most MAX_MESSAGE_SIZE in frames of its size
+bool Message::isValidTps(const Packet &p)
+{
+    return p.header.TPS > 0 && p.header.TPS <= (MAX_MESSAGE_SIZE + p.getFrameSize() - 1) / p.getFrameSize();
 }
 
 // Add a packet to the received message
 bool Message::addPacket(const Packet &p)
 {
     // Implementation according to the CAN BUS
-    
-    // For further testing
-    // if (p.header.PSN >= packets.size()) {
-    //     return false;
-    // }
+    // Retransmitted packets may arrive more than once
+    if (p.header.PSN >= tps || received[p.header.PSN])
+        return false;
 
+    received[p.header.PSN] = true;
     packets.push_back(p);
     return true;
 }
 
+// Returns the lowest PSN that was not received yet (TPS when complete)
+uint32_t Message::firstMissing() const
+{
+    uint32_t psn = 0;
+    while (psn < tps && received[psn])
+        psn++;
+    return psn;
+}
+
+// Returns a bitmap of the 32 packets after firstMissing, bit i set if PSN firstMissing+1+i arrived
+uint32_t Message::receivedBitmap() const
+{
+    uint32_t base = firstMissing();
+    uint32_t bitmap = 0;
+    for (uint32_t i = 0; i < 32 && base + 1 + i < tps; ++i)
+        if (received[base + 1 + i])
+            bitmap |= 1u << i;
+    return bitmap;
+}
+
 // Check if the message is complete
 bool Message::isComplete() const
 {
     return packets.size() == tps;
 }
 
-// Get the complete data of the message
+// Get the complete data of the message, nullptr if compressed data is malformed
 void *Message::completeData() const
 {
-    size_t totalSize = (tps - 1) * SIZE_PACKET + packets.back().header.DLC;
-    void *data = malloc(totalSize);
+    size_t size = receivedDataSize();
+    void *data = malloc(size);
     for (const auto &packet : packets) {
-        std::memcpy(static_cast<char*>(data) + packet.header.PSN * SIZE_PACKET, packet.data, packet.header.DLC);
+        std::memcpy(static_cast<char*>(data) + packet.header.PSN * packet.getFrameSize(), packet.data, packet.getDataLength());
     }
-    return data;
+    if (!isCompressed())
+        return data;
+
+    const uint8_t *position = static_cast<const uint8_t *>(data);
+    const uint8_t *end = position + size;
+    uint64_t originalSize;
+    void *original = nullptr;
+    // The size comes from a peer, a larger one than any message is malformed
+    if (getVarint(position, end, originalSize) && originalSize <= MAX_MESSAGE_SIZE) {
+        original = malloc(originalSize ? originalSize : 1);
+        if (original && !Compression::decompress(position, end - position, static_cast<uint8_t *>(original), originalSize)) {
+            free(original);
+            original = nullptr;
+        }
+    }
+    free(data);
+    return original;
+}
+
+// Get the size of the complete data of the message
+size_t Message::completeDataSize() const
+{
+    if (!isCompressed())
+        return receivedDataSize();
+
+    // The size of the original data fits in the first frame
+    for (const auto &packet : packets) {
+        if (packet.header.PSN != 0)
+            continue;
+        const uint8_t *position = packet.data;
+        uint64_t originalSize;
+        if (getVarint(position, packet.data + packet.getDataLength(), originalSize))
+            return originalSize;
+    }
+    return 0;
+}
+
+// Get the size of the data in the packets, compressed or not
+size_t Message::receivedDataSize() const
+{
+    // Every packet of a message has the same frame size, the last one may be shorter
+    size_t totalSize = 0;
+    for (const auto &packet : packets)
+        totalSize = std::max(totalSize, packet.header.PSN * packet.getFrameSize() + packet.getDataLength());
+    return totalSize;
+}
+
+// Check if the packets carry compressed data
+bool Message::isCompressed() const
+{
+    return !packets.empty() && packets.front().header.isCompressed;
 }
 
 // Get the packets of the message
@@ -1,19 +1,34 @@
 #include "../include/packet.h"
+#include "../include/simulation_clock.h"
 // Constructor to initialize Packet for sending
-Packet::Packet(uint32_t id, uint32_t psn, uint32_t tps, uint32_t srcID, uint32_t destID, void *data, uint8_t dlc, bool isBroadcast, bool RTR, bool passive)
+Packet::Packet(uint32_t id, uint32_t psn, uint32_t tps, uint32_t srcID, uint32_t destID, void *data, uint8_t length, bool isBroadcast, bool RTR, bool passive, bool isFD)
 {
+    if (length > (isFD ? SIZE_PACKET_FD : SIZE_PACKET))
+        throw std::invalid_argument("Invalid data length: larger than the frame size.");
+
     header.ID = id;
     header.PSN = psn;
     header.TPS = tps;
+    header.MSN = 0;
     header.SrcID = srcID;
     header.DestID = destID;
-    header.DLC = dlc;
-    std::memcpy(this->data, data, dlc);
-    header.CRC = calculateCRC(data, dlc);
-    header.timestamp = std::time(nullptr);
+    header.DLC = lengthToDlc(length);
+    header.isFD = isFD;
+    header.padding = dlcToLength(header.DLC) - length;
+    std::memcpy(this->data, data, length);
+    std::memset(this->data + length, 0, header.padding);
+    header.CRC = calculateCRC(data, length);
+    header.timestamp = SimulationClock::getInstance().now();
     header.RTR = RTR;
     header.passive = passive;
     header.isBroadcast = isBroadcast;
+    header.isBulk = false;
+    header.type = FrameType::DATA;
+    header.isReliable = false;
+    header.isDelta = false;
+    header.isCompressed = false;
+    header.isRpc = false;
+    header.flowID = 0;
 }
 
 // Constructor to initialize receiving Packet ID for init
@@ -21,25 +36,69 @@ Packet::Packet(uint32_t id)
 {
     std::memset(&header, 0, sizeof(header)); // Initialize all fields to zero
     header.SrcID = id;
-    header.timestamp = std::time(nullptr);
+    header.timestamp = SimulationClock::getInstance().now();
 }
 
-// Implementation according to the CAN BUS
+// Implementation according to the CAN BUS - CRC-15 (polynomial 0x4599)
 uint16_t Packet::calculateCRC(const void *data, size_t length)
 {
-    uint16_t crc = 0xFFFF;
-    // Calculate CRC for the given data and length
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint16_t crc = 0;
+    for (size_t i = 0; i < length; ++i) {
+        for (int bit = 7; bit >= 0; --bit) {
+            bool inBit = (bytes[i] >> bit) & 1;
+            bool topBit = (crc >> 14) & 1;
+            crc = (crc << 1) & 0x7FFF;
+            if (inBit != topBit)
+                crc ^= 0x4599;
+        }
+    }
     return crc;
 }
 
+// Returns the number of valid data bytes in the packet
+size_t Packet::getDataLength() const
+{
+    return dlcToLength(header.DLC) - header.padding;
+}
+
+// Returns the payload size of a full frame of this packet's type
+size_t Packet::getFrameSize() const
+{
+    return header.isFD ? SIZE_PACKET_FD : SIZE_PACKET;
+}
+
+// Converts a data length in bytes to the smallest DLC code that holds it
+uint8_t Packet::lengthToDlc(size_t length)
+{
+    if (length <= 8)
+        return length;
+    if (length <= 24)
+        return 9 + (length - 9) / 4;
+    if (length <= 32)
+        return 13;
+    if (length <= 48)
+        return 14;
+    return 15;
+}
+
+// Converts a DLC code to the data length in bytes
+size_t Packet::dlcToLength(uint8_t dlc)
+{
+    static const uint8_t lengths[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+    return lengths[dlc & 0x0F];
+}
+
 // A function to convert the data to hexa (logger)
 std::string Packet::pointerToHex(const void* data, size_t size) const
 {
+    static const char digits[] = "0123456789abcdef";
     const unsigned char* byteData = reinterpret_cast<const unsigned char*>(data);
-    std::ostringstream oss;
-    oss<<"0x";
-    for (size_t i = 0; i < size; ++i)
-        oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byteData[i]);
-
-    return oss.str();
+    std::string hex(2 + 2 * size, '0');
+    hex[1] = 'x';
+    for (size_t i = 0; i < size; ++i) {
+        hex[2 + 2 * i] = digits[byteData[i] >> 4];
+        hex[3 + 2 * i] = digits[byteData[i] & 0xf];
+    }
+    return hex;
 }
\ No newline at end of file
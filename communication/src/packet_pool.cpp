@@ -0,0 +1,138 @@
+#include "../include/packet_pool.h"
+
+// Constructor
+PacketPool::PacketPool(size_t size) : nodes(size), freeList(nullptr), freeCount(size)
+{
+    if (size == 0)
+        throw std::invalid_argument("Packet pool size must be positive");
+    for (size_t i = 0; i < size; ++i) {
+        nodes[i].next = freeList;
+        freeList = &nodes[i];
+    }
+}
+
+// Takes a frame, waits while the pool is empty
+PooledPacket *PacketPool::acquire()
+{
+    std::unique_lock<std::mutex> lock(poolMutex);
+    released.wait(lock, [this]() { return freeList != nullptr; });
+    PooledPacket *node = freeList;
+    freeList = node->next;
+    freeCount--;
+    node->next = nullptr;
+    return node;
+}
+
+// Takes up to count frames without waiting, linked through next, returns the number taken
+size_t PacketPool::tryAcquire(PooledPacket **frames, size_t count)
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+    size_t taken = 0;
+    while (taken < count && freeList) {
+        frames[taken] = freeList;
+        freeList = freeList->next;
+        frames[taken]->next = nullptr;
+        taken++;
+    }
+    freeCount -= taken;
+    return taken;
+}
+
+// Returns a frame
+void PacketPool::release(PooledPacket *node)
+{
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        node->next = freeList;
+        freeList = node;
+        freeCount++;
+    }
+    released.notify_one();
+}
+
+// Returns a list of frames linked through next
+void PacketPool::releaseList(PooledPacket *head)
+{
+    if (!head)
+        return;
+    PooledPacket *last = head;
+    size_t count = 1;
+    for (; last->next; last = last->next)
+        count++;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        last->next = freeList;
+        freeList = head;
+        freeCount += count;
+    }
+    released.notify_all();
+}
+
+// Returns the number of frames that are not in use
+size_t PacketPool::getFreeCount()
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return freeCount;
+}
+
+// Returns the number of frames of the pool
+size_t PacketPool::getSize() const
+{
+    return nodes.size();
+}
+
+// Constructor
+PacketQueue::PacketQueue() : head(nullptr), tail(nullptr), closed(false)
+{
+}
+
+// Appends a frame, false if the queue is closed (the frame stays with the caller)
+bool PacketQueue::push(PooledPacket *node)
+{
+    node->next = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (closed)
+            return false;
+        bool wasEmpty = head == nullptr;
+        if (tail)
+            tail->next = node;
+        else
+            head = node;
+        tail = node;
+        // The consumer only sleeps on an empty queue
+        if (!wasEmpty)
+            return true;
+    }
+    pushed.notify_one();
+    return true;
+}
+
+// Takes all the queued frames in order, waits while the queue is empty, nullptr once closed and empty
+PooledPacket *PacketQueue::popAll()
+{
+    std::unique_lock<std::mutex> lock(queueMutex);
+    pushed.wait(lock, [this]() { return head != nullptr || closed; });
+    PooledPacket *list = head;
+    head = tail = nullptr;
+    return list;
+}
+
+// Wakes the consumer, no more frames are accepted
+void PacketQueue::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        closed = true;
+    }
+    pushed.notify_all();
+}
+
+// Takes the frames that were never consumed
+PooledPacket *PacketQueue::drain()
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    PooledPacket *list = head;
+    head = tail = nullptr;
+    return list;
+}
@@ -0,0 +1,205 @@
+#include "../include/rpc_channel.h"
+#include "../include/varint.h"
+
+// Constructor, receives the RPC messages of the communication, srcID is the ID the calls are sent from
+RpcChannel::RpcChannel(Communication &comm, uint32_t srcID) : comm(comm), srcID(srcID), nextCorrelation(1), running(true)
+{
+    timeoutThread = std::thread(&RpcChannel::expireCalls, this);
+    comm.setRpcHandler(std::bind(&RpcChannel::handleMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+// Registers a method that peers may call
+void RpcChannel::registerMethod(uint32_t method, Method handler)
+{
+    if (!handler)
+        throw std::invalid_argument("RPC method handler cannot be null");
+
+    std::lock_guard<std::mutex> lock(methodMutex);
+    methods[method] = handler;
+}
+
+// Calls a method of the peer, the callback runs when the call completes
+void RpcChannel::call(uint32_t destID, uint32_t method, const void *data, size_t size, Callback callback, std::chrono::milliseconds timeout)
+{
+    if (!callback)
+        throw std::invalid_argument("RPC callback cannot be null");
+
+    uint64_t correlation = nextCorrelation++;
+    {
+        // Pending before it is sent, the response may arrive before send returns
+        std::lock_guard<std::mutex> lock(callMutex);
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        pending[correlation] = {destID, deadline, callback};
+        bool earliest = deadlines.empty() || deadline < deadlines.begin()->first;
+        deadlines.emplace(deadline, correlation);
+        if (earliest)
+            deadlineChanged.notify_all();
+    }
+
+    ErrorCode res = sendMessage(RpcKind::REQUEST, destID, correlation, method, data, size);
+    if (res != ErrorCode::SUCCESS)
+        complete(correlation, destID, {res, {}});
+}
+
+// Calls a method of the peer, the future is ready when the call completes
+std::future<RpcResult> RpcChannel::call(uint32_t destID, uint32_t method, const void *data, size_t size, std::chrono::milliseconds timeout)
+{
+    auto promise = std::make_shared<std::promise<RpcResult>>();
+    std::future<RpcResult> future = promise->get_future();
+    call(destID, method, data, size, [promise](RpcResult result) { promise->set_value(std::move(result)); }, timeout);
+    return future;
+}
+
+// Returns the number of calls waiting for a response
+size_t RpcChannel::getPendingCount()
+{
+    std::lock_guard<std::mutex> lock(callMutex);
+    return pending.size();
+}
+
+// Receives the RPC messages from the communication
+void RpcChannel::handleMessage(uint32_t senderID, void *data, size_t dataSize)
+{
+    const uint8_t *position = static_cast<const uint8_t *>(data);
+    const uint8_t *end = position + dataSize;
+    uint64_t correlation;
+    RpcKind kind = position == end ? RpcKind::REQUEST : (RpcKind)*position++;
+    if (!getVarint(position, end, correlation)) {
+        RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(senderID), std::to_string(srcID), "Malformed RPC message");
+        free(data);
+        return;
+    }
+
+    uint32_t method;
+    uint64_t error;
+    switch (kind) {
+    case RpcKind::REQUEST:
+        if (getVarint32(position, end, method))
+            handleRequest(senderID, correlation, method, position, end - position);
+        break;
+    case RpcKind::RESPONSE:
+        complete(correlation, senderID, {ErrorCode::SUCCESS, std::vector<uint8_t>(position, end)});
+        break;
+    case RpcKind::ERROR:
+        if (getVarint(position, end, error))
+            complete(correlation, senderID, {(ErrorCode)-(int)error, {}});
+        break;
+    default:
+        RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(senderID), std::to_string(srcID), "Unknown RPC message kind " + std::to_string((int)kind));
+    }
+    free(data);
+}
+
+// Runs the method of a request and sends its response
+void RpcChannel::handleRequest(uint32_t senderID, uint64_t correlation, uint32_t method, const uint8_t *arguments, size_t size)
+{
+    Method handler;
+    {
+        std::lock_guard<std::mutex> lock(methodMutex);
+        auto it = methods.find(method);
+        if (it != methods.end())
+            handler = it->second;
+    }
+
+    if (!handler) {
+        uint64_t error = -(int)ErrorCode::RPC_UNKNOWN_METHOD;
+        std::vector<uint8_t> payload;
+        putVarint(payload, error);
+        sendMessage(RpcKind::ERROR, senderID, correlation, 0, payload.data(), payload.size());
+        return;
+    }
+
+    try {
+        std::vector<uint8_t> result = handler(senderID, std::vector<uint8_t>(arguments, arguments + size));
+        sendMessage(RpcKind::RESPONSE, senderID, correlation, 0, result.data(), result.size());
+    }
+    catch (const std::exception &e) {
+        RealSocket::log.logMessage(logger::LogLevel::ERROR, std::to_string(senderID), std::to_string(srcID), "RPC method " + std::to_string(method) + " failed: " + e.what());
+        uint64_t error = -(int)ErrorCode::RPC_FAILED;
+        std::vector<uint8_t> payload;
+        putVarint(payload, error);
+        sendMessage(RpcKind::ERROR, senderID, correlation, 0, payload.data(), payload.size());
+    }
+}
+
+// Completes a pending call, false if it already completed
+bool RpcChannel::complete(uint64_t correlation, uint32_t senderID, RpcResult result)
+{
+    Callback callback;
+    {
+        std::lock_guard<std::mutex> lock(callMutex);
+        auto it = pending.find(correlation);
+        // A late response, or one from a peer that was not called
+        if (it == pending.end() || it->second.destID != senderID)
+            return false;
+        callback = it->second.callback;
+        auto range = deadlines.equal_range(it->second.deadline);
+        for (auto deadline = range.first; deadline != range.second; ++deadline)
+            if (deadline->second == correlation) {
+                deadlines.erase(deadline);
+                break;
+            }
+        pending.erase(it);
+    }
+    callback(std::move(result));
+    return true;
+}
+
+// Sends an RPC message of the kind
+ErrorCode RpcChannel::sendMessage(RpcKind kind, uint32_t destID, uint64_t correlation, uint32_t method, const void *data, size_t size)
+{
+    std::vector<uint8_t> message;
+    message.reserve(size + 12);
+    message.push_back((uint8_t)kind);
+    putVarint(message, correlation);
+    if (kind == RpcKind::REQUEST)
+        putVarint(message, method);
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    message.insert(message.end(), bytes, bytes + size);
+    return comm.sendRpcMessage(message.data(), message.size(), destID, srcID);
+}
+
+// Runs in a thread - fails the calls whose time is up
+void RpcChannel::expireCalls()
+{
+    std::unique_lock<std::mutex> lock(callMutex);
+    while (running) {
+        if (deadlines.empty()) {
+            deadlineChanged.wait(lock);
+            continue;
+        }
+        auto next = deadlines.begin();
+        if (std::chrono::steady_clock::now() < next->first) {
+            // A copy, a response may erase the entry while this waits
+            auto deadline = next->first;
+            deadlineChanged.wait_until(lock, deadline);
+            continue;
+        }
+
+        uint64_t correlation = next->second;
+        deadlines.erase(next);
+        auto it = pending.find(correlation);
+        Callback callback = it->second.callback;
+        pending.erase(it);
+        lock.unlock();
+        callback({ErrorCode::RPC_TIMEOUT, {}});
+        lock.lock();
+    }
+}
+
+// Destructor, fails the calls that are still waiting
+RpcChannel::~RpcChannel()
+{
+    comm.setRpcHandler(nullptr);
+    std::unordered_map<uint64_t, PendingCall> remaining;
+    {
+        std::lock_guard<std::mutex> lock(callMutex);
+        running = false;
+        remaining.swap(pending);
+        deadlines.clear();
+        deadlineChanged.notify_all();
+    }
+    timeoutThread.join();
+    for (auto &call : remaining)
+        call.second.callback({ErrorCode::RPC_TIMEOUT, {}});
+}
@@ -1,12 +1,17 @@
 #include <csignal>
 #include <iostream>
 #include "../include/server_connection.h"
+#include <netinet/tcp.h>
+
+thread_local bool ServerConnection::creditHeld = false;
 
 // Constructor
 ServerConnection::ServerConnection(int port, std::function<void(Packet&)> callback, ISocket* socketInterface) {
     setPort(port);
     setReceiveDataCallback(callback);
     setSocketInterface(socketInterface);
+    setFlowControlWindow(FLOW_CONTROL_WINDOW);
+    connectionLimit = 0;
     running = false;
 }
 
@@ -43,8 +48,8 @@ ErrorCode ServerConnection::startConnection()
     }
     
     running = true;
+    // Joined by stopServer, it must not outlive the server it accepts for
     mainThread = std::thread(&ServerConnection::startThread, this);
-    mainThread.detach();
 
     return ErrorCode::SUCCESS;
 }
@@ -61,6 +66,10 @@ void ServerConnection::startThread()
             stopServer();
             return;
         }
+
+        // Frames are small and acknowledgments wait for them, do not let TCP hold them back
+        int noDelay = 1;
+        socketInterface->setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
         // Opens a new thread for handleClient - listening to messages from the process
         {
             std::lock_guard<std::mutex> lock(threadMutex);
@@ -72,42 +81,57 @@ void ServerConnection::startThread()
 // Closes the sockets and the threads
 void ServerConnection::stopServer()
 {
-    if(!running)
-        return;
-        
-    running = false;
-    socketInterface->close(serverSocket);
-    {
-        std::lock_guard<std::mutex> lock(socketMutex);
-        for (int sock : sockets)
-            socketInterface->close(sock);
-        sockets.clear();
-    }
-    {
-        std::lock_guard<std::mutex> lock(threadMutex);
-        for (auto &th : clientThreads)
-            if (th.joinable())
-                th.join();
+    if (running.exchange(false)) {
+        socketInterface->close(serverSocket);
+        {
+            std::lock_guard<std::mutex> lock(socketMutex);
+            for (int sock : sockets)
+                socketInterface->close(sock);
+            sockets.clear();
+        }
+        {
+            std::lock_guard<std::mutex> lock(threadMutex);
+            for (auto &th : clientThreads)
+                if (th.joinable())
+                    th.join();
+        }
     }
+
+    // The accepting thread ends once its socket is closed, it stops the server itself when accept fails
+    if (mainThread.joinable() && mainThread.get_id() != std::this_thread::get_id())
+        mainThread.join();
 }
 
 // Runs in a thread for each process - waits for a message and forwards it to the manager
 void ServerConnection::handleClient(int clientSocket)
 {
     Packet packet;
-    int valread = socketInterface->recv(clientSocket, &packet, sizeof(Packet), 0);
+    int valread = socketInterface->recvAll(clientSocket, &packet, sizeof(Packet), 0);
 
     //implement according to CAN bus
     if (valread <= 0)
         return;
     
     uint32_t clientID = packet.header.SrcID;
-    if(!isValidId(clientID))
-        return;
-
     {
         std::lock_guard<std::mutex> lock(IDMapMutex);
+        // Checked with the registration, two clients with one ID that connect together can not both pass
+        if(!isValidId(clientID)) {
+            RealSocket::log.logMessage(logger::LogLevel::ERROR, "Connection of client " + std::to_string(clientID) + " refused, the ID may not connect to this bus or is connected already");
+            socketInterface->close(clientSocket);
+            return;
+        }
+        // Counted with the registration, clients that connect together can not pass the limit
+        if (connectionLimit && clientIDMap.size() >= connectionLimit) {
+            RealSocket::log.logMessage(logger::LogLevel::ERROR, "Connection of client " + std::to_string(clientID) + " refused, " + std::to_string(connectionLimit) + " clients are connected already");
+            socketInterface->close(clientSocket);
+            return;
+        }
         clientIDMap[clientSocket] = clientID;
+        sendMutexes[clientSocket] = std::make_shared<std::mutex>();
+        consumedCredits[clientSocket] = 0;
+        if (packet.header.isBulk)
+            bulkClients.insert(clientID);
     }
 
     {
@@ -115,36 +139,57 @@ void ServerConnection::handleClient(int clientSocket)
         sockets.push_back(clientSocket);
     }
 
+    // The client may send a full window, credits return as the packets are forwarded
+    uint32_t window = flowControlWindow;
+    if (window)
+        sendCredit(clientSocket, clientID, window);
+
+    if (connectCallback)
+        connectCallback(clientID);
+
     while (running) {
-        int valread = socketInterface->recv(clientSocket, &packet, sizeof(Packet), 0);
+        int valread = socketInterface->recvAll(clientSocket, &packet, sizeof(Packet), 0);
         if (valread == 0)
             break;
 
         if(valread < 0)
            continue;
      
+        creditHeld = false;
         receiveDataCallback(packet);
+
+        if (window && packet.header.type == FrameType::DATA && !creditHeld)
+            consumeCredit(clientSocket, clientID);
     }
 
     {
     // If the process is no longer connected
     std::lock_guard<std::mutex> lock(socketMutex);
     auto it = std::find(sockets.begin(), sockets.end(), clientSocket);
-    socketInterface->close(*it);
-    if (it != sockets.end())
+    // Closed already when the server stopped
+    if (it != sockets.end()) {
+        socketInterface->close(*it);
         sockets.erase(it);
     }
+    }
     {
         std::lock_guard<std::mutex> lock(IDMapMutex);
         clientIDMap.erase(clientSocket);
+        sendMutexes.erase(clientSocket);
+        consumedCredits.erase(clientSocket);
+        bulkClients.erase(clientID);
     }
 }
 
-// Implementation according to the CAN BUS
+// Implementation according to the CAN BUS - the ID is allowed and no connected client has it, called with IDMapMutex locked
 bool ServerConnection::isValidId(uint32_t id)
 {
-    std::lock_guard<std::mutex> lock(IDMapMutex);
-    return clientIDMap.find(id) == clientIDMap.end();
+    if (!allowedIds.empty() && allowedIds.count(id) == 0)
+        return false;
+    for (const auto &client : clientIDMap)
+        if (client.second == id)
+            return false;
+    return true;
 }
 
 // Returns the sockets ID
@@ -158,6 +203,66 @@ int ServerConnection::getClientSocketByID(uint32_t destID)
     return -1;
 }
 
+// Grants the client permission to send more packets
+ErrorCode ServerConnection::sendCredit(int clientSocket, uint32_t clientID, uint32_t credits)
+{
+    Packet packet(0, 0, 1, 0, clientID, &credits, sizeof(credits), false);
+    packet.header.type = FrameType::CREDIT;
+    ssize_t bytesSent = sendFrame(clientSocket, packet);
+    if (bytesSent < (ssize_t)sizeof(Packet))
+        return ErrorCode::SEND_FAILED;
+    return ErrorCode::SUCCESS;
+}
+
+// Counts a frame of the client that left the bus, returns the credits every half window
+void ServerConnection::consumeCredit(int clientSocket, uint32_t clientID)
+{
+    uint32_t credits;
+    {
+        std::lock_guard<std::mutex> lock(IDMapMutex);
+        auto it = consumedCredits.find(clientSocket);
+        if (it == consumedCredits.end() || ++it->second < flowControlWindow / 2)
+            return;
+        credits = it->second;
+        it->second = 0;
+    }
+    sendCredit(clientSocket, clientID, credits);
+}
+
+// Called by the receive callback that keeps the frame to send it later, its credit waits for releaseCredit
+void ServerConnection::holdCredit()
+{
+    creditHeld = true;
+}
+
+// Returns the credit of a held frame of the client, once the frame is sent or dropped
+void ServerConnection::releaseCredit(uint32_t clientID)
+{
+    if (!flowControlWindow)
+        return;
+    int clientSocket = getClientSocketByID(clientID);
+    if (clientSocket != -1)
+        consumeCredit(clientSocket, clientID);
+}
+
+// Writes one frame to the client socket, holding the send mutex of the socket
+ssize_t ServerConnection::sendFrame(int clientSocket, const Packet &packet)
+{
+    std::shared_ptr<std::mutex> sendMutex;
+    {
+        std::lock_guard<std::mutex> lock(IDMapMutex);
+        auto it = sendMutexes.find(clientSocket);
+        if (it != sendMutexes.end())
+            sendMutex = it->second;
+    }
+    // A socket that is not registered (yet) has no other writers
+    if (!sendMutex)
+        return socketInterface->sendAll(clientSocket, &packet, sizeof(Packet), 0);
+
+    std::lock_guard<std::mutex> lock(*sendMutex);
+    return socketInterface->sendAll(clientSocket, &packet, sizeof(Packet), 0);
+}
+
 // Sends the message to destination
 ErrorCode ServerConnection::sendDestination(const Packet &packet)
 {
@@ -165,7 +270,7 @@ ErrorCode ServerConnection::sendDestination(const Packet &packet)
     if (targetSocket == -1)
         return ErrorCode::INVALID_CLIENT_ID;
     
-    ssize_t bytesSent = socketInterface->send(targetSocket, &packet, sizeof(Packet), 0);
+    ssize_t bytesSent = sendFrame(targetSocket, packet);
     if (!bytesSent)
         return ErrorCode::SEND_FAILED;
 
@@ -177,12 +282,32 @@ ErrorCode ServerConnection::sendDestination(const Packet &packet)
     return ErrorCode::SUCCESS;
 }
 
+// Returns the number of clients that completed the connection
+size_t ServerConnection::getConnectedCount()
+{
+    std::lock_guard<std::mutex> lock(socketMutex);
+    return sockets.size();
+}
+
+// Checks if a client with the ID is connected to this bus
+bool ServerConnection::hasClient(uint32_t id)
+{
+    return getClientSocketByID(id) != -1;
+}
+
+// Checks if the client is connected and reads the shared memory of this host (bulk channel)
+bool ServerConnection::canReadBulk(uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(IDMapMutex);
+    return bulkClients.count(id) > 0;
+}
+
 // Sends the message to all connected processes - broadcast
 ErrorCode ServerConnection::sendBroadcast(const Packet &packet)
 {
     std::lock_guard<std::mutex> lock(socketMutex);
     for (int sock : sockets) {
-        ssize_t bytesSent = socketInterface->send(sock, &packet, sizeof(Packet), 0);
+        ssize_t bytesSent = sendFrame(sock, packet);
         if (bytesSent < sizeof(Packet))
             return ErrorCode::SEND_FAILED;
         if (bytesSent<0){
@@ -210,6 +335,12 @@ void ServerConnection::setReceiveDataCallback(std::function<void(Packet&)> callb
     this->receiveDataCallback = callback;
 }
 
+// Sets the callback that gets the ID of every client that completed the connection, nullptr for none
+void ServerConnection::setConnectCallback(std::function<void(uint32_t)> callback)
+{
+    connectCallback = callback;
+}
+
 // Sets the socket interface, throws an exception if the socketInterface is null.
 void ServerConnection::setSocketInterface(ISocket* socketInterface) {
     if (socketInterface == nullptr) {
@@ -218,6 +349,29 @@ void ServerConnection::setSocketInterface(ISocket* socketInterface) {
     this->socketInterface = socketInterface;
 }
 
+// Sets the number of packets a client may send ahead, 0 disables flow control
+void ServerConnection::setFlowControlWindow(uint32_t window)
+{
+    // A window of one could never be replenished in halves
+    if (window == 1)
+        throw std::invalid_argument("Invalid flow control window: must be 0 or at least 2.");
+    flowControlWindow = window;
+}
+
+// Sets the IDs that may connect, the connections of other IDs are closed. Empty allows every ID.
+void ServerConnection::setAllowedIds(const std::vector<uint32_t> &ids)
+{
+    std::lock_guard<std::mutex> lock(IDMapMutex);
+    allowedIds = std::set<uint32_t>(ids.begin(), ids.end());
+}
+
+// Sets the number of clients that may be connected at once, 0 for no limit
+void ServerConnection::setConnectionLimit(uint32_t limit)
+{
+    std::lock_guard<std::mutex> lock(IDMapMutex);
+    connectionLimit = limit;
+}
+
 // For testing
 int ServerConnection::getServerSocket()
 {
@@ -0,0 +1,100 @@
+#include "../include/simulation_clock.h"
+#include <thread>
+
+thread_local bool SimulationClock::woken = false;
+
+// Private constructor
+SimulationClock::SimulationClock()
+    : mode(ClockMode::REAL_TIME), virtualTime(0), startTime(std::chrono::steady_clock::now()), runningThreads(0)
+{
+}
+
+// Static function to return a singleton instance
+SimulationClock &SimulationClock::getInstance()
+{
+    static SimulationClock instance;
+    return instance;
+}
+
+// Returns the current mode
+ClockMode SimulationClock::getMode()
+{
+    return mode;
+}
+
+// Switches mode, threads sleeping on virtual time are released
+void SimulationClock::setMode(ClockMode newMode)
+{
+    std::lock_guard<std::mutex> lock(clockMutex);
+    // Virtual time starts at 0 in the bus and in every client, whenever each of them started
+    if (mode == ClockMode::REAL_TIME && newMode != ClockMode::REAL_TIME)
+        virtualTime = 0;
+    // Threads that woke in the virtual modes may have ended without sleeping again
+    if (newMode == ClockMode::REAL_TIME)
+        runningThreads = 0;
+    mode = newMode;
+    timeAdvanced.notify_all();
+}
+
+// Returns the simulation time in nanoseconds
+uint64_t SimulationClock::now()
+{
+    if (mode == ClockMode::REAL_TIME)
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+    return virtualTime;
+}
+
+// Sleeps on wall time or until the virtual time has advanced by duration
+void SimulationClock::sleepFor(std::chrono::nanoseconds duration)
+{
+    if (mode == ClockMode::REAL_TIME) {
+        std::this_thread::sleep_for(duration);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(clockMutex);
+    finishStep();
+    uint64_t deadline = virtualTime + duration.count();
+    auto it = deadlines.insert(deadline);
+    timeAdvanced.wait(lock, [this, deadline]() {
+        return mode == ClockMode::REAL_TIME || virtualTime >= deadline;
+    });
+    deadlines.erase(it);
+
+    if (mode != ClockMode::REAL_TIME) {
+        woken = true;
+        runningThreads++;
+    }
+}
+
+// Moves the virtual time forward and wakes the threads whose deadline passed
+void SimulationClock::advanceTo(uint64_t time)
+{
+    std::lock_guard<std::mutex> lock(clockMutex);
+    if (time <= virtualTime)
+        return;
+    virtualTime = time;
+    timeAdvanced.notify_all();
+}
+
+// Waits until every thread woken by the last ticks sleeps again, false on timeout
+bool SimulationClock::waitIdle(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(clockMutex);
+    return stepDone.wait_for(lock, timeout, [this]() {
+        // A due deadline belongs to a thread that was notified but did not run yet
+        bool dueSleepers = !deadlines.empty() && *deadlines.begin() <= virtualTime;
+        return !dueSleepers && runningThreads == 0;
+    });
+}
+
+// Marks the current thread as finished with its step
+void SimulationClock::finishStep()
+{
+    if (!woken)
+        return;
+    woken = false;
+    if (runningThreads > 0)
+        runningThreads--;
+    stepDone.notify_all();
+}
@@ -0,0 +1,149 @@
+#include "../include/sliding_window.h"
+#include <algorithm>
+#include <cmath>
+
+// Constructor
+RttEstimator::RttEstimator() : srtt(0), rttvar(0), measured(false)
+{
+}
+
+// Adds a round trip time of a packet that was sent once
+void RttEstimator::addSample(std::chrono::nanoseconds rtt)
+{
+    double sample = rtt.count();
+    if (!measured) {
+        srtt = sample;
+        rttvar = sample / 2;
+        measured = true;
+        return;
+    }
+    rttvar = 0.75 * rttvar + 0.25 * std::abs(srtt - sample);
+    srtt = 0.875 * srtt + 0.125 * sample;
+}
+
+// Returns the timeout, doubled for every timeout in a row
+std::chrono::nanoseconds RttEstimator::getTimeout(int backoff) const
+{
+    std::chrono::nanoseconds timeout = measured ? std::chrono::nanoseconds((int64_t)(srtt + 4 * rttvar)) : std::chrono::milliseconds(RELIABLE_RTO_MS);
+    timeout = std::max<std::chrono::nanoseconds>(timeout, std::chrono::milliseconds(RELIABLE_MIN_RTO_MS));
+    for (int i = 0; i < backoff && timeout < std::chrono::milliseconds(RELIABLE_MAX_RTO_MS); ++i)
+        timeout *= 2;
+    return std::min<std::chrono::nanoseconds>(timeout, std::chrono::milliseconds(RELIABLE_MAX_RTO_MS));
+}
+
+// Constructor
+SlidingWindow::SlidingWindow(uint32_t tps, uint32_t size)
+    : tps(tps), size(size ? size : 1), base(0), next(0), acked(tps, false), resent(tps, false), sentAt(tps), news(false),
+      timeoutDuration(std::chrono::milliseconds(RELIABLE_RTO_MS)), rttSample(0)
+{
+}
+
+// Checks if a new packet fits in the window
+bool SlidingWindow::canSend() const
+{
+    return next < tps && next < base + size;
+}
+
+// Returns the next new packet to send and marks it as sent
+uint32_t SlidingWindow::takeNext()
+{
+    sentAt[next] = std::chrono::steady_clock::now();
+    return next++;
+}
+
+// Returns the packets to send again and clears the list
+std::vector<uint32_t> SlidingWindow::takeRetransmits()
+{
+    std::vector<uint32_t> result;
+    result.swap(retransmits);
+    return result;
+}
+
+// Marks a packet as sent again
+void SlidingWindow::markSent(uint32_t psn)
+{
+    resent[psn] = true;
+    sentAt[psn] = std::chrono::steady_clock::now();
+}
+
+// Applies an acknowledgment, a NACK also requests the missing packets
+void SlidingWindow::acknowledge(uint32_t cumulative, uint32_t bitmap, bool isNack)
+{
+    news = true;
+    cumulative = std::min(cumulative, next);
+    // Karn's rule - a packet that was sent again does not tell the round trip time
+    if (cumulative > base && !resent[cumulative - 1] && !acked[cumulative - 1])
+        rttSample = std::chrono::steady_clock::now() - sentAt[cumulative - 1];
+    for (uint32_t psn = base; psn < cumulative; ++psn)
+        acked[psn] = true;
+    for (uint32_t i = 0; i < 32 && cumulative + 1 + i < next; ++i)
+        if (bitmap & (1u << i))
+            acked[cumulative + 1 + i] = true;
+    while (base < tps && acked[base])
+        base++;
+
+    if (!isNack)
+        return;
+
+    // The frames arrive in order, so only the packets before the last one received are lost
+    auto now = std::chrono::steady_clock::now();
+    uint32_t lastReceived = cumulative;
+    for (uint32_t i = 0; i < 32; ++i)
+        if (bitmap & (1u << i))
+            lastReceived = cumulative + 1 + i;
+    uint32_t reported = std::min(next, lastReceived + (bitmap ? 0 : 1));
+    for (uint32_t psn = base; psn < reported; ++psn)
+        if (!acked[psn])
+            requestRetransmit(psn, now);
+}
+
+// No acknowledgment arrived in time, every packet in flight is sent again
+void SlidingWindow::timeout()
+{
+    retransmits.clear();
+    for (uint32_t psn = base; psn < next; ++psn)
+        if (!acked[psn])
+            retransmits.push_back(psn);
+}
+
+// Checks and clears whether anything arrived since the last call
+bool SlidingWindow::takeNews()
+{
+    bool result = news;
+    news = false;
+    return result;
+}
+
+// Checks if every packet was acknowledged
+bool SlidingWindow::isComplete() const
+{
+    return base == tps;
+}
+
+// Sets the current retransmission timeout
+void SlidingWindow::setTimeout(std::chrono::nanoseconds timeout)
+{
+    timeoutDuration = timeout;
+}
+
+// Returns the round trip time measured by the last acknowledgment, false if there is none
+bool SlidingWindow::takeRttSample(std::chrono::nanoseconds &sample)
+{
+    if (rttSample.count() == 0)
+        return false;
+    sample = rttSample;
+    rttSample = std::chrono::nanoseconds(0);
+    return true;
+}
+
+// Queues the packet for retransmission unless it was sent very recently
+void SlidingWindow::requestRetransmit(uint32_t psn, std::chrono::steady_clock::time_point now)
+{
+    // Every packet after a gap causes a NACK, one resend per gap is enough
+    if (resent[psn] && now - sentAt[psn] < timeoutDuration / 2)
+        return;
+    for (uint32_t queued : retransmits)
+        if (queued == psn)
+            return;
+    retransmits.push_back(psn);
+}
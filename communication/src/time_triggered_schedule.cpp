@@ -0,0 +1,184 @@
+#include "../include/time_triggered_schedule.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+// Constructor, frameSize is the payload of a frame - 8 bytes (classic) or 64 bytes (CAN-FD)
+TimeTriggeredSchedule::TimeTriggeredSchedule(std::chrono::microseconds cycle, uint32_t bitrate, size_t frameSize)
+    : cycle(cycle), bitrate(bitrate), frameSize(frameSize)
+{
+    if (cycle.count() <= 0)
+        throw std::invalid_argument("Schedule cycle must be positive");
+    if (bitrate == 0)
+        throw std::invalid_argument("Schedule bit rate must be positive");
+    if (frameSize != SIZE_PACKET && frameSize != SIZE_PACKET_FD)
+        throw std::invalid_argument("Frame size must be 8 (classic) or 64 (CAN-FD) bytes");
+}
+
+// Reads a schedule file - cycle_us, bitrate, can_fd and "slot = start_us length_us id..." lines
+TimeTriggeredSchedule TimeTriggeredSchedule::loadFromFile(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Cannot open schedule: " + path);
+
+    int64_t cycleUs = 0;
+    uint32_t bitrate = SCHEDULE_DEFAULT_BITRATE;
+    bool canFD = false;
+    std::vector<std::pair<int, std::string>> slotLines;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            if (line.find_first_not_of(" \t\r") != std::string::npos)
+                throw std::invalid_argument(path + ":" + std::to_string(lineNumber) + ": expected key = value");
+            continue;
+        }
+
+        std::string key;
+        std::istringstream(line.substr(0, equals)) >> key;
+        std::string value = line.substr(equals + 1);
+        try {
+            if (key == "cycle_us")
+                cycleUs = std::stoll(value);
+            else if (key == "bitrate")
+                bitrate = std::stoul(value);
+            else if (key == "can_fd") {
+                std::string flag;
+                std::istringstream(value) >> flag;
+                canFD = flag == "true" || flag == "1";
+            }
+            else if (key == "slot")
+                slotLines.emplace_back(lineNumber, value);
+            else
+                throw std::invalid_argument("unknown key " + key);
+        }
+        catch (const std::exception &e) {
+            throw std::invalid_argument(path + ":" + std::to_string(lineNumber) + ": " + e.what());
+        }
+    }
+
+    // Slots are read last, the cycle may come after them in the file
+    TimeTriggeredSchedule schedule(std::chrono::microseconds(cycleUs), bitrate, canFD ? SIZE_PACKET_FD : SIZE_PACKET);
+    for (auto &slotLine : slotLines) {
+        std::istringstream tokens(slotLine.second);
+        int64_t start, length;
+        if (!(tokens >> start >> length))
+            throw std::invalid_argument(path + ":" + std::to_string(slotLine.first) + ": expected slot = start_us length_us id...");
+
+        std::vector<uint32_t> ids;
+        std::string id;
+        while (tokens >> id) {
+            if (id == "*")
+                continue;
+            try {
+                ids.push_back(std::stoul(id, nullptr, 0));
+            }
+            catch (const std::exception &) {
+                throw std::invalid_argument(path + ":" + std::to_string(slotLine.first) + ": invalid ID " + id);
+            }
+        }
+        schedule.addSlot(std::chrono::microseconds(start), std::chrono::microseconds(length), ids);
+    }
+    return schedule;
+}
+
+// Adds a window, ids empty or "*" in the file for an arbitrating window
+void TimeTriggeredSchedule::addSlot(std::chrono::microseconds start, std::chrono::microseconds length, const std::vector<uint32_t> &ids)
+{
+    if (start.count() < 0 || length.count() <= 0)
+        throw std::invalid_argument("Slot start must not be negative and its length must be positive");
+
+    ScheduleSlot slot = {start, length, ids};
+    std::sort(slot.ids.begin(), slot.ids.end());
+    auto position = std::upper_bound(slots.begin(), slots.end(), slot, [](const ScheduleSlot &a, const ScheduleSlot &b) {
+        return a.start < b.start;
+    });
+    slots.insert(position, slot);
+}
+
+// Returns the length of the cycle
+std::chrono::microseconds TimeTriggeredSchedule::getCycle() const
+{
+    return cycle;
+}
+
+// Returns the windows sorted by start
+const std::vector<ScheduleSlot> &TimeTriggeredSchedule::getSlots() const
+{
+    return slots;
+}
+
+// Checks if the ID owns a window
+bool TimeTriggeredSchedule::isScheduled(uint32_t id) const
+{
+    for (const ScheduleSlot &slot : slots)
+        if (std::binary_search(slot.ids.begin(), slot.ids.end(), id))
+            return true;
+    return false;
+}
+
+// Checks if the ID may transmit in the window
+bool TimeTriggeredSchedule::isAllowed(const ScheduleSlot &slot, uint32_t id) const
+{
+    if (slot.ids.empty())
+        return !isScheduled(id);
+    return std::binary_search(slot.ids.begin(), slot.ids.end(), id);
+}
+
+// Checks if the ID may transmit in any window
+bool TimeTriggeredSchedule::hasSlotFor(uint32_t id) const
+{
+    for (const ScheduleSlot &slot : slots)
+        if (isAllowed(slot, id))
+            return true;
+    return false;
+}
+
+// Returns the worst case time of a full frame on the wire, with bit stuffing
+std::chrono::nanoseconds TimeTriggeredSchedule::frameTime() const
+{
+    // Standard ID frame: 34 stuffed control bits, 13 unstuffed trailer bits, one stuff bit per 4 bits at worst.
+    // CAN-FD frames are counted at the same bit rate, without the faster data phase.
+    uint64_t dataBits = 8 * frameSize;
+    uint64_t bits = 34 + dataBits + 13 + (34 + dataBits - 1) / 4;
+    return std::chrono::nanoseconds(bits * 1000000000ull / bitrate);
+}
+
+// Returns the number of full frames that fit in the window
+size_t TimeTriggeredSchedule::slotCapacity(const ScheduleSlot &slot) const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(slot.length) / frameTime();
+}
+
+// Returns the share of the cycle that the windows reserve
+double TimeTriggeredSchedule::utilisation() const
+{
+    std::chrono::microseconds reserved(0);
+    for (const ScheduleSlot &slot : slots)
+        reserved += slot.length;
+    return (double)reserved.count() / cycle.count();
+}
+
+// Returns the problems of the schedule - windows outside the cycle, overlapping or shorter than a frame
+std::vector<std::string> TimeTriggeredSchedule::validate() const
+{
+    std::vector<std::string> problems;
+    if (slots.empty())
+        problems.push_back("the schedule has no slots");
+
+    for (size_t i = 0; i < slots.size(); ++i) {
+        const ScheduleSlot &slot = slots[i];
+        std::string name = "slot at " + std::to_string(slot.start.count()) + "us";
+        if (slot.start + slot.length > cycle)
+            problems.push_back(name + " ends after the cycle");
+        if (slotCapacity(slot) == 0)
+            problems.push_back(name + " is shorter than a frame (" + std::to_string(frameTime().count() / 1000) + "us)");
+        if (i + 1 < slots.size() && slot.start + slot.length > slots[i + 1].start)
+            problems.push_back(name + " overlaps the slot at " + std::to_string(slots[i + 1].start.count()) + "us");
+    }
+    return problems;
+}
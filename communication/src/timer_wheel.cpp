@@ -0,0 +1,91 @@
+#include "../include/timer_wheel.h"
+
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+// Constructor, start is the first tick to process
+TimerWheel::TimerWheel(uint64_t start) : current(start), count(0)
+{
+}
+
+// Puts the timer in the slot for its distance from the current tick
+void TimerWheel::place(const WheelTimer &timer)
+{
+    uint64_t expiry = timer.expiry < current ? current : timer.expiry;
+    // Timers beyond the top level wait in its last slot and are placed again from there
+    uint64_t range = 1ull << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS);
+    if (expiry - current >= range)
+        expiry = current + range - 1;
+
+    int level = 0;
+    while (level + 1 < TIMER_WHEEL_LEVELS && expiry - current >= 1ull << (TIMER_WHEEL_BITS * (level + 1)))
+        level++;
+    slots[level][(expiry >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK].push_back(timer);
+}
+
+// Moves the timers of the higher levels whose slots come up at the current tick down
+void TimerWheel::cascade()
+{
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+        // A level's slot comes up when the bits of all the levels below it wrap to zero
+        if (current & ((1ull << (TIMER_WHEEL_BITS * level)) - 1))
+            break;
+        std::vector<WheelTimer> moving;
+        moving.swap(slots[level][(current >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK]);
+        for (const WheelTimer &timer : moving)
+            place(timer);
+    }
+}
+
+// Adds a timer, a tick that was already processed fires at the next one
+void TimerWheel::schedule(uint32_t id, uint64_t expiry)
+{
+    place({expiry, id});
+    count++;
+}
+
+// Processes the ticks before until and appends the timers that fired
+void TimerWheel::advance(uint64_t until, std::vector<WheelTimer> &expired)
+{
+    // The timers of the current tick are always on the lowest level
+    while (current < until) {
+        // Empty ticks are skipped, nextTick never passes a tick where timers move down
+        uint64_t next = nextTick();
+        if (next > current) {
+            current = next < until ? next : until;
+            cascade();
+            continue;
+        }
+
+        std::vector<WheelTimer> &slot = slots[0][current & TIMER_WHEEL_MASK];
+        count -= slot.size();
+        expired.insert(expired.end(), slot.begin(), slot.end());
+        slot.clear();
+        current++;
+        cascade();
+    }
+}
+
+// Returns the first tick that may have timers - a tick with timers or where far timers move down, UINT64_MAX if empty
+uint64_t TimerWheel::nextTick() const
+{
+    if (count == 0)
+        return UINT64_MAX;
+    uint64_t boundary = (current | TIMER_WHEEL_MASK) + 1;
+    for (uint64_t tick = current; tick < boundary; ++tick)
+        if (!slots[0][tick & TIMER_WHEEL_MASK].empty())
+            return tick;
+    return boundary;
+}
+
+// Returns the next tick to process
+uint64_t TimerWheel::getCurrent() const
+{
+    return current;
+}
+
+// Returns the number of timers
+size_t TimerWheel::size() const
+{
+    return count;
+}
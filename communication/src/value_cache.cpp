@@ -0,0 +1,100 @@
+#include "../include/value_cache.h"
+#include "../include/message.h"
+
+// Constructor
+ValueCache::ValueCache() : storeCount(0)
+{
+}
+
+// Checks if the frame belongs to a message worth keeping
+bool ValueCache::isCacheable(const Packet &p)
+{
+    return p.header.type == FrameType::DATA && !p.header.RTR && !p.header.isBulk && !p.header.isDelta && !p.header.isRpc &&
+           Message::isValidTps(p) && p.header.PSN < p.header.TPS;
+}
+
+// Adds a frame, its message becomes the value of its stream once all its frames arrived
+void ValueCache::store(const Packet &p)
+{
+    if (!isCacheable(p))
+        return;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    StreamKey key(p.header.ID, p.header.SrcID, p.header.DestID);
+    Assembly &assembly = assemblies[key];
+    // A frame of a newer message drops the unfinished one
+    if (assembly.packets.empty() || assembly.srcID != p.header.SrcID || assembly.msn != p.header.MSN || assembly.packets.size() != p.header.TPS) {
+        assembly.srcID = p.header.SrcID;
+        assembly.msn = p.header.MSN;
+        assembly.packets.assign(p.header.TPS, Packet());
+        assembly.received.assign(p.header.TPS, false);
+        assembly.count = 0;
+    }
+    // Retransmissions of a reliable message repeat frames
+    if (assembly.received[p.header.PSN])
+        return;
+    assembly.received[p.header.PSN] = true;
+    assembly.packets[p.header.PSN] = p;
+    if (++assembly.count < p.header.TPS)
+        return;
+
+    Entry &entry = values[key];
+    entry.packets.swap(assembly.packets);
+    entry.stored = storeCount++;
+    assemblies.erase(key);
+
+    if (values.size() > VALUE_CACHE_LIMIT) {
+        auto oldest = values.begin();
+        for (auto it = values.begin(); it != values.end(); ++it)
+            if (it->second.stored < oldest->second.stored)
+                oldest = it;
+        values.erase(oldest);
+    }
+}
+
+// Copies the frames of the last value of the ID that the source sent to the client or broadcast, false if there is none
+bool ValueCache::lookup(uint32_t id, uint32_t srcID, uint32_t clientID, std::vector<Packet> &packets)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    // The streams of the ID and source are next to each other, the newest one the client may see wins
+    const Entry *found = nullptr;
+    for (auto it = values.lower_bound(StreamKey(id, srcID, 0)); it != values.end(); ++it) {
+        if (std::get<0>(it->first) != id || std::get<1>(it->first) != srcID)
+            break;
+        const Packet::Header &header = it->second.packets.front().header;
+        if ((header.isBroadcast || header.DestID == clientID) && (!found || it->second.stored > found->stored))
+            found = &it->second;
+    }
+    if (!found)
+        return false;
+    packets = found->packets;
+    return true;
+}
+
+// Returns the last values that the client would have received - sent to it or broadcast
+std::vector<std::vector<Packet>> ValueCache::snapshotFor(uint32_t clientID)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    std::vector<std::vector<Packet>> snapshot;
+    for (auto &value : values) {
+        const Packet::Header &header = value.second.packets.front().header;
+        if ((header.isBroadcast && header.SrcID != clientID) || header.DestID == clientID)
+            snapshot.push_back(value.second.packets);
+    }
+    return snapshot;
+}
+
+// Returns the number of streams with a value
+size_t ValueCache::size()
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return values.size();
+}
+
+// Forgets all the values
+void ValueCache::clear()
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    assemblies.clear();
+    values.clear();
+}
@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../include/bus_bridge.h"
+#include "../include/bus_manager.h"
+#include "../include/communication.h"
+
+// Drops the data of passData, the messages of these tests come to the RPC handler with their size
+static void dropData(uint32_t, void *data)
+{
+    free(data);
+}
+
+// Keeps the messages that reached a process
+struct Received
+{
+    std::mutex mutex;
+    std::vector<std::vector<uint8_t>> messages;
+};
+
+// Waits until the process received the number of messages or a second passed
+static void waitForMessages(Received &received, size_t count)
+{
+    for (int i = 0; i < 200; ++i) {
+        {
+            std::lock_guard<std::mutex> lock(received.mutex);
+            if (received.messages.size() >= count)
+                return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
+
+// Connects a process that keeps the messages it receives in received
+static std::unique_ptr<Communication> connectProcess(uint32_t id, int port, size_t bulkThreshold, Received &received)
+{
+    std::unique_ptr<Communication> process(new Communication(id, dropData));
+    process->setServerAddress("127.0.0.1", port);
+    process->setBulkThreshold(bulkThreshold);
+    process->setRpcHandler([&received](uint32_t, void *data, size_t size) {
+        std::lock_guard<std::mutex> lock(received.mutex);
+        received.messages.emplace_back((uint8_t *)data, (uint8_t *)data + size);
+        free(data);
+    });
+    EXPECT_EQ(process->startConnection(), ErrorCode::SUCCESS);
+    return process;
+}
+
+// Test that large messages reach a process that reads the bulk regions, and one that asked the bus for no bulk messages
+TEST(BulkChannelTest, RefusedBulkFallsBackToFragments) {
+    const int port = 8096;
+    BusManager *bus = BusManager::getInstance({}, 0, port);
+    ASSERT_EQ(bus->startConnection(), ErrorCode::SUCCESS);
+
+    Received bulkReceived, fragmentReceived, unused;
+    std::unique_ptr<Communication> bulkReceiver = connectProcess(2, port, BULK_THRESHOLD, bulkReceived);
+    std::unique_ptr<Communication> fragmentReceiver = connectProcess(3, port, 0, fragmentReceived);
+    std::unique_ptr<Communication> sender = connectProcess(1, port, BULK_THRESHOLD, unused);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::vector<uint8_t> data(BULK_THRESHOLD * 4);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (uint8_t)(i * 7);
+    for (int i = 0; i < 3; ++i) {
+        data[0] = (uint8_t)i;
+        EXPECT_EQ(sender->sendRpcMessage(data.data(), data.size(), 2, 1), ErrorCode::SUCCESS);
+        EXPECT_EQ(sender->sendRpcMessage(data.data(), data.size(), 3, 1), ErrorCode::SUCCESS);
+    }
+
+    waitForMessages(bulkReceived, 3);
+    waitForMessages(fragmentReceived, 3);
+    for (Received *received : {&bulkReceived, &fragmentReceived}) {
+        std::lock_guard<std::mutex> lock(received->mutex);
+        ASSERT_EQ(received->messages.size(), 3u);
+        for (size_t i = 0; i < 3; ++i) {
+            data[0] = (uint8_t)i;
+            EXPECT_EQ(received->messages[i], data);
+        }
+    }
+
+    sender.reset();
+    fragmentReceiver.reset();
+    bulkReceiver.reset();
+    bus->stopConnection();
+    delete bus;
+}
+
+// Test that a large message for a client behind the bridge crosses it as fragments, not as a bulk descriptor
+TEST(BulkChannelTest, BridgedDestinationGetsFragments) {
+    const int port = 8097;
+    const int bridgePort = 8098;
+    std::mutex framesMutex;
+    std::vector<Packet> frames;
+    BusBridge otherBus([&](Packet &p) {
+        std::lock_guard<std::mutex> lock(framesMutex);
+        frames.push_back(p);
+    });
+    ASSERT_EQ(otherBus.listen(bridgePort), ErrorCode::SUCCESS);
+
+    BusManager *bus = BusManager::getInstance({}, 0, port);
+    ASSERT_EQ(bus->startConnection(), ErrorCode::SUCCESS);
+    ASSERT_EQ(bus->connectBridge("127.0.0.1", bridgePort), ErrorCode::SUCCESS);
+
+    Received unused;
+    std::unique_ptr<Communication> sender = connectProcess(1, port, BULK_THRESHOLD, unused);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // Not compressible, the frames carry all of it
+    std::vector<uint8_t> data(BULK_THRESHOLD * 2);
+    uint32_t random = 1;
+    for (uint8_t &byte : data) {
+        random = random * 1103515245 + 12345;
+        byte = (uint8_t)(random >> 16);
+    }
+    EXPECT_EQ(sender->sendRpcMessage(data.data(), data.size(), 5, 1), ErrorCode::SUCCESS);
+
+    size_t fragments = 0;
+    for (int i = 0; i < 200 && fragments * SIZE_PACKET < data.size(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        std::lock_guard<std::mutex> lock(framesMutex);
+        fragments = frames.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(framesMutex);
+        EXPECT_GE(frames.size() * SIZE_PACKET, data.size());
+        for (const Packet &frame : frames) {
+            EXPECT_FALSE(frame.header.isBulk);
+            EXPECT_EQ(frame.header.DestID, 5u);
+        }
+    }
+
+    sender.reset();
+    bus->stopConnection();
+    delete bus;
+    otherBus.stop();
+}
+
+// Test that a sender whose receiver is slow keeps the regions it did not read and sends the rest as fragments
+TEST(BulkChannelTest, SlowReceiverLosesNoRegion) {
+    const int port = 8105;
+    const size_t messages = MAX_PENDING_BULKS + 44;
+    BusManager *bus = BusManager::getInstance({}, 0, port);
+    ASSERT_EQ(bus->startConnection(), ErrorCode::SUCCESS);
+
+    Received received;
+    std::unique_ptr<Communication> receiver(new Communication(2, dropData));
+    receiver->setServerAddress("127.0.0.1", port);
+    receiver->setRpcHandler([&received](uint32_t, void *data, size_t size) {
+        std::lock_guard<std::mutex> lock(received.mutex);
+        // Reads nothing else while the sender publishes more regions than it keeps
+        if (received.messages.empty())
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        received.messages.emplace_back((uint8_t *)data, (uint8_t *)data + size);
+        free(data);
+    });
+    ASSERT_EQ(receiver->startConnection(), ErrorCode::SUCCESS);
+    Received unused;
+    std::unique_ptr<Communication> sender = connectProcess(1, port, BULK_THRESHOLD, unused);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::vector<uint8_t> data(BULK_THRESHOLD);
+    for (size_t i = 0; i < messages; ++i) {
+        data[0] = (uint8_t)i;
+        data[1] = (uint8_t)(i >> 8);
+        EXPECT_EQ(sender->sendRpcMessage(data.data(), data.size(), 2, 1), ErrorCode::SUCCESS);
+    }
+
+    // The first message alone holds the receiver for half a second
+    for (int i = 0; i < 10; ++i)
+        waitForMessages(received, messages);
+    {
+        std::lock_guard<std::mutex> lock(received.mutex);
+        ASSERT_EQ(received.messages.size(), messages);
+        for (size_t i = 0; i < messages; ++i) {
+            data[0] = (uint8_t)i;
+            data[1] = (uint8_t)(i >> 8);
+            EXPECT_EQ(received.messages[i], data) << i;
+        }
+    }
+
+    // The receiver read every region
+    for (uint32_t seq = 0; seq < messages; ++seq)
+        EXPECT_NE(access(("/dev/shm" + BulkChannel::regionName(1, seq)).c_str(), F_OK), 0) << seq;
+
+    sender.reset();
+    receiver.reset();
+    bus->stopConnection();
+    delete bus;
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include "../include/bus_bridge.h"
+#include "../include/message.h"
+
+// Checks that two frames carry the same header fields and data
+static void expectSameFrame(const Packet &a, const Packet &b)
+{
+    EXPECT_EQ(a.header.ID, b.header.ID);
+    EXPECT_EQ(a.header.PSN, b.header.PSN);
+    EXPECT_EQ(a.header.TPS, b.header.TPS);
+    EXPECT_EQ(a.header.MSN, b.header.MSN);
+    EXPECT_EQ(a.header.SrcID, b.header.SrcID);
+    EXPECT_EQ(a.header.DestID, b.header.DestID);
+    EXPECT_EQ(a.header.DLC, b.header.DLC);
+    EXPECT_EQ(a.header.CRC, b.header.CRC);
+    EXPECT_EQ(a.header.timestamp, b.header.timestamp);
+    EXPECT_EQ(a.header.isBroadcast, b.header.isBroadcast);
+    EXPECT_EQ(a.header.isFD, b.header.isFD);
+    EXPECT_EQ(a.header.padding, b.header.padding);
+    EXPECT_EQ(a.header.type, b.header.type);
+    EXPECT_EQ(a.header.flowID, b.header.flowID);
+    EXPECT_EQ(std::memcmp(a.data, b.data, a.getDataLength()), 0);
+}
+
+// Test that frames of several messages survive the encoding
+TEST(BridgeCodecTest, RoundTrip) {
+    std::vector<uint8_t> data(300);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<uint8_t>(i);
+    Message classic(1, data.data(), data.size(), false, 2, SIZE_PACKET, 5);
+    Message fd(3, data.data(), 100, true, 0xFFFF, SIZE_PACKET_FD, 9);
+
+    std::vector<Packet> frames = classic.getPackets();
+    frames.insert(frames.begin() + 3, fd.getPackets().begin(), fd.getPackets().end());
+    frames[1].header.timestamp -= 1000;
+    // The trace flow crosses the bridge with the message
+    for (size_t i = 3; i < 3 + fd.getPackets().size(); ++i)
+        frames[i].header.flowID = 77;
+
+    BridgeCodec encoder, decoder;
+    std::vector<uint8_t> buffer;
+    for (const Packet &frame : frames)
+        encoder.encode(frame, buffer);
+    // Continuation frames leave the header out
+    EXPECT_LT(buffer.size(), frames.size() * 20);
+
+    const uint8_t *position = buffer.data();
+    const uint8_t *end = position + buffer.size();
+    for (const Packet &frame : frames) {
+        Packet decoded;
+        ASSERT_TRUE(decoder.decode(position, end, decoded));
+        expectSameFrame(decoded, frame);
+    }
+    EXPECT_EQ(position, end);
+}
+
+// Test that a truncated frame is rejected
+TEST(BridgeCodecTest, TruncatedFrame) {
+    uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    Packet packet(10, 0, 1, 4, 6, data, sizeof(data), false);
+    BridgeCodec encoder, decoder;
+    std::vector<uint8_t> buffer;
+    encoder.encode(packet, buffer);
+
+    const uint8_t *position = buffer.data();
+    Packet decoded;
+    EXPECT_FALSE(decoder.decode(position, buffer.data() + buffer.size() - 1, decoded));
+}
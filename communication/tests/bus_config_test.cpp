@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include "../include/bus_config.h"
+#include "../include/bus_manager.h"
+#include "../include/client_connection.h"
+
+// Writes the text to a file and reads it as a config
+static BusConfig load(const std::string &text)
+{
+    const char *path = "bus_config_test.conf";
+    {
+        std::ofstream file(path);
+        file << text;
+    }
+    try {
+        BusConfig config = BusConfig::loadFromFile(path);
+        std::remove(path);
+        return config;
+    }
+    catch (...) {
+        std::remove(path);
+        throw;
+    }
+}
+
+// Test that every key is read
+TEST(BusConfigTest, LoadAllKeys) {
+    BusConfig config = load("# bus\nport = 9090\nids = 1 0x10\nlimit = 2\ntransport = socket\n"
+                            "scheduler = time_triggered\nschedule_file = slots.conf\nclock = lockstep\nclock_step_us = 500\n"
+                            "clock_speed = 2.5\nbridge_connect = 10.0.0.2:9000\nbridge_routes = 7 8\nvalue_cache = true\n"
+                            "replay_on_connect = 1\nio_cpus = 0 1\nscheduler_cpus = 2\n");
+    EXPECT_EQ(config.port, 9090);
+    EXPECT_EQ(config.ids, (std::vector<uint32_t>{1, 0x10}));
+    EXPECT_EQ(config.limit, 2u);
+    EXPECT_EQ(config.scheduler, SchedulerMode::TIME_TRIGGERED);
+    EXPECT_EQ(config.scheduleFile, "slots.conf");
+    EXPECT_EQ(config.clockMode, ClockMode::LOCKSTEP);
+    EXPECT_EQ(config.clockStepUs, 500u);
+    EXPECT_DOUBLE_EQ(config.clockSpeed, 2.5);
+    EXPECT_EQ(config.bridgeHost, "10.0.0.2");
+    EXPECT_EQ(config.bridgePort, 9000);
+    EXPECT_EQ(config.bridgeRoutes, (std::vector<uint32_t>{7, 8}));
+    EXPECT_TRUE(config.valueCache);
+    EXPECT_TRUE(config.replayOnConnect);
+    EXPECT_EQ(config.ioCpus, (std::vector<int>{0, 1}));
+    EXPECT_EQ(config.schedulerCpus, (std::vector<int>{2}));
+    EXPECT_TRUE(config.validate().empty());
+}
+
+// Test that mistakes in the file name their line
+TEST(BusConfigTest, RejectsMalformedLines) {
+    EXPECT_THROW(load("port = 1\nunknown = 3\n"), std::invalid_argument);
+    EXPECT_THROW(load("transport = carrier_pigeon\n"), std::invalid_argument);
+    EXPECT_THROW(load("value_cache = maybe\n"), std::invalid_argument);
+    try {
+        load("\nports 8080\n");
+        FAIL();
+    }
+    catch (const std::invalid_argument &e) {
+        EXPECT_NE(std::string(e.what()).find(":2:"), std::string::npos);
+    }
+}
+
+// Test that the pooled transport refuses the options it does not support
+TEST(BusConfigTest, PooledTransportIsForwardingOnly) {
+    BusConfig config;
+    config.transport = BusTransport::POOLED;
+    EXPECT_TRUE(config.validate().empty());
+
+    config.scheduler = SchedulerMode::TIME_TRIGGERED;
+    config.valueCache = true;
+    config.bridgeListenPort = 9000;
+    config.ioCpus = {-1};
+    config.limit = 2;
+    // No schedule file, no scheduler, no value cache, no bridge, no limit and an invalid CPU
+    EXPECT_EQ(config.validate().size(), 6u);
+}
+
+// Test that the bus accepts only the configured IDs, and no more of them than the limit
+TEST(BusConfigTest, BusEnforcesIdsAndLimit) {
+    const int port = 8103;
+    BusManager *bus = BusManager::getInstance({1, 2, 3}, 2, port);
+    ASSERT_EQ(bus->startConnection(), ErrorCode::SUCCESS);
+
+    std::vector<std::unique_ptr<ClientConnection>> clients;
+    // 4 is not listed, 3 comes after the limit is reached
+    for (uint32_t id : {4u, 1u, 2u, 3u}) {
+        clients.emplace_back(new ClientConnection([](Packet &) {}));
+        clients.back()->setServerAddress("127.0.0.1", port);
+        ASSERT_EQ(clients.back()->connectToServer(id), ErrorCode::SUCCESS);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    // The bus closes a refused connection
+    for (int i = 0; i < 100 && (clients[0]->isConnected() || clients[3]->isConnected()); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_FALSE(clients[0]->isConnected());
+    EXPECT_TRUE(clients[1]->isConnected());
+    EXPECT_TRUE(clients[2]->isConnected());
+    EXPECT_FALSE(clients[3]->isConnected());
+
+    for (auto &client : clients)
+        client->closeConnection();
+    bus->stopConnection();
+    delete bus;
+}
+
+// Test that the bus refuses a second client with the ID of a connected one
+TEST(BusConfigTest, BusRefusesDuplicateId) {
+    const int port = 8106;
+    BusManager *bus = BusManager::getInstance({}, 0, port);
+    ASSERT_EQ(bus->startConnection(), ErrorCode::SUCCESS);
+
+    std::vector<std::unique_ptr<ClientConnection>> clients;
+    for (int i = 0; i < 2; ++i) {
+        clients.emplace_back(new ClientConnection([](Packet &) {}));
+        clients.back()->setServerAddress("127.0.0.1", port);
+        ASSERT_EQ(clients.back()->connectToServer(1), ErrorCode::SUCCESS);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    for (int i = 0; i < 100 && clients[1]->isConnected(); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_TRUE(clients[0]->isConnected());
+    EXPECT_FALSE(clients[1]->isConnected());
+
+    for (auto &client : clients)
+        client->closeConnection();
+    bus->stopConnection();
+    delete bus;
+}
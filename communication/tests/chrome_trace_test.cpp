@@ -0,0 +1,337 @@
+#include <gtest/gtest.h>
+#include <cctype>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "../include/packet.h"
+#include "../../logger/chrome_trace.h"
+
+// Fields of one event, nested objects as their JSON text
+typedef std::map<std::string, std::string> ChromeEvent;
+
+static std::string tracePath(const std::string &name)
+{
+    return "/tmp/chrome_trace_test_" + std::to_string(getpid()) + "_" + name + ".json";
+}
+
+static std::string readFile(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+static void writeFile(const std::string &path, const std::string &content)
+{
+    std::ofstream file(path, std::ios::binary);
+    file << content;
+}
+
+static void skipSpace(const std::string &text, size_t &position)
+{
+    while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position])))
+        position++;
+}
+
+static bool parseValue(const std::string &text, size_t &position, std::string &value);
+
+static bool parseString(const std::string &text, size_t &position, std::string &value)
+{
+    if (position >= text.size() || text[position] != '"')
+        return false;
+    value.clear();
+    for (position++; position < text.size(); position++) {
+        if (text[position] == '"') {
+            position++;
+            return true;
+        }
+        if (text[position] == '\\' && ++position == text.size())
+            return false;
+        value += text[position];
+    }
+    return false;
+}
+
+// Parses an object, its fields go to fields when it is given
+static bool parseObject(const std::string &text, size_t &position, ChromeEvent *fields)
+{
+    if (position >= text.size() || text[position] != '{')
+        return false;
+    position++;
+    skipSpace(text, position);
+    if (position < text.size() && text[position] == '}')
+        return ++position, true;
+    while (true) {
+        std::string name, value;
+        skipSpace(text, position);
+        if (!parseString(text, position, name))
+            return false;
+        skipSpace(text, position);
+        if (position >= text.size() || text[position++] != ':')
+            return false;
+        skipSpace(text, position);
+        if (!parseValue(text, position, value))
+            return false;
+        if (fields)
+            (*fields)[name] = value;
+        skipSpace(text, position);
+        if (position >= text.size())
+            return false;
+        if (text[position] == '}')
+            return ++position, true;
+        if (text[position++] != ',')
+            return false;
+    }
+}
+
+static bool parseValue(const std::string &text, size_t &position, std::string &value)
+{
+    size_t start = position;
+    if (position < text.size() && text[position] == '"')
+        return parseString(text, position, value);
+    if (position < text.size() && text[position] == '{') {
+        if (!parseObject(text, position, nullptr))
+            return false;
+        value = text.substr(start, position - start);
+        return true;
+    }
+    // A number - the only other values of a trace
+    while (position < text.size() && std::strchr("-+.eE0123456789", text[position]))
+        position++;
+    value = text.substr(start, position - start);
+    char *end = nullptr;
+    std::strtod(value.c_str(), &end);
+    return !value.empty() && *end == '\0';
+}
+
+// Parses a trace as chrome://tracing loads it, false if it is not a JSON array of objects
+static bool parseTrace(const std::string &text, std::vector<ChromeEvent> &events)
+{
+    size_t position = 0;
+    skipSpace(text, position);
+    if (position >= text.size() || text[position++] != '[')
+        return false;
+    while (true) {
+        skipSpace(text, position);
+        ChromeEvent event;
+        if (!parseObject(text, position, &event))
+            return false;
+        events.push_back(event);
+        skipSpace(text, position);
+        if (position >= text.size())
+            return false;
+        if (text[position] == ']')
+            break;
+        if (text[position++] != ',')
+            return false;
+    }
+    position++;
+    skipSpace(text, position);
+    return position == text.size();
+}
+
+// The events of the phase, in the order of the file
+static std::vector<ChromeEvent> withPhase(const std::vector<ChromeEvent> &events, const std::string &phase)
+{
+    std::vector<ChromeEvent> found;
+    for (const ChromeEvent &event : events)
+        if (event.at("ph") == phase)
+            found.push_back(event);
+    return found;
+}
+
+// The event of the phase and name, an empty one if there is none
+static ChromeEvent find(const std::vector<ChromeEvent> &events, const std::string &phase, const std::string &name)
+{
+    for (const ChromeEvent &event : events)
+        if (event.at("ph") == phase && event.at("name") == name)
+            return event;
+    return ChromeEvent();
+}
+
+// Writes a span on the thread, an instant event and a flow into a span of another thread
+static void writeTrace(const std::string &path, const char *processName)
+{
+    ASSERT_TRUE(ChromeTrace::start(path, processName));
+    uint32_t flow = ChromeTrace::newFlow();
+    EXPECT_NE(flow, 0u);
+    {
+        TRACE_SPAN("send", "communication");
+        ChromeTrace::flowStart(flow, "communication");
+        ChromeTrace::instant("drop", "communication", 3, 1);
+    }
+    std::thread receiver([flow]() {
+        ChromeTrace::FlowScope scope(flow);
+        EXPECT_EQ(ChromeTrace::currentFlow(), flow);
+        TRACE_SPAN("receive", "communication");
+        ChromeTrace::flowEnd(flow, "communication");
+    });
+    receiver.join();
+    EXPECT_EQ(ChromeTrace::currentFlow(), 0u);
+    ChromeTrace::stop();
+}
+
+// Runs the body in a child process that leaves with _exit, as a process that dies does
+template <typename Body>
+static pid_t runChild(Body body)
+{
+    pid_t child = fork();
+    if (child == 0) {
+        body();
+        _exit(0);
+    }
+    return child;
+}
+
+// Test that the trace flow ID fills the alignment gap at the end of the header and the frame keeps its size
+TEST(ChromeTraceTest, PacketKeepsItsSize) {
+    EXPECT_EQ(sizeof(Packet), 120u);
+    EXPECT_EQ(offsetof(Packet::Header, flowID) + sizeof(uint32_t), sizeof(Packet::Header));
+}
+
+// Test that spans, an instant event and a flow across threads are written as a loadable trace
+TEST(ChromeTraceTest, EventsParse) {
+    std::string path = tracePath("events");
+    writeTrace(path, "chrome \"test\"");
+    EXPECT_FALSE(ChromeTrace::isEnabled());
+
+    std::vector<ChromeEvent> events;
+    ASSERT_TRUE(parseTrace(readFile(path), events)) << readFile(path);
+    std::string pid = std::to_string(getpid());
+    for (const ChromeEvent &event : events)
+        EXPECT_EQ(event.at("pid"), pid);
+    ASSERT_EQ(events[0].at("ph"), "M");
+    EXPECT_EQ(events[0].at("args"), "{\"name\":\"chrome \\\"test\\\"\"}");
+
+    // Each thread writes its own buffer, the receiving thread first as it ends first
+    ASSERT_EQ(withPhase(events, "B").size(), 2u);
+    ASSERT_EQ(withPhase(events, "E").size(), 2u);
+    ChromeEvent send = find(events, "B", "send");
+    ChromeEvent receive = find(events, "B", "receive");
+    ASSERT_FALSE(send.empty());
+    ASSERT_FALSE(receive.empty());
+    for (const ChromeEvent &begin : {send, receive}) {
+        ChromeEvent end = find(events, "E", begin.at("name"));
+        ASSERT_FALSE(end.empty());
+        EXPECT_EQ(begin.at("tid"), end.at("tid"));
+        EXPECT_LE(std::stod(begin.at("ts")), std::stod(end.at("ts")));
+    }
+    EXPECT_NE(send.at("tid"), receive.at("tid"));
+
+    std::vector<ChromeEvent> instants = withPhase(events, "i");
+    ASSERT_EQ(instants.size(), 1u);
+    EXPECT_EQ(instants[0].at("name"), "drop");
+    EXPECT_EQ(instants[0].at("s"), "t");
+    EXPECT_EQ(instants[0].at("args"), "{\"src\":3,\"dst\":1}");
+
+    std::vector<ChromeEvent> starts = withPhase(events, "s");
+    std::vector<ChromeEvent> finishes = withPhase(events, "f");
+    ASSERT_EQ(starts.size(), 1u);
+    ASSERT_EQ(finishes.size(), 1u);
+    EXPECT_EQ(starts[0].at("id"), finishes[0].at("id"));
+    EXPECT_EQ(finishes[0].at("bp"), "e");
+    EXPECT_EQ(starts[0].at("tid"), send.at("tid"));
+    EXPECT_EQ(finishes[0].at("tid"), receive.at("tid"));
+    unlink(path.c_str());
+}
+
+// Test that a trace cut anywhere in its last event, or by a process that died before stop, still loads
+TEST(ChromeTraceTest, CutTraceStaysLoadable) {
+    std::string path = tracePath("cut");
+    writeTrace(path, "cut");
+    std::string complete = readFile(path);
+    std::vector<ChromeEvent> all;
+    ASSERT_TRUE(parseTrace(complete, all));
+
+    size_t lastEvent = complete.rfind(",\n{");
+    size_t lastEnd = complete.rfind('}') + 1;
+    for (size_t length = lastEvent; length < lastEnd; ++length) {
+        writeFile(path, complete.substr(0, length));
+        bool cutShort;
+        std::string text = ChromeTrace::readEvents(path, cutShort);
+        std::vector<ChromeEvent> events;
+        ASSERT_TRUE(parseTrace("[\n" + text + "\n]", events)) << length;
+        EXPECT_EQ(events.size(), all.size() - 1) << length;
+        // Cut inside ",\n{" of the last event only the separator is lost
+        EXPECT_EQ(cutShort, length > lastEvent + 2) << length;
+    }
+
+    // More events than a thread buffers, the last ones never reach the file
+    pid_t child = runChild([&path]() {
+        ChromeTrace::start(path, "dying");
+        for (int i = 0; i < 2 * CHROME_TRACE_BUFFER_EVENTS; ++i)
+            ChromeTrace::instant("tick", "communication", i, 0);
+    });
+    int status;
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+    ASSERT_TRUE(WIFEXITED(status));
+    bool cutShort;
+    std::string text = ChromeTrace::readEvents(path, cutShort);
+    std::vector<ChromeEvent> events;
+    ASSERT_TRUE(parseTrace("[\n" + text + "\n]", events));
+    EXPECT_GT(events.size(), 1u);
+    EXPECT_LT(events.size(), size_t(2 * CHROME_TRACE_BUFFER_EVENTS + 1));
+    unlink(path.c_str());
+}
+
+// Test that the traces of two processes merge into one timeline with a flow from one to the other
+TEST(ChromeTraceTest, MergePerProcessFiles) {
+    std::string paths[2] = {tracePath("sender"), tracePath("receiver")};
+    uint32_t flow = 12345;
+    pid_t children[2];
+    int status;
+    children[0] = runChild([&]() {
+        ChromeTrace::start(paths[0], "sender");
+        {
+            TRACE_SPAN("send", "communication");
+            ChromeTrace::flowStart(flow, "communication");
+        }
+        ChromeTrace::stop();
+    });
+    ASSERT_EQ(waitpid(children[0], &status, 0), children[0]);
+    children[1] = runChild([&]() {
+        ChromeTrace::start(paths[1], "receiver");
+        {
+            TRACE_SPAN("receive", "communication");
+            ChromeTrace::flowEnd(flow, "communication");
+        }
+        ChromeTrace::stop();
+    });
+    ASSERT_EQ(waitpid(children[1], &status, 0), children[1]);
+
+    // As trace_merge joins them
+    std::string merged = "[\n";
+    for (int i = 0; i < 2; ++i) {
+        bool cutShort;
+        merged += (i ? ",\n" : "") + ChromeTrace::readEvents(paths[i], cutShort);
+        EXPECT_FALSE(cutShort);
+        unlink(paths[i].c_str());
+    }
+    merged += "\n]\n";
+
+    std::vector<ChromeEvent> events;
+    ASSERT_TRUE(parseTrace(merged, events)) << merged;
+    std::vector<ChromeEvent> names = withPhase(events, "M");
+    ASSERT_EQ(names.size(), 2u);
+    EXPECT_EQ(names[0].at("pid"), std::to_string(children[0]));
+    EXPECT_EQ(names[1].at("pid"), std::to_string(children[1]));
+
+    std::vector<ChromeEvent> starts = withPhase(events, "s");
+    std::vector<ChromeEvent> finishes = withPhase(events, "f");
+    ASSERT_EQ(starts.size(), 1u);
+    ASSERT_EQ(finishes.size(), 1u);
+    EXPECT_EQ(starts[0].at("id"), std::to_string(flow));
+    EXPECT_EQ(finishes[0].at("id"), std::to_string(flow));
+    EXPECT_EQ(starts[0].at("pid"), std::to_string(children[0]));
+    EXPECT_EQ(finishes[0].at("pid"), std::to_string(children[1]));
+    EXPECT_LT(std::stod(starts[0].at("ts")), std::stod(finishes[0].at("ts")));
+}
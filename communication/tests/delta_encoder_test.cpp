@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include "../include/delta_encoder.h"
+
+// Encodes the data and applies the payload, returns the rebuilt data
+static std::vector<uint8_t> roundTrip(DeltaEncoder &encoder, DeltaDecoder &decoder, const std::vector<uint8_t> &data, size_t &payloadSize)
+{
+    std::vector<uint8_t> payload;
+    EXPECT_TRUE(encoder.encode(data.data(), data.size(), DELTA_FULL_EVERY, 0, payload));
+    payloadSize = payload.size();
+    void *rebuilt;
+    EXPECT_EQ(decoder.decode(payload.data(), payload.size(), rebuilt), DeltaResult::DATA);
+    std::vector<uint8_t> result((uint8_t *)rebuilt, (uint8_t *)rebuilt + data.size());
+    free(rebuilt);
+    return result;
+}
+
+// Test that a small change is sent as a short delta and rebuilt in full
+TEST(DeltaEncoderTest, SmallChangeIsRebuilt) {
+    DeltaEncoder encoder;
+    DeltaDecoder decoder;
+    std::vector<uint8_t> data(200, 7);
+    size_t payloadSize;
+    EXPECT_EQ(roundTrip(encoder, decoder, data, payloadSize), data);
+    EXPECT_GT(payloadSize, data.size());
+
+    data[10] = 1;
+    data[150] = 2;
+    data[151] = 3;
+    EXPECT_EQ(roundTrip(encoder, decoder, data, payloadSize), data);
+    EXPECT_LT(payloadSize, 20u);
+}
+
+// Test that unchanged data is not sent, unless a heartbeat or a full frame is due
+TEST(DeltaEncoderTest, UnchangedDataSendsNothing) {
+    DeltaEncoder encoder;
+    std::vector<uint8_t> data(16, 1);
+    std::vector<uint8_t> payload;
+    ASSERT_TRUE(encoder.encode(data.data(), data.size(), 4, 0, payload));
+    EXPECT_FALSE(encoder.encode(data.data(), data.size(), 4, 0, payload));
+    EXPECT_FALSE(encoder.encode(data.data(), data.size(), 4, 0, payload));
+    EXPECT_FALSE(encoder.encode(data.data(), data.size(), 4, 0, payload));
+    ASSERT_TRUE(encoder.encode(data.data(), data.size(), 4, 0, payload));
+    EXPECT_EQ(payload[0], (uint8_t)DeltaKind::FULL);
+
+    EXPECT_FALSE(encoder.encode(data.data(), data.size(), 4, 2, payload));
+    ASSERT_TRUE(encoder.encode(data.data(), data.size(), 4, 2, payload));
+    EXPECT_EQ(payload[0], (uint8_t)DeltaKind::HEARTBEAT);
+}
+
+// Test that the receiver drops deltas after a lost payload until the next full frame
+TEST(DeltaEncoderTest, LostPayloadWaitsForFullFrame) {
+    DeltaEncoder encoder;
+    DeltaDecoder decoder;
+    std::vector<uint8_t> data(32, 0);
+    std::vector<uint8_t> payload;
+    void *rebuilt;
+    ASSERT_TRUE(encoder.encode(data.data(), data.size(), 3, 0, payload));
+    ASSERT_EQ(decoder.decode(payload.data(), payload.size(), rebuilt), DeltaResult::DATA);
+    free(rebuilt);
+
+    data[0] = 1;
+    ASSERT_TRUE(encoder.encode(data.data(), data.size(), 3, 0, payload)); // Lost
+    data[1] = 1;
+    ASSERT_TRUE(encoder.encode(data.data(), data.size(), 3, 0, payload));
+    EXPECT_EQ(decoder.decode(payload.data(), payload.size(), rebuilt), DeltaResult::MISSING_BASE);
+
+    data[2] = 1;
+    ASSERT_TRUE(encoder.encode(data.data(), data.size(), 3, 0, payload));
+    ASSERT_EQ(payload[0], (uint8_t)DeltaKind::FULL);
+    ASSERT_EQ(decoder.decode(payload.data(), payload.size(), rebuilt), DeltaResult::DATA);
+    EXPECT_EQ(std::vector<uint8_t>((uint8_t *)rebuilt, (uint8_t *)rebuilt + data.size()), data);
+    free(rebuilt);
+}
+
+// Test that a payload with a range outside the data is rejected
+TEST(DeltaEncoderTest, RejectsMalformedPayload) {
+    DeltaEncoder encoder;
+    DeltaDecoder decoder;
+    std::vector<uint8_t> data(8, 0);
+    std::vector<uint8_t> payload;
+    void *rebuilt;
+    ASSERT_TRUE(encoder.encode(data.data(), data.size(), DELTA_FULL_EVERY, 0, payload));
+    ASSERT_EQ(decoder.decode(payload.data(), payload.size(), rebuilt), DeltaResult::DATA);
+    free(rebuilt);
+
+    // Delta of seq 2 over 8 bytes: one range 6 bytes in, 4 bytes long
+    std::vector<uint8_t> bad = {(uint8_t)DeltaKind::DELTA, 2, 8, 1, 6, 4, 1, 2, 3, 4};
+    EXPECT_EQ(decoder.decode(bad.data(), bad.size(), rebuilt), DeltaResult::MALFORMED);
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "../sockets/fault_injection_socket.h"
+
+// Plain socket calls without logging, the decorated end of a socket pair
+class PlainSocket : public ISocket
+{
+public:
+    int socket(int domain, int type, int protocol) override { return ::socket(domain, type, protocol); }
+    int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen) override { return ::setsockopt(sockfd, level, optname, optval, optlen); }
+    int bind(int sockfd, const struct sockaddr *addr, socklen_t addrlen) override { return ::bind(sockfd, addr, addrlen); }
+    int listen(int sockfd, int backlog) override { return ::listen(sockfd, backlog); }
+    int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) override { return ::accept(sockfd, addr, addrlen); }
+    int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) override { return ::connect(sockfd, addr, addrlen); }
+    ssize_t send(int sockfd, const void *buf, size_t len, int flags) override { return ::send(sockfd, buf, len, flags); }
+    ssize_t recv(int sockfd, void *buf, size_t len, int flags) override { return ::recv(sockfd, buf, len, flags); }
+    int close(int fd) override { return ::close(fd); }
+};
+
+class FaultInjectionSocketTest : public ::testing::Test {
+protected:
+    int fds[2];
+    PlainSocket plain;
+
+    void SetUp() override {
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    }
+
+    void TearDown() override {
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+
+    // Builds a frame with a recognizable ID
+    static Packet makeFrame(uint32_t id, FrameType type = FrameType::DATA) {
+        uint8_t data[4] = {1, 2, 3, 4};
+        Packet packet(id, 0, 1, 1, 2, data, sizeof(data), false);
+        packet.header.type = type;
+        return packet;
+    }
+};
+
+// Test that the configuration file sets the options and rejects mistakes
+TEST_F(FaultInjectionSocketTest, LoadsConfigFile) {
+    const char *path = "fault_injection_test.conf";
+    {
+        std::ofstream file(path);
+        file << "# comment\n\nlatency_us = 500\njitter_us=100 # trailing\nrecv_loss = 0.25\nseed = 7\n";
+    }
+    FaultConfig config = FaultConfig::loadFromFile(path);
+    EXPECT_EQ(config.latency.count(), 500);
+    EXPECT_EQ(config.jitter.count(), 100);
+    EXPECT_DOUBLE_EQ(config.recvLoss, 0.25);
+    EXPECT_EQ(config.seed, 7u);
+    std::remove(path);
+
+    EXPECT_THROW(config.set("unknown", "1"), std::invalid_argument);
+    EXPECT_THROW(config.set("send_loss", "1.5"), std::invalid_argument);
+    EXPECT_THROW(config.set("latency_us", "fast"), std::invalid_argument);
+    EXPECT_THROW(FaultConfig::loadFromFile("missing.conf"), std::runtime_error);
+}
+
+// Test that partial sends and receives are put back together into whole frames
+TEST_F(FaultInjectionSocketTest, PartialSendAndRecvKeepFrames) {
+    FaultConfig config;
+    config.partialSendRate = 0.5;
+    config.partialRecvRate = 0.5;
+    FaultInjectionSocket sender(new PlainSocket(), config);
+    FaultInjectionSocket receiver(new PlainSocket(), config);
+
+    for (uint32_t id = 0; id < 50; ++id) {
+        Packet packet = makeFrame(id);
+        ASSERT_EQ(sender.sendAll(fds[0], &packet, sizeof(Packet), 0), (ssize_t)sizeof(Packet));
+        Packet received;
+        ASSERT_EQ(receiver.recvAll(fds[1], &received, sizeof(Packet), 0), (ssize_t)sizeof(Packet));
+        EXPECT_EQ(received.header.ID, id);
+        EXPECT_EQ(std::memcmp(&received, &packet, sizeof(Packet)), 0);
+    }
+}
+
+// Test that loss hits data frames but not control frames
+TEST_F(FaultInjectionSocketTest, RecvLossSparesControlFrames) {
+    FaultConfig config;
+    config.recvLoss = 1;
+    FaultInjectionSocket receiver(new PlainSocket(), config);
+
+    Packet frames[] = {makeFrame(1, FrameType::CREDIT), makeFrame(2), makeFrame(3, FrameType::CLOCK_TICK)};
+    for (Packet &frame : frames)
+        ASSERT_EQ(plain.sendAll(fds[0], &frame, sizeof(Packet), 0), (ssize_t)sizeof(Packet));
+
+    Packet received;
+    ASSERT_EQ(receiver.recvAll(fds[1], &received, sizeof(Packet), 0), (ssize_t)sizeof(Packet));
+    EXPECT_EQ(received.header.ID, 1u);
+    ASSERT_EQ(receiver.recvAll(fds[1], &received, sizeof(Packet), 0), (ssize_t)sizeof(Packet));
+    EXPECT_EQ(received.header.ID, 3u);
+}
+
+// Test that the latency holds frames back without reordering them
+TEST_F(FaultInjectionSocketTest, LatencyDelaysInOrder) {
+    FaultConfig config;
+    config.latency = std::chrono::milliseconds(20);
+    config.jitter = std::chrono::milliseconds(10);
+    FaultInjectionSocket sender(new PlainSocket(), config);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t id = 0; id < 20; ++id) {
+        Packet packet = makeFrame(id);
+        ASSERT_EQ(sender.sendAll(fds[0], &packet, sizeof(Packet), 0), (ssize_t)sizeof(Packet));
+    }
+    for (uint32_t id = 0; id < 20; ++id) {
+        Packet received;
+        ASSERT_EQ(plain.recvAll(fds[1], &received, sizeof(Packet), 0), (ssize_t)sizeof(Packet));
+        EXPECT_EQ(received.header.ID, id);
+    }
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(10));
+}
+
+// Test that reordering swaps whole frames and loses none
+TEST_F(FaultInjectionSocketTest, ReorderSwapsWholeFrames) {
+    FaultConfig config;
+    config.reorderRate = 0.3;
+    config.partialSendRate = 0.3;
+    FaultInjectionSocket sender(new PlainSocket(), config);
+
+    for (uint32_t id = 0; id < 100; ++id) {
+        Packet packet = makeFrame(id);
+        ASSERT_EQ(sender.sendAll(fds[0], &packet, sizeof(Packet), 0), (ssize_t)sizeof(Packet));
+    }
+    std::vector<bool> seen(100, false);
+    bool reordered = false;
+    uint32_t last = 0;
+    for (int i = 0; i < 100; ++i) {
+        Packet received;
+        ASSERT_EQ(plain.recvAll(fds[1], &received, sizeof(Packet), 0), (ssize_t)sizeof(Packet));
+        ASSERT_LT(received.header.ID, 100u);
+        EXPECT_FALSE(seen[received.header.ID]);
+        EXPECT_EQ(received.data[3], 4);
+        seen[received.header.ID] = true;
+        if (i && received.header.ID < last)
+            reordered = true;
+        last = received.header.ID;
+    }
+    EXPECT_TRUE(reordered);
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../include/client_connection.h"
+#include "../include/server_connection.h"
+
+// Keeps the PSNs of the data frames that reached a client
+struct Collected
+{
+    std::mutex mutex;
+    std::vector<uint32_t> psns;
+};
+
+// Waits until the client received the number of frames or two seconds passed
+static void waitForFrames(Collected &collected, size_t count)
+{
+    for (int i = 0; i < 400; ++i) {
+        {
+            std::lock_guard<std::mutex> lock(collected.mutex);
+            if (collected.psns.size() >= count)
+                return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
+
+// Test that frames and credits the bus writes from several threads to one client arrive whole and in order
+TEST(FlowControlTest, CreditsAndFramesShareTheSocket) {
+    const int port = 8100;
+    const uint32_t frames = 500;
+    ServerConnection *serverPointer = nullptr;
+    ServerConnection server(port, [&serverPointer](Packet &packet) {
+        serverPointer->sendDestination(packet);
+    });
+    serverPointer = &server;
+    server.setFlowControlWindow(4);
+    ASSERT_EQ(server.startConnection(), ErrorCode::SUCCESS);
+
+    Collected collected[2];
+    std::unique_ptr<ClientConnection> clients[2];
+    for (uint32_t i = 0; i < 2; ++i) {
+        Collected *target = &collected[i];
+        clients[i].reset(new ClientConnection([target](Packet &packet) {
+            std::lock_guard<std::mutex> lock(target->mutex);
+            if (packet.header.type == FrameType::DATA)
+                target->psns.push_back(packet.header.PSN);
+        }));
+        clients[i]->setServerAddress("127.0.0.1", port);
+        ASSERT_EQ(clients[i]->connectToServer(i + 1), ErrorCode::SUCCESS);
+    }
+    while (server.getConnectedCount() < 2)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // Each client sends to the other, the bus thread of one writes credits while the other forwards frames to it
+    std::vector<std::thread> senders;
+    for (uint32_t i = 0; i < 2; ++i)
+        senders.emplace_back([&clients, i]() {
+            uint8_t data[8] = {0};
+            for (uint32_t psn = 0; psn < frames; ++psn) {
+                Packet packet(3, psn, frames, i + 1, 2 - i, data, sizeof(data), false);
+                EXPECT_EQ(clients[i]->sendPacket(packet), ErrorCode::SUCCESS);
+            }
+        });
+    for (std::thread &sender : senders)
+        sender.join();
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        waitForFrames(collected[i], frames);
+        std::lock_guard<std::mutex> lock(collected[i].mutex);
+        ASSERT_EQ(collected[i].psns.size(), frames);
+        for (uint32_t psn = 0; psn < frames; ++psn)
+            EXPECT_EQ(collected[i].psns[psn], psn);
+    }
+
+    for (auto &client : clients)
+        client->closeConnection();
+    server.stopServer();
+}
@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "../../logger/trace_log.h"
+#include "../../logger/tools/log_index.h"
+
+static std::string logPath(const std::string &name)
+{
+    return "/tmp/log_index_test_" + std::to_string(getpid()) + "_" + name;
+}
+
+static void removeLog(const std::string &path)
+{
+    unlink(path.c_str());
+    unlink(LogIndex::indexPath(path).c_str());
+}
+
+// Writes one line of the text log, frames 3->1 on even lines and 1->3 on odd ones
+static void writeLine(std::ofstream &log, uint64_t timestamp, int i)
+{
+    uint32_t src = i % 2 ? 1 : 3;
+    uint32_t dst = i % 2 ? 3 : 1;
+    log << "[" << timestamp << "ns] [" << (i % 10 == 0 ? "ERROR" : "INFO") << "] [communication] SRC " << src
+        << " DST " << dst << " sending packet " << i << "\n";
+}
+
+// Test that a text log of a few blocks is indexed, its blocks cover their times and the queries filter
+TEST(LogIndexTest, TextLogQueries) {
+    const int lines = 3 * LOG_INDEX_BLOCK;
+    const uint64_t step = 1000000; // 1 ms, 1000 lines a second
+    std::string path = logPath("text.log");
+    {
+        std::ofstream log(path);
+        for (int i = 0; i < lines; ++i)
+            writeLine(log, i * step, i);
+        log << "a line without a time\n";
+    }
+
+    LogIndex index(path, 4);
+    ASSERT_EQ(index.size(), size_t(lines));
+    ASSERT_EQ(index.blockCount(), 3u);
+    for (size_t b = 0; b < index.blockCount(); ++b) {
+        EXPECT_EQ(index.block(b).first, b * LOG_INDEX_BLOCK * step);
+        EXPECT_EQ(index.block(b).last, ((b + 1) * LOG_INDEX_BLOCK - 1) * step);
+    }
+    EXPECT_EQ(index.componentName(index.at(0).component), "communication");
+    EXPECT_EQ(index.line(index.at(5)), "[5000000ns] [INFO] [communication] SRC 1 DST 3 sending packet 5");
+
+    // Frames 3->1 between 2 s and 5 s, inclusive
+    LogQuery query;
+    query.src = 3;
+    query.dst = 1;
+    query.from = 2000 * step;
+    query.to = 5000 * step;
+    std::vector<size_t> selected = index.select(query, 4);
+    ASSERT_EQ(selected.size(), 1501u);
+    EXPECT_EQ(selected.front(), 2000u);
+    EXPECT_EQ(selected.back(), 5000u);
+    for (size_t i = 1; i < selected.size(); ++i)
+        EXPECT_EQ(selected[i], selected[i - 1] + 2);
+
+    LogQuery errors;
+    errors.level = 0;
+    EXPECT_EQ(index.select(errors, 2).size(), size_t(lines / 10 + 1));
+    LogQuery sends;
+    sends.event = static_cast<int>(TraceEvent::SEND);
+    sends.component = "communication";
+    EXPECT_EQ(index.select(sends, 3).size(), size_t(lines));
+    sends.component = "control";
+    EXPECT_TRUE(index.select(sends, 3).empty());
+
+    // 1000 lines a second, half of them each way
+    LogRates rates;
+    index.countRates(index.select(LogQuery(), 4), rates);
+    EXPECT_EQ(rates[std::make_tuple(uint64_t(0), 3u, 1u)], 500u);
+    EXPECT_EQ(rates[std::make_tuple(uint64_t(0), 1u, 3u)], 500u);
+    EXPECT_EQ(rates[std::make_tuple(uint64_t(12), 3u, 1u)], 144u);
+    uint64_t total = 0;
+    for (const auto &rate : rates)
+        total += rate.second;
+    EXPECT_EQ(total, uint64_t(lines));
+    removeLog(path);
+}
+
+// Test that an index is rebuilt when the log grows or is rewritten with the same size
+TEST(LogIndexTest, StaleIndexRebuilt) {
+    std::string path = logPath("stale.log");
+    {
+        std::ofstream log(path);
+        for (int i = 0; i < 10; ++i)
+            writeLine(log, i, i);
+    }
+    {
+        LogIndex index(path, 1);
+        EXPECT_EQ(index.size(), 10u);
+    }
+
+    // Grown
+    {
+        std::ofstream log(path, std::ios::app);
+        writeLine(log, 10, 10);
+    }
+    {
+        LogIndex index(path, 1);
+        ASSERT_EQ(index.size(), 11u);
+        EXPECT_EQ(index.at(10).timestamp, 10u);
+    }
+
+    // Same size, another source on the first line and another time
+    std::string content;
+    {
+        std::ifstream log(path);
+        std::getline(log, content, '\0');
+    }
+    content.replace(content.find("SRC 3"), 5, "SRC 4");
+    {
+        std::ofstream log(path);
+        log << content;
+    }
+    struct timespec times[2] = {{1, 0}, {1, 0}};
+    ASSERT_EQ(utimensat(AT_FDCWD, path.c_str(), times, 0), 0);
+    {
+        LogIndex index(path, 1);
+        ASSERT_EQ(index.size(), 11u);
+        EXPECT_EQ(index.at(0).src, 4u);
+    }
+    removeLog(path);
+}
+
+// Test that the records of a binary trace are indexed with their ends and decoded like trace_decode
+TEST(LogIndexTest, TraceQueries) {
+    std::string path = logPath("trace.bin");
+    std::vector<std::string> files;
+    {
+        TraceWriter writer(path, 1 << 20);
+        ASSERT_TRUE(writer.isOpen());
+        for (uint32_t i = 0; i < 100; ++i) {
+            TracePacket packet = {i, 0};
+            writer.write(1, TraceComponent::COMMUNICATION, i % 2 ? 1 : 3, i % 2 ? 3 : 1, TraceEvent::SEND, &packet,
+                         sizeof(packet));
+        }
+        std::string text = "bus closed";
+        writer.write(0, TraceComponent::MAIN_BUS, 0, 0, TraceEvent::ERROR, text.data(), text.size());
+        files = writer.getFiles();
+    }
+    ASSERT_EQ(files.size(), 1u);
+
+    {
+        LogIndex index(files[0], 2);
+        ASSERT_EQ(index.size(), 101u);
+        ASSERT_EQ(index.blockCount(), 1u);
+        EXPECT_EQ(index.block(0).first, index.at(0).timestamp);
+        EXPECT_EQ(index.block(0).last, index.at(100).timestamp);
+
+        LogQuery query;
+        query.src = 3;
+        query.dst = 1;
+        query.event = static_cast<int>(TraceEvent::SEND);
+        query.from = index.at(20).timestamp;
+        query.to = index.at(40).timestamp;
+        std::vector<size_t> selected = index.select(query, 2);
+        for (size_t i : selected) {
+            EXPECT_EQ(index.at(i).src, 3u);
+            EXPECT_GE(index.at(i).timestamp, query.from);
+            EXPECT_LE(index.at(i).timestamp, query.to);
+        }
+        // Records written in the same ns may share the ends of the range
+        EXPECT_GE(selected.size(), 11u);
+
+        LogQuery errors;
+        errors.component = TraceReader::componentName(static_cast<uint16_t>(TraceComponent::MAIN_BUS));
+        selected = index.select(errors, 2);
+        ASSERT_EQ(selected.size(), 1u);
+        EXPECT_NE(index.line(index.at(selected[0])).find("bus closed"), std::string::npos);
+
+        TraceReader reader(files[0]);
+        TraceEntry record;
+        ASSERT_TRUE(reader.next(record));
+        EXPECT_EQ(index.line(index.at(0)), TraceReader::toText(record));
+    }
+    for (const std::string &file : files)
+        removeLog(file);
+}
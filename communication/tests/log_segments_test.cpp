@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "../../logger/log_segments.h"
+
+static std::string segmentPrefix(const std::string &name)
+{
+    return "/tmp/log_segments_test_" + std::to_string(getpid()) + "_" + name;
+}
+
+static std::string readFile(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+static void removeFiles(MappedSegments &segments)
+{
+    for (const std::string &path : segments.getFiles())
+        unlink(path.c_str());
+}
+
+// Test that lines of writers on many threads all land whole while small segments rotate under them
+TEST(LogSegmentsTest, ConcurrentWritersRotate) {
+    const int threads = 8;
+    const int lines = 5000;
+    std::vector<std::string> files;
+    {
+        MappedSegments segments(segmentPrefix("rotate"), ".log", 4096);
+        ASSERT_TRUE(segments.isOpen());
+        std::vector<std::thread> writers;
+        for (int t = 0; t < threads; ++t)
+            writers.emplace_back([&segments, t]() {
+                for (int i = 0; i < lines; ++i) {
+                    std::string line = "writer " + std::to_string(t) + " line " + std::to_string(i) + "\n";
+                    EXPECT_TRUE(segments.append(line.data(), line.size()));
+                    if (i % 500 == 0)
+                        segments.sync();
+                }
+            });
+        for (std::thread &writer : writers)
+            writer.join();
+        EXPECT_EQ(segments.getDropped(), 0u);
+        files = segments.getFiles();
+    }
+    EXPECT_GT(files.size(), 10u);
+
+    std::set<std::string> seen;
+    for (const std::string &path : files) {
+        std::istringstream content(readFile(path));
+        std::string line;
+        while (std::getline(content, line))
+            EXPECT_TRUE(seen.insert(line).second) << line;
+        unlink(path.c_str());
+    }
+    EXPECT_EQ(seen.size(), size_t(threads * lines));
+}
+
+// Test that the oldest segments are deleted above the retention and each segment starts with the header
+TEST(LogSegmentsTest, RetentionDeletesOldestSegments) {
+    MappedSegments segments(segmentPrefix("retention"), ".log", 1024, std::chrono::seconds(0), 4096, "HEAD");
+    std::string line(100, 'x');
+    line.back() = '\n';
+    for (int i = 0; i < 200; ++i)
+        ASSERT_TRUE(segments.append(line.data(), line.size()));
+
+    std::vector<std::string> files = segments.getFiles();
+    EXPECT_LE(files.size(), 5u);
+    EXPECT_EQ(files.back(), segmentPrefix("retention") + ".000020.log");
+    for (const std::string &path : files)
+        EXPECT_EQ(readFile(path).substr(0, 4), "HEAD");
+    EXPECT_EQ(access((segmentPrefix("retention") + ".000001.log").c_str(), F_OK), -1);
+    removeFiles(segments);
+}
+
+// Test that a record larger than a segment is dropped and counted
+TEST(LogSegmentsTest, OversizedRecordIsDropped) {
+    MappedSegments segments(segmentPrefix("oversized"), ".log", 1024);
+    std::string record(2000, 'x');
+    EXPECT_FALSE(segments.append(record.data(), record.size()));
+    EXPECT_EQ(segments.getDropped(), 1u);
+    removeFiles(segments);
+}
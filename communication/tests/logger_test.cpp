@@ -0,0 +1,219 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "../../logger/logger.h"
+
+static std::string logPath(const std::string &name)
+{
+    return "/tmp/logger_test_" + std::to_string(getpid()) + "_" + name + ".log";
+}
+
+static std::vector<std::string> readLines(const std::string &path)
+{
+    std::ifstream file(path);
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(file, line))
+        lines.push_back(line);
+    return lines;
+}
+
+// Returns the time printed at the start of a line - "[123ns] ..."
+static long long lineTime(const std::string &line)
+{
+    return std::stoll(line.substr(1, line.find("ns]") - 1));
+}
+
+// Test that the writer merges the queues of many threads - every line once, in time order and in the order of each thread
+TEST(LoggerTest, AsyncMergeKeepsOrderAndEveryLine) {
+    const int threads = 8;
+    const int lines = 2000;
+    std::string path = logPath("merge");
+    unlink(path.c_str());
+    {
+        logger log("merge");
+        log.setFile(path);
+        log.startAsync();
+        std::vector<std::thread> writers;
+        for (int t = 0; t < threads; ++t)
+            writers.emplace_back([&log, t]() {
+                for (int i = 0; i < lines; ++i)
+                    log.logMessage(logger::LogLevel::INFO, "thread " + std::to_string(t) + " line " + std::to_string(i));
+            });
+        for (std::thread &writer : writers)
+            writer.join();
+        EXPECT_TRUE(logger::flush(std::chrono::milliseconds(5000)));
+        logger::stopAsync();
+    }
+
+    std::vector<std::string> written = readLines(path);
+    ASSERT_EQ(written.size(), size_t(threads * lines));
+    std::set<std::string> seen;
+    std::map<int, int> nextLine;
+    long long previousTime = 0;
+    for (const std::string &line : written) {
+        EXPECT_TRUE(seen.insert(line).second) << line;
+        EXPECT_GE(lineTime(line), previousTime) << line;
+        previousTime = lineTime(line);
+
+        size_t threadAt = line.find("thread ");
+        ASSERT_NE(threadAt, std::string::npos) << line;
+        int t = std::stoi(line.substr(threadAt + 7));
+        int i = std::stoi(line.substr(line.find(" line ", threadAt) + 6));
+        EXPECT_EQ(i, nextLine[t]++) << line;
+    }
+    unlink(path.c_str());
+}
+
+// Test that a thread that fills its queue waits for the writer, flush returns once the lines are in the file and stopAsync writes the rest
+TEST(LoggerTest, AsyncQueueKeepsEveryLine) {
+    const int lines = LOG_ASYNC_QUEUE_SIZE * 3;
+    std::string path = logPath("queue");
+    unlink(path.c_str());
+    logger log("queue");
+    log.setFile(path);
+    log.startAsync();
+    ASSERT_TRUE(logger::isAsync());
+
+    for (int i = 0; i < lines; ++i)
+        log.logMessage(logger::LogLevel::INFO, "line " + std::to_string(i));
+    EXPECT_TRUE(logger::flush(std::chrono::milliseconds(5000)));
+    EXPECT_EQ(readLines(path).size(), size_t(lines));
+
+    // Left in the queue, the writer empties it before it stops
+    for (int i = lines; i < lines + 100; ++i)
+        log.logMessage(logger::LogLevel::INFO, "line " + std::to_string(i));
+    logger::stopAsync();
+    EXPECT_FALSE(logger::isAsync());
+
+    std::vector<std::string> written = readLines(path);
+    ASSERT_EQ(written.size(), size_t(lines + 100));
+    for (int i = 0; i < lines + 100; ++i)
+        EXPECT_NE(written[i].find("[queue] line " + std::to_string(i)), std::string::npos) << written[i];
+    unlink(path.c_str());
+}
+
+// Counts the lines of the file that contain the text
+static size_t countLines(const std::string &path, const std::string &text)
+{
+    size_t count = 0;
+    for (const std::string &line : readLines(path))
+        count += line.find(text) != std::string::npos;
+    return count;
+}
+
+// Test that a component with its own file keeps its lines apart, its level filters them and copies share the settings
+TEST(LoggerTest, ComponentSinksAreSeparate) {
+    std::string busPath = logPath("bus");
+    std::string clientPath = logPath("client");
+    unlink(busPath.c_str());
+    unlink(clientPath.c_str());
+
+    logger bus("bus");
+    bus.setFile(busPath);
+    logger client("client");
+    client.setFile(clientPath);
+    client.setLevel(logger::LogLevel::ERROR);
+    logger clientCopy = client;
+
+    bus.logMessage(logger::LogLevel::INFO, "bus info");
+    bus.logMessage(logger::LogLevel::ERROR, "bus error");
+    client.logMessage(logger::LogLevel::INFO, "client info");
+    client.logMessage(logger::LogLevel::ERROR, "client error");
+    clientCopy.logMessage(logger::LogLevel::INFO, "copy info");
+    clientCopy.logMessage(logger::LogLevel::ERROR, "copy error");
+    EXPECT_TRUE(bus.isLogging(logger::LogLevel::INFO));
+    EXPECT_FALSE(client.isLogging(logger::LogLevel::INFO));
+
+    EXPECT_EQ(readLines(busPath).size(), 2u);
+    EXPECT_EQ(countLines(busPath, "[bus] bus info"), 1u);
+    EXPECT_EQ(countLines(busPath, "[bus] bus error"), 1u);
+
+    std::vector<std::string> clientLines = readLines(clientPath);
+    ASSERT_EQ(clientLines.size(), 2u);
+    EXPECT_NE(clientLines[0].find("[ERROR] [client] client error"), std::string::npos) << clientLines[0];
+    EXPECT_NE(clientLines[1].find("[ERROR] [client] copy error"), std::string::npos) << clientLines[1];
+    unlink(busPath.c_str());
+    unlink(clientPath.c_str());
+}
+
+// Test that sampling and the rate limit suppress lines and the summary counts them
+TEST(LoggerTest, LimitedLinesAreSummarized) {
+    std::string sampledPath = logPath("sampled");
+    std::string limitedPath = logPath("limited");
+    unlink(sampledPath.c_str());
+    unlink(limitedPath.c_str());
+
+    logger sampled("sampled");
+    sampled.setFile(sampledPath);
+    sampled.setSampling(4);
+    sampled.setSummaryInterval(std::chrono::seconds(3600));
+    for (int i = 0; i < 100; ++i)
+        LOG_LIMITED_AT(sampled, logger::LogLevel::INFO, "sample ", i);
+    EXPECT_EQ(countLines(sampledPath, "sample "), 25u);
+    EXPECT_EQ(countLines(sampledPath, "suppressed"), 0u);
+    sampled.flushSummaries();
+    EXPECT_EQ(countLines(sampledPath, "suppressed 75 lines of logger_test.cpp:"), 1u);
+
+    // A bucket of 5 lines that refills once an hour, each key has its own
+    logger limited("limited");
+    limited.setFile(limitedPath);
+    limited.setRateLimit(1.0 / 3600, 5);
+    limited.setSummaryInterval(std::chrono::seconds(3600));
+    for (int i = 0; i < 20; ++i) {
+        LOG_KEYED_AT(limited, logger::LogLevel::INFO, "first", "first ", i);
+        LOG_KEYED_AT(limited, logger::LogLevel::INFO, "second", "second ", i);
+    }
+    EXPECT_EQ(countLines(limitedPath, "first "), 5u);
+    EXPECT_EQ(countLines(limitedPath, "second "), 5u);
+    limited.flushSummaries();
+    EXPECT_EQ(countLines(limitedPath, "suppressed 15 lines of first,"), 1u);
+    EXPECT_EQ(countLines(limitedPath, "suppressed 15 lines of second,"), 1u);
+
+    // Counted again from 0 after a summary
+    limited.flushSummaries();
+    EXPECT_EQ(countLines(limitedPath, "suppressed"), 2u);
+    unlink(sampledPath.c_str());
+    unlink(limitedPath.c_str());
+}
+
+// Counts its calls, an argument whose evaluation the test can see
+static int evaluated(int &calls)
+{
+    return ++calls;
+}
+
+// Test that the arguments of a line below the compile-time or the component level are never evaluated
+TEST(LoggerTest, DisabledArgumentsAreNotEvaluated) {
+    static_assert(!logger::isEnabled(logger::LogLevel::DEBUG), "the test needs DEBUG above LOG_LEVEL");
+    std::string path = logPath("lazy");
+    unlink(path.c_str());
+
+    logger log("lazy");
+    log.setFile(path);
+    int calls = 0;
+    LOG_DEBUG(log, "debug ", evaluated(calls));
+    LOG_SRC_DST_AT(log, logger::LogLevel::DEBUG, evaluated(calls), evaluated(calls), "debug ", evaluated(calls));
+    LOG_LIMITED_AT(log, logger::LogLevel::DEBUG, "debug ", evaluated(calls));
+    EXPECT_EQ(calls, 0);
+
+    logger quiet("quiet");
+    quiet.setFile(path);
+    quiet.setLevel(logger::LogLevel::ERROR);
+    LOG_INFO(quiet, "info ", evaluated(calls));
+    LOG_SRC_DST_AT(quiet, logger::LogLevel::INFO, evaluated(calls), evaluated(calls), "info ", evaluated(calls));
+    LOG_KEYED_AT(quiet, logger::LogLevel::INFO, "key", "info ", evaluated(calls));
+    EXPECT_EQ(calls, 0);
+    EXPECT_TRUE(readLines(path).empty());
+
+    // An enabled line evaluates each argument once
+    LOG_ERROR(quiet, "error ", evaluated(calls));
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(countLines(path, "[ERROR] [quiet] error 1"), 1u);
+    unlink(path.c_str());
+}
@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+#include "../include/message.h"
+#include "../include/compression.h"
+
+// Builds a buffer with a recognizable pattern
+static std::vector<uint8_t> makeData(size_t size)
+{
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i)
+        data[i] = static_cast<uint8_t>(i * 7 + 1);
+    return data;
+}
+
+// Passes all the packets of a sent message through a receiving message
+static Message reassemble(Message &sent)
+{
+    Message received(sent.getPackets().size());
+    for (auto &packet : sent.getPackets())
+        received.addPacket(packet);
+    return received;
+}
+
+// Test the DLC codes of CAN-FD
+TEST(MessageTest, DlcCodes) {
+    EXPECT_EQ(Packet::lengthToDlc(0), 0);
+    EXPECT_EQ(Packet::lengthToDlc(8), 8);
+    EXPECT_EQ(Packet::lengthToDlc(9), 9);
+    EXPECT_EQ(Packet::lengthToDlc(12), 9);
+    EXPECT_EQ(Packet::lengthToDlc(13), 10);
+    EXPECT_EQ(Packet::lengthToDlc(24), 12);
+    EXPECT_EQ(Packet::lengthToDlc(25), 13);
+    EXPECT_EQ(Packet::lengthToDlc(33), 14);
+    EXPECT_EQ(Packet::lengthToDlc(49), 15);
+    EXPECT_EQ(Packet::lengthToDlc(64), 15);
+    for (uint8_t dlc = 0; dlc < 16; ++dlc)
+        EXPECT_EQ(Packet::lengthToDlc(Packet::dlcToLength(dlc)), dlc);
+}
+
+// Test classic segmentation into 8 byte frames
+TEST(MessageTest, ClassicSegmentation) {
+    std::vector<uint8_t> data = makeData(20);
+    Message msg(1, data.data(), data.size(), false, 2);
+    ASSERT_EQ(msg.getPackets().size(), 3);
+    EXPECT_EQ(msg.getPackets().back().header.DLC, 4);
+    EXPECT_FALSE(msg.getPackets().back().header.isFD);
+}
+
+// Test that every frame carries the CAN ID of its message - srcID + destID unless the sender chose one
+TEST(MessageTest, MessageIdOnEveryFrame) {
+    std::vector<uint8_t> data = makeData(20);
+    Message byDefault(1, data.data(), data.size(), false, 2);
+    for (auto &packet : byDefault.getPackets())
+        EXPECT_EQ(packet.header.ID, 3u);
+
+    Message chosen(1, data.data(), data.size(), false, 2, SIZE_PACKET, 0, 0, 0x123);
+    for (auto &packet : chosen.getPackets())
+        EXPECT_EQ(packet.header.ID, 0x123u);
+}
+
+// Test CAN-FD segmentation into 64 byte frames with a padded last frame
+TEST(MessageTest, FDSegmentation) {
+    std::vector<uint8_t> data = makeData(150);
+    Message msg(1, data.data(), data.size(), false, 2, SIZE_PACKET_FD);
+    ASSERT_EQ(msg.getPackets().size(), 3);
+    Packet &last = msg.getPackets().back();
+    EXPECT_TRUE(last.header.isFD);
+    EXPECT_EQ(last.header.DLC, 12);
+    EXPECT_EQ(last.getDataLength(), 22);
+    EXPECT_EQ(last.header.padding, 2);
+}
+
+// Test that both frame sizes rebuild the original data
+TEST(MessageTest, ReassemblyBothModes) {
+    for (size_t frameSize : {SIZE_PACKET, SIZE_PACKET_FD}) {
+        std::vector<uint8_t> data = makeData(1000);
+        Message msg(1, data.data(), data.size(), false, 2, frameSize);
+        Message received = reassemble(msg);
+        ASSERT_TRUE(received.isComplete());
+        ASSERT_EQ(received.completeDataSize(), data.size());
+        void *complete = received.completeData();
+        EXPECT_EQ(std::memcmp(complete, data.data(), data.size()), 0);
+        free(complete);
+    }
+}
+
+// Test that a retransmitted packet is not added twice
+TEST(MessageTest, DuplicatePacketIgnored) {
+    std::vector<uint8_t> data = makeData(40);
+    Message msg(1, data.data(), data.size(), false, 2);
+    Message received(msg.getPackets().size());
+    EXPECT_TRUE(received.addPacket(msg.getPackets()[0]));
+    EXPECT_TRUE(received.addPacket(msg.getPackets()[2]));
+    EXPECT_FALSE(received.addPacket(msg.getPackets()[2]));
+    EXPECT_EQ(received.firstMissing(), 1);
+    EXPECT_EQ(received.receivedBitmap(), 0b1);
+    EXPECT_FALSE(received.isComplete());
+}
+
+// Test that an unsupported frame size is rejected
+TEST(MessageTest, InvalidFrameSize) {
+    std::vector<uint8_t> data = makeData(10);
+    EXPECT_THROW(Message(1, data.data(), data.size(), false, 2, 16), std::invalid_argument);
+}
+
+// Test that a TPS larger than a message of MAX_MESSAGE_SIZE needs is rejected for both frame sizes
+TEST(MessageTest, TpsLimitedToMaxMessageSize) {
+    std::vector<uint8_t> data = makeData(8);
+    for (bool isFD : {false, true}) {
+        size_t frameSize = isFD ? SIZE_PACKET_FD : SIZE_PACKET;
+        uint32_t maxTps = (MAX_MESSAGE_SIZE + frameSize - 1) / frameSize;
+        Packet packet(3, 0, maxTps, 1, 2, data.data(), data.size(), false, false, false, isFD);
+        EXPECT_TRUE(Message::isValidTps(packet));
+        packet.header.TPS = maxTps + 1;
+        EXPECT_FALSE(Message::isValidTps(packet));
+        packet.header.TPS = 0;
+        EXPECT_FALSE(Message::isValidTps(packet));
+    }
+    EXPECT_THROW(Message(UINT32_MAX), std::invalid_argument);
+}
+
+// Test that a compressed message claiming a larger original size than any message is not allocated
+TEST(MessageTest, ForgedCompressedSizeRejected) {
+    // Varint of 1 GiB followed by junk instead of compressed data
+    uint8_t forged[8] = {0x80, 0x80, 0x80, 0x80, 0x04, 1, 2, 3};
+    Packet packet(3, 0, 1, 1, 2, forged, sizeof(forged), false);
+    packet.header.isCompressed = true;
+    Message received(1);
+    received.addPacket(packet);
+    ASSERT_TRUE(received.isComplete());
+    EXPECT_EQ(received.completeData(), nullptr);
+}
+
+// Test that repetitive data is compressed into fewer frames and restored
+TEST(MessageTest, CompressedRoundTrip) {
+    std::string text;
+    for (int i = 0; i < 40; ++i)
+        text += "{\"alert\":\"obstacle\",\"distance\":" + std::to_string(i) + "},";
+    for (size_t frameSize : {SIZE_PACKET, SIZE_PACKET_FD}) {
+        Message msg(1, &text[0], text.size(), false, 2, frameSize, 0, COMPRESSION_THRESHOLD);
+        EXPECT_TRUE(msg.getPackets().front().header.isCompressed);
+        EXPECT_LT(msg.getPackets().size() * 3, (text.size() + frameSize - 1) / frameSize);
+
+        Message received = reassemble(msg);
+        ASSERT_TRUE(received.isComplete());
+        ASSERT_EQ(received.completeDataSize(), text.size());
+        void *complete = received.completeData();
+        ASSERT_NE(complete, nullptr);
+        EXPECT_EQ(std::memcmp(complete, text.data(), text.size()), 0);
+        free(complete);
+    }
+}
+
+// Test that data that does not compress is sent as it is
+TEST(MessageTest, IncompressibleDataNotCompressed) {
+    std::vector<uint8_t> data(500);
+    uint32_t state = 12345;
+    for (auto &byte : data) {
+        state = state * 1103515245 + 12345;
+        byte = state >> 24;
+    }
+    Message msg(1, data.data(), data.size(), false, 2, SIZE_PACKET, 0, COMPRESSION_THRESHOLD);
+    EXPECT_FALSE(msg.getPackets().front().header.isCompressed);
+    EXPECT_EQ(msg.getPackets().size(), 63u);
+}
+
+// Test that long runs and overlapping matches decompress exactly
+TEST(MessageTest, CompressionLongMatches) {
+    std::vector<uint8_t> data(5000, 'a');
+    for (size_t i = 0; i < data.size(); i += 997)
+        data[i] = 'b';
+    std::vector<uint8_t> compressed;
+    Compression::compress(data.data(), data.size(), compressed);
+    EXPECT_LT(compressed.size(), 100u);
+    std::vector<uint8_t> restored(data.size());
+    ASSERT_TRUE(Compression::decompress(compressed.data(), compressed.size(), restored.data(), restored.size()));
+    EXPECT_EQ(restored, data);
+    EXPECT_FALSE(Compression::decompress(compressed.data(), compressed.size() - 1, restored.data(), restored.size()));
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../include/pooled_client_connection.h"
+
+// Test that the frames go back to the pool and are taken again
+TEST(PacketPoolTest, AcquireAndRelease) {
+    PacketPool pool(4);
+    PooledPacket *frames[8];
+    EXPECT_EQ(pool.tryAcquire(frames, 8), 4u);
+    EXPECT_EQ(pool.getFreeCount(), 0u);
+
+    frames[0]->next = frames[1];
+    pool.releaseList(frames[0]);
+    pool.release(frames[2]);
+    EXPECT_EQ(pool.getFreeCount(), 3u);
+    EXPECT_NE(pool.acquire(), nullptr);
+    EXPECT_EQ(pool.getFreeCount(), 2u);
+}
+
+// Test that a reader waiting on an empty pool gets the released frame
+TEST(PacketPoolTest, AcquireWaitsForRelease) {
+    PacketPool pool(1);
+    PooledPacket *frame = pool.acquire();
+    std::thread releaser([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        pool.release(frame);
+    });
+    EXPECT_EQ(pool.acquire(), frame);
+    releaser.join();
+}
+
+// Test that the queue keeps the order of the frames and stops taking them once closed
+TEST(PacketPoolTest, QueueOrderAndClose) {
+    PacketPool pool(8);
+    PacketQueue queue;
+    for (uint32_t psn = 0; psn < 3; ++psn) {
+        PooledPacket *node = pool.acquire();
+        node->packet.header.PSN = psn;
+        ASSERT_TRUE(queue.push(node));
+    }
+
+    uint32_t expected = 0;
+    for (PooledPacket *node = queue.popAll(); node; node = node->next)
+        EXPECT_EQ(node->packet.header.PSN, expected++);
+    EXPECT_EQ(expected, 3u);
+
+    queue.close();
+    PooledPacket *late = pool.acquire();
+    EXPECT_FALSE(queue.push(late));
+    EXPECT_EQ(queue.popAll(), nullptr);
+}
+
+// Collects the frames a client receives
+struct Collector
+{
+    std::shared_ptr<std::vector<uint32_t>> psns;
+    std::shared_ptr<std::mutex> mutex;
+
+    void operator()(Packet &packet)
+    {
+        std::lock_guard<std::mutex> lock(*mutex);
+        psns->push_back(packet.header.PSN);
+    }
+};
+
+// Drops the frames with an odd PSN
+struct DropOdd
+{
+    bool operator()(Packet &packet) { return packet.header.PSN % 2 == 0; }
+};
+
+// Test that the pooled server forwards the frames in order and applies the handler
+TEST(PacketPoolTest, PooledServerForwardsFrames) {
+    PooledServerConnection<PosixTransport, DropOdd> server(8095, DropOdd(), PosixTransport(), 16);
+    ASSERT_EQ(server.startConnection(), ErrorCode::SUCCESS);
+
+    Collector collector = {std::make_shared<std::vector<uint32_t>>(), std::make_shared<std::mutex>()};
+    PooledClientConnection<PosixTransport> sender;
+    PooledClientConnection<PosixTransport, Collector> receiver(collector);
+    ASSERT_EQ(receiver.connectToServer(2, "127.0.0.1", 8095), ErrorCode::SUCCESS);
+    ASSERT_EQ(sender.connectToServer(1, "127.0.0.1", 8095), ErrorCode::SUCCESS);
+    while (server.getConnectedCount() < 2)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // More frames than the pool holds
+    std::vector<Packet> packets;
+    uint8_t data[8] = {0};
+    for (uint32_t psn = 0; psn < 200; ++psn)
+        packets.emplace_back(3, psn, 200, 1, 2, data, sizeof(data), false);
+    ASSERT_EQ(sender.sendPackets(packets.data(), packets.size()), ErrorCode::SUCCESS);
+
+    for (int i = 0; i < 200 && server.getFramesForwarded() < 100; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::lock_guard<std::mutex> lock(*collector.mutex);
+    ASSERT_EQ(collector.psns->size(), 100u);
+    for (uint32_t i = 0; i < 100; ++i)
+        EXPECT_EQ((*collector.psns)[i], 2 * i);
+}
+
+// Test that every client gets every fragment of broadcasts that need more copies than the pool has free
+TEST(PacketPoolTest, BroadcastWaitsForCopies) {
+    const uint32_t frames = 300;
+    PooledServerConnection<PosixTransport> server(8104, ForwardAll(), PosixTransport(), 16);
+    ASSERT_EQ(server.startConnection(), ErrorCode::SUCCESS);
+
+    std::vector<Collector> collectors;
+    std::vector<std::unique_ptr<PooledClientConnection<PosixTransport, Collector>>> receivers;
+    for (uint32_t id = 2; id < 6; ++id) {
+        collectors.push_back({std::make_shared<std::vector<uint32_t>>(), std::make_shared<std::mutex>()});
+        receivers.emplace_back(new PooledClientConnection<PosixTransport, Collector>(collectors.back()));
+        ASSERT_EQ(receivers.back()->connectToServer(id, "127.0.0.1", 8104), ErrorCode::SUCCESS);
+    }
+    PooledClientConnection<PosixTransport> sender;
+    ASSERT_EQ(sender.connectToServer(1, "127.0.0.1", 8104), ErrorCode::SUCCESS);
+    while (server.getConnectedCount() < 5)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    std::vector<Packet> packets;
+    uint8_t data[8] = {0};
+    for (uint32_t psn = 0; psn < frames; ++psn)
+        packets.emplace_back(1, psn, frames, 1, 0, data, sizeof(data), true);
+    ASSERT_EQ(sender.sendPackets(packets.data(), packets.size()), ErrorCode::SUCCESS);
+
+    // Each receiver and the sender get all of them
+    for (int i = 0; i < 400 && server.getFramesForwarded() < frames * 5; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_EQ(server.getFramesForwarded(), frames * 5);
+    for (Collector &collector : collectors) {
+        std::lock_guard<std::mutex> lock(*collector.mutex);
+        ASSERT_EQ(collector.psns->size(), frames);
+        for (uint32_t psn = 0; psn < frames; ++psn)
+            EXPECT_EQ((*collector.psns)[psn], psn);
+    }
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include "../include/rpc_channel.h"
+
+// Passes every written packet back to the reader, so a communication receives its own messages
+class LoopbackSocket : public ISocket
+{
+public:
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<Packet> packets;
+    bool closed = false;
+
+    int socket(int, int, int) override { return 3; }
+    int setsockopt(int, int, int, const void *, socklen_t) override { return 0; }
+    int bind(int, const struct sockaddr *, socklen_t) override { return 0; }
+    int listen(int, int) override { return 0; }
+    int accept(int, struct sockaddr *, socklen_t *) override { return 0; }
+    int connect(int, const struct sockaddr *, socklen_t) override { return 0; }
+
+    ssize_t send(int, const void *buf, size_t len, int) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        const Packet *packet = static_cast<const Packet *>(buf);
+        // The connection request is not part of the test
+        if (packet->header.DLC != 0 || packet->header.TPS != 0)
+            packets.push_back(*packet);
+        changed.notify_all();
+        return len;
+    }
+
+    ssize_t recv(int, void *buf, size_t, int) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return closed || !packets.empty(); });
+        if (packets.empty())
+            return 0;
+        std::memcpy(buf, &packets.front(), sizeof(Packet));
+        packets.pop_front();
+        return sizeof(Packet);
+    }
+
+    int close(int) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        changed.notify_all();
+        return 0;
+    }
+};
+
+static void ignoreData(uint32_t, void *data)
+{
+    free(data);
+}
+
+class RpcChannelTest : public ::testing::Test
+{
+protected:
+    Communication *comm;
+    RpcChannel *rpc;
+
+    void SetUp() override {
+        comm = new Communication(1, ignoreData, new LoopbackSocket());
+        ASSERT_EQ(comm->startConnection(), ErrorCode::SUCCESS);
+        rpc = new RpcChannel(*comm, 1);
+    }
+
+    void TearDown() override {
+        delete rpc;
+        delete comm;
+        // Lets the detached receive thread leave the socket
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+};
+
+// Test that many calls may be outstanding and each gets its own result
+TEST_F(RpcChannelTest, PipelinedCallsGetTheirResults) {
+    rpc->registerMethod(7, [](uint32_t, const std::vector<uint8_t> &arguments) {
+        std::vector<uint8_t> result(arguments);
+        for (auto &byte : result)
+            byte++;
+        return result;
+    });
+
+    std::vector<std::future<RpcResult>> futures;
+    for (uint8_t i = 0; i < 20; ++i) {
+        std::vector<uint8_t> arguments(1 + i * 3, i);
+        futures.push_back(rpc->call(1, 7, arguments.data(), arguments.size()));
+    }
+    for (uint8_t i = 0; i < 20; ++i) {
+        RpcResult result = futures[i].get();
+        ASSERT_EQ(result.status, ErrorCode::SUCCESS);
+        EXPECT_EQ(result.data, std::vector<uint8_t>(1 + i * 3, i + 1));
+    }
+    EXPECT_EQ(rpc->getPendingCount(), 0u);
+}
+
+// Test that a call of a method that does not exist or throws fails
+TEST_F(RpcChannelTest, FailedMethodsReportErrors) {
+    rpc->registerMethod(1, [](uint32_t, const std::vector<uint8_t> &) -> std::vector<uint8_t> {
+        throw std::runtime_error("no reading");
+    });
+    uint8_t argument = 0;
+    EXPECT_EQ(rpc->call(1, 2, &argument, 1).get().status, ErrorCode::RPC_UNKNOWN_METHOD);
+    EXPECT_EQ(rpc->call(1, 1, &argument, 1).get().status, ErrorCode::RPC_FAILED);
+}
+
+// Test that a call without a response times out
+TEST_F(RpcChannelTest, CallWithoutResponseTimesOut) {
+    uint8_t argument = 0;
+    // Nothing answers for ID 9
+    auto start = std::chrono::steady_clock::now();
+    RpcResult result = rpc->call(9, 1, &argument, 1, std::chrono::milliseconds(50)).get();
+    EXPECT_EQ(result.status, ErrorCode::RPC_TIMEOUT);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+    EXPECT_EQ(rpc->getPendingCount(), 0u);
+}
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include "../include/client_connection.h"
+
+// Records the written packets, the first write waits until it is released
+class GatedSocket : public ISocket
+{
+public:
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool released = false;
+    bool closed = false;
+    std::vector<uint32_t> writtenIds;
+    std::vector<uint32_t> writtenPsns;
+
+    int socket(int, int, int) override { return 3; }
+    int setsockopt(int, int, int, const void *, socklen_t) override { return 0; }
+    int bind(int, const struct sockaddr *, socklen_t) override { return 0; }
+    int listen(int, int) override { return 0; }
+    int accept(int, struct sockaddr *, socklen_t *) override { return 0; }
+    int connect(int, const struct sockaddr *, socklen_t) override { return 0; }
+
+    ssize_t send(int, const void *buf, size_t len, int) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        const Packet *packet = static_cast<const Packet *>(buf);
+        // The connection request is not part of the test
+        if (packet->header.DLC == 0 && packet->header.TPS == 0)
+            return len;
+        changed.wait(lock, [this]() { return released; });
+        writtenIds.push_back(packet->header.ID);
+        writtenPsns.push_back(packet->header.PSN);
+        return len;
+    }
+
+    ssize_t recv(int, void *, size_t, int) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return closed; });
+        return 0;
+    }
+
+    int close(int) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        changed.notify_all();
+        return 0;
+    }
+};
+
+// Closes the connection and lets the detached receive thread leave the socket
+static void disconnect(ClientConnection &client)
+{
+    client.closeConnection();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+// Builds the fragments of a message with the given CAN ID
+static std::vector<Packet> makePackets(uint32_t id, uint32_t count)
+{
+    std::vector<Packet> packets;
+    uint8_t data[8] = {0};
+    for (uint32_t psn = 0; psn < count; ++psn)
+        packets.emplace_back(id, psn, count, 1, 2, data, sizeof(data), false);
+    return packets;
+}
+
+// Test that a high priority message overtakes the rest of a low priority message
+TEST(SendQueueTest, LowerIdPreemptsMessageInProgress) {
+    GatedSocket *socket = new GatedSocket();
+    ClientConnection client([](Packet &) {}, socket);
+    ASSERT_EQ(client.connectToServer(1), ErrorCode::SUCCESS);
+
+    std::vector<Packet> low = makePackets(100, 4);
+    std::vector<Packet> high = makePackets(5, 2);
+    std::thread lowSender([&]() { EXPECT_EQ(client.sendPackets(low), ErrorCode::SUCCESS); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::thread highSender([&]() { EXPECT_EQ(client.sendPackets(high), ErrorCode::SUCCESS); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    {
+        std::lock_guard<std::mutex> lock(socket->mutex);
+        socket->released = true;
+        socket->changed.notify_all();
+    }
+    lowSender.join();
+    highSender.join();
+
+    // The first low priority fragment was already on the wire
+    std::vector<uint32_t> expected = {100, 5, 5, 100, 100, 100};
+    EXPECT_EQ(socket->writtenIds, expected);
+    disconnect(client);
+}
+
+// Test that fragments with the same ID keep their order
+TEST(SendQueueTest, SameIdKeepsOrder) {
+    GatedSocket *socket = new GatedSocket();
+    socket->released = true;
+    ClientConnection client([](Packet &) {}, socket);
+    ASSERT_EQ(client.connectToServer(1), ErrorCode::SUCCESS);
+
+    std::vector<Packet> packets = makePackets(7, 10);
+    ASSERT_EQ(client.sendPackets(packets), ErrorCode::SUCCESS);
+    ASSERT_EQ(socket->writtenPsns.size(), 10u);
+    for (uint32_t psn = 0; psn < 10; ++psn)
+        EXPECT_EQ(socket->writtenPsns[psn], psn);
+    disconnect(client);
+}
+
+// Test that messages between the same processes are arbitrated by the CAN ID their sender chose
+TEST(SendQueueTest, ChosenIdPreemptsSameEndpoints) {
+    GatedSocket *socket = new GatedSocket();
+    ClientConnection client([](Packet &) {}, socket);
+    ASSERT_EQ(client.connectToServer(1), ErrorCode::SUCCESS);
+
+    uint8_t data[32] = {0};
+    Message low(1, data, sizeof(data), false, 2, SIZE_PACKET, 0, 0, 0x700);
+    Message high(1, data, sizeof(data), false, 2, SIZE_PACKET, 1, 0, 0x10);
+    std::thread lowSender([&]() { EXPECT_EQ(client.sendPackets(low.getPackets()), ErrorCode::SUCCESS); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::thread highSender([&]() { EXPECT_EQ(client.sendPackets(high.getPackets()), ErrorCode::SUCCESS); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    {
+        std::lock_guard<std::mutex> lock(socket->mutex);
+        socket->released = true;
+        socket->changed.notify_all();
+    }
+    lowSender.join();
+    highSender.join();
+
+    std::vector<uint32_t> expected = {0x700, 0x10, 0x10, 0x10, 0x10, 0x700, 0x700, 0x700};
+    EXPECT_EQ(socket->writtenIds, expected);
+    disconnect(client);
+}
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include "../include/bus_manager.h"
+#include "../include/communication.h"
+#include "../include/simulation_clock.h"
+
+// Drops the data of passData
+static void dropData(uint32_t, void *data)
+{
+    free(data);
+}
+
+// Test that virtual time starts at 0 and only moves forward
+TEST(SimulationClockTest, VirtualTimeStartsAtZero) {
+    SimulationClock &clock = SimulationClock::getInstance();
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    clock.setMode(ClockMode::VIRTUAL);
+    EXPECT_EQ(clock.now(), 0u);
+
+    clock.advanceTo(5000);
+    EXPECT_EQ(clock.now(), 5000u);
+    clock.advanceTo(3000);
+    EXPECT_EQ(clock.now(), 5000u);
+
+    clock.setMode(ClockMode::REAL_TIME);
+    EXPECT_GT(clock.now(), 0u);
+}
+
+// Test that a sleeping thread wakes only when the virtual time reaches its deadline
+TEST(SimulationClockTest, SleepWaitsForVirtualTime) {
+    SimulationClock &clock = SimulationClock::getInstance();
+    clock.setMode(ClockMode::VIRTUAL);
+    std::atomic<bool> awake(false);
+    std::thread sleeper([&]() {
+        clock.sleepFor(std::chrono::microseconds(10));
+        awake = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    clock.advanceTo(5000);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(awake);
+
+    clock.advanceTo(10000);
+    sleeper.join();
+    EXPECT_TRUE(awake);
+    clock.setMode(ClockMode::REAL_TIME);
+}
+
+// Test that a lockstep client acknowledges every tick, the bus does not wait for the ACK timeout
+TEST(SimulationClockTest, LockstepTicksAreAcknowledged) {
+    const int port = 8099;
+    BusManager *bus = BusManager::getInstance({}, 0, port);
+    ASSERT_EQ(bus->startConnection(), ErrorCode::SUCCESS);
+    std::unique_ptr<Communication> client(new Communication(1, dropData));
+    client->setServerAddress("127.0.0.1", port);
+    ASSERT_EQ(client->startConnection(), ErrorCode::SUCCESS);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    ASSERT_EQ(bus->startClock(ClockMode::LOCKSTEP, std::chrono::milliseconds(1)), ErrorCode::SUCCESS);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    bus->stopClock();
+
+    SimulationClock &clock = SimulationClock::getInstance();
+    // A tick without its ACK would hold the bus back for CLOCK_ACK_TIMEOUT_MS
+    EXPECT_GE(clock.now(), 10000000u);
+    clock.setMode(ClockMode::REAL_TIME);
+
+    client.reset();
+    bus->stopConnection();
+    delete bus;
+}
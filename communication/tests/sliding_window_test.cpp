@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+#include "../include/sliding_window.h"
+
+// Test that new packets stop at the window size
+TEST(SlidingWindowTest, SendsUpToWindowSize) {
+    SlidingWindow window(10, 4);
+    int sent = 0;
+    while (window.canSend()) {
+        EXPECT_EQ(window.takeNext(), sent);
+        sent++;
+    }
+    EXPECT_EQ(sent, 4);
+}
+
+// Test that a cumulative acknowledgment slides the window
+TEST(SlidingWindowTest, CumulativeAckSlides) {
+    SlidingWindow window(10, 4);
+    while (window.canSend())
+        window.takeNext();
+    window.acknowledge(2, 0, false);
+    EXPECT_TRUE(window.canSend());
+    EXPECT_EQ(window.takeNext(), 4);
+    EXPECT_EQ(window.takeNext(), 5);
+    EXPECT_FALSE(window.canSend());
+}
+
+// Test that a NACK requests only the packets before the last one received
+TEST(SlidingWindowTest, NackRequestsOnlyGaps) {
+    SlidingWindow window(10, 8);
+    while (window.canSend())
+        window.takeNext();
+    // 0 arrived, 1 and 3 were lost, 2 and 4 arrived, 5-7 are still on their way
+    window.acknowledge(1, 0b101, true);
+    std::vector<uint32_t> retransmits = window.takeRetransmits();
+    EXPECT_EQ(retransmits, (std::vector<uint32_t>{1, 3}));
+}
+
+// Test that a repeated NACK does not resend a packet that was just resent
+TEST(SlidingWindowTest, NackDoesNotRepeatRetransmit) {
+    SlidingWindow window(10, 8);
+    while (window.canSend())
+        window.takeNext();
+    window.acknowledge(1, 0b10, true);
+    for (uint32_t psn : window.takeRetransmits())
+        window.markSent(psn);
+    window.acknowledge(1, 0b110, true);
+    EXPECT_TRUE(window.takeRetransmits().empty());
+}
+
+// Test that a timeout resends everything that is in flight
+TEST(SlidingWindowTest, TimeoutResendsInFlight) {
+    SlidingWindow window(10, 4);
+    while (window.canSend())
+        window.takeNext();
+    window.acknowledge(1, 0b1, false);
+    window.timeout();
+    EXPECT_EQ(window.takeRetransmits(), (std::vector<uint32_t>{1, 3}));
+}
+
+// Test completion after all packets are acknowledged
+TEST(SlidingWindowTest, CompleteAfterAllAcked) {
+    SlidingWindow window(3, 4);
+    while (window.canSend())
+        window.takeNext();
+    EXPECT_FALSE(window.isComplete());
+    window.acknowledge(3, 0, false);
+    EXPECT_TRUE(window.isComplete());
+    EXPECT_TRUE(window.takeNews());
+    EXPECT_FALSE(window.takeNews());
+}
+
+// Test the retransmission timeout bounds and backoff
+TEST(SlidingWindowTest, RttEstimatorTimeout) {
+    RttEstimator estimator;
+    EXPECT_EQ(estimator.getTimeout(), std::chrono::milliseconds(RELIABLE_RTO_MS));
+    estimator.addSample(std::chrono::microseconds(100));
+    EXPECT_EQ(estimator.getTimeout(), std::chrono::milliseconds(RELIABLE_MIN_RTO_MS));
+    EXPECT_EQ(estimator.getTimeout(1), std::chrono::milliseconds(2 * RELIABLE_MIN_RTO_MS));
+    EXPECT_EQ(estimator.getTimeout(20), std::chrono::milliseconds(RELIABLE_MAX_RTO_MS));
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "../include/bus_manager.h"
+#include "../include/client_connection.h"
+#include "../include/time_triggered_schedule.h"
+
+// Test the worst case frame time and the frames that fit in a slot
+TEST(TimeTriggeredScheduleTest, FrameTimeAndCapacity) {
+    TimeTriggeredSchedule schedule(std::chrono::microseconds(10000), 500000);
+    // 8 data bytes - 135 bits at 500 kbit/s
+    EXPECT_EQ(schedule.frameTime(), std::chrono::microseconds(270));
+    schedule.addSlot(std::chrono::microseconds(0), std::chrono::microseconds(1000), {1});
+    EXPECT_EQ(schedule.slotCapacity(schedule.getSlots()[0]), 3u);
+}
+
+// Test that exclusive windows belong to their IDs and arbitrating windows to the rest
+TEST(TimeTriggeredScheduleTest, AllowedIds) {
+    TimeTriggeredSchedule schedule(std::chrono::microseconds(10000));
+    schedule.addSlot(std::chrono::microseconds(5000), std::chrono::microseconds(2000), {});
+    schedule.addSlot(std::chrono::microseconds(0), std::chrono::microseconds(1000), {7, 3});
+    const ScheduleSlot &exclusive = schedule.getSlots()[0];
+    const ScheduleSlot &arbitrating = schedule.getSlots()[1];
+
+    EXPECT_EQ(exclusive.start.count(), 0);
+    EXPECT_TRUE(schedule.isAllowed(exclusive, 3));
+    EXPECT_FALSE(schedule.isAllowed(exclusive, 4));
+    EXPECT_FALSE(schedule.isAllowed(arbitrating, 3));
+    EXPECT_TRUE(schedule.isAllowed(arbitrating, 4));
+    EXPECT_TRUE(schedule.hasSlotFor(4));
+}
+
+// Test that the file is read and overlapping, too long and too short slots are reported
+TEST(TimeTriggeredScheduleTest, LoadAndValidate) {
+    const char *path = "schedule_test.conf";
+    {
+        std::ofstream file(path);
+        file << "# test\nslot = 0 1000 1 0x10\nslot = 900 500 *\nslot = 9900 200 2\nslot = 5000 100 3\ncycle_us = 10000\n";
+    }
+    TimeTriggeredSchedule schedule = TimeTriggeredSchedule::loadFromFile(path);
+    std::remove(path);
+
+    ASSERT_EQ(schedule.getSlots().size(), 4u);
+    EXPECT_TRUE(schedule.isScheduled(0x10));
+    EXPECT_DOUBLE_EQ(schedule.utilisation(), 0.18);
+    // Overlap at 900us, 9900us ends after the cycle, 9900us and 5000us are shorter than a frame
+    EXPECT_EQ(schedule.validate().size(), 4u);
+}
+
+// Test that a schedule without mistakes passes
+TEST(TimeTriggeredScheduleTest, ValidSchedule) {
+    TimeTriggeredSchedule schedule(std::chrono::microseconds(10000), 1000000, SIZE_PACKET_FD);
+    schedule.addSlot(std::chrono::microseconds(0), std::chrono::microseconds(5000), {1});
+    schedule.addSlot(std::chrono::microseconds(5000), std::chrono::microseconds(5000), {});
+    EXPECT_TRUE(schedule.validate().empty());
+    EXPECT_DOUBLE_EQ(schedule.utilisation(), 1.0);
+    EXPECT_THROW(TimeTriggeredSchedule(std::chrono::microseconds(0)), std::invalid_argument);
+}
+
+// Counts the data frames that reached a client, per source
+struct ReceivedFrames
+{
+    std::mutex mutex;
+    std::map<uint32_t, size_t> perSource;
+    size_t total = 0;
+};
+
+// Connects a client of the bus that counts its frames in received
+static std::unique_ptr<ClientConnection> connectClient(uint32_t id, int port, ReceivedFrames &received)
+{
+    std::unique_ptr<ClientConnection> client(new ClientConnection([&received](Packet &packet) {
+        std::lock_guard<std::mutex> lock(received.mutex);
+        if (packet.header.type != FrameType::DATA)
+            return;
+        received.perSource[packet.header.SrcID]++;
+        received.total++;
+    }));
+    client->setServerAddress("127.0.0.1", port);
+    EXPECT_EQ(client->connectToServer(id), ErrorCode::SUCCESS);
+    return client;
+}
+
+// Test that the credit of a buffered frame returns when its slot sends it, not when it is buffered
+TEST(TimeTriggeredBusTest, CreditsWaitForTheSlot) {
+    const int port = 8101;
+    BusManager *bus = BusManager::getInstance({}, 0, port);
+    ASSERT_EQ(bus->startConnection(), ErrorCode::SUCCESS);
+    // One frame every 10 ms
+    TimeTriggeredSchedule schedule(std::chrono::microseconds(10000));
+    schedule.addSlot(std::chrono::microseconds(0), std::chrono::microseconds(300), {3});
+    ASSERT_EQ(bus->startSchedule(schedule), ErrorCode::SUCCESS);
+
+    ReceivedFrames received, unused;
+    std::unique_ptr<ClientConnection> receiver = connectClient(2, port, received);
+    std::unique_ptr<ClientConnection> sender = connectClient(1, port, unused);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    const uint32_t frames = FLOW_CONTROL_WINDOW * 2;
+    std::atomic<uint32_t> written(0);
+    std::thread sending([&]() {
+        uint8_t data[8] = {0};
+        for (uint32_t psn = 0; psn < frames; ++psn) {
+            Packet packet(3, psn, frames, 1, 2, data, sizeof(data), false);
+            EXPECT_EQ(sender->sendPacket(packet), ErrorCode::SUCCESS);
+            written++;
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    {
+        std::lock_guard<std::mutex> lock(received.mutex);
+        EXPECT_LE(written.load(), received.total + FLOW_CONTROL_WINDOW);
+    }
+
+    // Stopping sends the buffered frames and returns their credits
+    bus->stopSchedule();
+    sending.join();
+    for (int i = 0; i < 200 && received.total < frames; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    {
+        std::lock_guard<std::mutex> lock(received.mutex);
+        EXPECT_EQ(received.total, frames);
+    }
+
+    sender->closeConnection();
+    receiver->closeConnection();
+    bus->stopConnection();
+    delete bus;
+}
+
+// Test that a message that starts while the buffer of its ID is full is dropped whole, the others arrive whole
+TEST(TimeTriggeredBusTest, FullBufferDropsWholeMessages) {
+    const int port = 8102;
+    const uint32_t frames = SCHEDULE_BUFFER_LIMIT / 4;
+    BusManager *bus = BusManager::getInstance({}, 0, port);
+    ASSERT_EQ(bus->startConnection(), ErrorCode::SUCCESS);
+    // The only slot comes late in a long cycle, nothing leaves the buffer while the test fills it
+    TimeTriggeredSchedule schedule(std::chrono::microseconds(5000000));
+    schedule.addSlot(std::chrono::microseconds(4000000), std::chrono::microseconds(300), {3});
+    ASSERT_EQ(bus->startSchedule(schedule), ErrorCode::SUCCESS);
+
+    ReceivedFrames received, unused;
+    std::unique_ptr<ClientConnection> receiver = connectClient(10, port, received);
+    std::vector<std::unique_ptr<ClientConnection>> senders;
+    for (uint32_t id = 1; id <= 5; ++id)
+        senders.push_back(connectClient(id, port, unused));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    // Four messages fill the buffer, the fifth finds it full
+    uint8_t data[8] = {0};
+    for (uint32_t id = 1; id <= 5; ++id) {
+        std::vector<Packet> packets;
+        for (uint32_t psn = 0; psn < frames; ++psn)
+            packets.emplace_back(3, psn, frames, id, 10, data, sizeof(data), false);
+        ASSERT_EQ(senders[id - 1]->sendPackets(packets), ErrorCode::SUCCESS);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    bus->stopSchedule();
+    for (int i = 0; i < 200 && received.total < frames * 4; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    {
+        std::lock_guard<std::mutex> lock(received.mutex);
+        for (uint32_t id = 1; id <= 4; ++id)
+            EXPECT_EQ(received.perSource[id], frames);
+        EXPECT_EQ(received.perSource[5], 0u);
+    }
+
+    for (auto &sender : senders)
+        sender->closeConnection();
+    receiver->closeConnection();
+    bus->stopConnection();
+    delete bus;
+}
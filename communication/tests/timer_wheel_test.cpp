@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <map>
+#include "../include/timer_wheel.h"
+
+// Test that timers on every level fire exactly at their tick
+TEST(TimerWheelTest, FiresAtExpiryOnEveryLevel) {
+    TimerWheel wheel(1000);
+    std::vector<uint64_t> expiries = {1000, 1001, 1063, 1064, 1100, 5000, 70000, 300000, 20000000};
+    for (uint32_t id = 0; id < expiries.size(); ++id)
+        wheel.schedule(id, expiries[id]);
+    EXPECT_EQ(wheel.size(), expiries.size());
+
+    // Uneven steps, a timer fires in the step that covers its tick
+    std::map<uint32_t, uint64_t> firedAt;
+    std::vector<WheelTimer> expired;
+    uint64_t previous = 999;
+    for (uint64_t tick = 1000; tick <= 20000000; tick += 1 + tick % 7) {
+        expired.clear();
+        wheel.advance(tick + 1, expired);
+        for (const WheelTimer &timer : expired) {
+            EXPECT_GT(timer.expiry, previous);
+            EXPECT_LE(timer.expiry, tick);
+            firedAt[timer.id] = timer.expiry;
+        }
+        previous = tick;
+    }
+    ASSERT_EQ(firedAt.size(), expiries.size());
+    for (uint32_t id = 0; id < expiries.size(); ++id) {
+        EXPECT_EQ(firedAt[id], expiries[id]) << "timer " << id;
+    }
+    EXPECT_EQ(wheel.size(), 0u);
+}
+
+// Test that a timer in the past fires at the next tick
+TEST(TimerWheelTest, PastTimerFiresAtNextTick) {
+    TimerWheel wheel(500);
+    wheel.schedule(1, 100);
+    EXPECT_EQ(wheel.nextTick(), 500u);
+    std::vector<WheelTimer> expired;
+    wheel.advance(501, expired);
+    ASSERT_EQ(expired.size(), 1u);
+    EXPECT_EQ(expired[0].id, 1u);
+}
+
+// Test that empty ticks are skipped up to the next timer or level boundary
+TEST(TimerWheelTest, NextTickSkipsEmptyTicks) {
+    TimerWheel wheel(10);
+    EXPECT_EQ(wheel.nextTick(), UINT64_MAX);
+    wheel.schedule(1, 40);
+    EXPECT_EQ(wheel.nextTick(), 40u);
+    wheel.schedule(2, 1000);
+    std::vector<WheelTimer> expired;
+    wheel.advance(41, expired);
+    EXPECT_EQ(expired.size(), 1u);
+    // Timer 2 is on a higher level, it moves down at the boundary of 64 ticks
+    EXPECT_EQ(wheel.nextTick(), 64u);
+}
+
+// Test that many timers with the same period fire together and rescheduling keeps the period
+TEST(TimerWheelTest, ThousandsOfPeriodicTimers) {
+    TimerWheel wheel(0);
+    const uint32_t count = 5000;
+    for (uint32_t id = 0; id < count; ++id)
+        wheel.schedule(id, id % 100);
+
+    std::vector<uint32_t> fired(count, 0);
+    std::vector<WheelTimer> expired;
+    for (uint64_t tick = 0; tick < 1000; ++tick) {
+        expired.clear();
+        wheel.advance(tick + 1, expired);
+        for (const WheelTimer &timer : expired) {
+            EXPECT_EQ(timer.expiry, tick);
+            fired[timer.id]++;
+            wheel.schedule(timer.id, timer.expiry + 100);
+        }
+    }
+    for (uint32_t id = 0; id < count; ++id)
+        EXPECT_EQ(fired[id], 10u);
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "../../logger/trace_log.h"
+
+static std::string tracePath(const std::string &name)
+{
+    return "/tmp/trace_log_test_" + std::to_string(getpid()) + "_" + name + ".bin";
+}
+
+static void removeFiles(const std::vector<std::string> &files)
+{
+    for (const std::string &path : files)
+        unlink(path.c_str());
+}
+
+// Reads every record of a trace file
+static std::vector<TraceEntry> readAll(const std::string &path)
+{
+    TraceReader reader(path);
+    std::vector<TraceEntry> entries;
+    TraceEntry entry;
+    while (reader.next(entry))
+        entries.push_back(entry);
+    return entries;
+}
+
+// Test that records with and without payload are read back and decoded to text and CSV like trace_decode
+TEST(TraceLogTest, RoundTripDecodes) {
+    std::vector<std::string> files;
+    {
+        TraceWriter writer(tracePath("round_trip"), 1 << 16);
+        ASSERT_TRUE(writer.isOpen());
+        uint8_t packet[sizeof(TracePacket) + 2];
+        TracePacket header = {7, 2};
+        std::memcpy(packet, &header, sizeof(header));
+        packet[sizeof(header)] = 0xab;
+        packet[sizeof(header) + 1] = 0x01;
+        ASSERT_TRUE(writer.write(1, TraceComponent::COMMUNICATION, 3, 1, TraceEvent::SEND, packet, sizeof(packet)));
+        ASSERT_TRUE(writer.write(1, TraceComponent::MAIN_BUS, 5, 0, TraceEvent::CONNECT));
+        std::string text = "say \"hi\"";
+        ASSERT_TRUE(writer.write(0, TraceComponent::CONTROL, 2, 4, TraceEvent::TEXT, text.data(), text.size()));
+        EXPECT_EQ(writer.getDropped(), 0u);
+        files = writer.getFiles();
+    }
+    ASSERT_EQ(files.size(), 1u);
+    EXPECT_EQ(files[0], "/tmp/trace_log_test_" + std::to_string(getpid()) + "_round_trip.000001.bin");
+
+    std::vector<TraceEntry> entries = readAll(files[0]);
+    ASSERT_EQ(entries.size(), 3u);
+    EXPECT_LE(entries[0].record.timestamp, entries[1].record.timestamp);
+    EXPECT_LE(entries[1].record.timestamp, entries[2].record.timestamp);
+    EXPECT_TRUE(entries[1].payload.empty());
+
+    std::string time = "[" + std::to_string(entries[0].record.timestamp) + "ns] ";
+    EXPECT_EQ(TraceReader::toText(entries[0]),
+              time + "[INFO] SRC 3 DST 1 communication SEND packet number: 2, of messageId: 7 Data: 0xab01");
+    time = "[" + std::to_string(entries[1].record.timestamp) + "ns] ";
+    EXPECT_EQ(TraceReader::toText(entries[1]), time + "[INFO] SRC 5 DST 0 main_bus CONNECT");
+
+    EXPECT_EQ(TraceReader::csvHeader(), "timestamp_ns,level,component,src,dst,event,payload");
+    EXPECT_EQ(TraceReader::toCsv(entries[1]), std::to_string(entries[1].record.timestamp) + ",INFO,main_bus,5,0,CONNECT,\"\"");
+    EXPECT_EQ(TraceReader::toCsv(entries[2]),
+              std::to_string(entries[2].record.timestamp) + ",ERROR,control,2,4,TEXT,\"say \"\"hi\"\"\"");
+    removeFiles(files);
+}
+
+// Test that reading stops at a record whose flags byte was never written
+TEST(TraceLogTest, UnfinishedRecordEndsTrace) {
+    std::vector<std::string> files;
+    {
+        TraceWriter writer(tracePath("unfinished"), 1 << 16);
+        for (int i = 0; i < 3; ++i)
+            ASSERT_TRUE(writer.write(1, TraceComponent::COMMUNICATION, i, 0, TraceEvent::CONNECT));
+        files = writer.getFiles();
+    }
+    ASSERT_EQ(readAll(files[0]).size(), 3u);
+
+    // The second record as a writer that died before committing it leaves it
+    size_t second;
+    {
+        TraceReader reader(files[0]);
+        TraceEntry entry;
+        ASSERT_TRUE(reader.next(entry));
+        second = reader.getPosition();
+    }
+    {
+        std::fstream file(files[0], std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(second + offsetof(TraceRecord, flags));
+        file.put(0);
+    }
+    std::vector<TraceEntry> entries = readAll(files[0]);
+    ASSERT_EQ(entries.size(), 1u);
+    EXPECT_EQ(entries[0].record.src, 0u);
+    removeFiles(files);
+}
+
+// Test that a record larger than a segment is dropped and counted, the records around it are kept
+TEST(TraceLogTest, OversizedRecordIsDropped) {
+    std::vector<std::string> files;
+    {
+        TraceWriter writer(tracePath("oversized"), 256);
+        ASSERT_TRUE(writer.write(1, TraceComponent::COMMUNICATION, 1, 2, TraceEvent::CONNECT));
+        std::string text(300, 'x');
+        EXPECT_FALSE(writer.write(1, TraceComponent::COMMUNICATION, 1, 2, TraceEvent::TEXT, text.data(), text.size()));
+        EXPECT_EQ(writer.getDropped(), 1u);
+        ASSERT_TRUE(writer.write(1, TraceComponent::COMMUNICATION, 1, 2, TraceEvent::CLOSE));
+        files = writer.getFiles();
+    }
+    std::vector<TraceEntry> entries;
+    for (const std::string &path : files)
+        for (const TraceEntry &entry : readAll(path))
+            entries.push_back(entry);
+    ASSERT_EQ(entries.size(), 2u);
+    EXPECT_EQ(entries[0].record.event, static_cast<uint16_t>(TraceEvent::CONNECT));
+    EXPECT_EQ(entries[1].record.event, static_cast<uint16_t>(TraceEvent::CLOSE));
+    removeFiles(files);
+}
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include "../include/message.h"
+#include "../include/value_cache.h"
+
+// Builds the frames of a message from src to dest
+static std::vector<Packet> makeMessage(uint32_t src, uint32_t dest, uint8_t value, size_t size, uint32_t msn, bool isBroadcast = false)
+{
+    std::vector<uint8_t> data(size, value);
+    Message msg(src, data.data(), data.size(), isBroadcast, dest, SIZE_PACKET, msn);
+    return msg.getPackets();
+}
+
+// Test that a message becomes the value of its ID only when all its frames arrived
+TEST(ValueCacheTest, KeepsLastCompleteMessage) {
+    ValueCache cache;
+    std::vector<Packet> first = makeMessage(1, 2, 10, 20, 0);
+    for (const Packet &packet : first)
+        cache.store(packet);
+
+    std::vector<Packet> second = makeMessage(1, 2, 20, 20, 1);
+    cache.store(second[0]);
+    cache.store(second[1]);
+
+    std::vector<Packet> packets;
+    ASSERT_TRUE(cache.lookup(3, 1, 2, packets));
+    ASSERT_EQ(packets.size(), 3u);
+    EXPECT_EQ(packets[0].data[0], 10);
+
+    cache.store(second[1]);
+    cache.store(second[2]);
+    ASSERT_TRUE(cache.lookup(3, 1, 2, packets));
+    EXPECT_EQ(packets[0].header.MSN, 1u);
+    EXPECT_EQ(packets[2].data[0], 20);
+    EXPECT_FALSE(cache.lookup(4, 1, 2, packets));
+}
+
+// Test that bulk descriptors, deltas and RTR frames are not kept
+TEST(ValueCacheTest, SkipsMessagesThatNeedContext) {
+    ValueCache cache;
+    std::vector<Packet> packets = makeMessage(1, 2, 1, 4, 0);
+    packets[0].header.isDelta = true;
+    cache.store(packets[0]);
+    packets[0].header.isDelta = false;
+    packets[0].header.isBulk = true;
+    cache.store(packets[0]);
+    packets[0].header.isBulk = false;
+    packets[0].header.RTR = true;
+    cache.store(packets[0]);
+    EXPECT_EQ(cache.size(), 0u);
+}
+
+// Test that a client gets the values sent to it and the broadcasts of others
+TEST(ValueCacheTest, SnapshotForClient) {
+    ValueCache cache;
+    for (auto &message : {makeMessage(1, 2, 1, 8, 0), makeMessage(1, 5, 2, 8, 1), makeMessage(4, 0, 3, 8, 0, true),
+                          makeMessage(2, 0, 4, 8, 0, true)})
+        for (const Packet &packet : message)
+            cache.store(packet);
+
+    std::vector<std::vector<Packet>> snapshot = cache.snapshotFor(2);
+    ASSERT_EQ(snapshot.size(), 2u);
+    std::vector<uint8_t> values = {snapshot[0][0].data[0], snapshot[1][0].data[0]};
+    std::sort(values.begin(), values.end());
+    EXPECT_EQ(values, std::vector<uint8_t>({1, 3}));
+}
+
+// Test that streams whose message IDs are equal keep their own values
+TEST(ValueCacheTest, StreamsWithTheSameIdAreKeptApart) {
+    ValueCache cache;
+    // 1 to 2 and 2 to 1 both have ID 3
+    for (auto &message : {makeMessage(1, 2, 1, 8, 0), makeMessage(2, 1, 2, 8, 0)})
+        for (const Packet &packet : message)
+            cache.store(packet);
+    EXPECT_EQ(cache.size(), 2u);
+
+    std::vector<Packet> packets;
+    ASSERT_TRUE(cache.lookup(3, 1, 2, packets));
+    EXPECT_EQ(packets[0].data[0], 1);
+    ASSERT_TRUE(cache.lookup(3, 2, 1, packets));
+    EXPECT_EQ(packets[0].data[0], 2);
+    // The value of a stream is not given to a client it was not sent to
+    EXPECT_FALSE(cache.lookup(3, 1, 5, packets));
+}
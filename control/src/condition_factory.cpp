@@ -3,7 +3,7 @@
 // Function that creates and returns a Condition object based on the given OperatorTypes value.
 Condition *createCondition(OperatorTypes operatorType)
 {
-    GlobalProperties::controlLogger.logMessage(logger::LogLevel::DEBUG, "Creating the node");
+    LOG_DEBUG(GlobalProperties::controlLogger, "Creating the node");
     Condition *conditionPtr;
     if (operatorType == OperatorTypes::o)
         conditionPtr = new OrOperator;
@@ -22,14 +22,14 @@ void defineCurrentSensor(const string &condition, int &index)
     index = closeBracket + 1;
     currentSensor = instanceGP.sensors[id];
 
-    GlobalProperties::controlLogger.logMessage(logger::LogLevel::DEBUG, "The current sensor id is: " + to_string(currentSensor->id));
+    LOG_DEBUG(GlobalProperties::controlLogger, "The current sensor id is: ", currentSensor->id);
 }
 
 // Recursively builds the condition tree from the condition string.
 Condition *FullCondition::buildNode(const string &condition, int &index,
                                     map<int, int> bracketIndexes)
 {
-    GlobalProperties::controlLogger.logMessage(logger::LogLevel::DEBUG, "Entering buildNode function, condition[index] = " + condition[index]);
+    LOG_DEBUG(GlobalProperties::controlLogger, "Entering buildNode function, condition[index] = ", condition[index]);
     GlobalProperties &instanceGP = GlobalProperties::getInstance();
 
     if (condition.empty())
@@ -48,11 +48,11 @@ Condition *FullCondition::buildNode(const string &condition, int &index,
         (currentSensor ? to_string(currentSensor->id) : "-") +
         condition.substr(index, bracketIndexes[openBracketIndex] - index + 1);
 
-    GlobalProperties::controlLogger.logMessage(logger::LogLevel::DEBUG, "Generated condition key: " + key);
+    LOG_DEBUG(GlobalProperties::controlLogger, "Generated condition key: ", key);
 
     // Check if the key already exists in the existingConditions map
     if (s_existingConditions.find(key) != s_existingConditions.end()) {
-        instanceGP.controlLogger.logMessage(logger::LogLevel::DEBUG, "Condition key already exists: " + key);
+        LOG_DEBUG(instanceGP.controlLogger, "Condition key already exists: ", key);
 
         index = bracketIndexes[openBracketIndex] + 1;
         if (condition[index] == ',')
@@ -65,7 +65,7 @@ Condition *FullCondition::buildNode(const string &condition, int &index,
     OperatorTypes operatorType = convertStringToOperatorTypes(
         condition.substr(index, openBracketIndex - index));
 
-    GlobalProperties::controlLogger.logMessage(logger::LogLevel::DEBUG, "Operator type: " + std::to_string(operatorType));
+    LOG_DEBUG(GlobalProperties::controlLogger, "Operator type: ", std::to_string(operatorType));
 
     Condition *conditionPtr = createCondition(operatorType);
 
@@ -111,7 +111,7 @@ Condition *FullCondition::buildNode(const string &condition, int &index,
         string name = condition.substr(openBracketIndex + 1,
                                        commaIndex - openBracketIndex - 1);
 
-        GlobalProperties::controlLogger.logMessage(logger::LogLevel::DEBUG, "Field name: " + name);
+        LOG_DEBUG(GlobalProperties::controlLogger, "Field name: ", name);
 
         int closeBracket = bracketIndexes[openBracketIndex];
 
@@ -139,7 +139,7 @@ Condition *FullCondition::buildNode(const string &condition, int &index,
 // Maps the positions of opening bracket indexes to their corresponding closing bracket indexes
 map<int, int> findBrackets(string condition)
 {
-    GlobalProperties::controlLogger.logMessage(logger::LogLevel::DEBUG, "Generate a map with the brackets indexes");
+    LOG_DEBUG(GlobalProperties::controlLogger, "Generate a map with the brackets indexes");
     map<int, int> mapIndexes;
     stack<int> stackIndexes;
     // Scans the input string for brackets and uses a stack to keep track of their positions
@@ -172,7 +172,7 @@ FullCondition::FullCondition(string condition,
         this->buildNode(condition, index, bracketsIndexes);
     root = new Root(this->id, firstCondition);
 
-    GlobalProperties::controlLogger.logMessage(logger::LogLevel::DEBUG, "The tree created successfully ");
+    LOG_DEBUG(GlobalProperties::controlLogger, "The tree created successfully ");
 
     firstCondition->parents.push_back(root);
     currentSensor = nullptr;
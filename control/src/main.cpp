@@ -4,6 +4,7 @@
 #include "input.h"
 #include "full_condition.h"
 #include "global_properties.h"
+#include "../../communication/include/simulation_clock.h"
 // #include "../parser_json/src/packet_parser.h"
 using namespace std;
 
@@ -17,9 +18,9 @@ int main()
     // Starting communication with the server
     instanceGP.comm->startConnection();
 
-    // Running in a time loop to receive messages and handle them
+    // Running in a time loop to receive messages and handle them, on the simulation time
     while (true) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        SimulationClock::getInstance().sleepFor(std::chrono::milliseconds(100));
     }
 
     GlobalProperties::controlLogger.cleanUp();
@@ -10,11 +10,11 @@ Sensor::Sensor(int id, string name, string jsonFilePath) : id(id), name(name)
     for (auto field : tempFields) {
         if (field.type == "bit_field") 
             for (auto subField : parser->getBitFieldFields(field.name)) {
-                GlobalProperties::controlLogger.logMessage(logger::LogLevel::DEBUG, subField.name + " : " + subField.type);
+                LOG_DEBUG(GlobalProperties::controlLogger, subField.name, " : ", subField.type);
                 fieldsMap[subField.name] = subField;
             }
         else {
-            GlobalProperties::controlLogger.logMessage(logger::LogLevel::DEBUG, field.name + " : " + field.type);
+            LOG_DEBUG(GlobalProperties::controlLogger, field.name, " : ", field.type);
             fieldsMap[field.name] = field;
         }  
     }
@@ -26,7 +26,7 @@ void Sensor::handleMessage(void *msg)
 
     for (auto field : fieldsMap) {
         string fieldName = field.first;
-        GlobalProperties::controlLogger.logMessage(logger::LogLevel::DEBUG, "Processing field: " + fieldName);
+        LOG_DEBUG(GlobalProperties::controlLogger, "Processing field: ", fieldName);
 
         updateTrueRoots(fieldName, parser->getFieldValue(fieldName),
                         parser->getFieldType(field.second.type));
@@ -92,7 +92,7 @@ void Sensor::updateTrueRoots(string field, FieldValue value, FieldType type)
 
         // If the condition's status has changed
         if (flag != prevStatus) {
-            GlobalProperties::controlLogger.logMessage(logger::LogLevel::DEBUG, "Condition status changed for field: " + field);
+            LOG_DEBUG(GlobalProperties::controlLogger, "Condition status changed for field: ", field);
 
             // Update parent conditions and check if the root condition is true
             for (Node *parent : bc->parents) {
@@ -109,7 +109,7 @@ void Sensor::updateTrueRoots(string field, FieldValue value, FieldType type)
 template <typename T>
 bool Sensor::applyComparison(T a, T b, OperatorTypes op)
 {
-    GlobalProperties::controlLogger.logMessage(logger::LogLevel::DEBUG, "applyComparison");
+    LOG_DEBUG(GlobalProperties::controlLogger, "applyComparison");
     switch (op) {
         case OperatorTypes::e:
             return a == b;
@@ -0,0 +1,278 @@
+#include "chrome_trace.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+std::atomic<bool> ChromeTrace::enabled(false);
+std::mutex ChromeTrace::fileMutex;
+FILE *ChromeTrace::file = nullptr;
+int ChromeTrace::processId = 0;
+std::string ChromeTrace::processName;
+std::atomic<uint32_t> ChromeTrace::nextFlow(1);
+std::mutex ChromeTrace::buffersMutex;
+std::vector<ChromeTrace::ThreadBuffer *> ChromeTrace::buffers;
+
+static thread_local uint32_t threadFlow = 0;
+
+// Writes the buffer of the thread when the thread ends
+struct ThreadBufferOwner {
+  ChromeTrace::ThreadBuffer *buffer = nullptr;
+  ~ThreadBufferOwner() {
+    if (buffer)
+      ChromeTrace::releaseBuffer(buffer);
+  }
+};
+
+static thread_local ThreadBufferOwner threadOwner;
+
+static uint64_t monotonicNs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Quotes the text as a JSON string
+static void appendString(std::string &json, const char *text) {
+  json += '"';
+  for (; *text; ++text) {
+    if (*text == '"' || *text == '\\')
+      json += '\\';
+    json += *text;
+  }
+  json += '"';
+}
+
+// Whether the braces of the event close, braces in strings do not count
+static bool isComplete(const std::string &event) {
+  int depth = 0;
+  bool quoted = false;
+  for (size_t i = 0; i < event.size(); ++i) {
+    if (quoted) {
+      if (event[i] == '\\')
+        ++i;
+      else if (event[i] == '"')
+        quoted = false;
+    } else if (event[i] == '"') {
+      quoted = true;
+    } else if (event[i] == '{') {
+      ++depth;
+    } else if (event[i] == '}' && --depth == 0) {
+      return i + 1 == event.size();
+    }
+  }
+  return false;
+}
+
+bool ChromeTrace::start(const std::string &path, const std::string &name) {
+  std::lock_guard<std::mutex> guard(fileMutex);
+  if (file)
+    return true;
+  file = std::fopen(path.c_str(), "w");
+  if (!file)
+    return false;
+
+  // Once, a restarted trace is closed by the same handler
+  static bool stopAtExit = false;
+  if (!stopAtExit) {
+    std::atexit(stop);
+    stopAtExit = true;
+  }
+  processId = getpid();
+  processName = name;
+  nextFlow = ((uint32_t)processId * 2654435761u) ^ (uint32_t)monotonicNs();
+
+  // Every event after this one starts with a comma, a trace cut short is
+  // still readable without the closing bracket
+  std::string json = "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" +
+                     std::to_string(processId) + ",\"args\":{\"name\":";
+  appendString(json, name.c_str());
+  json += "}}";
+  std::fwrite(json.data(), 1, json.size(), file);
+  enabled = true;
+  return true;
+}
+
+bool ChromeTrace::startFromEnvironment(const std::string &name) {
+  const char *directory = std::getenv(CHROME_TRACE_ENVIRONMENT);
+  if (!directory || !*directory)
+    return false;
+  return start(std::string(directory) + "/" + name + "." +
+                   std::to_string(getpid()) + ".json",
+               name);
+}
+
+void ChromeTrace::stop() {
+  enabled = false;
+  {
+    std::lock_guard<std::mutex> guard(buffersMutex);
+    for (ThreadBuffer *buffer : buffers) {
+      std::lock_guard<std::mutex> bufferGuard(buffer->mutex);
+      writeEvents(*buffer);
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(fileMutex);
+  if (!file)
+    return;
+  std::fputs("\n]\n", file);
+  std::fclose(file);
+  file = nullptr;
+}
+
+std::string ChromeTrace::readEvents(const std::string &path, bool &cutShort) {
+  std::ifstream input(path, std::ios::binary);
+  if (!input)
+    throw std::runtime_error("cannot read " + path);
+  std::stringstream content;
+  content << input.rdbuf();
+  std::string text = content.str();
+
+  cutShort = false;
+  size_t first = text.find('{');
+  if (first == std::string::npos)
+    return "";
+  size_t last = text.find_last_not_of(" \t\r\n],");
+  text = text.substr(first, last + 1 - first);
+  // Every event but the first starts with ",\n{", a cut may leave the last
+  // one without its closing brace or inside its arguments
+  size_t lastEvent = text.rfind(",\n{");
+  size_t start = lastEvent == std::string::npos ? 0 : lastEvent + 2;
+  if (!isComplete(text.substr(start))) {
+    text.resize(start ? lastEvent : 0);
+    cutShort = true;
+  }
+  return text;
+}
+
+void ChromeTrace::begin(const char *name, const char *category) {
+  if (isEnabled())
+    record('B', name, category);
+}
+
+void ChromeTrace::end(const char *name, const char *category) {
+  if (isEnabled())
+    record('E', name, category);
+}
+
+void ChromeTrace::instant(const char *name, const char *category, uint32_t src,
+                          uint32_t dst) {
+  if (isEnabled())
+    record('i', name, category, 0, src, dst);
+}
+
+void ChromeTrace::flowStart(uint32_t flow, const char *category) {
+  if (flow && isEnabled())
+    record('s', "message", category, flow);
+}
+
+void ChromeTrace::flowStep(uint32_t flow, const char *category) {
+  if (flow && isEnabled())
+    record('t', "message", category, flow);
+}
+
+void ChromeTrace::flowEnd(uint32_t flow, const char *category) {
+  if (flow && isEnabled())
+    record('f', "message", category, flow);
+}
+
+uint32_t ChromeTrace::newFlow() {
+  uint32_t flow = nextFlow++;
+  return flow ? flow : nextFlow++;
+}
+
+uint32_t ChromeTrace::currentFlow() { return threadFlow; }
+
+ChromeTrace::FlowScope::FlowScope(uint32_t flow) : previous(threadFlow) {
+  threadFlow = flow;
+}
+
+ChromeTrace::FlowScope::~FlowScope() { threadFlow = previous; }
+
+ChromeTrace::Span::Span(const char *name, const char *category)
+    : name(name), category(category), active(isEnabled()) {
+  if (active)
+    record('B', name, category);
+}
+
+ChromeTrace::Span::~Span() {
+  // Ended even if the trace stopped meanwhile, a begin without an end would
+  // run to the end of the timeline
+  if (active)
+    record('E', name, category);
+}
+
+ChromeTrace::ThreadBuffer &ChromeTrace::threadBuffer() {
+  if (!threadOwner.buffer) {
+    ThreadBuffer *buffer = new ThreadBuffer();
+    buffer->events.reserve(CHROME_TRACE_BUFFER_EVENTS);
+    buffer->thread = syscall(SYS_gettid);
+    std::lock_guard<std::mutex> guard(buffersMutex);
+    buffers.push_back(buffer);
+    threadOwner.buffer = buffer;
+  }
+  return *threadOwner.buffer;
+}
+
+void ChromeTrace::record(char phase, const char *name, const char *category,
+                         uint32_t flow, uint32_t src, uint32_t dst) {
+  ThreadBuffer &buffer = threadBuffer();
+  Event event = {name, category, monotonicNs(), flow, src, dst, phase};
+  std::lock_guard<std::mutex> guard(buffer.mutex);
+  buffer.events.push_back(event);
+  if (buffer.events.size() >= CHROME_TRACE_BUFFER_EVENTS)
+    writeEvents(buffer);
+}
+
+void ChromeTrace::writeEvents(ThreadBuffer &buffer) {
+  if (buffer.events.empty())
+    return;
+
+  std::string json;
+  json.reserve(buffer.events.size() * 128);
+  std::string process = std::to_string(processId);
+  std::string thread = std::to_string(buffer.thread);
+  for (const Event &event : buffer.events) {
+    json += ",\n{\"name\":";
+    appendString(json, event.name);
+    json += ",\"cat\":";
+    appendString(json, event.category);
+    json += ",\"ph\":\"";
+    json += event.phase;
+    // Microseconds with the nanoseconds as the fraction
+    json += "\",\"ts\":" + std::to_string(event.timestamp / 1000) + "." +
+            std::to_string(event.timestamp % 1000 + 1000).substr(1) +
+            ",\"pid\":" + process + ",\"tid\":" + thread;
+    if (event.flow)
+      json += ",\"id\":" + std::to_string(event.flow);
+    if (event.phase == 'f')
+      json += ",\"bp\":\"e\"";
+    if (event.phase == 'i')
+      json += ",\"s\":\"t\"";
+    if (event.src != CHROME_TRACE_NO_ID || event.dst != CHROME_TRACE_NO_ID)
+      json += ",\"args\":{\"src\":" + std::to_string(event.src) +
+              ",\"dst\":" + std::to_string(event.dst) + "}";
+    json += "}";
+  }
+  buffer.events.clear();
+
+  std::lock_guard<std::mutex> guard(fileMutex);
+  // Dropped when the trace was stopped meanwhile
+  if (file)
+    std::fwrite(json.data(), 1, json.size(), file);
+}
+
+void ChromeTrace::releaseBuffer(ThreadBuffer *buffer) {
+  std::lock_guard<std::mutex> guard(buffersMutex);
+  {
+    std::lock_guard<std::mutex> bufferGuard(buffer->mutex);
+    writeEvents(*buffer);
+  }
+  buffers.erase(std::remove(buffers.begin(), buffers.end(), buffer),
+                buffers.end());
+  delete buffer;
+}
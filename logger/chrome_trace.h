@@ -0,0 +1,130 @@
+#ifndef CHROME_TRACE_H
+#define CHROME_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Events a thread collects before it writes them to the file
+#define CHROME_TRACE_BUFFER_EVENTS 4096
+
+// Directory of the traces of processes that do not start one themselves,
+// each writes <directory>/<process>.<pid>.json
+#define CHROME_TRACE_ENVIRONMENT "VCS_CHROME_TRACE"
+
+// src and dst of an event that names none
+#define CHROME_TRACE_NO_ID 0xffffffffu
+
+#define CHROME_TRACE_CONCAT_(a, b) a##b
+#define CHROME_TRACE_CONCAT(a, b) CHROME_TRACE_CONCAT_(a, b)
+
+// A begin / end span for the rest of the scope
+#define TRACE_SPAN(name, category)                                             \
+  ChromeTrace::Span CHROME_TRACE_CONCAT(traceSpan, __LINE__)(name, category)
+
+// Events in the Chrome Trace Event format - spans, instant events and flows
+// that connect the spans of one message across threads and processes. The
+// events wait in a buffer of their thread, the buffers are written to one
+// JSON file per process. Times are CLOCK_MONOTONIC, the files of all processes
+// on a host share them and can be merged into one timeline
+// (logger/tools/trace_merge). Names and categories must be string literals.
+class ChromeTrace {
+public:
+  // Opens the trace of this process, false if the file cannot be created
+  static bool start(const std::string &path, const std::string &processName);
+
+  // Starts a trace in the CHROME_TRACE_ENVIRONMENT directory if it is set
+  static bool startFromEnvironment(const std::string &processName);
+
+  // Writes the buffered events and closes the file
+  static void stop();
+
+  static bool isEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+  }
+
+  static void begin(const char *name, const char *category);
+  static void end(const char *name, const char *category);
+  static void instant(const char *name, const char *category,
+                      uint32_t src = CHROME_TRACE_NO_ID,
+                      uint32_t dst = CHROME_TRACE_NO_ID);
+
+  // Flow arrows - bound to the span open on the thread at that moment
+  static void flowStart(uint32_t flow, const char *category);
+  static void flowStep(uint32_t flow, const char *category);
+  static void flowEnd(uint32_t flow, const char *category);
+
+  // A new flow id - the ids of a process start at a random point, so the
+  // flows of different processes rarely share one. Never 0.
+  static uint32_t newFlow();
+
+  // The flow of the message the thread works on, 0 for none. Messages sent
+  // meanwhile continue it.
+  static uint32_t currentFlow();
+
+  // The events of a trace file without the brackets of the array, for
+  // merging. A trace cut short loses its unfinished last event and sets
+  // cutShort. Throws std::runtime_error if the file cannot be read.
+  static std::string readEvents(const std::string &path, bool &cutShort);
+
+  // Sets the current flow of the thread until the end of the scope
+  class FlowScope {
+  public:
+    explicit FlowScope(uint32_t flow);
+    ~FlowScope();
+
+  private:
+    uint32_t previous;
+  };
+
+  class Span {
+  public:
+    Span(const char *name, const char *category);
+    ~Span();
+
+  private:
+    const char *name;
+    const char *category;
+    bool active;
+  };
+
+private:
+  struct Event {
+    const char *name;
+    const char *category;
+    uint64_t timestamp;
+    uint32_t flow;
+    uint32_t src;
+    uint32_t dst;
+    char phase;
+  };
+
+  // Events of one thread, locked only against stop
+  struct ThreadBuffer {
+    std::mutex mutex;
+    std::vector<Event> events;
+    uint32_t thread;
+  };
+
+  static std::atomic<bool> enabled;
+  static std::mutex fileMutex;
+  static FILE *file;
+  static int processId;
+  static std::string processName;
+  static std::atomic<uint32_t> nextFlow;
+  static std::mutex buffersMutex;
+  static std::vector<ThreadBuffer *> buffers;
+
+  static void record(char phase, const char *name, const char *category,
+                     uint32_t flow = 0, uint32_t src = CHROME_TRACE_NO_ID,
+                     uint32_t dst = CHROME_TRACE_NO_ID);
+  static ThreadBuffer &threadBuffer();
+  static void writeEvents(ThreadBuffer &buffer);
+  static void releaseBuffer(ThreadBuffer *buffer);
+  friend struct ThreadBufferOwner;
+};
+
+#endif // CHROME_TRACE_H
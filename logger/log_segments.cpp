@@ -0,0 +1,255 @@
+#include "log_segments.h"
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+std::atomic<uint8_t *> MappedSegments::liveBase[LOG_SEGMENT_MAX_LIVE];
+std::atomic<size_t> MappedSegments::liveSize[LOG_SEGMENT_MAX_LIVE];
+
+static int64_t steadyNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+MappedSegments::MappedSegments(const std::string &prefix,
+                               const std::string &suffix, size_t segmentBytes,
+                               std::chrono::seconds rotateEvery,
+                               uint64_t retentionBytes,
+                               const std::string &header)
+    : prefix(prefix), suffix(suffix), segmentBytes(segmentBytes),
+      rotateNs(std::chrono::duration_cast<std::chrono::nanoseconds>(rotateEvery)
+                   .count()),
+      retentionBytes(retentionBytes), header(header), current(nullptr),
+      dropped(0), sequence(0), closedBytes(0), pinning(0) {
+  if (segmentBytes <= header.size())
+    throw std::invalid_argument("Log segment is smaller than its header");
+  if (retentionBytes && retentionBytes < segmentBytes)
+    throw std::invalid_argument("Log retention is smaller than a segment");
+  current = openSegment();
+}
+
+MappedSegments::~MappedSegments() {
+  for (Segment *segment : retired)
+    delete segment;
+  Segment *segment = current.exchange(nullptr);
+  if (!segment)
+    return;
+  while (segment->writers > 0)
+    std::this_thread::yield();
+  closeSegment(segment);
+  delete segment;
+}
+
+bool MappedSegments::isOpen() const { return current.load() != nullptr; }
+
+MappedSegments::Segment *MappedSegments::openSegment() {
+  char number[16];
+  std::snprintf(number, sizeof(number), ".%06llu",
+                (unsigned long long)++sequence);
+  std::string path = prefix + number + suffix;
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return nullptr;
+  // Allocated up front, a full disk fails here and not as SIGBUS on a write
+  if (posix_fallocate(fd, 0, segmentBytes) != 0 &&
+      ftruncate(fd, segmentBytes) != 0) {
+    close(fd);
+    unlink(path.c_str());
+    return nullptr;
+  }
+  void *mapping =
+      mmap(nullptr, segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    close(fd);
+    unlink(path.c_str());
+    return nullptr;
+  }
+
+  Segment *segment = new Segment();
+  segment->path = path;
+  segment->fd = fd;
+  segment->base = static_cast<uint8_t *>(mapping);
+  segment->capacity = segmentBytes;
+  segment->used = header.size();
+  segment->filled = segmentBytes;
+  segment->writers = 0;
+  segment->openedAt = steadyNs();
+  std::memcpy(segment->base, header.data(), header.size());
+
+  for (int i = 0; i < LOG_SEGMENT_MAX_LIVE; ++i) {
+    uint8_t *expected = nullptr;
+    if (liveBase[i].compare_exchange_strong(expected, segment->base)) {
+      liveSize[i] = segmentBytes;
+      break;
+    }
+  }
+  return segment;
+}
+
+void MappedSegments::closeSegment(Segment *segment) {
+  for (int i = 0; i < LOG_SEGMENT_MAX_LIVE; ++i) {
+    uint8_t *expected = segment->base;
+    if (liveBase[i].compare_exchange_strong(expected, nullptr))
+      break;
+  }
+
+  size_t length = std::min(segment->used.load(), segment->filled.load());
+  msync(segment->base, length, MS_ASYNC);
+  munmap(segment->base, segment->capacity);
+  // The unused end goes back, readers see only whole records
+  if (ftruncate(segment->fd, length) != 0)
+    std::perror("Failed to truncate a log segment");
+  close(segment->fd);
+
+  closed.emplace_back(segment->path, length);
+  closedBytes += length;
+}
+
+void MappedSegments::rotate(Segment *full) {
+  std::lock_guard<std::mutex> lock(rotateMutex);
+  // Another writer rotated it already
+  if (current.load() != full)
+    return;
+  Segment *next = openSegment();
+  if (!next)
+    return;
+
+  current = next;
+  while (full->writers > 0)
+    std::this_thread::yield();
+  closeSegment(full);
+
+  // A writer that loaded the old pointer may still count itself in it, the
+  // ones that start now load the new segment
+  retired.push_back(full);
+  if (pinning == 0) {
+    for (Segment *segment : retired)
+      delete segment;
+    retired.clear();
+  }
+
+  while (retentionBytes && !closed.empty() &&
+         closedBytes + segmentBytes > retentionBytes) {
+    unlink(closed.front().first.c_str());
+    closedBytes -= closed.front().second;
+    closed.pop_front();
+  }
+}
+
+MappedSegments::Reservation MappedSegments::reserve(size_t size) {
+  if (size > segmentBytes - header.size()) {
+    dropped++;
+    return {nullptr, nullptr};
+  }
+
+  while (true) {
+    Segment *segment = pinCurrent();
+    if (!segment) {
+      dropped++;
+      return {nullptr, nullptr};
+    }
+
+    if (!rotateNs || steadyNs() - segment->openedAt < rotateNs ||
+        segment->used == header.size()) {
+      size_t offset = segment->used.fetch_add(size);
+      if (offset + size <= segment->capacity)
+        return {segment->base + offset, segment};
+      // The first reservation that does not fit marks the end of the data
+      if (offset <= segment->capacity)
+        segment->filled = offset;
+    }
+    segment->writers--;
+
+    rotate(segment);
+    if (current.load() == segment) {
+      // No new segment could be opened
+      dropped++;
+      return {nullptr, nullptr};
+    }
+  }
+}
+
+MappedSegments::Segment *MappedSegments::pinCurrent() {
+  pinning++;
+  Segment *segment;
+  while (true) {
+    segment = current.load();
+    if (!segment)
+      break;
+    // Counted before the check, rotation waits for it before unmapping
+    segment->writers++;
+    if (current.load() == segment)
+      break;
+    segment->writers--;
+  }
+  pinning--;
+  return segment;
+}
+
+void MappedSegments::release(Reservation &reservation) {
+  if (reservation.segment)
+    reservation.segment->writers--;
+  reservation.segment = nullptr;
+}
+
+bool MappedSegments::append(const void *data, size_t size) {
+  Reservation reservation = reserve(size);
+  if (!reservation.data)
+    return false;
+  std::memcpy(reservation.data, data, size);
+  release(reservation);
+  return true;
+}
+
+void MappedSegments::sync() {
+  Segment *segment = pinCurrent();
+  if (!segment)
+    return;
+  msync(segment->base, std::min(segment->used.load(), segment->capacity),
+        MS_ASYNC);
+  segment->writers--;
+}
+
+std::vector<std::string> MappedSegments::getFiles() {
+  std::lock_guard<std::mutex> lock(rotateMutex);
+  std::vector<std::string> files;
+  for (auto &segment : closed)
+    files.push_back(segment.first);
+  Segment *segment = current.load();
+  if (segment)
+    files.push_back(segment->path);
+  return files;
+}
+
+uint64_t MappedSegments::getDropped() const { return dropped; }
+
+void MappedSegments::syncAll() {
+  for (int i = 0; i < LOG_SEGMENT_MAX_LIVE; ++i) {
+    uint8_t *base = liveBase[i];
+    // A segment unmapped meanwhile only makes msync fail
+    if (base)
+      msync(base, liveSize[i], MS_SYNC);
+  }
+}
+
+void MappedSegments::syncOnSignal(int signum) {
+  syncAll();
+  signal(signum, SIG_DFL);
+  raise(signum);
+}
+
+void MappedSegments::installSignalSync() {
+  for (int signum : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+    struct sigaction previous;
+    if (sigaction(signum, nullptr, &previous) == 0 &&
+        previous.sa_handler == SIG_DFL)
+      signal(signum, syncOnSignal);
+  }
+}
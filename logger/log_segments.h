@@ -0,0 +1,101 @@
+#ifndef LOG_SEGMENTS_H
+#define LOG_SEGMENTS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Size of a log segment, allocated on disk when the segment is opened
+#define LOG_SEGMENT_BYTES (64u << 20)
+
+// Segments of all writers that a fatal signal writes back to disk
+#define LOG_SEGMENT_MAX_LIVE 64
+
+// Memory-mapped files written one after another - prefix.000001suffix,
+// prefix.000002suffix... A segment is closed when it is full or older than
+// rotateEvery, the oldest closed segments are deleted while all of them take
+// more than retentionBytes. Every segment starts with the header bytes.
+// Writers reserve their space with one atomic add, only rotation takes a lock.
+class MappedSegments {
+private:
+  struct Segment {
+    std::string path;
+    int fd;
+    uint8_t *base;
+    size_t capacity;
+    std::atomic<size_t> used;
+    std::atomic<size_t> filled; // End of the last reservation that fit
+    std::atomic<int> writers;
+    int64_t openedAt;
+  };
+
+public:
+  // Space reserved in a segment, the segment stays mapped until release
+  struct Reservation {
+    uint8_t *data;
+    Segment *segment;
+  };
+
+  MappedSegments(const std::string &prefix, const std::string &suffix,
+                 size_t segmentBytes = LOG_SEGMENT_BYTES,
+                 std::chrono::seconds rotateEvery = std::chrono::seconds(0),
+                 uint64_t retentionBytes = 0, const std::string &header = "");
+  ~MappedSegments();
+
+  bool isOpen() const;
+
+  // data is nullptr if the size does not fit in a segment or no segment
+  // could be opened
+  Reservation reserve(size_t size);
+  void release(Reservation &reservation);
+  bool append(const void *data, size_t size);
+
+  // Starts writing the mapped pages back to disk
+  void sync();
+
+  // Files of the segments that were not deleted, oldest first
+  std::vector<std::string> getFiles();
+  uint64_t getDropped() const;
+
+  // Writes every live segment back to disk, only system calls - safe in a
+  // signal handler
+  static void syncAll();
+
+  // Syncs the segments on SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT, unless
+  // another handler is installed for them
+  static void installSignalSync();
+
+private:
+  std::string prefix;
+  std::string suffix;
+  size_t segmentBytes;
+  int64_t rotateNs;
+  uint64_t retentionBytes;
+  std::string header;
+  std::atomic<Segment *> current;
+  std::atomic<uint64_t> dropped;
+  std::mutex rotateMutex;
+  uint64_t sequence;
+  std::deque<std::pair<std::string, uint64_t>> closed;
+  uint64_t closedBytes;
+  // Writers between loading current and counting themselves in its segment -
+  // closed segments are freed only when there are none
+  std::atomic<int> pinning;
+  std::vector<Segment *> retired;
+
+  static std::atomic<uint8_t *> liveBase[LOG_SEGMENT_MAX_LIVE];
+  static std::atomic<size_t> liveSize[LOG_SEGMENT_MAX_LIVE];
+
+  Segment *openSegment();
+  Segment *pinCurrent();
+  void closeSegment(Segment *segment);
+  void rotate(Segment *full);
+  static void syncOnSignal(int signum);
+};
+
+#endif // LOG_SEGMENTS_H
@@ -1,54 +1,238 @@
 #include "logger.h"
+#include <algorithm>
+#include <csignal>
+#include <fcntl.h>
+#include <functional>
+#include <time.h>
+#include <unistd.h>
 
 std::string logger::logFileName;
+bool logger::logFileCreated = false;
+std::atomic<int> logger::sharedFile(-1);
 std::mutex logger::logMutex;
 std::chrono::system_clock::time_point logger::initTime =
     std::chrono::system_clock::now();
-std::string logger::componentName = "out";
+std::chrono::steady_clock::time_point logger::steadyInitTime =
+    std::chrono::steady_clock::now();
+std::atomic<logger::ThreadQueue *> logger::threadQueues[LOG_ASYNC_THREADS];
+std::atomic<bool> logger::asyncRunning(false);
+std::atomic<uint64_t> logger::linesWritten(0);
+std::atomic<bool> logger::writerSleeping(false);
+std::mutex logger::writerMutex;
+std::condition_variable logger::writerWake;
+std::thread logger::writerThread;
+std::atomic<TraceWriter *> logger::trace(nullptr);
+std::atomic<MappedSegments *> logger::segments(nullptr);
+std::atomic<int> logger::segmentUsers(0);
 
-logger::logger(std::string componentName) {
-  logger::componentName = componentName;
+// Gives the queue of the thread back when the thread ends
+struct ThreadQueueOwner {
+  logger::ThreadQueue *queue = nullptr;
+  bool none = false; // Every queue was taken
+  ~ThreadQueueOwner() {
+    if (queue)
+      queue->owned.store(false, std::memory_order_release);
+  }
+};
+
+static thread_local ThreadQueueOwner threadQueue;
+
+logger::logger(std::string componentName) : componentName(componentName) {}
+
+logger::LimitState::LimitState(const char *file, int line)
+    : LimitState(std::string(file) + ":" + std::to_string(line)) {
+  size_t slash = name.find_last_of('/');
+  if (slash != std::string::npos)
+    name.erase(0, slash + 1);
 }
+
+logger::LimitState::LimitState(const std::string &key)
+    : name(key), tokens(-1), refilledAt(0), seen(0), suppressed(0),
+      firstSuppressed(0), lastSuppressed(0) {}
+
+const std::string &logger::getComponentName() const { return componentName; }
+
 void logger::initializeLogFile() {
-  if (isInitialized)
+  std::lock_guard<std::mutex> guard(logMutex);
+  createLogFileName();
+}
+
+void logger::createLogFileName() {
+  if (logFileCreated)
     return;
 
   auto time = std::chrono::system_clock::to_time_t(initTime);
   std::tm tm = *std::localtime(&time);
 
   std::ostringstream oss;
-  oss << "" << std::put_time(&tm, "%Y_%m_%d_%H_%M_%S") << "_" << componentName
-      << ".log";
+  oss << "" << std::put_time(&tm, "%Y_%m_%d_%H_%M_%S") << "_"
+      << (componentName.empty() ? "out" : componentName) << ".log";
   logFileName = oss.str();
+  logFileCreated = true;
 
-  std::ofstream sharedFile(sharedLogFileName, std::ios::out | std::ios::trunc);
-  if (sharedFile) {
-    sharedFile << logFileName;
+  std::ofstream sharedNameFile(sharedLogFileName,
+                               std::ios::out | std::ios::trunc);
+  if (sharedNameFile) {
+    sharedNameFile << logFileName;
   } else {
     std::cerr << logLevelToString(LogLevel::ERROR)
               << "Failed to open shared log file name file" << std::endl;
   }
 
-  isInitialized = true;
+  // A file opened under an older name stays open, writers may still hold it
+  if (sharedFile >= 0)
+    sharedFile = openFile(logFileName);
+}
+
+const std::string &logger::resolveLogFileName() {
+  // Read once per process, later calls return the cached name
+  if (logFileName.empty()) {
+    std::ifstream sharedNameFile(sharedLogFileName);
+    if (sharedNameFile)
+      std::getline(sharedNameFile, logFileName);
+  }
+  if (logFileName.empty())
+    createLogFileName();
+  return logFileName;
 }
 
 std::string logger::getLogFileName() {
-  if (!isInitialized) {
-    if (!isInitialized) {
-      std::ifstream sharedFile(sharedLogFileName);
-      if (sharedFile) {
-        std::getline(sharedFile, logFileName);
-      }
-      if (logFileName.empty()) {
-        initializeLogFile();
-      }
+  if (sink && !sink->fileName.empty())
+    return sink->fileName;
+  std::lock_guard<std::mutex> guard(logMutex);
+  return resolveLogFileName();
+}
+
+void logger::cleanUp() { std::remove(sharedLogFileName.c_str()); }
+
+logger::Sink &logger::getSink() {
+  if (!sink) {
+    sink = std::make_shared<Sink>();
+    sink->level = static_cast<int>(LOG_LEVEL);
+    sink->file = -1;
+    sink->limited = false;
+    sink->linesPerSecond = 0;
+    sink->burst = 1;
+    sink->sampleOneIn = 1;
+    sink->summaryNs = LOG_SUMMARY_SECONDS * 1000000000LL;
+    sink->summaryDue = 0;
+  }
+  return *sink;
+}
+
+void logger::setLevel(LogLevel level) {
+  getSink().level = static_cast<int>(level);
+}
+
+void logger::setFile(const std::string &fileName) {
+  Sink &settings = getSink();
+  settings.fileName = fileName;
+  settings.file = -1;
+}
+
+void logger::setRateLimit(double linesPerSecond, double burst) {
+  Sink &settings = getSink();
+  settings.linesPerSecond = linesPerSecond;
+  settings.burst = std::max(burst, 1.0);
+  settings.limited = settings.linesPerSecond > 0 || settings.sampleOneIn > 1;
+}
+
+void logger::setSampling(uint32_t oneIn) {
+  Sink &settings = getSink();
+  settings.sampleOneIn = std::max(oneIn, 1u);
+  settings.limited = settings.linesPerSecond > 0 || settings.sampleOneIn > 1;
+}
+
+void logger::setSummaryInterval(std::chrono::seconds interval) {
+  getSink().summaryNs =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+}
+
+bool logger::admit(LimitState &state, LogLevel level) {
+  if (!sink || !sink->limited)
+    return true;
+
+  int64_t now = getElapsedNs();
+  bool admitted;
+  bool firstSuppressed = false;
+  {
+    std::lock_guard<std::mutex> guard(state.mutex);
+    // Sampled out lines take no token
+    admitted = state.seen++ % sink->sampleOneIn == 0;
+    if (sink->linesPerSecond > 0) {
+      double refill = state.tokens < 0 ? sink->burst
+                                       : state.tokens +
+                                             (now - state.refilledAt) *
+                                                 sink->linesPerSecond / 1e9;
+      state.tokens = std::min(refill, sink->burst);
+      state.refilledAt = now;
+      if (admitted && state.tokens >= 1)
+        state.tokens -= 1;
+      else
+        admitted = false;
     }
+
+    if (!admitted) {
+      firstSuppressed = state.suppressed == 0;
+      if (firstSuppressed)
+        state.firstSuppressed = now;
+      state.suppressed++;
+      state.lastSuppressed = now;
+    }
+  }
+  if (firstSuppressed) {
+    std::lock_guard<std::mutex> guard(sink->pendingMutex);
+    sink->pending.push_back(&state);
   }
 
-  return logFileName;
+  // One caller per interval writes the summaries
+  int64_t due = sink->summaryDue;
+  if (now >= due &&
+      sink->summaryDue.compare_exchange_strong(due, now + sink->summaryNs))
+    summarize(level);
+  return admitted;
 }
 
-void logger::cleanUp() { std::remove(sharedLogFileName.c_str()); }
+void logger::summarize(LogLevel level) {
+  std::vector<LimitState *> states;
+  {
+    std::lock_guard<std::mutex> guard(sink->pendingMutex);
+    states.swap(sink->pending);
+  }
+  for (LimitState *state : states) {
+    std::string summary;
+    {
+      std::lock_guard<std::mutex> guard(state->mutex);
+      if (!state->suppressed)
+        continue;
+      summary = concat("suppressed ", state->suppressed, " lines of ",
+                       state->name, ", first at ", state->firstSuppressed,
+                       "ns, last at ", state->lastSuppressed, "ns");
+      state->suppressed = 0;
+    }
+    logMessage(level, summary);
+  }
+}
+
+void logger::flushSummaries() {
+  if (sink && sink->limited)
+    summarize(LogLevel::INFO);
+}
+
+bool logger::admit(const std::string &key, LogLevel level) {
+  if (!sink || !sink->limited)
+    return true;
+
+  LimitState *state;
+  {
+    std::lock_guard<std::mutex> guard(sink->keysMutex);
+    std::unique_ptr<LimitState> &entry = sink->keys[key];
+    if (!entry)
+      entry.reset(new LimitState(key));
+    state = entry.get();
+  }
+  return admit(*state, level);
+}
 
 std::string logger::logLevelToString(LogLevel level) {
   switch (level) {
@@ -63,57 +247,353 @@ std::string logger::logLevelToString(LogLevel level) {
   }
 }
 
-bool logger::shouldLog(LogLevel level) {
-  switch (LOG_LEVEL) {
-  case LogLevel::ERROR:
-    return level == LogLevel::ERROR;
-  case LogLevel::INFO:
-    return level == LogLevel::ERROR || level == LogLevel::INFO;
-  case LogLevel::DEBUG:
-    return true;
-  default:
-    return false;
+int64_t logger::getElapsedNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - steadyInitTime)
+      .count();
+}
+
+std::string logger::formatLine(LogLevel level, const std::string &message,
+                               int64_t time) const {
+  std::string line =
+      "[" + std::to_string(time) + "ns] " + logLevelToString(level);
+  if (!componentName.empty())
+    line += " [" + componentName + "]";
+  return line + " " + message + "\n";
+}
+
+int logger::openFile(const std::string &fileName) {
+  int file =
+      open(fileName.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (file < 0)
+    std::cerr << logLevelToString(LogLevel::ERROR) << "Failed to open log file"
+              << std::endl;
+  return file;
+}
+
+int logger::openSharedFile() {
+  std::lock_guard<std::mutex> guard(logMutex);
+  if (sharedFile < 0)
+    sharedFile = openFile(resolveLogFileName());
+  return sharedFile;
+}
+
+int logger::getFile() {
+  if (!sink || sink->fileName.empty()) {
+    int file = sharedFile;
+    return file >= 0 ? file : openSharedFile();
   }
+  int file = sink->file;
+  if (file >= 0)
+    return file;
+  std::lock_guard<std::mutex> guard(logMutex);
+  if (sink->file < 0)
+    sink->file = openFile(sink->fileName);
+  return sink->file;
 }
 
-std::string logger::getElapsedTime() {
-  auto now = std::chrono::system_clock::now();
-  auto elapsed =
-      std::chrono::duration_cast<std::chrono::nanoseconds>(now - initTime)
-          .count();
-  return std::to_string(elapsed) + "ns";
+void logger::writeAll(int file, const char *data, size_t size) {
+  // O_APPEND puts every write at the end, lines of other writers do not mix
+  while (size > 0) {
+    ssize_t written = write(file, data, size);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0) {
+      std::cerr << logLevelToString(LogLevel::ERROR)
+                << "Failed to write log file" << std::endl;
+      return;
+    }
+    data += written;
+    size -= written;
+  }
 }
 
 void logger::logMessage(LogLevel level, std::string src, std::string dst,
                         const std::string &message) {
-  if (!shouldLog(level))
+  if (!isLogging(level))
     return;
 
+  logMessage(level, "SRC " + src + " DST " + dst + " " + message);
+}
+
+void logger::logMessage(LogLevel level, const std::string &message) {
+  if (!isLogging(level))
+    return;
+
+  // Marked before the time of the line is taken, the writer holds back the
+  // lines of other threads after it until this one is queued
+  ThreadQueue *queue = asyncRunning ? getThreadQueue() : nullptr;
+  if (queue)
+    queue->writingSince = getElapsedNs();
+  int64_t time = getElapsedNs();
+
+  std::string line = formatLine(level, message, time);
+  bool ownFile = sink && !sink->fileName.empty();
+  int file = ownFile || !writeSegments(line) ? getFile() : -1;
+  if (file >= 0) {
+    // Checked again after the mark, a writer that stopped meanwhile has not
+    // seen it
+    if (queue && asyncRunning)
+      pushAsync(*queue, time, line, file);
+    else
+      writeAll(file, line.data(), line.size());
+  }
+  if (queue)
+    queue->writingSince = INT64_MAX;
+}
+
+void logger::startAsync() {
   std::lock_guard<std::mutex> guard(logMutex);
-  std::ofstream logFile(getLogFileName(), std::ios_base::app);
-  if (!logFile) {
-    std::cerr << logLevelToString(LogLevel::ERROR) << "Failed to open log file"
-              << std::endl;
+  if (asyncRunning)
     return;
+
+  static bool handlersInstalled = false;
+  if (!handlersInstalled) {
+    handlersInstalled = true;
+    std::atexit(stopAsync);
+    for (int signum : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT})
+      signal(signum, flushOnSignal);
   }
-  logFile << "[" << getElapsedTime() << "] " << logLevelToString(level) << " "
-          << "SRC " << src << " "
-          << "DST " << dst << " " << message << std::endl;
+  asyncRunning = true;
+  writerThread = std::thread(runWriter);
 }
 
-void logger::logMessage(LogLevel level, const std::string &message) {
-  if (!shouldLog(level))
+void logger::stopAsync() {
+  std::lock_guard<std::mutex> guard(logMutex);
+  if (!asyncRunning.exchange(false))
     return;
 
+  writerWake.notify_one();
+  writerThread.join();
+}
+
+bool logger::isAsync() { return asyncRunning; }
+
+void logger::setTrace(TraceWriter *newTrace) { trace = newTrace; }
+
+TraceWriter *logger::getTrace() { return trace; }
+
+void logger::startSegments(size_t segmentBytes,
+                           std::chrono::seconds rotateEvery,
+                           uint64_t retentionBytes) {
   std::lock_guard<std::mutex> guard(logMutex);
+  if (segments)
+    return;
 
-  std::ofstream logFile(getLogFileName(), std::ios_base::app);
-  if (!logFile) {
-    std::cerr << logLevelToString(LogLevel::ERROR) << "Failed to open log file"
-              << std::endl;
+  std::string prefix = resolveLogFileName();
+  if (prefix.size() > 4 && prefix.compare(prefix.size() - 4, 4, ".log") == 0)
+    prefix.resize(prefix.size() - 4);
+  prefix += "." + std::to_string(getpid());
+
+  MappedSegments *opened = new MappedSegments(prefix, ".log", segmentBytes,
+                                              rotateEvery, retentionBytes);
+  if (!opened->isOpen()) {
+    std::cerr << logLevelToString(LogLevel::ERROR)
+              << "Failed to open log segment" << std::endl;
+    delete opened;
     return;
   }
+  MappedSegments::installSignalSync();
+  segments = opened;
+}
+
+void logger::stopSegments() {
+  std::lock_guard<std::mutex> guard(logMutex);
+  MappedSegments *closing = segments.exchange(nullptr);
+  // Writers that loaded the pointer before the exchange are counted
+  while (segmentUsers > 0)
+    std::this_thread::yield();
+  delete closing;
+}
+
+std::vector<std::string> logger::getSegmentFiles() {
+  segmentUsers++;
+  MappedSegments *current = segments;
+  std::vector<std::string> files;
+  if (current)
+    files = current->getFiles();
+  segmentUsers--;
+  return files;
+}
+
+bool logger::writeSegments(const std::string &line) {
+  segmentUsers++;
+  MappedSegments *current = segments;
+  // A line that does not fit is counted as dropped by the segments, it does
+  // not go to the file instead
+  if (current)
+    current->append(line.data(), line.size());
+  segmentUsers--;
+  return current != nullptr;
+}
+
+bool logger::flush(std::chrono::milliseconds timeout) {
+  // Only atomics and async-signal-safe calls, a signal may interrupt anything.
+  // The positions of the queues count on across their threads.
+  uint64_t target = 0;
+  for (size_t i = 0; i < LOG_ASYNC_THREADS; ++i) {
+    ThreadQueue *queue = threadQueues[i].load();
+    if (queue)
+      target += queue->tail.load();
+  }
+  timespec now, deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout.count() / 1000;
+  deadline.tv_nsec += (timeout.count() % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  timespec pause = {0, 100000};
+  while (linesWritten < target) {
+    if (!asyncRunning)
+      return false;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > deadline.tv_sec ||
+        (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec))
+      return false;
+    nanosleep(&pause, nullptr);
+  }
+  return true;
+}
+
+void logger::flushOnSignal(int signum) {
+  flush();
+  MappedSegments::syncAll();
+  signal(signum, SIG_DFL);
+  raise(signum);
+}
+
+logger::ThreadQueue *logger::getThreadQueue() {
+  if (threadQueue.queue || threadQueue.none)
+    return threadQueue.queue;
+
+  // A free queue of an ended thread first, a new one in an empty place else
+  for (size_t i = 0; i < LOG_ASYNC_THREADS; ++i) {
+    ThreadQueue *queue = threadQueues[i].load(std::memory_order_acquire);
+    if (!queue) {
+      ThreadQueue *created = new ThreadQueue();
+      if (threadQueues[i].compare_exchange_strong(queue, created)) {
+        threadQueue.queue = created;
+        return created;
+      }
+      delete created;
+    }
+    bool owned = false;
+    if (queue->owned.compare_exchange_strong(owned, true)) {
+      threadQueue.queue = queue;
+      return queue;
+    }
+  }
+  threadQueue.none = true;
+  return nullptr;
+}
+
+void logger::pushAsync(ThreadQueue &queue, int64_t time, std::string &line,
+                       int file) {
+  size_t tail = queue.tail.load(std::memory_order_relaxed);
+  while (tail - queue.head.load(std::memory_order_acquire) >=
+         LOG_ASYNC_QUEUE_SIZE) {
+    // Full, the writer is behind - wake it and wait for a free record
+    if (writerSleeping)
+      writerWake.notify_one();
+    std::this_thread::yield();
+  }
+  AsyncRecord &record = queue.records[tail & (LOG_ASYNC_QUEUE_SIZE - 1)];
+  record.time = time;
+  record.line.swap(line);
+  record.file = file;
+  queue.tail.store(tail + 1, std::memory_order_release);
+}
 
-  logFile << "[" << getElapsedTime() << "] " << logLevelToString(level) << " "
-          << message << std::endl;
-}
\ No newline at end of file
+void logger::runWriter() {
+  std::string batch;
+  batch.reserve(LOG_ASYNC_BATCH_BYTES);
+  int batchFile = -1;
+  std::vector<ThreadQueue *> queues(LOG_ASYNC_THREADS);
+  std::vector<size_t> tails(LOG_ASYNC_THREADS);
+  // (time, queue) of the next line of every queue - a min-heap
+  typedef std::pair<int64_t, size_t> Next;
+  std::vector<Next> heap;
+  heap.reserve(LOG_ASYNC_THREADS);
+  while (true) {
+    bool stopping = !asyncRunning;
+    // Every line before the cutoff is queued, a thread still queueing one
+    // took its time after its mark
+    int64_t cutoff = getElapsedNs();
+    for (size_t i = 0; i < LOG_ASYNC_THREADS; ++i) {
+      queues[i] = threadQueues[i].load(std::memory_order_acquire);
+      if (!queues[i])
+        continue;
+      int64_t since = queues[i]->writingSince;
+      cutoff = std::min(cutoff, since);
+      stopping = stopping && since == INT64_MAX;
+    }
+    // Checked before the queues are emptied, so nothing queued is left behind
+    if (stopping)
+      cutoff = INT64_MAX;
+
+    heap.clear();
+    for (size_t i = 0; i < LOG_ASYNC_THREADS; ++i) {
+      if (!queues[i])
+        continue;
+      size_t head = queues[i]->head.load(std::memory_order_relaxed);
+      tails[i] = queues[i]->tail.load(std::memory_order_acquire);
+      if (head != tails[i]) {
+        int64_t time =
+            queues[i]->records[head & (LOG_ASYNC_QUEUE_SIZE - 1)].time;
+        if (time <= cutoff)
+          heap.push_back(Next(time, i));
+      }
+    }
+    std::make_heap(heap.begin(), heap.end(), std::greater<Next>());
+
+    // k-way merge - the earliest line of all queues until the cutoff
+    uint64_t count = 0;
+    while (!heap.empty()) {
+      std::pop_heap(heap.begin(), heap.end(), std::greater<Next>());
+      size_t i = heap.back().second;
+      heap.pop_back();
+
+      ThreadQueue &queue = *queues[i];
+      size_t head = queue.head.load(std::memory_order_relaxed);
+      const AsyncRecord &record =
+          queue.records[head & (LOG_ASYNC_QUEUE_SIZE - 1)];
+      // A line of another file or a full batch ends the batch
+      if (!batch.empty() && (record.file != batchFile ||
+                             batch.size() >= LOG_ASYNC_BATCH_BYTES)) {
+        writeAll(batchFile, batch.data(), batch.size());
+        linesWritten += count;
+        count = 0;
+        batch.clear();
+      }
+      batchFile = record.file;
+      batch += record.line;
+      count++;
+      queue.head.store(++head, std::memory_order_release);
+
+      if (head != tails[i]) {
+        int64_t time = queue.records[head & (LOG_ASYNC_QUEUE_SIZE - 1)].time;
+        if (time <= cutoff) {
+          heap.push_back(Next(time, i));
+          std::push_heap(heap.begin(), heap.end(), std::greater<Next>());
+        }
+      }
+    }
+
+    if (!batch.empty()) {
+      writeAll(batchFile, batch.data(), batch.size());
+      linesWritten += count;
+      batch.clear();
+      continue;
+    }
+    if (stopping)
+      return;
+
+    std::unique_lock<std::mutex> lock(writerMutex);
+    writerSleeping = true;
+    writerWake.wait_for(lock, std::chrono::milliseconds(LOG_ASYNC_FLUSH_MS));
+    writerSleeping = false;
+  }
+}
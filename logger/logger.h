@@ -1,18 +1,95 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <condition_variable>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include "log_segments.h"
 
 #ifndef LOG_LEVEL
 #define LOG_LEVEL logger::LogLevel::INFO
 #endif
 
+// Records the async queue of each thread holds, a power of two - the thread
+// waits while its queue is full
+#ifndef LOG_ASYNC_QUEUE_SIZE
+#define LOG_ASYNC_QUEUE_SIZE 4096
+#endif
+
+// Threads with an async queue at the same time, the threads after them write
+// their lines themselves
+#ifndef LOG_ASYNC_THREADS
+#define LOG_ASYNC_THREADS 256
+#endif
+
+// Longest time a record waits in the async queue before it is written
+#define LOG_ASYNC_FLUSH_MS 10
+
+// Bytes the async writer collects before one write to the file
+#define LOG_ASYNC_BATCH_BYTES (1 << 20)
+
+// Longest time a fatal signal waits for the async writer to empty the queue
+#define LOG_SIGNAL_FLUSH_MS 200
+
+// Default time between the summaries of the lines a limit suppressed
+#define LOG_SUMMARY_SECONDS 10
+
+// Lazy logging - the arguments are evaluated and joined only when the level is
+// enabled for the handle, statements above LOG_LEVEL are never run and compile
+// away
+#define LOG_AT(log, level, ...)                                                \
+  do {                                                                         \
+    if ((log).isLogging(level))                                                \
+      (log).logMessage(level, logger::concat(__VA_ARGS__));                    \
+  } while (0)
+
+#define LOG_SRC_DST_AT(log, level, src, dst, ...)                              \
+  do {                                                                         \
+    if ((log).isLogging(level))                                                \
+      (log).logMessage(level, logger::concat(src), logger::concat(dst),        \
+                       logger::concat(__VA_ARGS__));                           \
+  } while (0)
+
+#define LOG_ERROR(log, ...) LOG_AT(log, logger::LogLevel::ERROR, __VA_ARGS__)
+#define LOG_INFO(log, ...) LOG_AT(log, logger::LogLevel::INFO, __VA_ARGS__)
+#define LOG_DEBUG(log, ...) LOG_AT(log, logger::LogLevel::DEBUG, __VA_ARGS__)
+
+// Lines under the rate limit and sampling of the component - every call site
+// has its own budget, the _KEYED forms share one per key instead
+#define LOG_LIMITED_AT(log, level, ...)                                        \
+  do {                                                                         \
+    static logger::LimitState logSite(__FILE__, __LINE__);                     \
+    if ((log).isLogging(level) && (log).admit(logSite, level))                 \
+      (log).logMessage(level, logger::concat(__VA_ARGS__));                    \
+  } while (0)
+
+#define LOG_SRC_DST_LIMITED_AT(log, level, src, dst, ...)                      \
+  do {                                                                         \
+    static logger::LimitState logSite(__FILE__, __LINE__);                     \
+    if ((log).isLogging(level) && (log).admit(logSite, level))                 \
+      (log).logMessage(level, logger::concat(src), logger::concat(dst),        \
+                       logger::concat(__VA_ARGS__));                           \
+  } while (0)
+
+#define LOG_KEYED_AT(log, level, key, ...)                                     \
+  do {                                                                         \
+    if ((log).isLogging(level) && (log).admit(key, level))                     \
+      (log).logMessage(level, logger::concat(__VA_ARGS__));                    \
+  } while (0)
+
+class TraceWriter;
+
 class logger {
 public:
   enum class LogLevel {
@@ -20,25 +97,202 @@ public:
     INFO,
     DEBUG,
   };
+
+  // Budget of one call site or key - token bucket, 1-in-N counter and the
+  // lines suppressed since the last summary
+  struct LimitState {
+    LimitState(const char *file, int line);
+    LimitState(const std::string &key);
+
+    std::string name;
+    std::mutex mutex;
+    double tokens;
+    int64_t refilledAt;
+    uint64_t seen;
+    uint64_t suppressed;
+    int64_t firstSuppressed;
+    int64_t lastSuppressed;
+  };
+
+  // A handle of one component, constructing it does no I/O. Copies share the
+  // sink settings.
   logger() {}
   logger(std::string componentName);
   void logMessage(LogLevel level, const std::string &message);
   void logMessage(LogLevel level, std::string src, std::string dst,
                   const std::string &message);
+
+  // Names a new log file for the processes after this one and writes the name
+  // to the shared file. The first process of a run calls it, the others read
+  // the name once when they log first.
   void initializeLogFile();
   std::string getLogFileName();
   std::string sharedLogFileName = "shared_log_file_name.txt";
   void cleanUp();
+  const std::string &getComponentName() const;
+
+  // Sink settings of the component - set them before the handle is shared
+  // between threads. The level can only lower LOG_LEVEL, an own file takes the
+  // lines of this component out of the shared file.
+  void setLevel(LogLevel level);
+  void setFile(const std::string &fileName);
+
+  // Limits of the _LIMITED and _KEYED lines of the component. A line passes
+  // when it is the first of every oneIn and a token is left - the bucket holds
+  // burst tokens and gains linesPerSecond, 0 for no rate limit. The suppressed
+  // lines are counted per call site or key, the first limited line after each
+  // interval logs a summary of all of them.
+  void setRateLimit(double linesPerSecond, double burst);
+  void setSampling(uint32_t oneIn);
+  void setSummaryInterval(std::chrono::seconds interval);
+
+  // Logs the summaries now, before the end of the program
+  void flushSummaries();
+
+  // False if the limits suppress the line, may log the summary first
+  bool admit(LimitState &state, LogLevel level);
+  bool admit(const std::string &key, LogLevel level);
+
+  static constexpr bool isEnabled(LogLevel level) { return level <= LOG_LEVEL; }
+  bool isLogging(LogLevel level) const {
+    return isEnabled(level) &&
+           (!sink || static_cast<int>(level) <= sink->level.load());
+  }
+
+  // Joins strings, characters and numbers into one string
+  template <typename... Parts> static std::string concat(const Parts &...parts) {
+    std::string text;
+    text.reserve(128);
+    appendParts(text, parts...);
+    return text;
+  }
+
+  // Moves the file writes to a background thread, logMessage only queues the
+  // formatted line in a queue of its thread. The writer merges the queues by
+  // the times of the lines, so the file stays in time order. The file stays
+  // open, stopAsync or exit writes the rest.
+  void startAsync();
+  static void stopAsync();
+  static bool isAsync();
+
+  // Waits until the lines queued before the call are in the file, false on
+  // timeout. Safe to call from a signal handler.
+  static bool flush(std::chrono::milliseconds timeout =
+                        std::chrono::milliseconds(LOG_SIGNAL_FLUSH_MS));
+
+  // Binary trace of the process, the hot paths write records to it instead
+  // of text lines. nullptr (the default) for text only.
+  static void setTrace(TraceWriter *trace);
+  static TraceWriter *getTrace();
+
+  // Writes the lines to memory-mapped segments next to the log file,
+  // <log name>.<pid>.000001.log... instead of appending to it. The lines are
+  // copied straight into the mapping, also in async mode. rotateEvery and
+  // retentionBytes of 0 turn time rotation and deletion off.
+  void startSegments(size_t segmentBytes = LOG_SEGMENT_BYTES,
+                     std::chrono::seconds rotateEvery = std::chrono::seconds(0),
+                     uint64_t retentionBytes = 0);
+  static void stopSegments();
+  static std::vector<std::string> getSegmentFiles();
 
 private:
+  static void append(std::string &text, const std::string &part) {
+    text += part;
+  }
+  static void append(std::string &text, const char *part) { text += part; }
+  static void append(std::string &text, char part) { text += part; }
+  template <typename T>
+  static typename std::enable_if<std::is_arithmetic<T>::value>::type
+  append(std::string &text, T part) {
+    text += std::to_string(part);
+  }
+  static void appendParts(std::string &) {}
+  template <typename Part, typename... Parts>
+  static void appendParts(std::string &text, const Part &part,
+                          const Parts &...parts) {
+    append(text, part);
+    appendParts(text, parts...);
+  }
+
+  // Where the lines of a component go - the file is opened once, -1 until
+  // then
+  struct Sink {
+    std::atomic<int> level;
+    std::string fileName; // Empty for the shared file
+    std::atomic<int> file;
+    bool limited; // Any limit set, admit passes everything otherwise
+    double linesPerSecond;
+    double burst;
+    uint32_t sampleOneIn;
+    int64_t summaryNs;
+    std::atomic<int64_t> summaryDue;
+    std::mutex keysMutex;
+    std::unordered_map<std::string, std::unique_ptr<LimitState>> keys;
+    std::mutex pendingMutex;
+    std::vector<LimitState *> pending; // Suppressed lines since the summary
+  };
+
   static std::string logLevelToString(LogLevel level);
-  static bool shouldLog(LogLevel level);
-  static std::string getElapsedTime();
-  static std::string componentName;
+  // Steady time since the start, a step of the system clock does not reorder
+  // the async lines or stall their writer
+  static int64_t getElapsedNs();
+  void summarize(LogLevel level);
+  std::string componentName;
+  std::shared_ptr<Sink> sink; // nullptr - the shared file at LOG_LEVEL
   static std::string logFileName;
-  bool isInitialized = false;
+  static bool logFileCreated;
+  static std::atomic<int> sharedFile;
   static std::mutex logMutex;
   static std::chrono::system_clock::time_point initTime;
+  static std::chrono::steady_clock::time_point steadyInitTime;
+
+  Sink &getSink();
+  void createLogFileName();
+  const std::string &resolveLogFileName();
+  std::string formatLine(LogLevel level, const std::string &message,
+                         int64_t time) const;
+  int getFile();
+  int openSharedFile();
+  static int openFile(const std::string &fileName);
+  static void writeAll(int file, const char *data, size_t size);
+
+  struct AsyncRecord {
+    int64_t time;
+    std::string line;
+    int file;
+  };
+
+  // Ring of one thread and the writer, the lines are in the order of their
+  // times. A queue goes to a new thread when its thread ends, it is never
+  // freed - a signal handler may read it.
+  struct ThreadQueue {
+    ThreadQueue() : tail(0), writingSince(INT64_MAX), owned(true), head(0) {}
+    std::atomic<size_t> tail;
+    // Time before the line the thread is queueing, INT64_MAX when it is not
+    std::atomic<int64_t> writingSince;
+    std::atomic<bool> owned;
+    AsyncRecord records[LOG_ASYNC_QUEUE_SIZE];
+    std::atomic<size_t> head;
+  };
+  static std::atomic<ThreadQueue *> threadQueues[LOG_ASYNC_THREADS];
+  static std::atomic<bool> asyncRunning;
+  static std::atomic<uint64_t> linesWritten;
+  static std::atomic<bool> writerSleeping;
+  static std::mutex writerMutex;
+  static std::condition_variable writerWake;
+  static std::thread writerThread;
+  static std::atomic<TraceWriter *> trace;
+  static std::atomic<MappedSegments *> segments;
+  static std::atomic<int> segmentUsers;
+
+  static bool writeSegments(const std::string &line);
+
+  static ThreadQueue *getThreadQueue();
+  friend struct ThreadQueueOwner;
+  static void pushAsync(ThreadQueue &queue, int64_t time, std::string &line,
+                        int file);
+  static void runWriter();
+  static void flushOnSignal(int signum);
 };
 
 #endif // LOGGER_H
\ No newline at end of file
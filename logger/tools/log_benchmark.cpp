@@ -0,0 +1,72 @@
+#include "../logger.h"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Statements run in each measurement
+#define BENCHMARK_LINES 1000000
+
+// Measures the send log line of RealSocket at a level that is not logged,
+// built eagerly as before the macros and through them. Prints ns per line.
+// Usage: log_benchmark
+
+// The hex dump of the data as Packet::pointerToHex built it with a stream
+static std::string streamHex(const uint8_t *data, size_t size) {
+  std::ostringstream hex;
+  hex << "0x";
+  for (size_t i = 0; i < size; ++i)
+    hex << std::hex << std::setw(2) << std::setfill('0')
+        << static_cast<int>(data[i]);
+  return hex.str();
+}
+
+template <typename Statement>
+static double measure(Statement statement) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < BENCHMARK_LINES; ++i)
+    statement(i);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         BENCHMARK_LINES;
+}
+
+int main() {
+  logger log("benchmark");
+  log.setFile("/dev/null");
+  logger quiet("quiet");
+  quiet.setFile("/dev/null");
+  quiet.setLevel(logger::LogLevel::ERROR);
+  volatile uint32_t src = 3, dst = 1, id = 7;
+  uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+  const char *error = strerror(0);
+
+  double eager = measure([&](uint32_t psn) {
+    log.logMessage(logger::LogLevel::DEBUG, std::to_string(src),
+                   std::to_string(dst),
+                   std::string("sending packet number: ") +
+                       std::to_string(psn) + std::string(", of messageId: ") +
+                       std::to_string(id) + std::string(" ") +
+                       std::string(error) + " Data: " +
+                       streamHex(data, sizeof(data)));
+  });
+  double compiled = measure([&](uint32_t psn) {
+    LOG_SRC_DST_AT(log, logger::LogLevel::DEBUG, src, dst,
+                   "sending packet number: ", psn, ", of messageId: ", id, ' ',
+                   error, " Data: ", streamHex(data, sizeof(data)));
+  });
+  double runtime = measure([&](uint32_t psn) {
+    LOG_SRC_DST_AT(quiet, logger::LogLevel::INFO, src, dst,
+                   "sending packet number: ", psn, ", of messageId: ", id, ' ',
+                   error, " Data: ", streamHex(data, sizeof(data)));
+  });
+
+  std::cout << std::fixed << std::setprecision(1)
+            << "eager DEBUG line:                 " << eager << " ns\n"
+            << "LOG_SRC_DST_AT DEBUG:             " << compiled << " ns\n"
+            << "LOG_SRC_DST_AT INFO, level ERROR: " << runtime << " ns\n";
+  return 0;
+}
@@ -0,0 +1,462 @@
+#include "log_index.h"
+#include "../trace_log.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace {
+
+// A file mapped read-only, empty files map to nullptr
+struct MappedFile {
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  int64_t modified = 0;
+
+  explicit MappedFile(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      throw std::runtime_error("Cannot open " + path);
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+      close(fd);
+      throw std::runtime_error("Cannot read " + path);
+    }
+    size = status.st_size;
+    modified = status.st_mtim.tv_sec * 1000000000LL + status.st_mtim.tv_nsec;
+    if (size) {
+      void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      if (mapping == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("Cannot map " + path);
+      }
+      data = static_cast<const uint8_t *>(mapping);
+    }
+    close(fd);
+  }
+  ~MappedFile() {
+    if (data)
+      munmap(const_cast<uint8_t *>(data), size);
+  }
+};
+
+// Entries of one part of the log, the component numbers are local to it
+struct Part {
+  std::vector<LogIndexEntry> entries;
+  std::vector<std::string> components;
+  std::unordered_map<std::string, uint16_t> numbers;
+
+  uint16_t number(const std::string &component) {
+    auto found = numbers.find(component);
+    if (found != numbers.end())
+      return found->second;
+    components.push_back(component);
+    return numbers[component] = components.size() - 1;
+  }
+};
+
+bool isTrace(const uint8_t *data, size_t size) {
+  return size >= sizeof(TraceFileHeader) &&
+         std::memcmp(data, TRACE_MAGIC, sizeof(TraceFileHeader::magic)) == 0;
+}
+
+// Component of lines without a tag - 2026_10_19_06_12_21_main_bus.log and its
+// segments 2026_10_19_06_12_21_main_bus.123.000001.log belong to main_bus
+std::string componentOfFile(const std::string &path) {
+  std::string name = path.substr(path.find_last_of('/') + 1);
+  name = name.substr(0, name.find('.'));
+  const size_t stamp = std::strlen("YYYY_MM_DD_HH_MM_SS_");
+  if (name.size() > stamp && name[stamp - 1] == '_' &&
+      std::isdigit(static_cast<unsigned char>(name[0])))
+    name.erase(0, stamp);
+  return name;
+}
+
+bool startsWith(const char *p, const char *end, const char *prefix) {
+  size_t length = std::strlen(prefix);
+  return (size_t)(end - p) >= length && std::memcmp(p, prefix, length) == 0;
+}
+
+// A decimal id, LOG_INDEX_NO_ID for anything else - connect lines name
+// "process" and "server"
+uint32_t parseId(const char *&p, const char *end) {
+  const char *start = p;
+  uint64_t value = 0;
+  while (p < end && *p >= '0' && *p <= '9')
+    value = value * 10 + (*p++ - '0');
+  bool number = p > start && (p == end || *p == ' ') && value < LOG_INDEX_NO_ID;
+  while (p < end && *p != ' ')
+    p++;
+  return number ? value : LOG_INDEX_NO_ID;
+}
+
+// Reads "[<ns>ns] [LEVEL] [component] SRC s DST d message", only the time and
+// the level are required
+bool parseLine(const char *p, const char *end, LogIndexEntry &entry,
+               std::string &component) {
+  if (p == end || *p++ != '[')
+    return false;
+  const char *digits = p;
+  uint64_t timestamp = 0;
+  while (p < end && *p >= '0' && *p <= '9')
+    timestamp = timestamp * 10 + (*p++ - '0');
+  if (p == digits || !startsWith(p, end, "ns] ["))
+    return false;
+  p += 5;
+  entry.timestamp = timestamp;
+
+  if (startsWith(p, end, "ERROR]"))
+    entry.level = 0, p += 6;
+  else if (startsWith(p, end, "INFO]"))
+    entry.level = 1, p += 5;
+  else if (startsWith(p, end, "DEBUG]"))
+    entry.level = 2, p += 6;
+  else
+    return false;
+
+  if (startsWith(p, end, " [")) {
+    const char *name = p + 2;
+    const char *close = static_cast<const char *>(memchr(name, ']', end - name));
+    if (close) {
+      component.assign(name, close);
+      p = close + 1;
+    }
+  }
+
+  entry.src = entry.dst = LOG_INDEX_NO_ID;
+  if (startsWith(p, end, " SRC ")) {
+    p += 5;
+    entry.src = parseId(p, end);
+    if (startsWith(p, end, " DST ")) {
+      p += 5;
+      entry.dst = parseId(p, end);
+    }
+  }
+
+  entry.event = static_cast<uint8_t>(TraceEvent::TEXT);
+  if (memmem(p, end - p, "sending packet", 14))
+    entry.event = static_cast<uint8_t>(TraceEvent::SEND);
+  else if (memmem(p, end - p, "received packet", 15))
+    entry.event = static_cast<uint8_t>(TraceEvent::RECEIVE);
+  else if (entry.level == 0)
+    entry.event = static_cast<uint8_t>(TraceEvent::ERROR);
+  return true;
+}
+
+// Indexes the lines that start in [begin, end), a line may run past end
+void scanText(const char *base, size_t begin, size_t end, size_t size,
+              const std::string &fileComponent, Part &part) {
+  std::string component;
+  size_t position = begin;
+  while (position < end) {
+    // The zeros after the last line of a log segment that was not closed
+    if (base[position] == '\0')
+      return;
+    const char *newline = static_cast<const char *>(
+        memchr(base + position, '\n', size - position));
+    size_t lineEnd = newline ? newline - base : size;
+
+    LogIndexEntry entry;
+    component = fileComponent;
+    if (parseLine(base + position, base + lineEnd, entry, component)) {
+      entry.offset = position;
+      entry.length = lineEnd - position;
+      entry.component = part.number(component);
+      part.entries.push_back(entry);
+    }
+    position = lineEnd + 1;
+  }
+}
+
+void scanTrace(const std::string &path, Part &part) {
+  TraceReader reader(path);
+  TraceEntry record;
+  size_t position = reader.getPosition();
+  while (reader.next(record)) {
+    LogIndexEntry entry;
+    entry.timestamp = record.record.timestamp;
+    entry.offset = position;
+    entry.length = reader.getPosition() - position;
+    entry.src = record.record.src;
+    entry.dst = record.record.dst;
+    entry.level = record.record.level;
+    entry.event = record.record.event;
+    entry.component =
+        part.number(TraceReader::componentName(record.record.component));
+    part.entries.push_back(entry);
+    position = reader.getPosition();
+  }
+}
+
+} // namespace
+
+std::string LogIndex::indexPath(const std::string &logPath) {
+  return logPath + ".idx";
+}
+
+void LogIndex::build(const std::string &logPath, unsigned threads) {
+  MappedFile log(logPath);
+  threads = std::max(1u, threads);
+
+  std::vector<Part> parts;
+  if (isTrace(log.data, log.size)) {
+    // Records are found only by walking from the first one
+    parts.resize(1);
+    scanTrace(logPath, parts[0]);
+  } else if (log.size) {
+    const char *base = reinterpret_cast<const char *>(log.data);
+    std::string fileComponent = componentOfFile(logPath);
+    size_t count = std::min<size_t>(threads, log.size / (1 << 20) + 1);
+    parts.resize(count);
+
+    // Every part starts on a line
+    std::vector<size_t> starts(count + 1, log.size);
+    starts[0] = 0;
+    for (size_t i = 1; i < count; ++i) {
+      size_t guess = std::max(log.size / count * i, starts[i - 1]);
+      const void *newline = memchr(base + guess, '\n', log.size - guess);
+      starts[i] = newline ? static_cast<const char *>(newline) - base + 1
+                          : log.size;
+    }
+    std::vector<std::thread> scanners;
+    for (size_t i = 0; i < count; ++i)
+      scanners.emplace_back(scanText, base, starts[i], starts[i + 1], log.size,
+                            std::cref(fileComponent), std::ref(parts[i]));
+    for (std::thread &scanner : scanners)
+      scanner.join();
+  }
+
+  // One numbering of the components for the whole file
+  Part merged;
+  for (Part &part : parts) {
+    std::vector<uint16_t> numbers;
+    for (const std::string &component : part.components)
+      numbers.push_back(merged.number(component));
+    for (LogIndexEntry &entry : part.entries) {
+      entry.component = numbers[entry.component];
+      merged.entries.push_back(entry);
+    }
+  }
+
+  std::vector<LogIndexBlock> blocks;
+  for (size_t i = 0; i < merged.entries.size(); i += LOG_INDEX_BLOCK) {
+    size_t end = std::min(merged.entries.size(), i + LOG_INDEX_BLOCK);
+    LogIndexBlock block = {UINT64_MAX, 0};
+    for (size_t j = i; j < end; ++j) {
+      block.first = std::min(block.first, merged.entries[j].timestamp);
+      block.last = std::max(block.last, merged.entries[j].timestamp);
+    }
+    blocks.push_back(block);
+  }
+
+  LogIndexHeader header = {};
+  std::memcpy(header.magic, LOG_INDEX_MAGIC, sizeof(header.magic));
+  header.version = LOG_INDEX_VERSION;
+  header.componentCount = merged.components.size();
+  header.sourceSize = log.size;
+  header.sourceModified = log.modified;
+  header.entryCount = merged.entries.size();
+  header.blockCount = blocks.size();
+
+  // Written aside and renamed, a reader never sees half an index
+  std::string path = indexPath(logPath);
+  std::string temporary = path + ".tmp";
+  FILE *file = std::fopen(temporary.c_str(), "wb");
+  if (!file)
+    throw std::runtime_error("Cannot write " + temporary);
+  bool written =
+      std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+      std::fwrite(merged.entries.data(), sizeof(LogIndexEntry),
+                  merged.entries.size(), file) == merged.entries.size() &&
+      std::fwrite(blocks.data(), sizeof(LogIndexBlock), blocks.size(), file) ==
+          blocks.size();
+  for (const std::string &component : merged.components) {
+    uint16_t length = component.size();
+    written = written && std::fwrite(&length, sizeof(length), 1, file) == 1 &&
+              std::fwrite(component.data(), 1, length, file) == length;
+  }
+  if (std::fclose(file) != 0 || !written ||
+      std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    throw std::runtime_error("Cannot write " + path);
+  }
+}
+
+LogIndex::LogIndex(const std::string &logPath, unsigned threads)
+    : logPath(logPath), mapping(nullptr), mappingSize(0), header(nullptr),
+      entries(nullptr), blocks(nullptr), source(nullptr), sourceSize(0) {
+  struct stat log;
+  if (stat(logPath.c_str(), &log) != 0)
+    throw std::runtime_error("Cannot open " + logPath);
+  int64_t modified = log.st_mtim.tv_sec * 1000000000LL + log.st_mtim.tv_nsec;
+
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    int fd = open(indexPath(logPath).c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if (fd >= 0 && fstat(fd, &status) == 0 &&
+        (size_t)status.st_size >= sizeof(LogIndexHeader)) {
+      void *mapped =
+          mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (mapped != MAP_FAILED) {
+        mapping = static_cast<const uint8_t *>(mapped);
+        mappingSize = status.st_size;
+      }
+    }
+    if (fd >= 0)
+      close(fd);
+
+    header = reinterpret_cast<const LogIndexHeader *>(mapping);
+    if (mapping &&
+        std::memcmp(header->magic, LOG_INDEX_MAGIC, sizeof(header->magic)) ==
+            0 &&
+        header->version == LOG_INDEX_VERSION &&
+        header->sourceSize == (uint64_t)log.st_size &&
+        header->sourceModified == modified &&
+        sizeof(LogIndexHeader) + header->entryCount * sizeof(LogIndexEntry) +
+                header->blockCount * sizeof(LogIndexBlock) <=
+            mappingSize)
+      break;
+
+    // Missing or stale
+    if (mapping)
+      munmap(const_cast<uint8_t *>(mapping), mappingSize);
+    mapping = nullptr;
+    header = nullptr;
+    if (attempt == 0)
+      build(logPath, threads);
+  }
+  if (!header)
+    throw std::runtime_error("Cannot index " + logPath);
+
+  entries = reinterpret_cast<const LogIndexEntry *>(mapping + sizeof(*header));
+  blocks =
+      reinterpret_cast<const LogIndexBlock *>(entries + header->entryCount);
+  const uint8_t *names =
+      reinterpret_cast<const uint8_t *>(blocks + header->blockCount);
+  const uint8_t *end = mapping + mappingSize;
+  for (uint32_t i = 0; i < header->componentCount; ++i) {
+    uint16_t length;
+    if (names + sizeof(length) > end)
+      break;
+    std::memcpy(&length, names, sizeof(length));
+    names += sizeof(length);
+    if (names + length > end)
+      break;
+    components.emplace_back(reinterpret_cast<const char *>(names), length);
+    names += length;
+  }
+  madvise(const_cast<uint8_t *>(mapping), mappingSize, MADV_WILLNEED);
+}
+
+LogIndex::~LogIndex() {
+  munmap(const_cast<uint8_t *>(mapping), mappingSize);
+  if (source)
+    munmap(const_cast<uint8_t *>(source), sourceSize);
+}
+
+size_t LogIndex::size() const { return header->entryCount; }
+
+const LogIndexEntry &LogIndex::at(size_t i) const { return entries[i]; }
+
+const std::string &LogIndex::componentName(uint16_t component) const {
+  static const std::string unknown = "unknown";
+  return component < components.size() ? components[component] : unknown;
+}
+
+size_t LogIndex::blockCount() const { return header->blockCount; }
+
+const LogIndexBlock &LogIndex::block(size_t b) const { return blocks[b]; }
+
+bool LogIndex::matches(const LogIndexEntry &entry, const LogQuery &query,
+                       int component) const {
+  return entry.timestamp >= query.from && entry.timestamp <= query.to &&
+         (query.src == LOG_INDEX_NO_ID || entry.src == query.src) &&
+         (query.dst == LOG_INDEX_NO_ID || entry.dst == query.dst) &&
+         (query.level < 0 || entry.level <= query.level) &&
+         (query.event < 0 || entry.event == query.event) &&
+         (component < 0 || entry.component == component);
+}
+
+std::vector<size_t> LogIndex::select(const LogQuery &query,
+                                     unsigned threads) const {
+  std::vector<size_t> selected;
+  int component = -1;
+  if (!query.component.empty()) {
+    auto found =
+        std::find(components.begin(), components.end(), query.component);
+    if (found == components.end())
+      return selected;
+    component = found - components.begin();
+  }
+
+  size_t blockCount = header->blockCount;
+  threads = std::max(1u, std::min<unsigned>(threads, blockCount));
+  std::vector<std::vector<size_t>> found(threads);
+  std::vector<std::thread> scanners;
+  for (unsigned t = 0; t < threads; ++t)
+    scanners.emplace_back([&, t]() {
+      for (size_t b = blockCount * t / threads;
+           b < blockCount * (t + 1) / threads; ++b) {
+        if (blocks[b].last < query.from || blocks[b].first > query.to)
+          continue;
+        size_t end =
+            std::min<size_t>(header->entryCount, (b + 1) * LOG_INDEX_BLOCK);
+        for (size_t i = b * LOG_INDEX_BLOCK; i < end; ++i)
+          if (matches(entries[i], query, component))
+            found[t].push_back(i);
+      }
+    });
+  for (std::thread &scanner : scanners)
+    scanner.join();
+
+  for (std::vector<size_t> &part : found)
+    selected.insert(selected.end(), part.begin(), part.end());
+  return selected;
+}
+
+void LogIndex::countRates(const std::vector<size_t> &selected,
+                          LogRates &rates) const {
+  for (size_t i : selected)
+    rates[std::make_tuple(entries[i].timestamp / 1000000000, entries[i].src,
+                          entries[i].dst)]++;
+}
+
+void LogIndex::mapSource() const {
+  if (source)
+    return;
+  int fd = open(logPath.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat status;
+  if (fd < 0 || fstat(fd, &status) != 0 || status.st_size == 0) {
+    if (fd >= 0)
+      close(fd);
+    throw std::runtime_error("Cannot open " + logPath);
+  }
+  void *mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+    throw std::runtime_error("Cannot map " + logPath);
+  source = static_cast<const uint8_t *>(mapped);
+  sourceSize = status.st_size;
+}
+
+std::string LogIndex::line(const LogIndexEntry &entry) const {
+  mapSource();
+  if (entry.offset + entry.length > sourceSize)
+    return std::string();
+  if (!isTrace(source, sourceSize))
+    return std::string(reinterpret_cast<const char *>(source + entry.offset),
+                       entry.length);
+
+  TraceEntry record;
+  std::memcpy(&record.record, source + entry.offset, sizeof(TraceRecord));
+  const uint8_t *payload = source + entry.offset + sizeof(TraceRecord);
+  record.payload.assign(payload, payload + record.record.payloadSize);
+  return TraceReader::toText(record);
+}
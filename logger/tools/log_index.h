@@ -0,0 +1,113 @@
+#ifndef LOG_INDEX_H
+#define LOG_INDEX_H
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// First bytes of every index file
+#define LOG_INDEX_MAGIC "VCSLOGIX"
+#define LOG_INDEX_VERSION 1
+
+// Entries summarized by one time range, a query skips the ranges outside its
+// times
+#define LOG_INDEX_BLOCK 4096
+
+// src or dst of a line that names none
+#define LOG_INDEX_NO_ID 0xffffffffu
+
+// Beginning of an index file - the entries, the blocks and the component
+// names follow it. The size and the time of the log tell when it is stale.
+struct LogIndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t componentCount;
+  uint64_t sourceSize;
+  int64_t sourceModified;
+  uint64_t entryCount;
+  uint64_t blockCount;
+};
+
+// One line of a text log or one record of a binary trace
+struct LogIndexEntry {
+  uint64_t timestamp; // ns, as written in the log
+  uint64_t offset;    // Where the line starts in the log
+  uint32_t src;
+  uint32_t dst;
+  uint32_t length;
+  uint16_t component; // Into the component names of the index
+  uint8_t level;      // logger::LogLevel
+  uint8_t event;      // TraceEvent, SEND and RECEIVE are told from the text
+};
+
+// Time range of LOG_INDEX_BLOCK entries in a row
+struct LogIndexBlock {
+  uint64_t first;
+  uint64_t last;
+};
+
+// Conditions of a query, the defaults match everything
+struct LogQuery {
+  uint64_t from = 0;
+  uint64_t to = std::numeric_limits<uint64_t>::max();
+  uint32_t src = LOG_INDEX_NO_ID;
+  uint32_t dst = LOG_INDEX_NO_ID;
+  int level = -1; // Lines of this level and more severe ones
+  int event = -1;
+  std::string component;
+};
+
+// Lines per (second, src, dst), the times of separate logs are added as they
+// are
+typedef std::map<std::tuple<uint64_t, uint32_t, uint32_t>, uint64_t> LogRates;
+
+// The index of one log or trace file, mapped read-only. It is built next to
+// the log as <log>.idx when it is missing or older than the log.
+class LogIndex {
+public:
+  LogIndex(const std::string &logPath, unsigned threads);
+  ~LogIndex();
+  LogIndex(const LogIndex &) = delete;
+  LogIndex &operator=(const LogIndex &) = delete;
+
+  // Scans the log with the threads and writes its index, throws
+  // std::runtime_error if the log cannot be read
+  static void build(const std::string &logPath, unsigned threads);
+  static std::string indexPath(const std::string &logPath);
+
+  size_t size() const;
+  const LogIndexEntry &at(size_t i) const;
+  const std::string &componentName(uint16_t component) const;
+  size_t blockCount() const;
+  const LogIndexBlock &block(size_t b) const;
+
+  // Positions of the matching entries in log order, the blocks are shared
+  // out between the threads
+  std::vector<size_t> select(const LogQuery &query, unsigned threads) const;
+
+  // Adds the selected entries to the lines of their second and pair
+  void countRates(const std::vector<size_t> &selected, LogRates &rates) const;
+
+  // The line of the entry, trace records decoded like trace_decode
+  std::string line(const LogIndexEntry &entry) const;
+
+private:
+  std::string logPath;
+  const uint8_t *mapping;
+  size_t mappingSize;
+  const LogIndexHeader *header;
+  const LogIndexEntry *entries;
+  const LogIndexBlock *blocks;
+  std::vector<std::string> components;
+  mutable const uint8_t *source;
+  mutable size_t sourceSize;
+
+  bool matches(const LogIndexEntry &entry, const LogQuery &query,
+               int component) const;
+  void mapSource() const;
+};
+
+#endif // LOG_INDEX_H
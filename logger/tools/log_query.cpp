@@ -0,0 +1,151 @@
+#include "../trace_log.h"
+#include "log_index.h"
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+// Answers queries over text logs and binary traces from their indexes, an
+// index is built next to each log the first time it is queried
+// Usage: log_query [options] index|lines|count|rate log...
+static void usage(const char *program) {
+  std::cerr
+      << "usage: " << program << " [options] index|lines|count|rate log...\n"
+      << "  index  build the indexes and print the number of entries\n"
+      << "  lines  print the matching lines\n"
+      << "  count  print the number of matching lines\n"
+      << "  rate   print the matching lines per second and src->dst pair\n"
+      << "options:\n"
+      << "  --from T, --to T    time range, ns or with s, ms or us\n"
+      << "  --src ID, --dst ID  ids of the frame ends\n"
+      << "  --level L           ERROR, INFO or DEBUG and more severe\n"
+      << "  --component NAME    lines of one component\n"
+      << "  --event E           send, receive, text, error, connect or close\n"
+      << "  --threads N         scanning threads, all CPUs by default\n";
+}
+
+static uint64_t parseTime(const std::string &text) {
+  size_t end;
+  double value = std::stod(text, &end);
+  std::string unit = text.substr(end);
+  if (unit == "s")
+    value *= 1e9;
+  else if (unit == "ms")
+    value *= 1e6;
+  else if (unit == "us")
+    value *= 1e3;
+  else if (!unit.empty() && unit != "ns")
+    throw std::invalid_argument("unknown time unit " + unit);
+  return value;
+}
+
+static int parseLevel(const std::string &text) {
+  if (text == "ERROR")
+    return 0;
+  if (text == "INFO")
+    return 1;
+  if (text == "DEBUG")
+    return 2;
+  throw std::invalid_argument("unknown level " + text);
+}
+
+static int parseEvent(const std::string &text) {
+  for (int event = 0; event <= static_cast<int>(TraceEvent::ERROR); ++event) {
+    std::string name = TraceReader::eventName(event);
+    for (char &c : name)
+      c = std::tolower(c);
+    if (name == text)
+      return event;
+  }
+  throw std::invalid_argument("unknown event " + text);
+}
+
+static std::string idText(uint32_t id) {
+  return id == LOG_INDEX_NO_ID ? "-" : std::to_string(id);
+}
+
+int main(int argc, char *argv[]) {
+  LogQuery query;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string command;
+  std::vector<std::string> logs;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string argument = argv[i];
+      bool hasValue = i + 1 < argc;
+      if (argument == "--from" && hasValue)
+        query.from = parseTime(argv[++i]);
+      else if (argument == "--to" && hasValue)
+        query.to = parseTime(argv[++i]);
+      else if (argument == "--src" && hasValue)
+        query.src = std::stoul(argv[++i], nullptr, 0);
+      else if (argument == "--dst" && hasValue)
+        query.dst = std::stoul(argv[++i], nullptr, 0);
+      else if (argument == "--level" && hasValue)
+        query.level = parseLevel(argv[++i]);
+      else if (argument == "--component" && hasValue)
+        query.component = argv[++i];
+      else if (argument == "--event" && hasValue)
+        query.event = parseEvent(argv[++i]);
+      else if (argument == "--threads" && hasValue)
+        threads = std::max(1, std::stoi(argv[++i]));
+      else if (argument.compare(0, 2, "--") == 0)
+        throw std::invalid_argument("unknown option " + argument);
+      else if (command.empty())
+        command = argument;
+      else
+        logs.push_back(argument);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    usage(argv[0]);
+    return 2;
+  }
+  if (logs.empty() || (command != "index" && command != "lines" &&
+                       command != "count" && command != "rate")) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::ios::sync_with_stdio(false);
+  uint64_t total = 0;
+  LogRates rates;
+  try {
+    for (const std::string &log : logs) {
+      if (command == "index") {
+        LogIndex::build(log, threads);
+        LogIndex index(log, threads);
+        std::cout << log << ": " << index.size() << " entries" << '\n';
+        continue;
+      }
+
+      LogIndex index(log, threads);
+      std::vector<size_t> selected = index.select(query, threads);
+      total += selected.size();
+      if (command == "lines") {
+        for (size_t i : selected) {
+          if (logs.size() > 1)
+            std::cout << log << ": ";
+          std::cout << index.line(index.at(i)) << '\n';
+        }
+      } else if (command == "rate") {
+        index.countRates(selected, rates);
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  if (command == "count")
+    std::cout << total << '\n';
+  if (command == "rate") {
+    std::cout << "second,src,dst,count" << '\n';
+    for (const auto &rate : rates)
+      std::cout << std::get<0>(rate.first) << ','
+                << idText(std::get<1>(rate.first)) << ','
+                << idText(std::get<2>(rate.first)) << ',' << rate.second
+                << '\n';
+  }
+  return 0;
+}
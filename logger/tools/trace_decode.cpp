@@ -0,0 +1,36 @@
+#include "../trace_log.h"
+#include <cstring>
+#include <iostream>
+
+// Converts binary trace files to text lines or CSV rows
+// Usage: trace_decode [--csv] trace_file...
+int main(int argc, char *argv[]) {
+  bool csv = false;
+  int first = 1;
+  if (argc > 1 && std::strcmp(argv[1], "--csv") == 0) {
+    csv = true;
+    first = 2;
+  }
+  if (first >= argc) {
+    std::cerr << "usage: " << argv[0] << " [--csv] trace_file..." << std::endl;
+    return 2;
+  }
+
+  std::ios::sync_with_stdio(false);
+  if (csv)
+    std::cout << TraceReader::csvHeader() << '\n';
+  for (int i = first; i < argc; ++i) {
+    try {
+      TraceReader reader(argv[i]);
+      TraceEntry entry;
+      while (reader.next(entry))
+        std::cout << (csv ? TraceReader::toCsv(entry)
+                          : TraceReader::toText(entry))
+                  << '\n';
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
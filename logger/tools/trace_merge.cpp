@@ -0,0 +1,75 @@
+#include "../chrome_trace.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Merges the Chrome traces of several processes into one timeline for
+// chrome://tracing or Perfetto. Directories add all their .json files.
+// Usage: trace_merge [-o output.json] trace.json|directory...
+static void usage(const char *program) {
+  std::cerr << "usage: " << program
+            << " [-o output.json] trace.json|directory...\n";
+}
+
+int main(int argc, char *argv[]) {
+  std::string outputPath;
+  std::vector<std::string> traces;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument = argv[i];
+    if (argument == "-o" && i + 1 < argc) {
+      outputPath = argv[++i];
+    } else if (argument[0] == '-') {
+      usage(argv[0]);
+      return 2;
+    } else if (std::filesystem::is_directory(argument)) {
+      std::vector<std::string> found;
+      for (const auto &file : std::filesystem::directory_iterator(argument))
+        if (file.path().extension() == ".json" && file.path() != outputPath)
+          found.push_back(file.path().string());
+      std::sort(found.begin(), found.end());
+      traces.insert(traces.end(), found.begin(), found.end());
+    } else {
+      traces.push_back(argument);
+    }
+  }
+  if (traces.empty()) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::ofstream file;
+  if (!outputPath.empty()) {
+    file.open(outputPath, std::ios::binary);
+    if (!file) {
+      std::cerr << "cannot create " << outputPath << std::endl;
+      return 1;
+    }
+  }
+  std::ostream &output = outputPath.empty() ? std::cout : file;
+
+  bool empty = true;
+  output << "[\n";
+  try {
+    for (const std::string &trace : traces) {
+      bool cutShort;
+      std::string text = ChromeTrace::readEvents(trace, cutShort);
+      if (cutShort)
+        std::cerr << trace << ": trace cut short, last event dropped"
+                  << std::endl;
+      if (text.empty())
+        continue;
+      if (!empty)
+        output << ",\n";
+      output << text;
+      empty = false;
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  output << "\n]\n";
+  return 0;
+}
@@ -0,0 +1,245 @@
+#include "trace_log.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t alignRecord(size_t size) {
+  return (size + TRACE_ALIGN - 1) & ~(size_t)(TRACE_ALIGN - 1);
+}
+
+static int64_t steadyNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Header bytes every segment starts with
+static std::string makeHeader() {
+  TraceFileHeader header = {};
+  std::memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_VERSION;
+  header.headerSize = alignRecord(sizeof(TraceFileHeader));
+  header.startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+  std::string bytes(header.headerSize, '\0');
+  std::memcpy(&bytes[0], &header, sizeof(header));
+  return bytes;
+}
+
+TraceWriter::TraceWriter(const std::string &path, size_t segmentBytes,
+                         std::chrono::seconds rotateEvery,
+                         uint64_t retentionBytes)
+    : startNs(steadyNow()) {
+  if (segmentBytes < alignRecord(sizeof(TraceFileHeader)) + sizeof(TraceRecord))
+    throw std::invalid_argument("Trace segment is too small");
+
+  // trace.bin is written as trace.000001.bin...
+  size_t slash = path.find_last_of('/');
+  size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    dot = path.size();
+  segments.reset(new MappedSegments(path.substr(0, dot), path.substr(dot),
+                                    segmentBytes, rotateEvery, retentionBytes,
+                                    makeHeader()));
+}
+
+TraceWriter::~TraceWriter() {}
+
+bool TraceWriter::isOpen() const { return segments->isOpen(); }
+
+bool TraceWriter::write(uint8_t level, TraceComponent component, uint32_t src,
+                        uint32_t dst, TraceEvent event, const void *payload,
+                        uint16_t payloadSize) {
+  size_t size = alignRecord(sizeof(TraceRecord) + payloadSize);
+  MappedSegments::Reservation reservation = segments->reserve(size);
+  if (!reservation.data)
+    return false;
+
+  TraceRecord *record = reinterpret_cast<TraceRecord *>(reservation.data);
+  record->timestamp = steadyNow() - startNs;
+  record->src = src;
+  record->dst = dst;
+  record->component = static_cast<uint16_t>(component);
+  record->event = static_cast<uint16_t>(event);
+  record->payloadSize = payloadSize;
+  record->level = level;
+  if (payloadSize)
+    std::memcpy(record + 1, payload, payloadSize);
+  __atomic_store_n(&record->flags, TRACE_COMMITTED, __ATOMIC_RELEASE);
+  segments->release(reservation);
+  return true;
+}
+
+void TraceWriter::sync() { segments->sync(); }
+
+uint64_t TraceWriter::getDropped() const { return segments->getDropped(); }
+
+std::vector<std::string> TraceWriter::getFiles() {
+  return segments->getFiles();
+}
+
+TraceReader::TraceReader(const std::string &path)
+    : base(nullptr), size(0), position(0), startTime(0) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Cannot open trace: " + path);
+  struct stat status;
+  if (fstat(fd, &status) != 0 ||
+      (size_t)status.st_size < sizeof(TraceFileHeader)) {
+    close(fd);
+    throw std::runtime_error("Not a trace file: " + path);
+  }
+  size = status.st_size;
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    throw std::runtime_error("Cannot map trace: " + path);
+  base = static_cast<const uint8_t *>(mapping);
+  madvise(mapping, size, MADV_SEQUENTIAL);
+
+  TraceFileHeader header;
+  std::memcpy(&header, base, sizeof(header));
+  if (std::memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != TRACE_VERSION || header.headerSize > size) {
+    munmap(const_cast<uint8_t *>(base), size);
+    throw std::runtime_error("Not a trace file: " + path);
+  }
+  startTime = header.startTime;
+  position = header.headerSize;
+}
+
+TraceReader::~TraceReader() { munmap(const_cast<uint8_t *>(base), size); }
+
+bool TraceReader::next(TraceEntry &entry) {
+  if (position + sizeof(TraceRecord) > size)
+    return false;
+  std::memcpy(&entry.record, base + position, sizeof(TraceRecord));
+  if (!(entry.record.flags & TRACE_COMMITTED))
+    return false;
+  size_t end = position + sizeof(TraceRecord) + entry.record.payloadSize;
+  if (end > size)
+    return false;
+  entry.payload.assign(base + position + sizeof(TraceRecord), base + end);
+  position += alignRecord(sizeof(TraceRecord) + entry.record.payloadSize);
+  return true;
+}
+
+int64_t TraceReader::getStartTime() const { return startTime; }
+
+size_t TraceReader::getPosition() const { return position; }
+
+std::string TraceReader::componentName(uint16_t component) {
+  switch (static_cast<TraceComponent>(component)) {
+  case TraceComponent::COMMUNICATION:
+    return "communication";
+  case TraceComponent::MAIN_BUS:
+    return "main_bus";
+  case TraceComponent::CONTROL:
+    return "control";
+  case TraceComponent::IMG_PROCESSING:
+    return "img_processing";
+  case TraceComponent::HSM:
+    return "hsm";
+  case TraceComponent::GUI:
+    return "gui";
+  default:
+    return "component_" + std::to_string(component);
+  }
+}
+
+std::string TraceReader::eventName(uint16_t event) {
+  switch (static_cast<TraceEvent>(event)) {
+  case TraceEvent::TEXT:
+    return "TEXT";
+  case TraceEvent::SEND:
+    return "SEND";
+  case TraceEvent::RECEIVE:
+    return "RECEIVE";
+  case TraceEvent::CONNECT:
+    return "CONNECT";
+  case TraceEvent::CLOSE:
+    return "CLOSE";
+  case TraceEvent::ERROR:
+    return "ERROR";
+  default:
+    return "EVENT_" + std::to_string(event);
+  }
+}
+
+static const char *levelName(uint8_t level) {
+  switch (level) {
+  case 0:
+    return "ERROR";
+  case 1:
+    return "INFO";
+  case 2:
+    return "DEBUG";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+// The payload as text - packets by their fields, text as is, the rest in hex
+static std::string describePayload(const TraceEntry &entry) {
+  std::ostringstream text;
+  TraceEvent event = static_cast<TraceEvent>(entry.record.event);
+  if ((event == TraceEvent::SEND || event == TraceEvent::RECEIVE) &&
+      entry.payload.size() >= sizeof(TracePacket)) {
+    TracePacket packet;
+    std::memcpy(&packet, entry.payload.data(), sizeof(packet));
+    text << "packet number: " << packet.psn << ", of messageId: " << packet.id;
+    if (entry.payload.size() > sizeof(TracePacket)) {
+      text << " Data: 0x" << std::hex << std::setfill('0');
+      for (size_t i = sizeof(TracePacket); i < entry.payload.size(); ++i)
+        text << std::setw(2) << (int)entry.payload[i];
+    }
+  } else if (event == TraceEvent::TEXT || event == TraceEvent::ERROR) {
+    text.write(reinterpret_cast<const char *>(entry.payload.data()),
+               entry.payload.size());
+  } else if (!entry.payload.empty()) {
+    text << "0x" << std::hex << std::setfill('0');
+    for (uint8_t byte : entry.payload)
+      text << std::setw(2) << (int)byte;
+  }
+  return text.str();
+}
+
+std::string TraceReader::toText(const TraceEntry &entry) {
+  const TraceRecord &record = entry.record;
+  std::string line = "[" + std::to_string(record.timestamp) + "ns] [" +
+                     levelName(record.level) + "] SRC " +
+                     std::to_string(record.src) + " DST " +
+                     std::to_string(record.dst) + " " +
+                     componentName(record.component) + " " +
+                     eventName(record.event);
+  std::string payload = describePayload(entry);
+  return payload.empty() ? line : line + " " + payload;
+}
+
+std::string TraceReader::csvHeader() {
+  return "timestamp_ns,level,component,src,dst,event,payload";
+}
+
+std::string TraceReader::toCsv(const TraceEntry &entry) {
+  const TraceRecord &record = entry.record;
+  std::string payload = describePayload(entry);
+  std::string quoted = "\"";
+  for (char c : payload) {
+    if (c == '"')
+      quoted += '"';
+    quoted += c;
+  }
+  quoted += '"';
+  return std::to_string(record.timestamp) + "," + levelName(record.level) +
+         "," + componentName(record.component) + "," +
+         std::to_string(record.src) + "," + std::to_string(record.dst) + "," +
+         eventName(record.event) + "," + quoted;
+}
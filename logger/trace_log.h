@@ -0,0 +1,133 @@
+#ifndef TRACE_LOG_H
+#define TRACE_LOG_H
+
+#include "log_segments.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Size of one trace segment file, a full segment is closed and the next one
+// opened
+#define TRACE_SEGMENT_BYTES (256u << 20)
+
+// First bytes of every trace file
+#define TRACE_MAGIC "VCSTRACE"
+#define TRACE_VERSION 1
+
+// Records start on this boundary
+#define TRACE_ALIGN 8
+
+// Set last, a record without it was not completely written
+#define TRACE_COMMITTED 0x80
+
+// Components that write to the trace
+enum class TraceComponent : uint16_t {
+  UNKNOWN,
+  COMMUNICATION,
+  MAIN_BUS,
+  CONTROL,
+  IMG_PROCESSING,
+  HSM,
+  GUI,
+};
+
+// What a record describes, the payload layout depends on it
+enum class TraceEvent : uint16_t {
+  TEXT,    // Payload - the message text
+  SEND,    // Payload - TracePacket
+  RECEIVE, // Payload - TracePacket
+  CONNECT,
+  CLOSE,
+  ERROR, // Payload - the error text
+};
+
+// Beginning of a trace file
+struct TraceFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  int64_t startTime; // Wall clock at the start, ns since the epoch
+};
+
+// Fixed part of a record, the payload follows it
+struct TraceRecord {
+  uint64_t timestamp; // ns since the start of the trace
+  uint32_t src;
+  uint32_t dst;
+  uint16_t component;
+  uint16_t event;
+  uint16_t payloadSize;
+  uint8_t level; // logger::LogLevel
+  uint8_t flags;
+};
+
+// Payload of SEND and RECEIVE, followed by the data bytes
+struct TracePacket {
+  uint32_t id;
+  uint32_t psn;
+};
+
+// Appends fixed-layout records to memory-mapped segments - trace.000001.bin,
+// trace.000002.bin... for the path trace.bin. Every segment starts with the
+// file header and decodes on its own. Writers reserve their space with one
+// atomic add and wait for each other only while a segment is replaced.
+class TraceWriter {
+public:
+  TraceWriter(const std::string &path,
+              size_t segmentBytes = TRACE_SEGMENT_BYTES,
+              std::chrono::seconds rotateEvery = std::chrono::seconds(0),
+              uint64_t retentionBytes = 0);
+  ~TraceWriter();
+
+  bool isOpen() const;
+  bool write(uint8_t level, TraceComponent component, uint32_t src,
+             uint32_t dst, TraceEvent event, const void *payload = nullptr,
+             uint16_t payloadSize = 0);
+
+  // Writes the mapped pages to the file
+  void sync();
+
+  uint64_t getDropped() const;
+  std::vector<std::string> getFiles();
+
+private:
+  int64_t startNs;
+  std::unique_ptr<MappedSegments> segments;
+};
+
+// A decoded record
+struct TraceEntry {
+  TraceRecord record;
+  std::vector<uint8_t> payload;
+};
+
+// Reads a trace file, stops at the first record that was not completely
+// written. Throws std::runtime_error if the file is not a trace.
+class TraceReader {
+public:
+  TraceReader(const std::string &path);
+  ~TraceReader();
+
+  bool next(TraceEntry &entry);
+  int64_t getStartTime() const;
+
+  // Offset of the next record in the file
+  size_t getPosition() const;
+
+  static std::string componentName(uint16_t component);
+  static std::string eventName(uint16_t event);
+
+  // One line like the text log, or one CSV row
+  static std::string toText(const TraceEntry &entry);
+  static std::string toCsv(const TraceEntry &entry);
+  static std::string csvHeader();
+
+private:
+  const uint8_t *base;
+  size_t size;
+  size_t position;
+  int64_t startTime;
+};
+
+#endif // TRACE_LOG_H
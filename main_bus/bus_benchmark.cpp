@@ -0,0 +1,169 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../communication/include/server_connection.h"
+#include "../communication/include/pooled_client_connection.h"
+
+// Frames sent through the bus in each run
+#define BENCHMARK_FRAMES 200000
+
+// Frames the sender writes with one call
+#define BENCHMARK_CHUNK 64
+
+// Counts the frames that reach the receiver
+struct FrameCounter
+{
+    std::shared_ptr<std::atomic<uint64_t>> count;
+
+    void operator()(Packet &) { (*count)++; }
+};
+
+// Sends the frames from one client to another through the bus on the port, returns ns per frame
+static double measure(int port, uint64_t frames)
+{
+    FrameCounter counter = {std::make_shared<std::atomic<uint64_t>>(0)};
+    PooledClientConnection<PosixTransport, FrameCounter> receiver(counter);
+    PooledClientConnection<PosixTransport> sender;
+    if (receiver.connectToServer(2, "127.0.0.1", port) != ErrorCode::SUCCESS ||
+        sender.connectToServer(1, "127.0.0.1", port) != ErrorCode::SUCCESS) {
+        std::cerr << "cannot connect to the bus on port " << port << std::endl;
+        return -1;
+    }
+    // The bus registers the clients in the background
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    std::vector<Packet> chunk;
+    for (uint32_t psn = 0; psn < BENCHMARK_CHUNK; ++psn)
+        chunk.emplace_back(3, psn, BENCHMARK_CHUNK, 1, 2, data, sizeof(data), false);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t sent = 0; sent < frames; sent += BENCHMARK_CHUNK)
+        if (sender.sendPackets(chunk.data(), chunk.size()) != ErrorCode::SUCCESS)
+            return -1;
+    auto deadline = start + std::chrono::seconds(60);
+    while (*counter.count < frames && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    if (*counter.count < frames)
+        std::cerr << "only " << *counter.count << " of " << frames << " frames arrived" << std::endl;
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / *counter.count;
+}
+
+// The system calls of PosixTransport behind virtual calls, the difference to PosixTransport is the cost of the
+// dispatch alone - the calls, batching and logging are the same
+struct DispatchedTransport
+{
+    struct Calls
+    {
+        virtual ~Calls() = default;
+        virtual int socket(int domain, int type, int protocol) = 0;
+        virtual int setsockopt(int fd, int level, int name, const void *value, socklen_t length) = 0;
+        virtual int bind(int fd, const struct sockaddr *addr, socklen_t length) = 0;
+        virtual int listen(int fd, int backlog) = 0;
+        virtual int accept(int fd, struct sockaddr *addr, socklen_t *length) = 0;
+        virtual int connect(int fd, const struct sockaddr *addr, socklen_t length) = 0;
+        virtual ssize_t send(int fd, const void *buf, size_t len) = 0;
+        virtual ssize_t recv(int fd, void *buf, size_t len) = 0;
+        virtual ssize_t sendv(int fd, const struct iovec *iov, int count) = 0;
+        virtual ssize_t recvWaiting(int fd, const struct iovec *iov, int count) = 0;
+        virtual int close(int fd) = 0;
+    };
+
+    struct PosixCalls : Calls
+    {
+        PosixTransport posix;
+        int socket(int domain, int type, int protocol) override { return posix.socket(domain, type, protocol); }
+        int setsockopt(int fd, int level, int name, const void *value, socklen_t length) override { return posix.setsockopt(fd, level, name, value, length); }
+        int bind(int fd, const struct sockaddr *addr, socklen_t length) override { return posix.bind(fd, addr, length); }
+        int listen(int fd, int backlog) override { return posix.listen(fd, backlog); }
+        int accept(int fd, struct sockaddr *addr, socklen_t *length) override { return posix.accept(fd, addr, length); }
+        int connect(int fd, const struct sockaddr *addr, socklen_t length) override { return posix.connect(fd, addr, length); }
+        ssize_t send(int fd, const void *buf, size_t len) override { return posix.send(fd, buf, len); }
+        ssize_t recv(int fd, void *buf, size_t len) override { return posix.recv(fd, buf, len); }
+        ssize_t sendv(int fd, const struct iovec *iov, int count) override { return posix.sendv(fd, iov, count); }
+        ssize_t recvWaiting(int fd, const struct iovec *iov, int count) override { return posix.recvWaiting(fd, iov, count); }
+        int close(int fd) override { return posix.close(fd); }
+    };
+
+    std::shared_ptr<Calls> calls = std::make_shared<PosixCalls>();
+
+    int socket(int domain, int type, int protocol) { return calls->socket(domain, type, protocol); }
+    int setsockopt(int fd, int level, int name, const void *value, socklen_t length) { return calls->setsockopt(fd, level, name, value, length); }
+    int bind(int fd, const struct sockaddr *addr, socklen_t length) { return calls->bind(fd, addr, length); }
+    int listen(int fd, int backlog) { return calls->listen(fd, backlog); }
+    int accept(int fd, struct sockaddr *addr, socklen_t *length) { return calls->accept(fd, addr, length); }
+    int connect(int fd, const struct sockaddr *addr, socklen_t length) { return calls->connect(fd, addr, length); }
+    ssize_t send(int fd, const void *buf, size_t len) { return calls->send(fd, buf, len); }
+    ssize_t recv(int fd, void *buf, size_t len) { return calls->recv(fd, buf, len); }
+    ssize_t sendv(int fd, const struct iovec *iov, int count) { return calls->sendv(fd, iov, count); }
+    ssize_t recvWaiting(int fd, const struct iovec *iov, int count) { return calls->recvWaiting(fd, iov, count); }
+    int close(int fd) { return calls->close(fd); }
+};
+
+// Runs the legacy server on the port, returns ns per frame
+static double measureLegacy(int port, uint64_t frames)
+{
+    ServerConnection *server = nullptr;
+    ServerConnection legacy(port, [&server](Packet &packet) { server->sendDestination(packet); });
+    server = &legacy;
+    legacy.setFlowControlWindow(0);
+    legacy.startConnection();
+    double result = measure(port, frames);
+    legacy.stopServer();
+    return result;
+}
+
+// Runs the pooled server with the transport on the port, returns ns per frame
+template <class Transport>
+static double measurePooled(int port, uint64_t frames)
+{
+    PooledServerConnection<Transport> pooled(port);
+    pooled.startConnection();
+    double result = measure(port, frames);
+    pooled.stopServer();
+    return result;
+}
+
+// Prints one result line
+static void report(const char *name, double nsPerFrame)
+{
+    std::cout << "  " << std::left << std::setw(46) << name << nsPerFrame << " ns/frame" << std::endl;
+}
+
+// Compares the per-frame cost of the bus servers - the virtual ISocket server, the pooled server over
+// the ISocket interface, over direct system calls behind virtual calls and over direct system calls.
+// Every server runs with the same logging - first with the frame lines off, then with them written
+// by the background thread. PosixTransport does not log, it runs only in the first round.
+int main(int argc, char *argv[])
+{
+    uint64_t frames = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : BENCHMARK_FRAMES;
+    frames = (frames + BENCHMARK_CHUNK - 1) / BENCHMARK_CHUNK * BENCHMARK_CHUNK;
+
+    std::cout << "Frame log off" << std::endl;
+    RealSocket::log.setLevel(logger::LogLevel::ERROR);
+    double legacy = measureLegacy(8180, frames);
+    double socket = measurePooled<SocketTransport>(8181, frames);
+    double dispatched = measurePooled<DispatchedTransport>(8184, frames);
+    double posix = measurePooled<PosixTransport>(8182, frames);
+    report("ServerConnection (ISocket):", legacy);
+    report("PooledServerConnection<SocketTransport>:", socket);
+    report("PooledServerConnection<DispatchedTransport>:", dispatched);
+    report("PooledServerConnection<PosixTransport>:", posix);
+    report("Devirtualisation alone (Dispatched - Posix):", dispatched - posix);
+
+    std::cout << "Frame log written by the background thread" << std::endl;
+    RealSocket::log.setLevel(logger::LogLevel::INFO);
+    RealSocket::log.startAsync();
+    legacy = measureLegacy(8183, frames);
+    socket = measurePooled<SocketTransport>(8185, frames);
+    logger::stopAsync();
+    report("ServerConnection (ISocket):", legacy);
+    report("PooledServerConnection<SocketTransport>:", socket);
+    return 0;
+}
@@ -1,10 +1,184 @@
+#include <pthread.h>
+#include <sched.h>
+#include <sys/signalfd.h>
+#include <csignal>
+#include <cstring>
+#include <iostream>
 #include "../communication/include/bus_manager.h"
-int main()
+#include "../communication/include/bus_config.h"
+#include "../communication/include/pooled_server_connection.h"
+#include "../logger/trace_log.h"
+#include "../logger/chrome_trace.h"
+
+// Pins the calling thread to the CPUs, the threads it starts afterwards inherit them. Empty keeps any CPU.
+static bool pinThread(const std::vector<int> &cpus, const char *role)
 {
-    std::vector<uint32_t> ids;
-    uint32_t limit;
-    BusManager* manager = BusManager::getInstance(ids, limit);
-    manager->startConnection();
-    while(true);
+    if (cpus.empty())
+        return true;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (result != 0)
+        std::cerr << "cannot pin the " << role << " threads: " << strerror(result) << std::endl;
+    return result == 0;
+}
+
+// Sleeps until SIGINT or SIGTERM arrives on the signalfd, returns the signal
+static int waitForSignal(int signalFd)
+{
+    signalfd_siginfo info;
+    while (true) {
+        ssize_t size = read(signalFd, &info, sizeof(info));
+        if (size == sizeof(info))
+            return info.ssi_signo;
+        if (size < 0 && errno != EINTR) {
+            std::cerr << "cannot read the signals: " << strerror(errno) << std::endl;
+            return SIGTERM;
+        }
+    }
+}
+
+// Runs BusManager with the scheduler, the clock, the bridge and the value cache of the config
+static int runBus(const BusConfig &config, int signalFd)
+{
+    // The server, client and bridge threads start from here on
+    if (!pinThread(config.ioCpus, "I/O"))
+        return 1;
+
+    BusManager *manager = BusManager::getInstance(config.ids, config.limit, config.port);
+    manager->setValueCache(config.valueCache);
+    manager->setReplayOnConnect(config.replayOnConnect);
+    ErrorCode result = manager->startConnection();
+    if (result == ErrorCode::SUCCESS && config.bridgeListenPort)
+        result = manager->listenBridge(config.bridgeListenPort);
+    if (result == ErrorCode::SUCCESS && !config.bridgeHost.empty())
+        result = manager->connectBridge(config.bridgeHost, config.bridgePort);
+    if (result == ErrorCode::SUCCESS && manager->getBridge())
+        for (uint32_t id : config.bridgeRoutes)
+            manager->getBridge()->addRoute(id);
+
+    // The schedule and clock threads start from here on
+    if (result == ErrorCode::SUCCESS && !pinThread(config.schedulerCpus, "scheduler"))
+        result = ErrorCode::INVALID_DATA;
+    if (result == ErrorCode::SUCCESS && config.scheduler == SchedulerMode::TIME_TRIGGERED) {
+        try {
+            TimeTriggeredSchedule schedule = TimeTriggeredSchedule::loadFromFile(config.scheduleFile);
+            for (const std::string &problem : schedule.validate())
+                std::cerr << config.scheduleFile << ": " << problem << std::endl;
+            result = manager->startSchedule(schedule);
+        }
+        catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            result = ErrorCode::INVALID_DATA;
+        }
+    }
+    if (result == ErrorCode::SUCCESS && config.clockMode != ClockMode::REAL_TIME)
+        result = manager->startClock(config.clockMode, std::chrono::microseconds(config.clockStepUs), config.clockSpeed);
+
+    if (result == ErrorCode::SUCCESS) {
+        std::cout << "bus listening on port " << config.port << std::endl;
+        int signum = waitForSignal(signalFd);
+        std::cout << "bus stopping on " << strsignal(signum) << std::endl;
+    }
+    else
+        std::cerr << "bus failed to start: " << toString(result) << std::endl;
+
+    manager->stopConnection();
+    delete manager;
+    return result == ErrorCode::SUCCESS ? 0 : 1;
+}
+
+// Runs the pooled server, frames are only forwarded
+static int runPooled(const BusConfig &config, int signalFd)
+{
+    if (!pinThread(config.ioCpus, "I/O"))
+        return 1;
+
+    PooledServerConnection<PosixTransport> server(config.port);
+    ErrorCode result = server.startConnection();
+    if (result != ErrorCode::SUCCESS) {
+        std::cerr << "bus failed to start: " << toString(result) << std::endl;
+        return 1;
+    }
+
+    std::cout << "pooled bus listening on port " << config.port << std::endl;
+    int signum = waitForSignal(signalFd);
+    std::cout << "bus stopping on " << strsignal(signum) << std::endl;
+    server.stopServer();
     return 0;
-}
\ No newline at end of file
+}
+
+// Bus daemon - main_bus [config file]
+int main(int argc, char *argv[])
+{
+    BusConfig config;
+    if (argc > 1) {
+        try {
+            config = BusConfig::loadFromFile(argv[1]);
+        }
+        catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    std::vector<std::string> problems = config.validate();
+    for (const std::string &problem : problems)
+        std::cerr << "config: " << problem << std::endl;
+    if (!problems.empty())
+        return 1;
+
+    // Blocked before any thread starts so every thread inherits the mask, the signals arrive on the signalfd
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+    int signalFd = signalfd(-1, &signals, SFD_CLOEXEC);
+    if (signalFd < 0) {
+        std::cerr << "cannot create the signalfd: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    if (config.logRateLimit > 0)
+        RealSocket::log.setRateLimit(config.logRateLimit, config.logBurst);
+    if (config.logSampleOneIn > 1)
+        RealSocket::log.setSampling(config.logSampleOneIn);
+    RealSocket::log.setSummaryInterval(std::chrono::seconds(config.logSummarySeconds));
+    std::chrono::seconds rotateEvery(config.logRotateSeconds);
+    if (config.logSegmentBytes)
+        RealSocket::log.startSegments(config.logSegmentBytes, rotateEvery, config.logRetentionBytes);
+    if (config.asyncLog)
+        RealSocket::log.startAsync();
+    std::unique_ptr<TraceWriter> trace;
+    if (!config.traceFile.empty()) {
+        trace.reset(new TraceWriter(config.traceFile, config.logSegmentBytes ? config.logSegmentBytes : TRACE_SEGMENT_BYTES,
+                                    rotateEvery, config.logRetentionBytes));
+        if (!trace->isOpen()) {
+            std::cerr << "cannot open the trace " << config.traceFile << ": " << strerror(errno) << std::endl;
+            return 1;
+        }
+        logger::setTrace(trace.get());
+    }
+
+    if (!config.chromeTrace.empty()) {
+        if (!ChromeTrace::start(config.chromeTrace, "main_bus")) {
+            std::cerr << "cannot open the Chrome trace " << config.chromeTrace << ": " << strerror(errno) << std::endl;
+            return 1;
+        }
+    }
+    else
+        ChromeTrace::startFromEnvironment("main_bus");
+
+    int result = config.transport == BusTransport::POOLED ? runPooled(config, signalFd) : runBus(config, signalFd);
+    close(signalFd);
+    logger::setTrace(nullptr);
+    RealSocket::log.flushSummaries();
+    logger::stopAsync();
+    logger::stopSegments();
+    ChromeTrace::stop();
+    return result;
+}